@@ -0,0 +1,459 @@
+/* c37-align.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sched.h>
+#include <stdatomic.h>
+
+#include "c37-align.h"
+
+/*
+ * Frames of many sources, aligned by reporting slot: The time of a
+ * frame rounded to the data rate gives the index of its slot, counted
+ * in frames since 1970. Every slot holds a buffer, each source
+ * copying its data to its own part of it, and is complete once every
+ * source did.
+ *
+ * The slots are a ring, the slot of an index at index % num_slots,
+ * so that a slot is found in O(1). The ring always covers the indices
+ * from the next slot to be taken out, and a slot taken out is made
+ * empty and given to the index num_slots later.
+ *
+ * Any number of threads can insert, as long as a source is inserted
+ * from one thread at a time, without a lock: The index a slot holds
+ * is checked after counting in as a writer of it, and a slot is only
+ * given a new index once no writer is left. Slots are taken out by a
+ * single thread.
+ */
+
+#define NSEC_PER_SEC 1000000000
+
+/* The index of a slot being taken out */
+#define INDEX_RELEASING INT64_MIN
+
+typedef struct
+{
+  _Atomic int64_t  index;
+  _Atomic uint32_t writers;
+  _Atomic uint32_t count;
+
+  _Atomic uint8_t *arrived;     /* One per source */
+  byte            *data;
+} CtsAlignSlot;
+
+struct _CtsAlign
+{
+  uint16_t num_sources;
+  int      data_rate;
+  uint32_t wait_ns;
+
+  size_t   slot_size;
+  byte    *empty;
+
+  /* Where the data of each source goes, size 0 if not set */
+  size_t  *offsets;
+  size_t  *sizes;
+
+  uint32_t         num_slots;
+  CtsAlignSlot    *slots;
+  _Atomic uint8_t *arrived;
+  byte            *data;
+
+  _Atomic int64_t next_index;
+  bool            taken;
+};
+
+static inline CtsAlignSlot *
+get_slot (const CtsAlign *self,
+          int64_t         index)
+{
+  int64_t position = index % self->num_slots;
+
+  if (position < 0)
+    position += self->num_slots;
+
+  return self->slots + position;
+}
+
+/* Keep writers out of @slot, and wait for those in */
+static void
+close_slot (CtsAlignSlot *slot)
+{
+  atomic_store (&slot->index, INDEX_RELEASING);
+
+  while (atomic_load (&slot->writers) != 0)
+    sched_yield ();
+}
+
+static void
+clear_slot (CtsAlign     *self,
+            CtsAlignSlot *slot)
+{
+  memcpy (slot->data, self->empty, self->slot_size);
+
+  for (uint16_t i = 0; i < self->num_sources; i++)
+    atomic_store_explicit (&slot->arrived[i], 0, memory_order_relaxed);
+
+  atomic_store_explicit (&slot->count, 0, memory_order_relaxed);
+}
+
+/**
+ * cts_align_new:
+ * @num_sources: The number of sources each slot waits for
+ * @data_rate: Frames per second, positive
+ * @wait_ns: How long after the time of a slot it is waited for
+ * @empty: @slot_size bytes that every slot starts as
+ * @slot_size: Size of the buffer of a slot
+ *
+ * Create slots for frames up to @wait_ns late and up to a second
+ * ahead. Set where each source goes with cts_align_set_source(), and
+ * the first slot with cts_align_start(), before inserting.
+ *
+ * Returns: (transfer full) (nullable): A new #CtsAlign, or %NULL if
+ * @data_rate is not positive or out of memory. Free with
+ * cts_align_free().
+ */
+CtsAlign *
+cts_align_new (uint16_t    num_sources,
+               int         data_rate,
+               uint32_t    wait_ns,
+               const byte *empty,
+               size_t      slot_size)
+{
+  CtsAlign *self;
+  uint32_t n;
+
+  if (data_rate <= 0 || empty == NULL || slot_size == 0)
+    return NULL;
+
+  self = calloc (1, sizeof *self);
+
+  if (self == NULL)
+    return NULL;
+
+  self->num_sources = num_sources;
+  self->data_rate = data_rate;
+  self->wait_ns = wait_ns;
+  self->slot_size = slot_size;
+  self->num_slots = n = (uint64_t) wait_ns * data_rate / NSEC_PER_SEC + data_rate + 2;
+
+  self->empty = malloc (slot_size);
+  self->offsets = calloc (num_sources + 1, sizeof (size_t));
+  self->sizes = calloc (num_sources + 1, sizeof (size_t));
+  self->slots = calloc (n, sizeof (CtsAlignSlot));
+  self->arrived = calloc ((size_t) n * num_sources + 1, sizeof (_Atomic uint8_t));
+  self->data = malloc (n * slot_size);
+
+  if (self->empty == NULL || self->offsets == NULL || self->sizes == NULL ||
+      self->slots == NULL || self->arrived == NULL || self->data == NULL)
+    {
+      cts_align_free (self);
+      return NULL;
+    }
+
+  memcpy (self->empty, empty, slot_size);
+
+  for (uint32_t i = 0; i < n; i++)
+    {
+      self->slots[i].arrived = self->arrived + (size_t) i * num_sources;
+      self->slots[i].data = self->data + i * slot_size;
+    }
+
+  cts_align_start (self, 0);
+
+  return self;
+}
+
+void
+cts_align_free (CtsAlign *self)
+{
+  if (self == NULL)
+    return;
+
+  free (self->empty);
+  free (self->offsets);
+  free (self->sizes);
+  free (self->slots);
+  free (self->arrived);
+  free (self->data);
+  free (self);
+}
+
+/**
+ * cts_align_set_source:
+ * @self: A #CtsAlign
+ * @source: The source, less than the number of sources
+ * @offset: Where the data of @source goes in a slot
+ * @size: Size of the data of @source
+ *
+ * Set where the data of @source goes. Should be done before
+ * inserting anything of @source.
+ *
+ * Returns: %true on success, %false if the data does not fit
+ */
+bool
+cts_align_set_source (CtsAlign *self,
+                      uint16_t  source,
+                      size_t    offset,
+                      size_t    size)
+{
+  if (source >= self->num_sources ||
+      offset > self->slot_size || size > self->slot_size - offset)
+    return false;
+
+  self->offsets[source] = offset;
+  self->sizes[source] = size;
+
+  return true;
+}
+
+uint32_t
+cts_align_get_num_slots (const CtsAlign *self)
+{
+  return self->num_slots;
+}
+
+/**
+ * cts_align_get_index:
+ * @self: A #CtsAlign
+ * @time: A #CtsTime
+ *
+ * Returns: The index of the slot of @time, rounded to the nearest
+ */
+int64_t
+cts_align_get_index (const CtsAlign *self,
+                     const CtsTime  *time)
+{
+  int64_t rate = self->data_rate;
+
+  return time->soc * rate +
+         ((int64_t) time->nanoseconds * rate + NSEC_PER_SEC / 2) / NSEC_PER_SEC;
+}
+
+/**
+ * cts_align_get_time_of_index:
+ * @self: A #CtsAlign
+ * @index: Index of a slot, not negative
+ * @time: (out): Return location for the time of the slot
+ */
+void
+cts_align_get_time_of_index (const CtsAlign *self,
+                             int64_t         index,
+                             CtsTime        *time)
+{
+  int64_t rate = self->data_rate;
+
+  time->soc = index / rate;
+  time->nanoseconds = ((index % rate) * NSEC_PER_SEC + rate / 2) / rate;
+  time->time_quality = 0;
+}
+
+/**
+ * cts_align_insert:
+ * @self: A #CtsAlign
+ * @source: The source of @data
+ * @index: The slot of @data, from cts_align_get_index()
+ * @data: The data of @source, of the size set with
+ * cts_align_set_source()
+ *
+ * Copy @data to the slot @index, if the slot is kept and @source is
+ * not already in it. Can be called from any thread, one at a time
+ * for a source.
+ *
+ * Returns: What became of @data. %CTS_ALIGN_COMPLETE is returned
+ * once for a slot, to the last source in.
+ */
+CtsAlignResult
+cts_align_insert (CtsAlign   *self,
+                  uint16_t    source,
+                  int64_t     index,
+                  const byte *data)
+{
+  CtsAlignSlot *slot;
+  int64_t held;
+  uint32_t count;
+
+  if (source >= self->num_sources || index < 0)
+    return CTS_ALIGN_LATE;
+
+  slot = get_slot (self, index);
+
+  atomic_fetch_add (&slot->writers, 1);
+  held = atomic_load (&slot->index);
+
+  if (held != index)
+    {
+      atomic_fetch_sub (&slot->writers, 1);
+
+      if (held == INDEX_RELEASING)
+        held = atomic_load (&self->next_index);
+
+      /* The slot holds a later index once this one was taken out */
+      return held >= index ? CTS_ALIGN_LATE : CTS_ALIGN_EARLY;
+    }
+
+  if (atomic_exchange (&slot->arrived[source], 1))
+    {
+      atomic_fetch_sub (&slot->writers, 1);
+      return CTS_ALIGN_DUPLICATE;
+    }
+
+  memcpy (slot->data + self->offsets[source], data, self->sizes[source]);
+
+  count = atomic_fetch_add_explicit (&slot->count, 1, memory_order_acq_rel) + 1;
+  atomic_fetch_sub_explicit (&slot->writers, 1, memory_order_release);
+
+  return count == self->num_sources ? CTS_ALIGN_COMPLETE : CTS_ALIGN_INSERTED;
+}
+
+/**
+ * cts_align_start:
+ * @self: A #CtsAlign
+ * @index: Index of the first slot, not negative
+ *
+ * Empty every slot and keep slots from @index on. Any slot not yet
+ * taken out is lost.
+ */
+void
+cts_align_start (CtsAlign *self,
+                 int64_t   index)
+{
+  for (uint32_t i = 0; i < self->num_slots; i++)
+    {
+      close_slot (self->slots + i);
+      clear_slot (self, self->slots + i);
+    }
+
+  self->taken = false;
+  atomic_store (&self->next_index, index);
+
+  for (uint32_t i = 0; i < self->num_slots; i++)
+    atomic_store (&get_slot (self, index + i)->index, index + i);
+}
+
+/**
+ * cts_align_get_next_index:
+ * @self: A #CtsAlign
+ *
+ * Returns: The index of the next slot to be taken out
+ */
+int64_t
+cts_align_get_next_index (const CtsAlign *self)
+{
+  return atomic_load (&((CtsAlign *) self)->next_index);
+}
+
+/**
+ * cts_align_is_due:
+ * @self: A #CtsAlign
+ * @now: (nullable): The current time, or %NULL to check completion
+ * alone
+ *
+ * Returns: %true if the next slot is complete, or waited for as long
+ * as it should be by @now.
+ */
+bool
+cts_align_is_due (const CtsAlign *self,
+                  const CtsTime  *now)
+{
+  int64_t index = cts_align_get_next_index (self);
+  CtsAlignSlot *slot = get_slot (self, index);
+  CtsTime time;
+
+  if (self->num_sources &&
+      atomic_load_explicit (&slot->count, memory_order_acquire) == self->num_sources)
+    return true;
+
+  if (now == NULL)
+    return false;
+
+  cts_align_get_time_of_index (self, index, &time);
+
+  return (int64_t) now->soc * NSEC_PER_SEC + now->nanoseconds >=
+         (int64_t) time.soc * NSEC_PER_SEC + time.nanoseconds + self->wait_ns;
+}
+
+/**
+ * cts_align_take:
+ * @self: A #CtsAlign
+ * @num_arrived: (out) (optional): Return location for the number of
+ * sources in the slot
+ *
+ * Take out the next slot, complete or not, of index
+ * cts_align_get_next_index(). Nothing is inserted to it after.
+ *
+ * Returns: (transfer none): The buffer of the slot, valid and
+ * writable till cts_align_release()
+ */
+byte *
+cts_align_take (CtsAlign *self,
+                uint16_t *num_arrived)
+{
+  CtsAlignSlot *slot = get_slot (self, cts_align_get_next_index (self));
+
+  if (!self->taken)
+    close_slot (slot);
+
+  self->taken = true;
+
+  if (num_arrived)
+    *num_arrived = atomic_load (&slot->count);
+
+  return slot->data;
+}
+
+/**
+ * cts_align_has_source:
+ * @self: A #CtsAlign
+ * @source: A source
+ *
+ * Returns: %true if @source is in the next slot
+ */
+bool
+cts_align_has_source (const CtsAlign *self,
+                      uint16_t        source)
+{
+  CtsAlignSlot *slot = get_slot (self, cts_align_get_next_index (self));
+
+  if (source >= self->num_sources)
+    return false;
+
+  return atomic_load (&slot->arrived[source]) != 0;
+}
+
+/**
+ * cts_align_release:
+ * @self: A #CtsAlign
+ *
+ * Done with the next slot: It is emptied and kept for the index
+ * num_slots later, and the slot after is the next.
+ */
+void
+cts_align_release (CtsAlign *self)
+{
+  int64_t index = cts_align_get_next_index (self);
+  CtsAlignSlot *slot = get_slot (self, index);
+
+  if (!self->taken)
+    close_slot (slot);
+
+  clear_slot (self, slot);
+  self->taken = false;
+
+  atomic_store (&self->next_index, index + 1);
+  atomic_store (&slot->index, index + self->num_slots);
+}
@@ -0,0 +1,71 @@
+/* c37-align.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef C37_ALIGN_H
+#define C37_ALIGN_H
+
+
+#include "c37-common.h"
+
+typedef enum {
+  CTS_ALIGN_INSERTED,   /* Kept, the slot waits for other sources */
+  CTS_ALIGN_COMPLETE,   /* Kept, and the last source the slot waited for */
+  CTS_ALIGN_DUPLICATE,  /* The source is already in the slot, dropped */
+  CTS_ALIGN_LATE,       /* The slot was already taken out, dropped */
+  CTS_ALIGN_EARLY,      /* Beyond the slots kept, dropped */
+} CtsAlignResult;
+
+typedef struct _CtsAlign CtsAlign;
+
+CtsAlign *cts_align_new  (uint16_t    num_sources,
+                          int         data_rate,
+                          uint32_t    wait_ns,
+                          const byte *empty,
+                          size_t      slot_size);
+void      cts_align_free (CtsAlign   *self);
+
+bool      cts_align_set_source (CtsAlign *self,
+                                uint16_t  source,
+                                size_t    offset,
+                                size_t    size);
+uint32_t  cts_align_get_num_slots (const CtsAlign *self);
+
+int64_t   cts_align_get_index         (const CtsAlign *self,
+                                       const CtsTime  *time);
+void      cts_align_get_time_of_index (const CtsAlign *self,
+                                       int64_t         index,
+                                       CtsTime        *time);
+
+CtsAlignResult cts_align_insert (CtsAlign   *self,
+                                 uint16_t    source,
+                                 int64_t     index,
+                                 const byte *data);
+
+void      cts_align_start          (CtsAlign       *self,
+                                    int64_t         index);
+int64_t   cts_align_get_next_index (const CtsAlign *self);
+bool      cts_align_is_due         (const CtsAlign *self,
+                                    const CtsTime  *now);
+byte     *cts_align_take           (CtsAlign       *self,
+                                    uint16_t       *num_arrived);
+bool      cts_align_has_source     (const CtsAlign *self,
+                                    uint16_t        source);
+void      cts_align_release        (CtsAlign       *self);
+
+
+#endif /* C37_ALIGN_H */
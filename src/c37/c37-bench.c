@@ -0,0 +1,734 @@
+/* c37-bench.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "c37.h"
+
+/*
+ * Microbenchmarks of the codecs, for `make bench` in src. Each is run
+ * for every configuration asked for: a number of PMUs (each with
+ * three voltage phasors, a current, an analog value and a digital
+ * status word) in integer or floating point, rectangular or polar.
+ *
+ *   crc: CHK of a data frame
+ *   data-encode, data-decode: a data frame with every value, by
+ *   CtsData as pmu-spi.c does (frame), or by CtsDataLayout and
+ *   CtsDataView (view)
+ *   config-encode, config-decode: a CFG-2, skipped if larger than a
+ *   frame can be
+ *   header: a header frame, once only as it is the same for all
+ *   command-write, command-parse: a DATA ON, once only too
+ *
+ * A benchmark is timed over SAMPLES rounds, of as many calls as take
+ * about a SAMPLES-th of --min-time each, and the median of the rounds
+ * is reported. A line of JSON is written for each:
+ *
+ *   {"name": "crc/10-float-polar", "pmus": 10, "format": "float-polar",
+ *    "bytes": 576, "iterations": 862016, "ns_per_frame": 590.3,
+ *    "bytes_per_second": 9.76e+08}
+ *
+ * With --baseline, the output of an earlier run, each line also has
+ * "baseline_ns_per_frame" and "change_percent", and the exit status is
+ * 1 if anything is slower than it by more than --tolerance percent.
+ */
+
+#define SAMPLES           5
+#define MAX_BENCHMARKS    256
+#define NUM_PHASORS       4
+#define NUM_ANALOGS       1
+#define NUM_DIGITALS      1
+#define NUM_CHANNEL_NAMES (NUM_PHASORS + NUM_ANALOGS + 16 * NUM_DIGITALS)
+
+static const char *phasor_names[NUM_PHASORS] = { "VA", "VB", "VC", "IA" };
+
+/* Kept by reference in every configuration, so they live for good */
+static char channel_name_text[NUM_CHANNEL_NAMES][17];
+static char *channel_names[NUM_CHANNEL_NAMES + 1];
+
+static const char *header_text =
+  "Benchmark PMU, firmware 1.0, 3 voltage and 1 current channels per PMU";
+
+typedef struct
+{
+  uint16_t       num_pmu;
+  bool           is_float;
+  bool           is_polar;
+  const char    *format;
+
+  CtsConf       *config;
+  CtsDataLayout *layout;
+  byte          *data_frame;
+  uint16_t       data_size;
+  byte          *config_frame;     /* NULL if too large for a frame */
+  uint16_t       config_size;
+  byte           command_frame[COMMAND_MINIMUM_FRAME_SIZE];
+} Setup;
+
+typedef struct
+{
+  const char *name;
+  bool        per_config;
+  /* Does the work once, and returns the bytes encoded or decoded */
+  size_t    (*run) (Setup *setup);
+} Benchmark;
+
+typedef struct
+{
+  char   name[128];
+  double ns_per_frame;
+} Baseline;
+
+static volatile uint64_t sink;
+
+static int64_t
+get_time_ns (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static float
+get_value (uint16_t pmu_index,
+           uint16_t index)
+{
+  return 1000.0f + pmu_index * 7 + index * 3;
+}
+
+static size_t
+bench_crc (Setup *setup)
+{
+  sink += cts_common_calc_crc (setup->data_frame, setup->data_size - 2, NULL);
+
+  return setup->data_size;
+}
+
+static size_t
+bench_data_encode_frame (Setup *setup)
+{
+  CtsData *data = cts_data_get_default ();
+  CtsTime time = { 1500000000, 500000000, 0 };
+
+  cts_data_set_time (data, &time);
+
+  for (uint16_t i = 1; i <= setup->num_pmu; i++)
+    {
+      cts_data_set_stat_of_pmu (data, i, 0);
+
+      for (uint16_t j = 1; j <= NUM_PHASORS; j++)
+        cts_data_set_phasor_of_pmu (data, i, j, get_value (i, j), get_value (i, j + 1));
+
+      cts_data_set_freq_of_pmu (data, i, 0.01f, 0.001f);
+
+      for (uint16_t j = 1; j <= NUM_ANALOGS; j++)
+        cts_data_set_analog_of_pmu (data, i, j, get_value (i, j));
+    }
+
+  return cts_data_write_raw_data (data, setup->data_frame);
+}
+
+static size_t
+bench_data_decode_frame (Setup *setup)
+{
+  CtsData *data = cts_data_get_default ();
+  float sum = 0;
+
+  cts_data_populate_from_raw_data (data, setup->data_frame, false);
+
+  for (uint16_t i = 1; i <= setup->num_pmu; i++)
+    {
+      float real, imaginary, freq, rocof, value;
+
+      sum += cts_data_get_stat_of_pmu (data, i);
+
+      for (uint16_t j = 1; j <= NUM_PHASORS; j++)
+        if (cts_data_get_phasor_of_pmu (data, i, j, &real, &imaginary))
+          sum += real + imaginary;
+
+      if (cts_data_get_freq_of_pmu (data, i, &freq, &rocof))
+        sum += freq + rocof;
+
+      for (uint16_t j = 1; j <= NUM_ANALOGS; j++)
+        if (cts_data_get_analog_of_pmu (data, i, j, &value))
+          sum += value;
+    }
+
+  sink += (uint64_t) sum;
+
+  return setup->data_size;
+}
+
+static size_t
+bench_data_encode_view (Setup *setup)
+{
+  CtsTime time = { 1500000000, 500000000, 0 };
+  const CtsDataLayout *layout = setup->layout;
+  byte *frame = setup->data_frame;
+
+  cts_data_layout_write_common (layout, &time, frame);
+
+  for (uint16_t i = 1; i <= setup->num_pmu; i++)
+    {
+      cts_data_layout_write_stat_of_pmu (layout, i, 0, frame);
+
+      for (uint16_t j = 1; j <= NUM_PHASORS; j++)
+        cts_data_layout_write_phasor_of_pmu (layout, i, j, get_value (i, j),
+                                             get_value (i, j + 1), frame);
+
+      cts_data_layout_write_freq_of_pmu (layout, i, 0.01f, 0.001f, frame);
+
+      for (uint16_t j = 1; j <= NUM_ANALOGS; j++)
+        cts_data_layout_write_analog_of_pmu (layout, i, j, get_value (i, j), frame);
+
+      for (uint16_t j = 1; j <= NUM_DIGITALS; j++)
+        cts_data_layout_write_status_word_of_pmu (layout, i, j, 0x0001, frame);
+    }
+
+  cts_data_layout_write_crc (layout, frame);
+
+  return setup->data_size;
+}
+
+static size_t
+bench_data_decode_view (Setup *setup)
+{
+  CtsDataView view;
+  CtsTime time;
+  float sum = 0;
+
+  if (!cts_data_view_init (&view, setup->layout, setup->data_frame, setup->data_size))
+    return 0;
+
+  cts_data_view_get_time (&view, &time);
+  sum += time.nanoseconds;
+
+  for (uint16_t i = 1; i <= setup->num_pmu; i++)
+    {
+      float real, imaginary, freq, rocof, value;
+      uint16_t status_word;
+
+      sum += cts_data_view_get_stat_of_pmu (&view, i);
+
+      for (uint16_t j = 1; j <= NUM_PHASORS; j++)
+        if (cts_data_view_get_phasor_of_pmu (&view, i, j, &real, &imaginary))
+          sum += real + imaginary;
+
+      if (cts_data_view_get_freq_of_pmu (&view, i, &freq, &rocof))
+        sum += freq + rocof;
+
+      for (uint16_t j = 1; j <= NUM_ANALOGS; j++)
+        if (cts_data_view_get_analog_of_pmu (&view, i, j, &value))
+          sum += value;
+
+      for (uint16_t j = 1; j <= NUM_DIGITALS; j++)
+        if (cts_data_view_get_status_word_of_pmu (&view, i, j, &status_word))
+          sum += status_word;
+    }
+
+  sink += (uint64_t) sum;
+
+  return setup->data_size;
+}
+
+static size_t
+bench_config_encode (Setup *setup)
+{
+  byte *frame;
+
+  if (setup->config_frame == NULL)
+    return 0;
+
+  frame = cts_conf_get_raw_data (setup->config, SYNC_CONFIG_TWO);
+  sink += frame[setup->config_size - 1];
+  free (frame);
+
+  return setup->config_size;
+}
+
+static size_t
+bench_config_decode (Setup *setup)
+{
+  CtsConf *config;
+
+  if (setup->config_frame == NULL)
+    return 0;
+
+  config = cts_conf_new_from_raw_data (setup->config_frame, setup->config_size);
+  sink += cts_conf_get_num_of_pmu (config);
+  cts_conf_free (config);
+
+  return setup->config_size;
+}
+
+static size_t
+bench_header (Setup *setup)
+{
+  byte *frame;
+  uint16_t size;
+
+  frame = cts_header_get_bin (setup->config, header_text);
+  size = cts_common_get_size (frame, 2);
+  sink += frame[size - 1];
+  free (frame);
+
+  return size;
+}
+
+static size_t
+bench_command_write (Setup *setup)
+{
+  return cts_command_write (setup->command_frame, 1, CTS_COMMAND_DATA_ON);
+}
+
+static size_t
+bench_command_parse (Setup *setup)
+{
+  const byte *frame = setup->command_frame;
+
+  if (cts_common_check_crc (frame, COMMAND_MINIMUM_FRAME_SIZE - 2, NULL,
+                            COMMAND_MINIMUM_FRAME_SIZE - 2))
+    sink += cts_bin_get_command_type (frame, true) + cts_common_get_size (frame, 4);
+
+  return COMMAND_MINIMUM_FRAME_SIZE;
+}
+
+static const Benchmark benchmarks[] = {
+  { "crc",               true,  bench_crc },
+  { "data-encode/frame", true,  bench_data_encode_frame },
+  { "data-decode/frame", true,  bench_data_decode_frame },
+  { "data-encode/view",  true,  bench_data_encode_view },
+  { "data-decode/view",  true,  bench_data_decode_view },
+  { "config-encode",     true,  bench_config_encode },
+  { "config-decode",     true,  bench_config_decode },
+  { "header",            false, bench_header },
+  { "command-write",     false, bench_command_write },
+  { "command-parse",     false, bench_command_parse },
+};
+
+static const char *format_names[] = {
+  "int-rect", "int-polar", "float-rect", "float-polar",
+};
+
+/* The size of a CFG-2 of @num_pmu, which may not fit in a frame */
+static size_t
+get_config_size (uint16_t num_pmu)
+{
+  size_t per_pmu = 16 + 2 + 2 + 2 * 3 + 16 * NUM_CHANNEL_NAMES +
+                   4 * (NUM_PHASORS + NUM_ANALOGS + NUM_DIGITALS) + 2 + 2;
+
+  return 24 + num_pmu * per_pmu;
+}
+
+static CtsConf *
+make_config (uint16_t num_pmu,
+             bool     is_float,
+             bool     is_polar)
+{
+  CtsConf *config = cts_conf_new ();
+  int n = 0;
+
+  for (int i = 0; i < NUM_PHASORS; i++)
+    snprintf (channel_name_text[n++], 17, "%-16.16s", phasor_names[i]);
+
+  for (int i = 0; i < NUM_ANALOGS; i++)
+    snprintf (channel_name_text[n++], 17, "ANALOG%-10d", i + 1);
+
+  for (int i = 0; i < 16 * NUM_DIGITALS; i++)
+    snprintf (channel_name_text[n++], 17, "DIGITAL%-9d", i);
+
+  for (int i = 0; i < NUM_CHANNEL_NAMES; i++)
+    channel_names[i] = channel_name_text[i];
+
+  cts_conf_set_id_code (config, 1);
+  cts_conf_set_num_of_pmu (config, num_pmu);
+  cts_conf_set_time_base (config, 1000000);
+  cts_conf_set_data_rate (config, 50);
+
+  for (uint16_t i = 1; i <= num_pmu; i++)
+    {
+      char station[17];
+
+      snprintf (station, sizeof station, "BENCH%05u", i);
+      cts_conf_set_station_name_of_pmu (config, i, station, strlen (station));
+      cts_conf_set_id_code_of_pmu (config, i, i);
+      cts_conf_set_num_of_phasors_of_pmu (config, i, NUM_PHASORS);
+      cts_conf_set_num_of_analogs_of_pmu (config, i, NUM_ANALOGS);
+      cts_conf_set_num_of_status_of_pmu (config, i, NUM_DIGITALS);
+      cts_conf_set_nominal_freq_of_pmu (config, i, NOMINAL_FREQ_50);
+
+      cts_conf_set_phasor_data_type_of_pmu (config, i, is_float ? VALUE_TYPE_FLOAT : VALUE_TYPE_INT);
+      cts_conf_set_freq_data_type_of_pmu (config, i, is_float ? VALUE_TYPE_FLOAT : VALUE_TYPE_INT);
+      cts_conf_set_analog_data_type_of_pmu (config, i, is_float ? VALUE_TYPE_FLOAT : VALUE_TYPE_INT);
+      cts_conf_set_phasor_complex_type_of_pmu (config, i, is_polar);
+
+      for (uint16_t j = 1; j <= NUM_PHASORS; j++)
+        cts_conf_set_phasor_measure_type_of_pmu (config, i, j,
+                                                 j <= 3 ? VALUE_TYPE_VOLTAGE : VALUE_TYPE_CURRENT);
+
+      cts_conf_set_all_phasor_conv_of_pmu (config, i, 100000);
+      cts_conf_set_all_analog_conv_of_pmu (config, i, 1000);
+      cts_conf_set_channel_names_of_pmu (config, i, channel_names);
+    }
+
+  cts_conf_update_frame_size (config);
+
+  return config;
+}
+
+static bool
+setup_init (Setup    *setup,
+            uint16_t  num_pmu,
+            int       format)
+{
+  memset (setup, 0, sizeof *setup);
+  setup->num_pmu = num_pmu;
+  setup->is_float = format >= 2;
+  setup->is_polar = format % 2;
+  setup->format = format_names[format];
+  setup->config = make_config (num_pmu, setup->is_float, setup->is_polar);
+  setup->layout = cts_data_layout_new (setup->config);
+
+  if (setup->layout == NULL)
+    return false;
+
+  setup->data_size = cts_data_layout_get_frame_size (setup->layout);
+  setup->data_frame = calloc (1, setup->data_size);
+
+  if (get_config_size (num_pmu) <= UINT16_MAX)
+    {
+      setup->config_size = get_config_size (num_pmu);
+      setup->config_frame = cts_conf_get_raw_data (setup->config, SYNC_CONFIG_TWO);
+    }
+
+  /* CtsData is a single one, made to match before the frame benchmarks */
+  if (!cts_data_set_config (cts_data_get_default (), setup->config))
+    return false;
+
+  bench_data_encode_view (setup);
+  cts_command_write (setup->command_frame, 1, CTS_COMMAND_DATA_ON);
+
+  return setup->data_frame != NULL;
+}
+
+static void
+setup_clear (Setup *setup)
+{
+  free (setup->data_frame);
+  free (setup->config_frame);
+  cts_data_layout_free (setup->layout);
+
+  /* Not freed, as the default CtsData may still refer to it */
+  setup->config = NULL;
+}
+
+/* Returns: The nanoseconds @count calls of @benchmark took */
+static int64_t
+time_calls (const Benchmark *benchmark,
+            Setup           *setup,
+            uint64_t         count)
+{
+  int64_t start = get_time_ns ();
+
+  for (uint64_t i = 0; i < count; i++)
+    benchmark->run (setup);
+
+  return get_time_ns () - start;
+}
+
+static int
+compare_doubles (const void *a,
+                 const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+
+  return (x > y) - (x < y);
+}
+
+static double
+measure (const Benchmark *benchmark,
+         Setup           *setup,
+         int64_t          min_time_ns,
+         uint64_t        *iterations)
+{
+  int64_t round_ns = min_time_ns / SAMPLES;
+  double samples[SAMPLES];
+  uint64_t count = 1;
+  int64_t elapsed;
+
+  /* As many calls as take a round, going by the fastest of the tries */
+  while ((elapsed = time_calls (benchmark, setup, count)) < round_ns)
+    {
+      uint64_t scale = elapsed > 0 ? (uint64_t) (1.2 * round_ns / elapsed) + 1 : 10;
+
+      count *= scale < 2 ? 2 : scale > 100 ? 100 : scale;
+    }
+
+  for (int i = 0; i < SAMPLES; i++)
+    samples[i] = (double) time_calls (benchmark, setup, count) / count;
+
+  qsort (samples, SAMPLES, sizeof *samples, compare_doubles);
+  *iterations = count * SAMPLES;
+
+  return samples[SAMPLES / 2];
+}
+
+static size_t
+load_baseline (const char *path,
+               Baseline   *baseline,
+               size_t      size)
+{
+  char line[1024];
+  size_t count = 0;
+  FILE *file;
+
+  file = fopen (path, "r");
+
+  if (file == NULL)
+    return 0;
+
+  while (count < size && fgets (line, sizeof line, file))
+    {
+      const char *name = strstr (line, "\"name\": \"");
+      const char *ns = strstr (line, "\"ns_per_frame\": ");
+      size_t length;
+
+      if (name == NULL || ns == NULL)
+        continue;
+
+      name += strlen ("\"name\": \"");
+      length = strcspn (name, "\"");
+
+      if (length >= sizeof baseline[count].name)
+        continue;
+
+      memcpy (baseline[count].name, name, length);
+      baseline[count].name[length] = '\0';
+      baseline[count].ns_per_frame = strtod (ns + strlen ("\"ns_per_frame\": "), NULL);
+      count++;
+    }
+
+  fclose (file);
+
+  return count;
+}
+
+static const Baseline *
+find_baseline (const Baseline *baseline,
+               size_t          count,
+               const char     *name)
+{
+  for (size_t i = 0; i < count; i++)
+    if (strcmp (baseline[i].name, name) == 0)
+      return baseline + i;
+
+  return NULL;
+}
+
+static bool
+parse_pmu_counts (const char *text,
+                  uint16_t   *counts,
+                  size_t     *num_counts)
+{
+  *num_counts = 0;
+
+  while (*text)
+    {
+      char *end;
+      long count = strtol (text, &end, 10);
+
+      if (end == text || count < 1 || count > UINT16_MAX || *num_counts == 16 ||
+          (*end != ',' && *end != '\0'))
+        return false;
+
+      counts[(*num_counts)++] = count;
+      text = *end ? end + 1 : end;
+    }
+
+  return *num_counts > 0;
+}
+
+static void
+print_usage (const char *program)
+{
+  fprintf (stderr,
+           "Usage: %s [OPTION…]\n"
+           "Benchmark the C37.118 codecs, writing a line of JSON for each\n\n"
+           "  -p, --pmus=N,N,…         Numbers of PMUs (default: 1,10,100,1000)\n"
+           "  -f, --filter=TEXT        Only benchmarks with TEXT in their name\n"
+           "  -t, --min-time=MS        Time to run each benchmark for (default: 200)\n"
+           "  -b, --baseline=FILE      Compare with the output of an earlier run\n"
+           "  -T, --tolerance=PERCENT  Slowdown from the baseline taken as noise (default: 10)\n"
+           "  -h, --help               Show this help\n",
+           program);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  static const struct option options[] = {
+    { "pmus",      required_argument, NULL, 'p' },
+    { "filter",    required_argument, NULL, 'f' },
+    { "min-time",  required_argument, NULL, 't' },
+    { "baseline",  required_argument, NULL, 'b' },
+    { "tolerance", required_argument, NULL, 'T' },
+    { "help",      no_argument,       NULL, 'h' },
+    { NULL }
+  };
+  static Baseline baseline[MAX_BENCHMARKS];
+  uint16_t pmu_counts[16] = { 1, 10, 100, 1000 };
+  size_t num_pmu_counts = 4, num_baseline = 0;
+  const char *filter = NULL, *baseline_path = NULL;
+  double tolerance = 10;
+  int64_t min_time_ns = 200000000;
+  int regressions = 0;
+  int option;
+
+  while ((option = getopt_long (argc, argv, "p:f:t:b:T:h", options, NULL)) != -1)
+    {
+      switch (option)
+        {
+        case 'p':
+          if (!parse_pmu_counts (optarg, pmu_counts, &num_pmu_counts))
+            {
+              print_usage (argv[0]);
+              return EXIT_FAILURE;
+            }
+          break;
+        case 'f':
+          filter = optarg;
+          break;
+        case 't':
+          min_time_ns = atol (optarg) * 1000000;
+          break;
+        case 'b':
+          baseline_path = optarg;
+          break;
+        case 'T':
+          tolerance = atof (optarg);
+          break;
+        default:
+          print_usage (argv[0]);
+          return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+  if (optind != argc || min_time_ns <= 0 || tolerance < 0)
+    {
+      print_usage (argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  if (baseline_path)
+    {
+      num_baseline = load_baseline (baseline_path, baseline, MAX_BENCHMARKS);
+
+      if (num_baseline == 0)
+        {
+          fprintf (stderr, "Nothing to compare with in %s\n", baseline_path);
+          return EXIT_FAILURE;
+        }
+    }
+
+  for (size_t i = 0; i < num_pmu_counts; i++)
+    for (int format = 0; format < 4; format++)
+      {
+        bool first = i == 0 && format == 0;
+        Setup setup;
+
+        if (!setup_init (&setup, pmu_counts[i], format))
+          {
+            fprintf (stderr, "Can't set up %u PMUs of %s, skipped\n",
+                     pmu_counts[i], format_names[format]);
+            setup_clear (&setup);
+            continue;
+          }
+
+        for (size_t j = 0; j < sizeof benchmarks / sizeof *benchmarks; j++)
+          {
+            const Benchmark *benchmark = benchmarks + j;
+            const Baseline *base;
+            uint64_t iterations;
+            char name[128];
+            double ns;
+            size_t bytes;
+
+            if (benchmark->per_config)
+              snprintf (name, sizeof name, "%s/%u-%s", benchmark->name,
+                        setup.num_pmu, setup.format);
+            else if (first)
+              snprintf (name, sizeof name, "%s", benchmark->name);
+            else
+              continue;
+
+            if (filter && strstr (name, filter) == NULL)
+              continue;
+
+            bytes = benchmark->run (&setup);
+
+            if (bytes == 0)
+              continue;
+
+            ns = measure (benchmark, &setup, min_time_ns, &iterations);
+
+            printf ("{\"name\": \"%s\", \"pmus\": %u, \"format\": \"%s\", \"bytes\": %zu, "
+                    "\"iterations\": %" PRIu64 ", \"ns_per_frame\": %.1f, \"bytes_per_second\": %.4g",
+                    name, benchmark->per_config ? setup.num_pmu : 0,
+                    benchmark->per_config ? setup.format : "", bytes, iterations, ns,
+                    bytes * 1e9 / ns);
+
+            base = find_baseline (baseline, num_baseline, name);
+
+            if (base && base->ns_per_frame > 0)
+              {
+                double change = (ns - base->ns_per_frame) * 100 / base->ns_per_frame;
+
+                printf (", \"baseline_ns_per_frame\": %.1f, \"change_percent\": %.1f",
+                        base->ns_per_frame, change);
+
+                if (change > tolerance)
+                  {
+                    fprintf (stderr, "%s: %.1f ns, %.1f%% slower than %.1f ns\n",
+                             name, ns, change, base->ns_per_frame);
+                    regressions++;
+                  }
+              }
+
+            printf ("}\n");
+            fflush (stdout);
+          }
+
+        setup_clear (&setup);
+      }
+
+  if (regressions)
+    fprintf (stderr, "%d slower than the baseline by more than %g%%\n",
+             regressions, tolerance);
+
+  return regressions ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -113,10 +113,12 @@ cts_bin_get_frac_of_second (const byte *data,
   data += 6;
 
   memcpy (&frac_of_second, data, 4);
-  frac_of_second = ntohl (frac_of_second);
+
+  /* The upper byte is TIME_QUALITY, not a part of the fraction */
+  frac_of_second = ntohl (frac_of_second) & 0x00FFFFFF;
 
   if (time_base)
-    frac_of_second = frac_of_second * (pow (10, 9) / time_base);
+    frac_of_second = (uint64_t) frac_of_second * 1000000000 / time_base;
 
   return frac_of_second;
 }
@@ -0,0 +1,641 @@
+/* c37-client.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "c37-client.h"
+#include "c37-command.h"
+
+/*
+ * The PDC end of IEEE C37.118.2: Commands are sent to a PMU (or PDC)
+ * and the frames received are handed over as they lie in the
+ * receive buffer. A stream is resynchronized on SYNC after anything
+ * that is not a frame with a valid CHK.
+ *
+ * The buffer can hold two of the largest frames, so that after
+ * moving the part of a frame left to the start, there is always
+ * room for the rest of it.
+ */
+
+#define MAX_FRAME_SIZE    UINT16_MAX
+#define BUFFER_SIZE       (2 * (MAX_FRAME_SIZE + 1))
+
+/* SYNC, FRAMESIZE, IDCODE, SOC, FRACSEC and CHK */
+#define MIN_FRAME_SIZE    16
+
+struct _CtsClient
+{
+  uint16_t id_code;
+  int      fd;
+  int      transport;
+
+  byte   *buffer;
+  size_t  fill;
+
+  CtsConf       *config;
+  CtsDataLayout *layout;
+
+  /* Configurations received, of CFG-1, CFG-2 and CFG-3 */
+  unsigned int num_configs[3];
+
+  CtsClientHandlers handlers;
+  void             *user_data;
+
+  CtsClientStats stats;
+};
+
+/**
+ * cts_client_new:
+ * @id_code: The ID code of the PMU or PDC to talk to
+ *
+ * Returns: (nullable) (transfer full): A new #CtsClient, not yet
+ * connected, or %NULL if out of memory. Free with cts_client_free().
+ */
+CtsClient *
+cts_client_new (uint16_t id_code)
+{
+  CtsClient *self;
+
+  self = calloc (1, sizeof *self);
+
+  if (self == NULL)
+    return NULL;
+
+  self->buffer = malloc (BUFFER_SIZE);
+
+  if (self->buffer == NULL)
+    {
+      free (self);
+      return NULL;
+    }
+
+  self->id_code = id_code;
+  self->fd = -1;
+
+  return self;
+}
+
+/**
+ * cts_client_free:
+ * @self: (nullable): A #CtsClient
+ *
+ * Close the connection if any, and free @self.
+ */
+void
+cts_client_free (CtsClient *self)
+{
+  if (self == NULL)
+    return;
+
+  cts_client_close (self);
+  cts_data_layout_free (self->layout);
+  cts_conf_free (self->config);
+  free (self->buffer);
+  free (self);
+}
+
+void
+cts_client_set_handlers (CtsClient               *self,
+                         const CtsClientHandlers *handlers,
+                         void                    *user_data)
+{
+  if (handlers)
+    self->handlers = *handlers;
+  else
+    memset (&self->handlers, 0, sizeof self->handlers);
+
+  self->user_data = user_data;
+}
+
+/**
+ * cts_client_connect:
+ * @self: A #CtsClient
+ * @host: The host name or address of the PMU
+ * @port: The port or service name
+ * @transport: %CTS_TRANSPORT_TCP or %CTS_TRANSPORT_UDP
+ *
+ * Connect to the first address of @host that accepts. With UDP, the
+ * socket is only connected so that commands go to @host, and frames
+ * from others are not received.
+ *
+ * Returns: %true if connected, %false otherwise with errno set.
+ */
+bool
+cts_client_connect (CtsClient  *self,
+                    const char *host,
+                    const char *port,
+                    int         transport)
+{
+  struct addrinfo hints = { 0 };
+  struct addrinfo *result, *address;
+  int fd = -1;
+  int status;
+
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = transport == CTS_TRANSPORT_UDP ? SOCK_DGRAM : SOCK_STREAM;
+
+  status = getaddrinfo (host, port, &hints, &result);
+
+  if (status != 0)
+    {
+      errno = status == EAI_SYSTEM ? errno : EHOSTUNREACH;
+      return false;
+    }
+
+  for (address = result; address; address = address->ai_next)
+    {
+      fd = socket (address->ai_family, address->ai_socktype | SOCK_CLOEXEC,
+                   address->ai_protocol);
+
+      if (fd < 0)
+        continue;
+
+      if (connect (fd, address->ai_addr, address->ai_addrlen) == 0)
+        break;
+
+      close (fd);
+      fd = -1;
+    }
+
+  freeaddrinfo (result);
+
+  if (fd < 0)
+    return false;
+
+  if (transport == CTS_TRANSPORT_TCP)
+    {
+      int one = 1;
+
+      /* Commands are small, and are waited upon */
+      setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    }
+
+  return cts_client_set_fd (self, fd, transport);
+}
+
+/**
+ * cts_client_set_fd:
+ * @self: A #CtsClient
+ * @fd: A connected socket, owned by @self from now
+ * @transport: %CTS_TRANSPORT_TCP if @fd is a stream, or
+ * %CTS_TRANSPORT_UDP if every read gives a single datagram
+ *
+ * Use @fd instead of connecting. Any earlier connection is closed,
+ * and what was received but not handled in it is dropped. The
+ * configuration is kept.
+ *
+ * Returns: %true
+ */
+bool
+cts_client_set_fd (CtsClient *self,
+                   int        fd,
+                   int        transport)
+{
+  cts_client_close (self);
+
+  self->fd = fd;
+  self->transport = transport;
+
+  return true;
+}
+
+int
+cts_client_get_fd (CtsClient *self)
+{
+  return self->fd;
+}
+
+void
+cts_client_close (CtsClient *self)
+{
+  if (self->fd >= 0)
+    close (self->fd);
+
+  self->fd = -1;
+  self->fill = 0;
+}
+
+/**
+ * cts_client_send_command:
+ * @self: A connected #CtsClient
+ * @command: A #CtsCommand
+ *
+ * Returns: %true if the command was sent, %false otherwise with
+ * errno set.
+ */
+bool
+cts_client_send_command (CtsClient *self,
+                         uint16_t   command)
+{
+  byte frame[COMMAND_MINIMUM_FRAME_SIZE];
+  uint16_t size;
+  ssize_t sent;
+
+  size = cts_command_write (frame, self->id_code, command);
+
+  do
+    sent = send (self->fd, frame, size, MSG_NOSIGNAL);
+  while (sent < 0 && errno == EINTR);
+
+  return sent == size;
+}
+
+static byte
+get_config_type (byte frame_type)
+{
+  switch (frame_type)
+    {
+    case CTS_TYPE_CONFIG1 & 0x70:
+      return CTS_TYPE_CONFIG1;
+    case CTS_TYPE_CONFIG2 & 0x70:
+      return CTS_TYPE_CONFIG2;
+    case CTS_TYPE_CONFIG3 & 0x70:
+      return CTS_TYPE_CONFIG3;
+    default:
+      return CTS_TYPE_INVALID;
+    }
+}
+
+static int
+get_config_index (byte type)
+{
+  switch (type)
+    {
+    case CTS_TYPE_CONFIG1:
+      return 0;
+    case CTS_TYPE_CONFIG2:
+      return 1;
+    default:
+      return 2;
+    }
+}
+
+static void
+handle_config (CtsClient  *self,
+               const byte *frame,
+               uint16_t    size,
+               byte        type)
+{
+  CtsConf *config;
+  CtsDataLayout *layout = NULL;
+
+  config = cts_conf_new_from_raw_data (frame, size);
+
+  if (config == NULL)
+    return;
+
+  /* CFG-1 tells what the PMU can do, not what the data frames are */
+  if (type != CTS_TYPE_CONFIG1)
+    {
+      layout = cts_data_layout_new (config);
+
+      if (layout == NULL)
+        {
+          cts_conf_free (config);
+          return;
+        }
+
+      cts_data_layout_free (self->layout);
+      cts_conf_free (self->config);
+      self->layout = layout;
+      self->config = config;
+    }
+
+  self->num_configs[get_config_index (type)]++;
+
+  if (self->handlers.config)
+    self->handlers.config (self, config, type, self->user_data);
+
+  if (layout == NULL)
+    cts_conf_free (config);
+}
+
+static void
+handle_frame (CtsClient  *self,
+              const byte *frame,
+              uint16_t    size)
+{
+  byte frame_type = frame[1] & 0x70;
+  CtsDataView view;
+
+  self->stats.frames++;
+
+  if (self->handlers.frame)
+    self->handlers.frame (self, frame, size, self->user_data);
+
+  if (frame_type == (CTS_TYPE_DATA & 0x70))
+    {
+      self->stats.data_frames++;
+
+      if (self->layout == NULL || !cts_data_view_init (&view, self->layout, frame, size))
+        self->stats.unknown_data++;
+      else if (self->handlers.data)
+        self->handlers.data (self, &view, self->user_data);
+    }
+  else if (frame_type == (CTS_TYPE_HEADER & 0x70))
+    {
+      if (self->handlers.header)
+        self->handlers.header (self, (const char *) frame + MIN_FRAME_SIZE - 2,
+                               size - MIN_FRAME_SIZE, self->user_data);
+    }
+  else if (get_config_type (frame_type) != CTS_TYPE_INVALID)
+    {
+      handle_config (self, frame, size, get_config_type (frame_type));
+    }
+}
+
+/* Handle every complete frame in @buffer, and return the bytes used */
+static size_t
+parse_buffer (CtsClient  *self,
+              const byte *buffer,
+              size_t      fill)
+{
+  size_t start = 0;
+
+  while (fill - start >= 4)
+    {
+      const byte *frame = buffer + start;
+      uint16_t size;
+
+      if (frame[0] != CTS_TYPE_SYNC)
+        {
+          const byte *sync = memchr (frame, CTS_TYPE_SYNC, fill - start);
+          size_t skip = sync ? (size_t) (sync - frame) : fill - start;
+
+          self->stats.skipped_bytes += skip;
+          start += skip;
+          continue;
+        }
+
+      size = cts_common_get_size (frame, 2);
+
+      /*
+       * A SYNC byte in the middle of something else is most often not
+       * followed by a frame type and size that make sense. If it is,
+       * the stream is waited upon till there is as much as the size.
+       */
+      if ((frame[1] & 0x80) || (frame[1] & 0x70) > (CTS_TYPE_CONFIG3 & 0x70) ||
+          size < MIN_FRAME_SIZE ||
+          ((frame[1] & 0x70) == (CTS_TYPE_DATA & 0x70) && self->layout &&
+           size != cts_data_layout_get_frame_size (self->layout)))
+        {
+          self->stats.skipped_bytes++;
+          start++;
+          continue;
+        }
+
+      if (fill - start < size)
+        break;
+
+      if (!cts_common_check_crc (frame, size - 2, NULL, size - 2))
+        {
+          self->stats.bad_crc++;
+          self->stats.skipped_bytes++;
+          start++;
+          continue;
+        }
+
+      handle_frame (self, frame, size);
+      start += size;
+    }
+
+  return start;
+}
+
+/**
+ * cts_client_read:
+ * @self: A connected #CtsClient
+ *
+ * Read what is available, once, and call the handlers for every
+ * complete frame. If the socket is blocking, this blocks until
+ * something is received.
+ *
+ * Returns: The number of bytes read, 0 if the connection was closed
+ * by the other end, or -1 with errno set on error (%EAGAIN if the
+ * socket is non blocking and there is nothing to read).
+ */
+ssize_t
+cts_client_read (CtsClient *self)
+{
+  ssize_t count;
+  size_t used;
+
+  if (self->transport == CTS_TRANSPORT_UDP)
+    self->fill = 0;
+
+  do
+    count = recv (self->fd, self->buffer + self->fill,
+                  BUFFER_SIZE - self->fill, 0);
+  while (count < 0 && errno == EINTR);
+
+  if (count <= 0)
+    return count;
+
+  self->fill += count;
+  used = parse_buffer (self, self->buffer, self->fill);
+
+  if (self->transport == CTS_TRANSPORT_UDP)
+    {
+      /* A datagram is a frame, or nothing */
+      self->stats.skipped_bytes += self->fill - used;
+      self->fill = 0;
+    }
+  else if (used)
+    {
+      memmove (self->buffer, self->buffer + used, self->fill - used);
+      self->fill -= used;
+    }
+
+  return count;
+}
+
+/**
+ * cts_client_feed:
+ * @self: A #CtsClient
+ * @datagram: A datagram received from the PMU
+ * @size: Size of @datagram
+ *
+ * Call the handlers for the frames of @datagram, as if it was read
+ * by cts_client_read() with UDP. For a socket shared with other PMUs,
+ * where @self has no socket of its own.
+ */
+void
+cts_client_feed (CtsClient  *self,
+                 const byte *datagram,
+                 size_t      size)
+{
+  self->stats.skipped_bytes += size - parse_buffer (self, datagram, size);
+}
+
+/**
+ * cts_client_feed_stream:
+ * @self: A #CtsClient
+ * @bytes: Bytes of a stream from the PMU, following the last fed
+ * @size: Size of @bytes
+ *
+ * Call the handlers for the frames completed by @bytes, as if they
+ * were read by cts_client_read() with TCP: a frame may be split
+ * across calls. For a stream read from elsewhere than a socket, say
+ * a capture. cts_client_close() forgets a partial frame, for when
+ * bytes of the stream are known to be missing.
+ */
+void
+cts_client_feed_stream (CtsClient  *self,
+                        const byte *bytes,
+                        size_t      size)
+{
+  while (size > 0)
+    {
+      size_t space = BUFFER_SIZE - self->fill;
+      size_t count = size < space ? size : space;
+      size_t used;
+
+      memcpy (self->buffer + self->fill, bytes, count);
+      self->fill += count;
+      bytes += count;
+      size -= count;
+
+      used = parse_buffer (self, self->buffer, self->fill);
+
+      if (used)
+        {
+          memmove (self->buffer, self->buffer + used, self->fill - used);
+          self->fill -= used;
+        }
+    }
+}
+
+static int64_t
+get_monotonic_ms (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * cts_client_request_config:
+ * @self: A connected #CtsClient
+ * @command: %CTS_COMMAND_SEND_CONFIG1, %CTS_COMMAND_SEND_CONFIG2
+ * or %CTS_COMMAND_SEND_CONFIG3
+ * @timeout_ms: How long to wait, in milliseconds
+ *
+ * Send @command and read until the configuration asked for is
+ * received. Every frame received meanwhile is handled as in
+ * cts_client_read().
+ *
+ * Returns: %true if the configuration was received, %false if not
+ * before @timeout_ms or on error.
+ */
+bool
+cts_client_request_config (CtsClient *self,
+                           uint16_t   command,
+                           int        timeout_ms)
+{
+  struct pollfd poll_fd = { self->fd, POLLIN, 0 };
+  unsigned int num_configs;
+  int64_t deadline;
+  int index;
+
+  switch (command)
+    {
+    case CTS_COMMAND_SEND_CONFIG1:
+      index = get_config_index (CTS_TYPE_CONFIG1);
+      break;
+    case CTS_COMMAND_SEND_CONFIG2:
+      index = get_config_index (CTS_TYPE_CONFIG2);
+      break;
+    case CTS_COMMAND_SEND_CONFIG3:
+      index = get_config_index (CTS_TYPE_CONFIG3);
+      break;
+    default:
+      return false;
+    }
+
+  num_configs = self->num_configs[index];
+
+  if (!cts_client_send_command (self, command))
+    return false;
+
+  deadline = get_monotonic_ms () + timeout_ms;
+
+  while (self->num_configs[index] == num_configs)
+    {
+      int64_t remaining = deadline - get_monotonic_ms ();
+      ssize_t count;
+      int status;
+
+      if (remaining <= 0)
+        return false;
+
+      status = poll (&poll_fd, 1, remaining);
+
+      if (status < 0 && errno != EINTR)
+        return false;
+      if (status <= 0)
+        continue;
+
+      count = cts_client_read (self);
+
+      if (count == 0 || (count < 0 && errno != EAGAIN))
+        return false;
+    }
+
+  return true;
+}
+
+/**
+ * cts_client_get_config:
+ * @self: A #CtsClient
+ *
+ * Returns: (nullable) (transfer none): The last CFG-2 or CFG-3
+ * received, that the data frames are read with.
+ */
+CtsConf *
+cts_client_get_config (CtsClient *self)
+{
+  return self->config;
+}
+
+/**
+ * cts_client_get_layout:
+ * @self: A #CtsClient
+ *
+ * Returns: (nullable) (transfer none): The layout of the data frames
+ * of cts_client_get_config().
+ */
+const CtsDataLayout *
+cts_client_get_layout (CtsClient *self)
+{
+  return self->layout;
+}
+
+void
+cts_client_get_stats (CtsClient      *self,
+                      CtsClientStats *stats)
+{
+  *stats = self->stats;
+}
@@ -0,0 +1,112 @@
+/* c37-client.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef C37_CLIENT_H
+#define C37_CLIENT_H
+
+
+#include <sys/types.h>
+
+#include "c37-common.h"
+#include "c37-conf.h"
+#include "c37-view.h"
+
+enum CtsTransport {
+  CTS_TRANSPORT_TCP,
+  CTS_TRANSPORT_UDP,
+};
+
+typedef struct _CtsClient CtsClient;
+
+/*
+ * Called from cts_client_read() for every frame received with a
+ * valid CHK. Neither the frames nor the views are valid after the
+ * handler returns.
+ *
+ * frame: Every frame, before being handled by the rest
+ * config: A configuration frame. If of CFG-2 or CFG-3, the data
+ * frames that follow are read with it, and it is valid until the
+ * next one is received. A CFG-1 is freed once the handler returns.
+ * header: The text of a header frame, not ending with '\0'
+ * data: A data frame that matches the last CFG-2 or CFG-3
+ */
+typedef struct _CtsClientHandlers
+{
+  void (*frame)  (CtsClient         *client,
+                  const byte        *frame,
+                  uint16_t           size,
+                  void              *user_data);
+  void (*config) (CtsClient         *client,
+                  CtsConf           *config,
+                  byte               type,
+                  void              *user_data);
+  void (*header) (CtsClient         *client,
+                  const char        *text,
+                  size_t             length,
+                  void              *user_data);
+  void (*data)   (CtsClient         *client,
+                  const CtsDataView *view,
+                  void              *user_data);
+} CtsClientHandlers;
+
+typedef struct _CtsClientStats
+{
+  uint64_t frames;
+  uint64_t data_frames;
+  uint64_t bad_crc;         /* Frames dropped for a wrong CHK */
+  uint64_t skipped_bytes;   /* Bytes skipped to find the next SYNC */
+  uint64_t unknown_data;    /* Data frames without a matching configuration */
+} CtsClientStats;
+
+CtsClient *cts_client_new  (uint16_t   id_code);
+void       cts_client_free (CtsClient *self);
+
+void cts_client_set_handlers (CtsClient               *self,
+                              const CtsClientHandlers *handlers,
+                              void                    *user_data);
+
+bool cts_client_connect (CtsClient  *self,
+                         const char *host,
+                         const char *port,
+                         int         transport);
+bool cts_client_set_fd  (CtsClient  *self,
+                         int         fd,
+                         int         transport);
+int  cts_client_get_fd  (CtsClient  *self);
+void cts_client_close   (CtsClient  *self);
+
+bool    cts_client_send_command   (CtsClient *self,
+                                   uint16_t   command);
+ssize_t cts_client_read           (CtsClient *self);
+void    cts_client_feed           (CtsClient  *self,
+                                   const byte *datagram,
+                                   size_t      size);
+void    cts_client_feed_stream    (CtsClient  *self,
+                                   const byte *bytes,
+                                   size_t      size);
+bool    cts_client_request_config (CtsClient *self,
+                                   uint16_t   command,
+                                   int        timeout_ms);
+
+CtsConf             *cts_client_get_config (CtsClient      *self);
+const CtsDataLayout *cts_client_get_layout (CtsClient      *self);
+void                 cts_client_get_stats  (CtsClient      *self,
+                                            CtsClientStats *stats);
+
+
+#endif /* C37_CLIENT_H */
@@ -45,3 +45,47 @@ cts_command_get_type (uint16_t command)
   return CTS_COMMAND_INVALID;
 }
 
+
+/**
+ * cts_command_write:
+ * @data: A buffer of at least %COMMAND_MINIMUM_FRAME_SIZE bytes
+ * @id_code: The ID code of the PMU or PDC the command is sent to
+ * @command: A #CtsCommand, or a user defined command
+ *
+ * Write a command frame, timestamped now, to @data. The fraction of
+ * second is left 0 as the time base of the other end need not be
+ * known, only the time quality is set.
+ *
+ * Returns: The number of bytes written.
+ */
+uint16_t
+cts_command_write (byte     *data,
+                   uint16_t  id_code,
+                   uint16_t  command)
+{
+  uint16_t values[] = { SYNC_COMMAND, COMMAND_MINIMUM_FRAME_SIZE, id_code };
+  uint16_t crc;
+  uint32_t word;
+  CtsTime time;
+
+  cts_common_get_timestamp (&time);
+
+  for (size_t i = 0; i < 3; i++)
+    {
+      values[i] = htons (values[i]);
+      memcpy (data + 2 * i, values + i, 2);
+    }
+
+  word = htonl (time.soc);
+  memcpy (data + 6, &word, 4);
+  word = htonl ((uint32_t) time.time_quality << 24);
+  memcpy (data + 10, &word, 4);
+
+  command = htons (command);
+  memcpy (data + 14, &command, 2);
+
+  crc = htons (cts_common_calc_crc (data, COMMAND_MINIMUM_FRAME_SIZE - 2, NULL));
+  memcpy (data + 16, &crc, 2);
+
+  return COMMAND_MINIMUM_FRAME_SIZE;
+}
@@ -27,6 +27,8 @@
  */
 #define COMMAND_MINIMUM_FRAME_SIZE 18
 
+#define SYNC_COMMAND 0xAA41
+
 enum CtsCommand {
   CTS_COMMAND_INVALID,
   CTS_COMMAND_DATA_OFF       = 0x01,
@@ -43,6 +45,10 @@ enum CtsCommand {
 
 uint16_t
 cts_command_get_type (uint16_t command);
+uint16_t
+cts_command_write    (byte     *data,
+                      uint16_t  id_code,
+                      uint16_t  command);
 
 
 #endif /* C37_COMMAND_H */
@@ -16,6 +16,10 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/timex.h>
+
 #include "c37-common.h"
 
 /**
@@ -173,17 +177,277 @@ cts_common_get_size (const byte *data, uint16_t offset)
   return length;
 }
 
+/*
+ * The PHC character devices (/dev/ptpN) are used as a dynamic clock by
+ * passing the file descriptor encoded as a clockid_t. See
+ * Documentation/ptp/testptp.c in Linux source.
+ */
+#define CLOCKFD 3
+#define FD_TO_CLOCKID(fd) ((~(clockid_t) (fd) << 3) | CLOCKFD)
+
+#define NSEC_PER_SEC 1000000000
+#define SEC_PER_DAY  86400
+
+/* Bits of the TIME_QUALITY byte (the upper byte of FRACSEC) */
+#define TIME_QUALITY_LEAP_DIRECTION_BIT 6
+#define TIME_QUALITY_LEAP_OCCURRED_BIT  5
+#define TIME_QUALITY_LEAP_PENDING_BIT   4
+#define TIME_QUALITY_FAULT              0x0F
+
+static clockid_t clock_id = CLOCK_REALTIME;
+static int       clock_type = CTS_CLOCK_REALTIME;
+static int       phc_fd = -1;
+
+/*
+ * Cached state of the kernel time keeping, refreshed at most once per
+ * second. Packed as: SOC of the last refresh (32 bits), TAI - UTC
+ * offset (16 bits) and TIME_QUALITY (8 bits), so that it can be read
+ * and written atomically from any thread.
+ */
+static _Atomic uint64_t time_state = 0;
+
+/* SOC at which a leap second was last seen, to keep the flag for a day */
+static _Atomic uint32_t leap_second_time = 0;
+
+/* Precomputed time base scaling: fraction = (ns * scale) >> 32 */
+static _Atomic uint64_t time_base_scale = 0;
+
+/**
+ * cts_common_set_clock_source:
+ * @source: "realtime", "tai" or the path to a PTP hardware clock
+ * like "/dev/ptp0".
+ *
+ * Select the clock used to timestamp frames. CLOCK_TAI and PHC clocks
+ * are converted to UTC using the TAI offset known to the kernel.
+ *
+ * Returns: %true if the clock source was changed, else %false, and
+ * the previous clock shall be kept.
+ */
+bool
+cts_common_set_clock_source (const char *source)
+{
+  struct timespec ts;
+  clockid_t new_clock;
+  int new_type;
+  int fd = -1;
+
+  if (source == NULL || strcmp (source, "realtime") == 0)
+    {
+      new_clock = CLOCK_REALTIME;
+      new_type = CTS_CLOCK_REALTIME;
+    }
+  else if (strcmp (source, "tai") == 0)
+    {
+      new_clock = CLOCK_TAI;
+      new_type = CTS_CLOCK_TAI;
+    }
+  else
+    {
+      fd = open (source, O_RDONLY);
+
+      if (fd == -1)
+        return false;
+
+      new_clock = FD_TO_CLOCKID (fd);
+      new_type = CTS_CLOCK_PHC;
+    }
+
+  if (clock_gettime (new_clock, &ts) != 0)
+    {
+      if (fd != -1)
+        close (fd);
+
+      return false;
+    }
+
+  clock_id = new_clock;
+  clock_type = new_type;
+
+  if (phc_fd != -1)
+    close (phc_fd);
+  phc_fd = fd;
+
+  /* Force a refresh of time quality */
+  time_state = 0;
+
+  return true;
+}
+
+/**
+ * cts_common_get_clock_type:
+ *
+ * Returns: one of #CTS_CLOCK_REALTIME, #CTS_CLOCK_TAI, #CTS_CLOCK_PHC
+ */
+int
+cts_common_get_clock_type (void)
+{
+  return clock_type;
+}
+
+static byte
+get_quality_from_error (long error_us)
+{
+  /* 64 bits, a long being too short for 10 s in ns on 32 bit targets */
+  int64_t error_ns;
+  int64_t limit = 1;
+
+  /* Resolution of kernel estimated error is 1 microsecond */
+  error_ns = error_us < 1 ? 1000 : (int64_t) error_us * 1000;
+
+  /* 0x01 is for 1 ns, 0x02 for 10 ns, ..., 0x0B for 10 seconds */
+  for (byte quality = 0x01; quality <= 0x0B; quality++)
+    {
+      if (error_ns <= limit)
+        return quality;
+
+      limit *= 10;
+    }
+
+  return TIME_QUALITY_FAULT;
+}
+
+static uint64_t
+refresh_time_state (uint32_t soc)
+{
+  struct timex tx = { 0 };
+  byte quality;
+  uint16_t tai;
+  int state;
+
+  state = ntp_adjtime (&tx);
+  tai = tx.tai;
+
+  if (state == -1 || state == TIME_ERROR || (tx.status & STA_UNSYNC))
+    quality = TIME_QUALITY_FAULT;
+  else
+    quality = get_quality_from_error (tx.esterror);
+
+  /* Only flag the pending leap second within the last minute of the day */
+  if ((state == TIME_INS || state == TIME_DEL) &&
+      soc % SEC_PER_DAY >= SEC_PER_DAY - 60)
+    {
+      SET_BIT (quality, TIME_QUALITY_LEAP_PENDING_BIT);
+
+      if (state == TIME_DEL)
+        SET_BIT (quality, TIME_QUALITY_LEAP_DIRECTION_BIT);
+    }
+
+  if (state == TIME_OOP || state == TIME_WAIT)
+    leap_second_time = soc;
+
+  if (leap_second_time && soc - leap_second_time < SEC_PER_DAY)
+    SET_BIT (quality, TIME_QUALITY_LEAP_OCCURRED_BIT);
+
+  return ((uint64_t) soc << 32) | ((uint64_t) tai << 16) | quality;
+}
+
+/**
+ * cts_common_get_timestamp:
+ * @time: The #CtsTime to fill
+ *
+ * Read the selected clock once, and fill @time with the time as
+ * seconds since epoch in UTC, nanoseconds and the time quality
+ * flags. As the clock is read only once, the seconds and the fraction
+ * of second always belong to the same instant.
+ *
+ * The kernel time keeping state (used for time quality, leap seconds
+ * and TAI offset) is refreshed at most once per second, so calling
+ * this is as cheap as a clock_gettime().
+ */
+void
+cts_common_get_timestamp (CtsTime *time)
+{
+  struct timespec ts;
+  uint64_t state;
+  uint32_t soc;
+
+  if (clock_gettime (clock_id, &ts) != 0)
+    {
+      time->soc = 0;
+      time->nanoseconds = 0;
+      time->time_quality = TIME_QUALITY_FAULT;
+      return;
+    }
+
+  state = time_state;
+  soc = ts.tv_sec;
+
+  if (clock_type != CTS_CLOCK_REALTIME)
+    soc -= (uint16_t) (state >> 16);
+
+  if ((uint32_t) (state >> 32) != soc)
+    {
+      state = refresh_time_state (soc);
+      time_state = state;
+
+      /* The TAI offset might have just changed */
+      if (clock_type != CTS_CLOCK_REALTIME)
+        soc = ts.tv_sec - (uint16_t) (state >> 16);
+    }
+
+  time->soc = soc;
+  time->nanoseconds = ts.tv_nsec;
+  time->time_quality = state & 0xFF;
+}
+
+/**
+ * cts_common_time_get_frac_of_second:
+ * @time: A valid #CtsTime
+ * @time_base: The precision of fraction of second
+ *
+ * Convert the nanoseconds in @time to FRACSEC, as transmitted in
+ * frames: the fraction of second in @time_base units in the lower 24
+ * bits and the TIME_QUALITY flags in the upper 8 bits.
+ *
+ * The scaling factor for @time_base is computed once and reused for
+ * every frame until @time_base changes.
+ *
+ * Returns: a 32 bit unsigned integer.
+ */
+uint32_t
+cts_common_time_get_frac_of_second (const CtsTime *time,
+                                    uint32_t       time_base)
+{
+  uint64_t scale = time_base_scale;
+  uint32_t fraction;
+
+  /* The time base is saved along with the scale in the upper 24 bits */
+  if ((scale >> 40) != time_base)
+    {
+      /* Round up, so that exact fractions (like 0.5 s) are not truncated */
+      scale = (((uint64_t) time_base << 32) + NSEC_PER_SEC - 1) / NSEC_PER_SEC;
+      scale |= (uint64_t) time_base << 40;
+      time_base_scale = scale;
+    }
+
+  scale &= ((uint64_t) 1 << 40) - 1;
+  fraction = ((uint64_t) time->nanoseconds * scale) >> 32;
+
+  if (fraction >= time_base && time_base)
+    fraction = time_base - 1;
+
+  return ((uint32_t) time->time_quality << 24) | (fraction & 0x00FFFFFF);
+}
+
 /**
  * cts_common_get_time:
  *
  * Returns the seconds since epoch (1970 January 1) in UTC.
  *
+ * If the fraction of second is also required, use
+ * cts_common_get_timestamp() instead, so that both belong
+ * to the same instant.
+ *
  * Returns: a 32 bit unsigned integer.
  */
 uint32_t
 cts_common_get_time (void)
 {
-  return time (NULL);
+  CtsTime time;
+
+  cts_common_get_timestamp (&time);
+
+  return time.soc;
 }
 
 /**
@@ -208,16 +472,12 @@ cts_common_get_time (void)
 uint32_t
 cts_common_get_frac_of_second (uint32_t time_base)
 {
-  struct timespec ts;
-  uint32_t time;
+  CtsTime time;
 
-  /*  This is a C11 function */
-  timespec_get(&ts, TIME_UTC);
-
-  time = ts.tv_nsec * (time_base / pow (10, 9));
+  cts_common_get_timestamp (&time);
 
   /* Return the last 24 bits only */
-  return time & 0x00FFFFFF;
+  return cts_common_time_get_frac_of_second (&time, time_base) & 0x00FFFFFF;
 }
 
 /**
@@ -255,22 +515,3 @@ cts_common_get_type (const byte *data)
       return CTS_TYPE_INVALID;
     }
 }
-
-void
-cts_common_set_time (uint32_t *time)
-{
-  *time = cts_common_get_time ();
-}
-
-void
-cts_common_set_frac_of_second (uint32_t *frac_of_second,
-                               uint16_t  time_base)
-{
-  uint32_t data;
-  uint32_t new_frac_of_second;
-
-  data = *frac_of_second;
-  new_frac_of_second = cts_common_get_frac_of_second (time_base);
-  data = (data & 0xFF000000) | (new_frac_of_second & 0x00FFFFFF);
-  *frac_of_second = data;
-}
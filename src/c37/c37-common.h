@@ -42,6 +42,26 @@ enum CtsType{
   CTS_TYPE_SYNC    = 0xAA,
 };
 
+enum CtsClock {
+  CTS_CLOCK_REALTIME,
+  CTS_CLOCK_TAI,
+  CTS_CLOCK_PHC,
+};
+
+/*
+ * An instant, as it is to be transmitted in frames.
+ * soc: seconds since epoch in UTC
+ * nanoseconds: nanoseconds since @soc
+ * time_quality: leap second and time quality flags, as in the
+ * upper byte of FRACSEC
+ */
+typedef struct _CtsTime
+{
+  uint32_t soc;
+  uint32_t nanoseconds;
+  byte     time_quality;
+} CtsTime;
+
 #define SET_BIT(value, bit_index) (value |= (1 << bit_index))
 #define CLEAR_BIT(value, bit_index) (value &= ~(1 << bit_index))
 #define TOGGLE_BIT(value, bit_index) (value ^= (1 << bit_index))
@@ -50,6 +70,15 @@ enum CtsType{
 
 unsigned short
 cts_common_calc_crc (const byte *data, size_t data_length, const byte *header);
+bool
+cts_common_set_clock_source (const char *source);
+int
+cts_common_get_clock_type (void);
+void
+cts_common_get_timestamp (CtsTime *time);
+uint32_t
+cts_common_time_get_frac_of_second (const CtsTime *time,
+                                    uint32_t       time_base);
 uint32_t
 cts_common_get_time (void);
 uint32_t
@@ -65,11 +94,6 @@ cts_common_set_crc (byte     *data,
                     byte     *header);
 bool
 cts_common_check_crc (const byte *data, size_t data_length, const byte *header, uint16_t offset);
-void
-cts_common_set_time (uint32_t *time);
-void
-cts_common_set_frac_of_second (uint32_t *frac_of_second,
-                               uint16_t  time_base);
 
 
 #endif /* C37_COMMON_H */
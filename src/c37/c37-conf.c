@@ -73,6 +73,9 @@ typedef struct _CtsPmuConf
    */
   char **channel_names;
 
+  /* channel_names when parsed from a frame, freed with the configuration */
+  char **owned_channel_names;
+
   /* 4 byte * num_phasors */
   uint32_t *conv_factor_phasor;
 
@@ -150,6 +153,7 @@ pmu_config_clear_all_data (CtsPmuConf *config)
   config->num_analog_values = 0;
   config->num_status_words = 0;
   config->channel_names = NULL;
+  config->owned_channel_names = NULL;
   config->conv_factor_phasor = NULL;
   config->conv_factor_analog = NULL;
   config->status_word_masks = NULL;
@@ -265,8 +269,12 @@ cts_conf_set_time_base (CtsConf  *self,
 void
 cts_conf_update_time (CtsConf *self)
 {
-  cts_common_set_time (&self->epoch_seconds);
-  cts_common_set_frac_of_second (&self->frac_of_second, self->time_base);
+  CtsTime time;
+
+  cts_common_get_timestamp (&time);
+  self->epoch_seconds = time.soc;
+  self->frac_of_second = cts_common_time_get_frac_of_second (&time,
+                                                             self->time_base);
 }
 
 uint32_t
@@ -647,14 +655,15 @@ cts_conf_set_values_of_pmu (CtsConf   *self,
 {
   uint32_t *data = NULL;
 
-  data = realloc (*ptr, sizeof **ptr * count);
-
   if (!count)
     {
+      free (*ptr);
       *ptr = NULL;
       return true;
     }
 
+  data = realloc (*ptr, sizeof **ptr * count);
+
   if (data)
     {
       *ptr = data;
@@ -884,6 +893,8 @@ cts_conf_set_channel_names_of_pmu (CtsConf   *self,
   if (!config->num_phasors)
     return false; /* Atleast one phasor is required */
 
+  free (config->owned_channel_names);
+  config->owned_channel_names = NULL;
   config->channel_names = channel_names;
   return true;
 }
@@ -1084,6 +1095,35 @@ cts_conf_set_phasor_conv_of_pmu (CtsConf  *self,
   return true;
 }
 
+/**
+ * cts_conf_get_phasor_conv_of_pmu:
+ * @self: A valid configuration
+ * @pmu_index: The index of PMU. If this code is being run on a PMU,
+ * this will be always 1.
+ * @phasor_index: The phasor index for which the value has to be retrieved.
+ *
+ * See cts_conf_set_phasor_conv_of_pmu() for the meaning of the value.
+ *
+ * Returns: The convertion factor of the phasor, or 0 on error.
+ */
+uint32_t
+cts_conf_get_phasor_conv_of_pmu (CtsConf  *self,
+                                 uint16_t  pmu_index,
+                                 uint16_t  phasor_index)
+{
+  CtsPmuConf *config;
+
+  if (pmu_index > self->num_pmu)
+    return 0;
+
+  config = self->pmu_config + pmu_index - 1;
+
+  if (phasor_index > config->num_phasors)
+    return 0;
+
+  return *(config->conv_factor_phasor + phasor_index - 1) & 0x00FFFFFF;
+}
+
 /**
  * cts_conf_set_all_phasor_conv_of_pmu:
  * @self: A valid configuration
@@ -1324,6 +1364,36 @@ cts_conf_set_analog_conv_of_pmu (CtsConf  *self,
   return true;
 }
 
+/**
+ * cts_conf_get_analog_conv_of_pmu:
+ * @self: A valid configuration
+ * @pmu_index: The index of PMU. If this code is being run on a PMU,
+ * this will be always 1.
+ * @analog_index: The analog index for which the value has to be retrieved.
+ *
+ * Like phasors, the transmitted analog value multiplied by the
+ * convertion factor and 10^(-5) gives the real value.
+ *
+ * Returns: The convertion factor of the analog value, or 0 on error.
+ */
+uint32_t
+cts_conf_get_analog_conv_of_pmu (CtsConf  *self,
+                                 uint16_t  pmu_index,
+                                 uint16_t  analog_index)
+{
+  CtsPmuConf *config;
+
+  if (pmu_index > self->num_pmu)
+    return 0;
+
+  config = self->pmu_config + pmu_index - 1;
+
+  if (analog_index > config->num_analog_values)
+    return 0;
+
+  return *(config->conv_factor_analog + analog_index - 1) & 0x00FFFFFF;
+}
+
 bool
 cts_conf_set_all_analog_conv_of_pmu (CtsConf  *self,
                                      uint16_t  pmu_index,
@@ -1391,6 +1461,34 @@ cts_conf_set_status_normal_masks_of_pmu (CtsConf  *self,
   return true;
 }
 
+/**
+ * cts_conf_get_status_masks_of_pmu:
+ * @self: A valid configuration
+ * @pmu_index: The index of PMU
+ * @status_index: The digital status word index
+ *
+ * Returns: The normal state masks in the upper 2 bytes and the
+ * validity masks in the lower 2 bytes, as sent in the configuration
+ * frame. 0 on error.
+ */
+uint32_t
+cts_conf_get_status_masks_of_pmu (CtsConf  *self,
+                                  uint16_t  pmu_index,
+                                  uint16_t  status_index)
+{
+  CtsPmuConf *config;
+
+  if (pmu_index > self->num_pmu)
+    return 0;
+
+  config = self->pmu_config + pmu_index - 1;
+
+  if (status_index > config->num_status_words)
+    return 0;
+
+  return *(config->status_word_masks + status_index - 1);
+}
+
 bool
 cts_conf_set_all_status_normal_masks_of_pmu (CtsConf  *self,
                                              uint16_t  pmu_index,
@@ -1523,6 +1621,28 @@ cts_conf_set_nominal_freq_of_pmu (CtsConf  *self,
   return true;
 }
 
+/**
+ * cts_conf_get_nominal_freq_of_pmu:
+ * @self: A valid configuration
+ * @pmu_index: The index of PMU. If this code is being run on a PMU,
+ * this will be always 1.
+ *
+ * Returns: The nominal line frequency in Hertz (50 or 60), or 0 if
+ * @pmu_index is invalid.
+ */
+uint16_t
+cts_conf_get_nominal_freq_of_pmu (CtsConf  *self,
+                                  uint16_t  pmu_index)
+{
+  if (pmu_index > self->num_pmu)
+    return 0;
+
+  if ((self->pmu_config + pmu_index - 1)->nominal_freq == NOMINAL_FREQ_60)
+    return 60;
+
+  return 50;
+}
+
 bool
 cts_conf_increment_change_count_of_pmu (CtsConf  *self,
                                         uint16_t  pmu_index)
@@ -1546,7 +1666,26 @@ cts_conf_set_change_count_of_pmu (CtsConf  *self,
   return true;
 }
 
-static CtsConf *
+uint16_t
+cts_conf_get_change_count_of_pmu (CtsConf  *self,
+                                  uint16_t  pmu_index)
+{
+  if (pmu_index > self->num_pmu)
+    return 0;
+
+  return (self->pmu_config + pmu_index - 1)->conf_change_count;
+}
+
+/**
+ * cts_conf_new:
+ *
+ * Create a new empty configuration. Set the number of PMUs with
+ * cts_conf_set_num_of_pmu() before setting anything else.
+ *
+ * Returns: (nullable) (transfer full): A new #CtsConf, or %NULL if
+ * allocating memory failed. Free with cts_conf_free().
+ */
+CtsConf *
 cts_conf_new (void)
 {
   CtsConf *self = NULL;
@@ -1563,6 +1702,33 @@ cts_conf_new (void)
   return self;
 }
 
+/**
+ * cts_conf_free:
+ * @self: (nullable): A #CtsConf
+ *
+ * Free @self and the memory allocated for its PMUs. The channel
+ * names set with cts_conf_set_channel_names_of_pmu() are not owned
+ * by @self, and are not freed. Those parsed by
+ * cts_conf_new_from_raw_data() are.
+ */
+void
+cts_conf_free (CtsConf *self)
+{
+  if (self == NULL)
+    return;
+
+  for (uint16_t i = 0; i < self->num_pmu; i++)
+    {
+      free (self->pmu_config[i].conv_factor_phasor);
+      free (self->pmu_config[i].conv_factor_analog);
+      free (self->pmu_config[i].status_word_masks);
+      free (self->pmu_config[i].owned_channel_names);
+    }
+
+  free (self->pmu_config);
+  free (self);
+}
+
 CtsConf *
 cts_conf_get_default_config_one (void)
 {
@@ -1624,6 +1790,9 @@ populate_raw_data_of_conf_part1 (CtsConf   *config,
 {
   uint16_t *byte2 = malloc (sizeof (*byte2));
   uint32_t *byte4 = malloc (sizeof (*byte4));
+  CtsTime time;
+
+  cts_common_get_timestamp (&time);
 
   *byte2 = htons (config_sync);
   memcpy (*pptr, byte2, 2);
@@ -1637,11 +1806,12 @@ populate_raw_data_of_conf_part1 (CtsConf   *config,
   memcpy (*pptr, byte2, 2);
   *pptr += 2;
 
-  *byte4 = htonl (cts_common_get_time ());
+  *byte4 = htonl (time.soc);
   memcpy (*pptr, byte4, 4);
   *pptr += 4;
 
-  *byte4 = htonl (cts_common_get_frac_of_second (config->time_base));
+  *byte4 = htonl (cts_common_time_get_frac_of_second (&time,
+                                                      config->time_base));
   memcpy (*pptr, byte4, 4);
   *pptr += 4;
 
@@ -1849,3 +2019,413 @@ cts_conf_get_frame_size (CtsConf *self)
 {
   return self->frame_size;
 }
+
+/*
+ * A cursor over a received frame. Reading past the end sets failed
+ * and gives zeroes, so that a frame can be parsed to the end before
+ * checking once.
+ */
+typedef struct
+{
+  const byte *data;
+  size_t      size;
+  size_t      offset;
+  bool        failed;
+} CtsReader;
+
+static const byte *
+reader_take (CtsReader *reader,
+             size_t     count)
+{
+  const byte *data;
+
+  if (reader->failed || reader->size - reader->offset < count)
+    {
+      reader->failed = true;
+      return NULL;
+    }
+
+  data = reader->data + reader->offset;
+  reader->offset += count;
+
+  return data;
+}
+
+static byte
+read_byte (CtsReader *reader)
+{
+  const byte *data = reader_take (reader, 1);
+
+  return data ? data[0] : 0;
+}
+
+static uint16_t
+read_uint16 (CtsReader *reader)
+{
+  const byte *data = reader_take (reader, 2);
+
+  return data ? (uint16_t) (data[0] << 8 | data[1]) : 0;
+}
+
+static uint32_t
+read_uint32 (CtsReader *reader)
+{
+  const byte *data = reader_take (reader, 4);
+
+  if (data == NULL)
+    return 0;
+
+  return (uint32_t) data[0] << 24 | (uint32_t) data[1] << 16 |
+         (uint32_t) data[2] << 8 | data[3];
+}
+
+static float
+read_float (CtsReader *reader)
+{
+  uint32_t bits = read_uint32 (reader);
+  float value;
+
+  memcpy (&value, &bits, 4);
+
+  return value;
+}
+
+/* Names are 16 bytes everywhere else, cut or padded with spaces */
+static void
+copy_name (char       *name,
+           const byte *text,
+           size_t      length)
+{
+  if (length > 16)
+    length = 16;
+
+  memcpy (name, text, length);
+  memset (name + length, ' ', 16 - length);
+}
+
+/* @count names of 16 bytes, owned by @config, in a single block */
+static char **
+alloc_channel_names (CtsPmuConf *config,
+                     size_t      count)
+{
+  char **names;
+  char *name;
+
+  names = malloc ((count + 1) * sizeof *names + count * 16);
+
+  if (names == NULL)
+    return NULL;
+
+  free (config->owned_channel_names);
+  config->owned_channel_names = names;
+  config->channel_names = names;
+  name = (char *) (names + count + 1);
+
+  for (size_t i = 0; i < count; i++)
+    names[i] = name + 16 * i;
+
+  names[count] = NULL;
+
+  return names;
+}
+
+/* Channel names, 1 byte length before each in CFG-3 */
+static bool
+read_pmu_names (CtsPmuConf *config,
+                CtsReader  *reader,
+                bool        length_prefixed)
+{
+  size_t count;
+  char **names;
+
+  count = config->num_phasors + config->num_analog_values +
+          16 * (size_t) config->num_status_words;
+  names = alloc_channel_names (config, count);
+
+  if (names == NULL)
+    return false;
+
+  for (size_t i = 0; i < count; i++)
+    {
+      size_t length = length_prefixed ? read_byte (reader) : 16;
+      const byte *text = reader_take (reader, length);
+
+      if (text == NULL)
+        return false;
+
+      copy_name (names[i], text, length);
+    }
+
+  return true;
+}
+
+/*
+ * Factors of CFG-3 are IEEE floats of the unit per bit, kept as the
+ * 24 bit factors of CFG-2 in units of 10^-5.
+ */
+static uint32_t
+scale_to_conv (float scale)
+{
+  float conv = roundf (fabsf (scale) * 1e5f);
+
+  if (!(conv >= 1))
+    return 1;
+  if (conv > 0x00FFFFFF)
+    return 0x00FFFFFF;
+
+  return (uint32_t) conv;
+}
+
+static bool
+read_pmu_conf (CtsConf    *self,
+               uint16_t    pmu_index,
+               CtsReader  *reader,
+               bool        is_config_three)
+{
+  CtsPmuConf *config = self->pmu_config + pmu_index - 1;
+  uint16_t num_phasors, num_analogs, num_status;
+  const byte *text;
+
+  if (is_config_three)
+    {
+      size_t length = read_byte (reader);
+
+      text = reader_take (reader, length);
+      if (text == NULL)
+        return false;
+
+      copy_name (config->station_name, text, length);
+      config->id_code = read_uint16 (reader);
+      reader_take (reader, 16); /* G_PMU_ID */
+    }
+  else
+    {
+      text = reader_take (reader, 16);
+      if (text == NULL)
+        return false;
+
+      memcpy (config->station_name, text, 16);
+      config->id_code = read_uint16 (reader);
+    }
+
+  config->data_format = read_uint16 (reader);
+  num_phasors = read_uint16 (reader);
+  num_analogs = read_uint16 (reader);
+  num_status = read_uint16 (reader);
+
+  if (reader->failed)
+    return false;
+
+  /* Before allocating anything, the frame has to be large enough */
+  if (reader->size - reader->offset < 4 * ((size_t) num_phasors + num_analogs + num_status))
+    return false;
+
+  if (cts_conf_set_num_of_phasors_of_pmu (self, pmu_index, num_phasors) != num_phasors ||
+      cts_conf_set_num_of_analogs_of_pmu (self, pmu_index, num_analogs) != num_analogs ||
+      cts_conf_set_num_of_status_of_pmu (self, pmu_index, num_status) != num_status)
+    return false;
+
+  if (!read_pmu_names (config, reader, is_config_three))
+    return false;
+
+  if (is_config_three)
+    {
+      for (uint16_t i = 0; i < num_phasors; i++)
+        {
+          /* Bits 15 - 8 of the first word are the phasor type, bit 3 for current */
+          uint32_t flags = read_uint32 (reader);
+          float scale = read_float (reader);
+          byte type;
+
+          read_float (reader); /* Angle adjustment */
+          type = (flags >> 8) & 0x08 ? VALUE_TYPE_CURRENT : VALUE_TYPE_VOLTAGE;
+          config->conv_factor_phasor[i] = (uint32_t) type << 24 | scale_to_conv (scale);
+        }
+
+      for (uint16_t i = 0; i < num_analogs; i++)
+        {
+          float scale = read_float (reader);
+
+          read_float (reader); /* Offset */
+          config->conv_factor_analog[i] = scale_to_conv (scale);
+        }
+    }
+  else
+    {
+      for (uint16_t i = 0; i < num_phasors; i++)
+        config->conv_factor_phasor[i] = read_uint32 (reader);
+
+      for (uint16_t i = 0; i < num_analogs; i++)
+        config->conv_factor_analog[i] = read_uint32 (reader);
+    }
+
+  for (uint16_t i = 0; i < num_status; i++)
+    config->status_word_masks[i] = read_uint32 (reader);
+
+  if (is_config_three)
+    {
+      /* PMU_LAT, PMU_LON, PMU_ELEV, SVC_CLASS, WINDOW and GRP_DLY */
+      reader_take (reader, 4 + 4 + 4 + 1 + 4 + 4);
+    }
+
+  config->nominal_freq = read_uint16 (reader) & 0x0001;
+  config->conf_change_count = read_uint16 (reader);
+
+  return !reader->failed;
+}
+
+/**
+ * cts_conf_new_from_raw_data:
+ * @data: A configuration frame, from SYNC to CHK
+ * @size: The number of bytes in @data
+ *
+ * Parse a CFG-1, CFG-2 or CFG-3 frame of any version, the opposite of
+ * cts_conf_get_raw_data(). The frame size and CHK are checked.
+ *
+ * A CFG-3 frame has to be a complete one (CONT_IDX of 0), and only
+ * what a CFG-2 frame can tell is kept: Names are cut to 16 bytes,
+ * the scale of phasors and analogs become convertion factors of
+ * 10^-5 units per bit, and the offsets, angle adjustments, global
+ * PMU ID, position and filter details are dropped.
+ *
+ * The channel names are owned by the returned configuration.
+ *
+ * Returns: (nullable) (transfer full): A new #CtsConf, or %NULL if
+ * @data is not a valid configuration frame or out of memory. Free
+ * with cts_conf_free().
+ */
+CtsConf *
+cts_conf_new_from_raw_data (const byte *data,
+                            size_t      size)
+{
+  CtsReader reader = { data, size, 0, false };
+  CtsConf *self;
+  uint16_t frame_size;
+  uint16_t num_pmu;
+  byte frame_type;
+  bool is_config_three;
+
+  if (data == NULL || size < CONFIG_COMMON_SIZE || data[0] != CTS_TYPE_SYNC)
+    return NULL;
+
+  /* Bits 6 - 4 of the second byte are the frame type, 0 - 3 the version */
+  frame_type = data[1] & 0x70;
+
+  if (frame_type != (CTS_TYPE_CONFIG1 & 0x70) &&
+      frame_type != (CTS_TYPE_CONFIG2 & 0x70) &&
+      frame_type != (CTS_TYPE_CONFIG3 & 0x70))
+    return NULL;
+
+  is_config_three = frame_type == (CTS_TYPE_CONFIG3 & 0x70);
+  frame_size = cts_common_get_size (data, 2);
+
+  if (frame_size < CONFIG_COMMON_SIZE || frame_size > size ||
+      !cts_common_check_crc (data, frame_size - 2, NULL, frame_size - 2))
+    return NULL;
+
+  reader.size = frame_size - 2;
+  self = cts_conf_new ();
+
+  if (self == NULL)
+    return NULL;
+
+  reader_take (&reader, 4);
+  self->id_code = read_uint16 (&reader);
+  self->epoch_seconds = read_uint32 (&reader);
+  self->frac_of_second = read_uint32 (&reader);
+  self->frame_size = frame_size;
+
+  if (is_config_three && read_uint16 (&reader) != 0)
+    goto error; /* Fragmented */
+
+  self->time_base = read_uint32 (&reader);
+  num_pmu = read_uint16 (&reader);
+
+  if (reader.failed ||
+      (size_t) num_pmu * CONFIG_COMMON_SIZE_PER_PMU > reader.size - reader.offset)
+    goto error;
+
+  if (num_pmu && cts_conf_set_num_of_pmu (self, num_pmu) != num_pmu)
+    goto error;
+
+  for (uint16_t i = 1; i <= num_pmu; i++)
+    if (!read_pmu_conf (self, i, &reader, is_config_three))
+      goto error;
+
+  self->data_rate = (int16_t) read_uint16 (&reader);
+
+  if (reader.failed || reader.offset != reader.size)
+    goto error;
+
+  return self;
+
+ error:
+  cts_conf_free (self);
+  return NULL;
+}
+
+/**
+ * cts_conf_copy_pmu:
+ * @self: A valid configuration
+ * @pmu_index: The index of PMU in @self to be set, starting from 1
+ * @source: The configuration to copy from
+ * @source_index: The index of PMU in @source, starting from 1
+ *
+ * Make the PMU @pmu_index of @self the same as the PMU @source_index
+ * of @source, as when a PDC combines the configuration of PMUs. The
+ * channel names are copied and owned by @self.
+ *
+ * Returns: %true if the PMU was copied, %false otherwise.
+ */
+bool
+cts_conf_copy_pmu (CtsConf  *self,
+                   uint16_t  pmu_index,
+                   CtsConf  *source,
+                   uint16_t  source_index)
+{
+  CtsPmuConf *config, *from;
+  char **names;
+  size_t count = 0;
+
+  if (pmu_index == 0 || pmu_index > self->num_pmu ||
+      source_index == 0 || source_index > source->num_pmu)
+    return false;
+
+  config = self->pmu_config + pmu_index - 1;
+  from = source->pmu_config + source_index - 1;
+
+  if (cts_conf_set_num_of_phasors_of_pmu (self, pmu_index, from->num_phasors) != from->num_phasors ||
+      cts_conf_set_num_of_analogs_of_pmu (self, pmu_index, from->num_analog_values) != from->num_analog_values ||
+      cts_conf_set_num_of_status_of_pmu (self, pmu_index, from->num_status_words) != from->num_status_words)
+    return false;
+
+  if (from->channel_names)
+    while (from->channel_names[count])
+      count++;
+
+  names = alloc_channel_names (config, count);
+
+  if (names == NULL)
+    return false;
+
+  for (size_t i = 0; i < count; i++)
+    memcpy (names[i], from->channel_names[i], 16);
+
+  memcpy (config->station_name, from->station_name, 16);
+  config->id_code = from->id_code;
+  config->data_format = from->data_format;
+  config->nominal_freq = from->nominal_freq;
+  config->conf_change_count = from->conf_change_count;
+
+  if (from->num_phasors)
+    memcpy (config->conv_factor_phasor, from->conv_factor_phasor,
+            sizeof (uint32_t) * from->num_phasors);
+  if (from->num_analog_values)
+    memcpy (config->conv_factor_analog, from->conv_factor_analog,
+            sizeof (uint32_t) * from->num_analog_values);
+  if (from->num_status_words)
+    memcpy (config->status_word_masks, from->status_word_masks,
+            sizeof (uint32_t) * from->num_status_words);
+
+  return true;
+}
@@ -27,6 +27,7 @@ typedef struct _CtsConf CtsConf;
 
 #define SYNC_CONFIG_ONE 0xAA21
 #define SYNC_CONFIG_TWO 0xAA31
+#define SYNC_CONFIG_THREE 0xAA52
 
 #define NOMINAL_FREQ_50 0x01 /* Hertz */
 #define NOMINAL_FREQ_60 0x00 /* Hertz */
@@ -141,6 +142,9 @@ bool cts_conf_set_phasor_conv_of_pmu         (CtsConf  *self,
                                               uint16_t  pmu_index,
                                               uint16_t  phasor_index,
                                               uint32_t  conv_factor);
+uint32_t cts_conf_get_phasor_conv_of_pmu (CtsConf  *self,
+                                          uint16_t  pmu_index,
+                                          uint16_t  phasor_index);
 bool cts_conf_set_all_phasor_conv_of_pmu     (CtsConf  *self,
                                               uint16_t  pmu_index,
                                               uint32_t  conv_factor);
@@ -165,6 +169,9 @@ bool cts_conf_set_analog_conv_of_pmu         (CtsConf  *self,
                                               uint16_t  pmu_index,
                                               uint16_t  analog_index,
                                               uint32_t  conv_factor);
+uint32_t cts_conf_get_analog_conv_of_pmu (CtsConf  *self,
+                                          uint16_t  pmu_index,
+                                          uint16_t  analog_index);
 bool cts_conf_set_all_analog_conv_of_pmu     (CtsConf  *self,
                                               uint16_t  pmu_index,
                                               uint32_t  conv_factor);
@@ -181,6 +188,10 @@ bool cts_conf_set_all_status_normal_masks_of_pmu     (CtsConf  *self,
 bool cts_conf_set_all_status_normal_masks_of_all_pmu (CtsConf  *self,
                                                       uint16_t  state);
 
+uint32_t cts_conf_get_status_masks_of_pmu (CtsConf  *self,
+                                           uint16_t  pmu_index,
+                                           uint16_t  status_index);
+
 bool cts_conf_set_status_validity_masks_of_pmu         (CtsConf  *self,
                                                         uint16_t  pmu_index,
                                                         uint16_t  status_index,
@@ -194,12 +205,16 @@ bool cts_conf_set_all_status_validity_masks_of_all_pmu (CtsConf  *self,
 bool cts_conf_set_nominal_freq_of_pmu (CtsConf  *self,
                                        uint16_t  pmu_index,
                                        uint16_t  freq);
+uint16_t cts_conf_get_nominal_freq_of_pmu (CtsConf  *self,
+                                           uint16_t  pmu_index);
 
 bool cts_conf_increment_change_count_of_pmu (CtsConf  *self,
                                              uint16_t  pmu_index);
 bool cts_conf_set_change_count_of_pmu       (CtsConf  *self,
                                              uint16_t  pmu_index,
                                              uint16_t  count);
+uint16_t cts_conf_get_change_count_of_pmu (CtsConf  *self,
+                                           uint16_t  pmu_index);
 
 void     cts_conf_update_frame_size (CtsConf *self);
 uint16_t cts_conf_get_frame_size    (CtsConf *self);
@@ -209,6 +224,13 @@ byte      *cts_conf_get_raw_data           (CtsConf  *self,
 
 uint16_t cts_conf_calc_total_size (CtsConf *self);
 
+CtsConf   *cts_conf_new                    (void);
+CtsConf   *cts_conf_new_from_raw_data      (const byte *data,
+                                            size_t      size);
+bool       cts_conf_copy_pmu               (CtsConf    *self,
+                                            uint16_t    pmu_index,
+                                            CtsConf    *source,
+                                            uint16_t    source_index);
 void       cts_conf_free                   (CtsConf *self);
 CtsConf  *cts_conf_get_default_config_one  (void);
 CtsConf  *cts_conf_get_default_config_two  (void);
@@ -231,6 +231,388 @@ cts_data_get_analog_value_of_pmu (CtsData  *self,
   return false;
 }
 
+static float
+get_conv_factor (uint32_t conv_factor)
+{
+  /* A factor of 0 is meaningless, take it as 1 unit per bit */
+  if (conv_factor == 0)
+    conv_factor = 100000;
+
+  return conv_factor * 1e-5f;
+}
+
+static uint16_t
+float_to_int16 (float value)
+{
+  value = roundf (value);
+
+  if (value > INT16_MAX)
+    value = INT16_MAX;
+  else if (value < -INT16_MAX)
+    value = -INT16_MAX;
+
+  return (uint16_t)(int16_t)value;
+}
+
+/**
+ * cts_data_set_phasor_of_pmu:
+ * @self: A valid #CtsData
+ * @pmu_index: The index of PMU, starting from 1
+ * @phasor_index: The index of phasor, starting from 1
+ * @real: The real part of the phasor, in Volts or Amperes (RMS)
+ * @imaginary: The imaginary part of the phasor
+ *
+ * Set the phasor in real world units. The value is converted to the
+ * format (integer or float, rectangular or polar) set in the
+ * configuration, using the phasor convertion factor for integers.
+ *
+ * Returns: %true if the value was set, %false otherwise.
+ */
+bool
+cts_data_set_phasor_of_pmu (CtsData  *self,
+                            uint16_t  pmu_index,
+                            uint16_t  phasor_index,
+                            float     real,
+                            float     imaginary)
+{
+  CtsPmuData *pmu_data;
+  bool is_polar;
+
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  pmu_data = self->pmu_data + pmu_index - 1;
+
+  if (phasor_index == 0 || phasor_index > pmu_data->num_phasors)
+    return false;
+
+  phasor_index--;
+  is_polar = cts_conf_get_phasor_complex_type_of_pmu (self->config, pmu_index) == VALUE_TYPE_POLAR;
+
+  if (pmu_data->phasor_type == VALUE_TYPE_FLOAT)
+    {
+      if (is_polar)
+        {
+          pmu_data->phasor_float[phasor_index][0] = hypotf (real, imaginary);
+          pmu_data->phasor_float[phasor_index][1] = atan2f (imaginary, real);
+        }
+      else
+        {
+          pmu_data->phasor_float[phasor_index][0] = real;
+          pmu_data->phasor_float[phasor_index][1] = imaginary;
+        }
+
+      return true;
+    }
+  else if (pmu_data->phasor_type == VALUE_TYPE_INT)
+    {
+      float scale;
+
+      scale = get_conv_factor (cts_conf_get_phasor_conv_of_pmu (self->config, pmu_index,
+                                                                phasor_index + 1));
+
+      if (is_polar)
+        {
+          float magnitude = roundf (hypotf (real, imaginary) / scale);
+
+          /* Magnitude is unsigned, angle is in radians * 10^4 */
+          pmu_data->phasor_int[phasor_index][0] = magnitude > UINT16_MAX ? UINT16_MAX : magnitude;
+          pmu_data->phasor_int[phasor_index][1] = float_to_int16 (atan2f (imaginary, real) * 1e4f);
+        }
+      else
+        {
+          pmu_data->phasor_int[phasor_index][0] = float_to_int16 (real / scale);
+          pmu_data->phasor_int[phasor_index][1] = float_to_int16 (imaginary / scale);
+        }
+
+      return true;
+    }
+
+  return false;
+}
+
+/**
+ * cts_data_get_phasor_of_pmu:
+ * @self: A valid #CtsData
+ * @pmu_index: The index of PMU, starting from 1
+ * @phasor_index: The index of phasor, starting from 1
+ * @real: (out): return location for the real part
+ * @imaginary: (out): return location for the imaginary part
+ *
+ * Get the phasor in real world units, in rectangular form, whatever
+ * be the format in the frame. See cts_data_set_phasor_of_pmu().
+ *
+ * Returns: %true if the value was retrieved, %false otherwise.
+ */
+bool
+cts_data_get_phasor_of_pmu (CtsData  *self,
+                            uint16_t  pmu_index,
+                            uint16_t  phasor_index,
+                            float    *real,
+                            float    *imaginary)
+{
+  CtsPmuData *pmu_data;
+  float first, second;
+  bool is_polar;
+
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  pmu_data = self->pmu_data + pmu_index - 1;
+
+  if (phasor_index == 0 || phasor_index > pmu_data->num_phasors)
+    return false;
+
+  is_polar = cts_conf_get_phasor_complex_type_of_pmu (self->config, pmu_index) == VALUE_TYPE_POLAR;
+
+  if (pmu_data->phasor_type == VALUE_TYPE_FLOAT)
+    {
+      first = pmu_data->phasor_float[phasor_index - 1][0];
+      second = pmu_data->phasor_float[phasor_index - 1][1];
+    }
+  else if (pmu_data->phasor_type == VALUE_TYPE_INT)
+    {
+      float scale;
+
+      scale = get_conv_factor (cts_conf_get_phasor_conv_of_pmu (self->config, pmu_index,
+                                                                phasor_index));
+
+      if (is_polar)
+        {
+          first = pmu_data->phasor_int[phasor_index - 1][0] * scale;
+          second = (int16_t)pmu_data->phasor_int[phasor_index - 1][1] * 1e-4f;
+        }
+      else
+        {
+          first = (int16_t)pmu_data->phasor_int[phasor_index - 1][0] * scale;
+          second = (int16_t)pmu_data->phasor_int[phasor_index - 1][1] * scale;
+        }
+    }
+  else
+    return false;
+
+  if (is_polar)
+    {
+      *real = first * cosf (second);
+      *imaginary = first * sinf (second);
+    }
+  else
+    {
+      *real = first;
+      *imaginary = second;
+    }
+
+  return true;
+}
+
+/**
+ * cts_data_set_analog_of_pmu:
+ * @self: A valid #CtsData
+ * @pmu_index: The index of PMU, starting from 1
+ * @analog_index: The index of analog value, starting from 1
+ * @value: The value in real world units
+ *
+ * Set the analog value, converted to integer with the analog
+ * convertion factor if the configuration says so.
+ *
+ * Returns: %true if the value was set, %false otherwise.
+ */
+bool
+cts_data_set_analog_of_pmu (CtsData  *self,
+                            uint16_t  pmu_index,
+                            uint16_t  analog_index,
+                            float     value)
+{
+  CtsPmuData *pmu_data;
+
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  pmu_data = self->pmu_data + pmu_index - 1;
+
+  if (analog_index == 0 || analog_index > pmu_data->num_analogs)
+    return false;
+
+  if (pmu_data->analog_type == VALUE_TYPE_FLOAT)
+    {
+      pmu_data->analog_float[analog_index - 1] = value;
+      return true;
+    }
+  else if (pmu_data->analog_type == VALUE_TYPE_INT)
+    {
+      float scale;
+
+      scale = get_conv_factor (cts_conf_get_analog_conv_of_pmu (self->config, pmu_index,
+                                                                analog_index));
+      pmu_data->analog_int[analog_index - 1] = float_to_int16 (value / scale);
+      return true;
+    }
+
+  return false;
+}
+
+/**
+ * cts_data_get_analog_of_pmu:
+ * @self: A valid #CtsData
+ * @pmu_index: The index of PMU, starting from 1
+ * @analog_index: The index of analog value, starting from 1
+ * @value: (out): Return location for the value in real world units
+ *
+ * The opposite of cts_data_set_analog_of_pmu().
+ *
+ * Returns: %true if the value was got, %false otherwise.
+ */
+bool
+cts_data_get_analog_of_pmu (CtsData  *self,
+                            uint16_t  pmu_index,
+                            uint16_t  analog_index,
+                            float    *value)
+{
+  CtsPmuData *pmu_data;
+
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  pmu_data = self->pmu_data + pmu_index - 1;
+
+  if (analog_index == 0 || analog_index > pmu_data->num_analogs)
+    return false;
+
+  if (pmu_data->analog_type == VALUE_TYPE_FLOAT)
+    {
+      *value = pmu_data->analog_float[analog_index - 1];
+      return true;
+    }
+  else if (pmu_data->analog_type == VALUE_TYPE_INT)
+    {
+      float scale;
+
+      scale = get_conv_factor (cts_conf_get_analog_conv_of_pmu (self->config, pmu_index,
+                                                                analog_index));
+      *value = (int16_t) pmu_data->analog_int[analog_index - 1] * scale;
+      return true;
+    }
+
+  return false;
+}
+
+/**
+ * cts_data_set_freq_of_pmu:
+ * @self: A valid #CtsData
+ * @pmu_index: The index of PMU, starting from 1
+ * @freq: The frequency in Hz
+ * @rocof: The rate of change of frequency in Hz per second
+ *
+ * Set FREQ and DFREQ of the PMU. As integers, FREQ is the deviation
+ * from the nominal frequency in mHz and DFREQ is ROCOF * 100. As
+ * floats, FREQ is the frequency itself and DFREQ is ROCOF.
+ *
+ * Returns: %true if the values were set, %false otherwise.
+ */
+bool
+cts_data_set_freq_of_pmu (CtsData  *self,
+                          uint16_t  pmu_index,
+                          float     freq,
+                          float     rocof)
+{
+  CtsPmuData *pmu_data;
+  uint16_t nominal_freq;
+
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  pmu_data = self->pmu_data + pmu_index - 1;
+
+  if (pmu_data->freq_type == VALUE_TYPE_FLOAT)
+    {
+      pmu_data->freq_deviation.float_val = freq;
+      pmu_data->rocof.float_val = rocof;
+      return true;
+    }
+  else if (pmu_data->freq_type == VALUE_TYPE_INT)
+    {
+      nominal_freq = cts_conf_get_nominal_freq_of_pmu (self->config, pmu_index);
+
+      pmu_data->freq_deviation.int_val = float_to_int16 ((freq - nominal_freq) * 1000);
+      pmu_data->rocof.int_val = float_to_int16 (rocof * 100);
+      return true;
+    }
+
+  return false;
+}
+
+/**
+ * cts_data_get_freq_of_pmu:
+ * @self: A valid #CtsData
+ * @pmu_index: The index of PMU, starting from 1
+ * @freq: (out): Return location for the frequency in Hz
+ * @rocof: (out): Return location for ROCOF in Hz per second
+ *
+ * The opposite of cts_data_set_freq_of_pmu().
+ *
+ * Returns: %true if the values were got, %false otherwise.
+ */
+bool
+cts_data_get_freq_of_pmu (CtsData  *self,
+                          uint16_t  pmu_index,
+                          float    *freq,
+                          float    *rocof)
+{
+  CtsPmuData *pmu_data;
+  uint16_t nominal_freq;
+
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  pmu_data = self->pmu_data + pmu_index - 1;
+
+  if (pmu_data->freq_type == VALUE_TYPE_FLOAT)
+    {
+      *freq = pmu_data->freq_deviation.float_val;
+      *rocof = pmu_data->rocof.float_val;
+      return true;
+    }
+  else if (pmu_data->freq_type == VALUE_TYPE_INT)
+    {
+      nominal_freq = cts_conf_get_nominal_freq_of_pmu (self->config, pmu_index);
+
+      *freq = nominal_freq + (int16_t)pmu_data->freq_deviation.int_val / 1000.0f;
+      *rocof = (int16_t)pmu_data->rocof.int_val / 100.0f;
+      return true;
+    }
+
+  return false;
+}
+
+/**
+ * cts_data_get_stat_of_pmu:
+ * @self: A valid #CtsData
+ * @pmu_index: The index of PMU, starting from 1
+ *
+ * Returns: The STAT word of the PMU, or 0 if @pmu_index is invalid.
+ */
+uint16_t
+cts_data_get_stat_of_pmu (CtsData  *self,
+                          uint16_t  pmu_index)
+{
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return 0;
+
+  return (self->pmu_data + pmu_index - 1)->stat;
+}
+
+bool
+cts_data_set_stat_of_pmu (CtsData  *self,
+                          uint16_t  pmu_index,
+                          uint16_t  stat)
+{
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  (self->pmu_data + pmu_index - 1)->stat = stat;
+  return true;
+}
+
 bool
 cts_data_get_status_word_of_pmu (CtsData  *self,
                                  uint16_t  pmu_index,
@@ -296,7 +678,7 @@ uint16_t
 cts_data_get_data_size_of_pmu (CtsData  *self,
                                uint16_t  pmu_index)
 {
-  uint8_t data_size;
+  uint16_t data_size;
 
   data_size = get_per_pmu_total_size (self, self->pmu_data + pmu_index - 1,
                                       pmu_index);
@@ -308,7 +690,7 @@ uint16_t
 cts_pmu_data_get_default_data_size (uint16_t pmu_index)
 {
   CtsData *cts_data;
-  uint8_t data_size;
+  uint16_t data_size;
 
   cts_data = cts_data_get_default ();
   data_size = get_per_pmu_total_size (cts_data,
@@ -488,6 +870,41 @@ cts_data_get_conf (CtsData *self)
   return self->config;
 }
 
+/**
+ * cts_data_set_time:
+ * @self: A valid #CtsData
+ * @time: The instant the data was captured
+ *
+ * Set the timestamp (SOC and FRACSEC) of the data frame. This should
+ * be called as soon as the data is ready, typically with a #CtsTime
+ * got from cts_common_get_timestamp(), so that the time transmitted
+ * doesn't depend on how late the frame gets encoded.
+ *
+ * The timestamp is used by cts_data_update_raw_data().
+ */
+void
+cts_data_set_time (CtsData       *self,
+                   const CtsTime *time)
+{
+  self->epoch_seconds = time->soc;
+  self->frac_of_second =
+    cts_common_time_get_frac_of_second (time,
+                                        cts_conf_get_time_base (self->config));
+}
+
+/**
+ * cts_data_get_soc:
+ * @self: A valid #CtsData
+ *
+ * Returns: The SOC of the data frame, as set by cts_data_set_time()
+ * or read by cts_data_populate_from_raw_data().
+ */
+uint32_t
+cts_data_get_soc (CtsData *self)
+{
+  return self->epoch_seconds;
+}
+
 void
 cts_data_populate_from_raw_data (CtsData    *self,
                                  const byte *data,
@@ -564,34 +981,14 @@ cts_data_populate_from_raw_data (CtsData    *self,
             {
               /* Real or Magnitude */
               memcpy (byte4, data, 4);
-              (*(pmu_data->phasor_float + i)) [0] = ntohl (*byte4);
+              *byte4 = ntohl (*byte4);
+              memcpy (*(pmu_data->phasor_float + i), byte4, 4);
               data += 4;
 
               /* Imaginary or Angle */
               memcpy (byte4, data, 4);
-              (*(pmu_data->phasor_float + i)) [1] = ntohl (*byte4);
-              data += 4;
-            }
-        }
-
-      /* Analog values */
-      count = pmu_data->num_analogs;
-
-      if (pmu_data->analog_type == VALUE_TYPE_INT)
-        {
-          for (uint16_t i = 0; i < count; i++)
-            {
-              memcpy (byte2, data, 2);
-              *(pmu_data->analog_int + i) = ntohs (*byte2);
-              data += 2;
-            }
-        }
-      else if (pmu_data->analog_type == VALUE_TYPE_FLOAT)
-        {
-          for (uint16_t i = 0; i < count; i++)
-            {
-              memcpy (byte4, data, 4);
-              *(pmu_data->analog_float + i) = ntohl (*byte4);
+              *byte4 = ntohl (*byte4);
+              memcpy (*(pmu_data->phasor_float + i) + 1, byte4, 4);
               data += 4;
             }
         }
@@ -606,7 +1003,8 @@ cts_data_populate_from_raw_data (CtsData    *self,
       else if (pmu_data->freq_type == VALUE_TYPE_FLOAT)
         {
           memcpy (byte4, data, 4);
-          pmu_data->freq_deviation.float_val = ntohl (*byte4);
+          *byte4 = ntohl (*byte4);
+          memcpy (&pmu_data->freq_deviation.float_val, byte4, 4);
           data += 4;
         }
 
@@ -620,10 +1018,34 @@ cts_data_populate_from_raw_data (CtsData    *self,
       else if (pmu_data->freq_type == VALUE_TYPE_FLOAT)
         {
           memcpy (byte4, data, 4);
-          pmu_data->rocof.float_val = ntohl (*byte4);
+          *byte4 = ntohl (*byte4);
+          memcpy (&pmu_data->rocof.float_val, byte4, 4);
           data += 4;
         }
 
+      /* Analog values */
+      count = pmu_data->num_analogs;
+
+      if (pmu_data->analog_type == VALUE_TYPE_INT)
+        {
+          for (uint16_t i = 0; i < count; i++)
+            {
+              memcpy (byte2, data, 2);
+              *(pmu_data->analog_int + i) = ntohs (*byte2);
+              data += 2;
+            }
+        }
+      else if (pmu_data->analog_type == VALUE_TYPE_FLOAT)
+        {
+          for (uint16_t i = 0; i < count; i++)
+            {
+              memcpy (byte4, data, 4);
+              *byte4 = ntohl (*byte4);
+              memcpy (pmu_data->analog_float + i, byte4, 4);
+              data += 4;
+            }
+        }
+
       /* Digital Status words */
       count = pmu_data->num_status_words;
       for (uint16_t i = 0; i < count; i++)
@@ -646,13 +1068,20 @@ cts_data_populate_from_raw_data (CtsData    *self,
   free (byte4);
 }
 
+/**
+ * cts_data_update_raw_data:
+ * @self: A valid #CtsData
+ * @data: The data frame to be updated
+ *
+ * Update the SYNC, FRAMESIZE, IDCODE, SOC, FRACSEC and CHK of @data.
+ * The time set with cts_data_set_time() is used as the timestamp.
+ */
 void
 cts_data_update_raw_data (CtsData *self,
                           byte    *data)
 {
   uint16_t *byte2;
   uint32_t *byte4;
-  CtsConf  *conf = cts_data_get_conf (self);
   byte     *copy;
   uint16_t  size;
 
@@ -673,13 +1102,11 @@ cts_data_update_raw_data (CtsData *self,
   memcpy (data, byte2, 2);
   data += 2;
 
-  cts_common_set_time (byte4);
-  *byte4 = htonl (*byte4);
+  *byte4 = htonl (self->epoch_seconds);
   memcpy (data, byte4, 4);
   data += 4;
 
-  cts_common_set_frac_of_second (byte4, cts_conf_get_time_base (conf));
-  *byte4 = htonl (*byte4);
+  *byte4 = htonl (self->frac_of_second);
   memcpy (data, byte4, 4);
   data += 4;
 
@@ -692,3 +1119,123 @@ cts_data_update_raw_data (CtsData *self,
   free (byte4);
 }
 
+static inline byte *
+write_uint16 (byte     *data,
+              uint16_t  value)
+{
+  value = htons (value);
+  memcpy (data, &value, 2);
+
+  return data + 2;
+}
+
+static inline byte *
+write_uint32 (byte     *data,
+              uint32_t  value)
+{
+  value = htonl (value);
+  memcpy (data, &value, 4);
+
+  return data + 4;
+}
+
+static inline byte *
+write_float (byte  *data,
+             float  value)
+{
+  uint32_t bits;
+
+  memcpy (&bits, &value, 4);
+
+  return write_uint32 (data, bits);
+}
+
+/**
+ * cts_data_get_raw_data_size:
+ * @self: A valid #CtsData
+ *
+ * Returns: The size of the data frame written by
+ * cts_data_write_raw_data().
+ */
+uint16_t
+cts_data_get_raw_data_size (CtsData *self)
+{
+  return calc_total_size (self);
+}
+
+/**
+ * cts_data_write_raw_data:
+ * @self: A valid #CtsData
+ * @data: A buffer of at least cts_data_get_raw_data_size() bytes
+ *
+ * Encode the complete data frame, including every value set with
+ * cts_data_set_phasor_of_pmu() and friends, to @data.
+ * Unlike cts_data_update_raw_data(), no part of @data is expected
+ * to be filled beforehand.
+ *
+ * The time set with cts_data_set_time() is used as the timestamp.
+ *
+ * Returns: The number of bytes written.
+ */
+uint16_t
+cts_data_write_raw_data (CtsData *self,
+                         byte    *data)
+{
+  byte *start = data;
+  uint16_t size;
+
+  size = calc_total_size (self);
+
+  data = write_uint16 (data, SYNC_DATA);
+  data = write_uint16 (data, size);
+  data = write_uint16 (data, cts_conf_get_id_code (self->config));
+  data = write_uint32 (data, self->epoch_seconds);
+  data = write_uint32 (data, self->frac_of_second);
+
+  for (uint16_t i = 0; i < self->num_pmu; i++)
+    {
+      CtsPmuData *pmu_data = self->pmu_data + i;
+
+      data = write_uint16 (data, pmu_data->stat);
+
+      for (uint16_t j = 0; j < pmu_data->num_phasors; j++)
+        {
+          if (pmu_data->phasor_type == VALUE_TYPE_FLOAT)
+            {
+              data = write_float (data, pmu_data->phasor_float[j][0]);
+              data = write_float (data, pmu_data->phasor_float[j][1]);
+            }
+          else
+            {
+              data = write_uint16 (data, pmu_data->phasor_int[j][0]);
+              data = write_uint16 (data, pmu_data->phasor_int[j][1]);
+            }
+        }
+
+      if (pmu_data->freq_type == VALUE_TYPE_FLOAT)
+        {
+          data = write_float (data, pmu_data->freq_deviation.float_val);
+          data = write_float (data, pmu_data->rocof.float_val);
+        }
+      else
+        {
+          data = write_uint16 (data, pmu_data->freq_deviation.int_val);
+          data = write_uint16 (data, pmu_data->rocof.int_val);
+        }
+
+      for (uint16_t j = 0; j < pmu_data->num_analogs; j++)
+        {
+          if (pmu_data->analog_type == VALUE_TYPE_FLOAT)
+            data = write_float (data, pmu_data->analog_float[j]);
+          else
+            data = write_uint16 (data, pmu_data->analog_int[j]);
+        }
+
+      for (uint16_t j = 0; j < pmu_data->num_status_words; j++)
+        data = write_uint16 (data, pmu_data->status_word[j]);
+    }
+
+  write_uint16 (data, cts_common_calc_crc (start, size - 2, NULL));
+
+  return size;
+}
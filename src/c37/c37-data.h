@@ -40,6 +40,31 @@
 
 #define DATA_FRAME_COMMON_SIZE (DATA_COMMON_SIZE + DATA_COMMON_SIZE_PER_PMU)
 
+/* STAT bits 14 - 15, the data of the PMU are not to be used unless 0 */
+#define STAT_DATA_ERROR_MASK 0xC000
+
+/* STAT bits 14 - 15 of a PMU whose data is absent, filled in by a PDC */
+#define STAT_DATA_ABSENT 0x8000
+
+/* STAT bit set for a minute when the configuration is to change */
+#define STAT_CONFIG_CHANGE_BIT 10
+
+/* STAT bit set while a trigger condition is met */
+#define STAT_TRIGGER_DETECTED_BIT 11
+
+/* The reason of the trigger, in bits 0 - 3 of STAT */
+enum CtsTriggerReason {
+  CTS_TRIGGER_REASON_MANUAL         = 0x00,
+  CTS_TRIGGER_REASON_MAGNITUDE_LOW  = 0x01,
+  CTS_TRIGGER_REASON_MAGNITUDE_HIGH = 0x02,
+  CTS_TRIGGER_REASON_ANGLE_DIFF     = 0x03,
+  CTS_TRIGGER_REASON_FREQUENCY      = 0x04,
+  CTS_TRIGGER_REASON_DF_DT          = 0x05,
+  CTS_TRIGGER_REASON_DIGITAL        = 0x07,
+  CTS_TRIGGER_REASON_USER           = 0x08, /* 0x08 to 0x0F */
+  CTS_TRIGGER_REASON_MASK           = 0x0F
+};
+
 typedef struct _CtsData CtsData;
 typedef struct _CtsPmuData PmuData;
 
@@ -72,7 +97,51 @@ bool cts_data_get_analog_value_of_pmu (CtsData  *self,
                                        uint16_t  analog_index,
                                        void     *analog_value);
 
-CtsConf *cts_data_get_conf (CtsData *self);
+bool cts_data_set_phasor_of_pmu (CtsData  *self,
+                                 uint16_t  pmu_index,
+                                 uint16_t  phasor_index,
+                                 float     real,
+                                 float     imaginary);
+bool cts_data_get_phasor_of_pmu (CtsData  *self,
+                                 uint16_t  pmu_index,
+                                 uint16_t  phasor_index,
+                                 float    *real,
+                                 float    *imaginary);
+bool cts_data_set_analog_of_pmu (CtsData  *self,
+                                 uint16_t  pmu_index,
+                                 uint16_t  analog_index,
+                                 float     value);
+bool cts_data_get_analog_of_pmu (CtsData  *self,
+                                 uint16_t  pmu_index,
+                                 uint16_t  analog_index,
+                                 float    *value);
+bool cts_data_set_freq_of_pmu   (CtsData  *self,
+                                 uint16_t  pmu_index,
+                                 float     freq,
+                                 float     rocof);
+bool cts_data_get_freq_of_pmu   (CtsData  *self,
+                                 uint16_t  pmu_index,
+                                 float    *freq,
+                                 float    *rocof);
+
+uint16_t cts_data_get_stat_of_pmu        (CtsData  *self,
+                                          uint16_t  pmu_index);
+bool     cts_data_set_stat_of_pmu        (CtsData  *self,
+                                          uint16_t  pmu_index,
+                                          uint16_t  stat);
+bool     cts_data_get_status_word_of_pmu (CtsData  *self,
+                                          uint16_t  pmu_index,
+                                          uint16_t  status_word_index,
+                                          uint16_t *status_word);
+
+uint16_t cts_data_get_raw_data_size (CtsData *self);
+uint16_t cts_data_write_raw_data    (CtsData *self,
+                                     byte    *data);
+
+CtsConf *cts_data_get_conf (CtsData       *self);
+void     cts_data_set_time (CtsData       *self,
+                            const CtsTime *time);
+uint32_t cts_data_get_soc  (CtsData       *self);
 
 
 #endif /* C37_DATA_H */
@@ -36,6 +36,7 @@ cts_header_get_bin (CtsConf    *conf,
   byte *data = NULL, *copy;
   uint16_t byte2;
   uint32_t byte4;
+  CtsTime time;
 
   if (name == NULL)
     return NULL;
@@ -61,12 +62,15 @@ cts_header_get_bin (CtsConf    *conf,
   memcpy (copy, &byte2, 2);
   copy += 2;
 
-  byte4 = htonl (cts_common_get_time ());
+  cts_common_get_timestamp (&time);
+
+  byte4 = htonl (time.soc);
   memcpy (copy, &byte4, 4);
   copy += 4;
 
-  byte4 = htonl (cts_common_get_frac_of_second (cts_conf_get_time_base
-                                                 (conf)));
+  byte4 = htonl (cts_common_time_get_frac_of_second (&time,
+                                                     cts_conf_get_time_base
+                                                     (conf)));
   memcpy (copy, &byte4, 4);
   copy += 4;
 
@@ -0,0 +1,1197 @@
+/* c37-ingest.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "c37-ingest.h"
+#include "c37-client.h"
+#include "c37-command.h"
+
+/*
+ * Data frames of many PMUs, received by a number of worker threads,
+ * each on a core of its own. A stream stays with one worker for as
+ * long as it lives: TCP streams are given to the workers in turn, and
+ * UDP datagrams are received by every worker on the same port with
+ * SO_REUSEPORT, the kernel sending those of a PMU always to the same
+ * one. A worker finds the CFG-2 of its streams, checks CHK and
+ * decodes the data frames, sharing nothing with the other workers.
+ *
+ * Decoded frames are put in a queue per worker, a ring of bytes with
+ * a single writer and a single reader and no lock. An eventfd is made
+ * readable when something is put in an empty queue, to wait upon.
+ *
+ * A frame refers to the layout of the configuration it was decoded
+ * with. When the configuration of a stream changes, the old layout is
+ * freed only once every frame queued before is released.
+ */
+
+#define DEFAULT_QUEUE_SIZE  (4 << 20)
+#define MIN_QUEUE_SIZE      (1 << 20)
+#define RETRY_INTERVAL_MS   5000
+#define CONFIG_INTERVAL_MS  1000
+#define UDP_BATCH           16
+#define UDP_BUCKETS         256
+#define MAX_DATAGRAM_SIZE   65536
+#define MAX_EVENTS          64
+
+/* What an epoll event is about, the first member of each */
+enum {
+  WATCH_STOP,
+  WATCH_STREAM,
+  WATCH_UDP,
+};
+
+enum {
+  STREAM_DISCONNECTED,
+  STREAM_CONNECTING,
+  STREAM_CONFIGURING,
+  STREAM_RUNNING,
+};
+
+typedef struct _CtsIngestWorker CtsIngestWorker;
+typedef struct _CtsIngestStream CtsIngestStream;
+
+struct _CtsIngestStream
+{
+  int              kind;
+  CtsIngestWorker *worker;
+  uint32_t         index;
+  uint16_t         id_code;
+  bool             udp;
+
+  struct sockaddr_storage address;
+  socklen_t               address_length;
+
+  CtsClient *client;
+  int        state;
+  int64_t    retry_time;
+
+  /* The layout frames are queued with, not that of the client */
+  CtsDataLayout *layout;
+  uint32_t       num_values;
+  uint32_t       num_words;
+
+  /* Of the client, already counted in the queue */
+  uint64_t bad_crc;
+  uint64_t unknown_data;
+
+  CtsIngestStream *next;    /* In the same UDP bucket */
+};
+
+typedef struct
+{
+  uint32_t size;            /* Of the whole record, header included */
+  uint32_t padding;         /* Nothing but a jump to the start */
+} CtsIngestRecord;
+
+typedef struct
+{
+  _Alignas (64) _Atomic size_t head;
+  _Alignas (64) _Atomic size_t tail;
+
+  _Alignas (64) byte *buffer;
+  size_t size;
+  int    event_fd;
+
+  _Atomic uint64_t frames;
+  _Atomic uint64_t dropped;
+  _Atomic uint64_t bad_crc;
+  _Atomic uint64_t unknown_data;
+  _Atomic uint64_t configs;
+  _Atomic uint64_t connects;
+} CtsIngestQueue;
+
+typedef struct
+{
+  CtsDataLayout *layout;
+  size_t         position;  /* Free once the queue is read past it */
+} CtsIngestRetired;
+
+struct _CtsIngestWorker
+{
+  CtsIngestQueue queue;
+
+  CtsIngest   *ingest;
+  unsigned int index;
+  pthread_t    thread;
+  bool         started;
+
+  int epoll_fd;
+  int udp_fd;
+  int udp_kind;
+
+  CtsIngestStream **streams;
+  size_t            num_streams;
+  CtsIngestStream  *buckets[UDP_BUCKETS];
+
+  CtsIngestRetired *retired;
+  size_t            num_retired;
+
+  byte *datagrams;          /* UDP_BATCH of MAX_DATAGRAM_SIZE */
+};
+
+struct _CtsIngest
+{
+  CtsIngestWorker **workers;
+  unsigned int      num_workers;
+
+  int  stop_fd;
+  int  stop_kind;
+  bool started;
+
+  _Atomic uint32_t next_stream;
+};
+
+static int64_t
+get_monotonic_ms (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void *
+append (void   *array,
+        size_t  count,
+        size_t  element_size)
+{
+  /* Grown in powers of 2 */
+  if (count & (count - 1))
+    return array;
+
+  return realloc (array, (count ? count * 2 : 4) * element_size);
+}
+
+static void
+stream_free (CtsIngestStream *stream)
+{
+  cts_client_free (stream->client);
+  cts_data_layout_free (stream->layout);
+  free (stream);
+}
+
+static void
+worker_free (CtsIngestWorker *worker)
+{
+  if (worker == NULL)
+    return;
+
+  for (size_t i = 0; i < worker->num_streams; i++)
+    stream_free (worker->streams[i]);
+
+  for (size_t i = 0; i < worker->num_retired; i++)
+    cts_data_layout_free (worker->retired[i].layout);
+
+  if (worker->epoll_fd >= 0)
+    close (worker->epoll_fd);
+
+  if (worker->udp_fd >= 0)
+    close (worker->udp_fd);
+
+  if (worker->queue.event_fd >= 0)
+    close (worker->queue.event_fd);
+
+  free (worker->streams);
+  free (worker->retired);
+  free (worker->datagrams);
+  free (worker->queue.buffer);
+  free (worker);
+}
+
+/**
+ * cts_ingest_new:
+ * @num_workers: The number of threads to receive with, or 0 for one
+ * per CPU
+ * @queue_size: Bytes of the queue of each worker, or 0 for the default
+ *
+ * Returns: (nullable) (transfer full): A new #CtsIngest, not yet
+ * started, or %NULL on error with errno set. Free with
+ * cts_ingest_free().
+ */
+CtsIngest *
+cts_ingest_new (unsigned int num_workers,
+                size_t       queue_size)
+{
+  CtsIngest *self;
+  struct epoll_event event = { 0 };
+  size_t size = MIN_QUEUE_SIZE;
+
+  if (num_workers == 0)
+    {
+      long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+      num_workers = cpus > 0 ? cpus : 1;
+    }
+
+  if (queue_size == 0)
+    queue_size = DEFAULT_QUEUE_SIZE;
+
+  while (size < queue_size && size < SIZE_MAX / 2)
+    size *= 2;
+
+  self = calloc (1, sizeof *self);
+
+  if (self == NULL)
+    return NULL;
+
+  self->stop_kind = WATCH_STOP;
+  self->stop_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+  self->workers = calloc (num_workers, sizeof (CtsIngestWorker *));
+
+  if (self->stop_fd < 0 || self->workers == NULL)
+    goto error;
+
+  self->num_workers = num_workers;
+
+  for (unsigned int i = 0; i < num_workers; i++)
+    {
+      CtsIngestWorker *worker;
+
+      worker = aligned_alloc (64, (sizeof *worker + 63) / 64 * 64);
+
+      if (worker == NULL)
+        goto error;
+
+      memset (worker, 0, sizeof *worker);
+      self->workers[i] = worker;
+
+      worker->ingest = self;
+      worker->index = i;
+      worker->udp_fd = -1;
+      worker->udp_kind = WATCH_UDP;
+      worker->queue.size = size;
+      worker->queue.buffer = malloc (size);
+      worker->queue.event_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+      worker->epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+
+      if (worker->queue.buffer == NULL || worker->queue.event_fd < 0 ||
+          worker->epoll_fd < 0)
+        goto error;
+
+      /* Never read, so that every worker sees it */
+      event.events = EPOLLIN;
+      event.data.ptr = &self->stop_kind;
+
+      if (epoll_ctl (worker->epoll_fd, EPOLL_CTL_ADD, self->stop_fd, &event) < 0)
+        goto error;
+    }
+
+  return self;
+
+ error:
+  cts_ingest_free (self);
+
+  return NULL;
+}
+
+/**
+ * cts_ingest_free:
+ * @self: (nullable): A #CtsIngest
+ *
+ * Stop the workers, close every stream and free @self. Frames not yet
+ * released are lost.
+ */
+void
+cts_ingest_free (CtsIngest *self)
+{
+  uint64_t one = 1;
+
+  if (self == NULL)
+    return;
+
+  if (self->stop_fd >= 0 && write (self->stop_fd, &one, sizeof one) < 0)
+    {
+      /* Can't be full: it is written once */
+    }
+
+  for (unsigned int i = 0; self->workers && i < self->num_workers; i++)
+    if (self->workers[i] && self->workers[i]->started)
+      pthread_join (self->workers[i]->thread, NULL);
+
+  for (unsigned int i = 0; self->workers && i < self->num_workers; i++)
+    worker_free (self->workers[i]);
+
+  if (self->stop_fd >= 0)
+    close (self->stop_fd);
+
+  free (self->workers);
+  free (self);
+}
+
+/* Free the layouts no frame in the queue refers to any more */
+static void
+free_retired (CtsIngestWorker *worker)
+{
+  size_t tail = atomic_load (&worker->queue.tail);
+  size_t kept = 0;
+
+  for (size_t i = 0; i < worker->num_retired; i++)
+    {
+      if (tail >= worker->retired[i].position)
+        cts_data_layout_free (worker->retired[i].layout);
+      else
+        worker->retired[kept++] = worker->retired[i];
+    }
+
+  worker->num_retired = kept;
+}
+
+static void
+stream_set_layout (CtsIngestStream *stream,
+                   CtsDataLayout   *layout)
+{
+  CtsIngestWorker *worker = stream->worker;
+  uint16_t num_pmu = cts_data_layout_get_num_of_pmu (layout);
+
+  if (stream->layout)
+    {
+      CtsIngestRetired *retired;
+
+      retired = append (worker->retired, worker->num_retired, sizeof *retired);
+
+      /* Better to leak than to free it under a reader */
+      if (retired != NULL)
+        {
+          worker->retired = retired;
+          retired[worker->num_retired].layout = stream->layout;
+          retired[worker->num_retired].position = atomic_load (&worker->queue.head);
+          worker->num_retired++;
+        }
+    }
+
+  stream->layout = layout;
+  stream->num_values = 0;
+  stream->num_words = 0;
+
+  for (uint16_t i = 1; i <= num_pmu; i++)
+    {
+      stream->num_values += 2 + 2 * cts_data_layout_get_num_of_phasors_of_pmu (layout, i) +
+                            cts_data_layout_get_num_of_analogs_of_pmu (layout, i);
+      stream->num_words += 1 + cts_data_layout_get_num_of_status_of_pmu (layout, i);
+    }
+}
+
+static void
+decode_frame (const CtsDataView *view,
+              float             *values,
+              uint16_t          *words)
+{
+  const CtsDataLayout *layout = view->layout;
+  uint16_t num_pmu = cts_data_layout_get_num_of_pmu (layout);
+
+  for (uint16_t i = 1; i <= num_pmu; i++)
+    {
+      uint16_t num_phasors = cts_data_layout_get_num_of_phasors_of_pmu (layout, i);
+      uint16_t num_analogs = cts_data_layout_get_num_of_analogs_of_pmu (layout, i);
+      uint16_t num_status = cts_data_layout_get_num_of_status_of_pmu (layout, i);
+
+      *words++ = cts_data_view_get_stat_of_pmu (view, i);
+
+      for (uint16_t j = 1; j <= num_status; j++)
+        cts_data_view_get_status_word_of_pmu (view, i, j, words++);
+
+      cts_data_view_get_freq_of_pmu (view, i, values, values + 1);
+      values += 2;
+
+      for (uint16_t j = 1; j <= num_phasors; j++, values += 2)
+        cts_data_view_get_phasor_of_pmu (view, i, j, values, values + 1);
+
+      for (uint16_t j = 1; j <= num_analogs; j++)
+        cts_data_view_get_analog_of_pmu (view, i, j, values++);
+    }
+}
+
+/* Decode a data frame of @stream to the end of the queue */
+static void
+queue_frame (CtsIngestStream   *stream,
+             const CtsDataView *client_view)
+{
+  CtsIngestQueue *queue = &stream->worker->queue;
+  CtsDataView view = { stream->layout, client_view->frame };
+  CtsIngestRecord *record;
+  CtsIngestFrame *frame;
+  size_t head, tail, position, contiguous, size, needed;
+  float *values;
+
+  size = sizeof (CtsIngestRecord) + sizeof (CtsIngestFrame) +
+         stream->num_values * sizeof (float) + stream->num_words * sizeof (uint16_t);
+  size = (size + 7) & ~(size_t) 7;
+
+  head = atomic_load_explicit (&queue->head, memory_order_relaxed);
+  tail = atomic_load_explicit (&queue->tail, memory_order_acquire);
+  position = head & (queue->size - 1);
+  contiguous = queue->size - position;
+
+  /* What does not fit before the end starts over, after a padding */
+  needed = size > contiguous ? size + contiguous : size;
+
+  if (needed > queue->size - (head - tail))
+    {
+      atomic_fetch_add_explicit (&queue->dropped, 1, memory_order_relaxed);
+      return;
+    }
+
+  if (size > contiguous)
+    {
+      record = (CtsIngestRecord *) (queue->buffer + position);
+      record->size = contiguous;
+      record->padding = true;
+      position = 0;
+    }
+
+  record = (CtsIngestRecord *) (queue->buffer + position);
+  record->size = size;
+  record->padding = false;
+
+  frame = (CtsIngestFrame *) (record + 1);
+  values = (float *) (frame + 1);
+
+  frame->stream = stream->index;
+  frame->id_code = cts_data_view_get_id_code (&view);
+  cts_data_view_get_time (&view, &frame->time);
+  frame->layout = stream->layout;
+  frame->num_pmu = cts_data_layout_get_num_of_pmu (stream->layout);
+  frame->num_values = stream->num_values;
+  frame->num_words = stream->num_words;
+  frame->values = values;
+  frame->words = (uint16_t *) (values + stream->num_values);
+
+  decode_frame (&view, values, (uint16_t *) frame->words);
+
+  /*
+   * Wake the reader if the queue was empty. Both ends publish their
+   * position before reading that of the other, so that one of them
+   * sees the other has moved.
+   */
+  atomic_store (&queue->head, head + needed);
+  atomic_fetch_add_explicit (&queue->frames, 1, memory_order_relaxed);
+
+  if (atomic_load (&queue->tail) == head)
+    {
+      uint64_t one = 1;
+
+      if (write (queue->event_fd, &one, sizeof one) < 0)
+        {
+          /* Already readable */
+        }
+    }
+}
+
+static void
+update_stats (CtsIngestStream *stream)
+{
+  CtsIngestQueue *queue = &stream->worker->queue;
+  CtsClientStats stats;
+
+  cts_client_get_stats (stream->client, &stats);
+
+  atomic_fetch_add_explicit (&queue->bad_crc, stats.bad_crc - stream->bad_crc,
+                             memory_order_relaxed);
+  atomic_fetch_add_explicit (&queue->unknown_data, stats.unknown_data - stream->unknown_data,
+                             memory_order_relaxed);
+
+  stream->bad_crc = stats.bad_crc;
+  stream->unknown_data = stats.unknown_data;
+}
+
+static void
+send_udp_command (CtsIngestStream *stream,
+                  uint16_t         command)
+{
+  byte frame[COMMAND_MINIMUM_FRAME_SIZE];
+  uint16_t size;
+
+  size = cts_command_write (frame, stream->id_code, command);
+  sendto (stream->worker->udp_fd, frame, size, MSG_DONTWAIT | MSG_NOSIGNAL,
+          (struct sockaddr *) &stream->address, stream->address_length);
+}
+
+static void
+stream_config_cb (CtsClient *client,
+                  CtsConf   *config,
+                  byte       type,
+                  void      *user_data)
+{
+  CtsIngestStream *stream = user_data;
+  CtsDataLayout *layout;
+
+  /* CFG-1 tells what the PMU can do, not what the data frames are */
+  if (type == CTS_TYPE_CONFIG1)
+    return;
+
+  layout = cts_data_layout_new (config);
+
+  if (layout == NULL)
+    return;
+
+  stream_set_layout (stream, layout);
+  atomic_fetch_add_explicit (&stream->worker->queue.configs, 1, memory_order_relaxed);
+
+  if (stream->state == STREAM_CONFIGURING)
+    {
+      cts_client_send_command (client, CTS_COMMAND_DATA_ON);
+      stream->state = STREAM_RUNNING;
+    }
+}
+
+static void
+stream_data_cb (CtsClient         *client,
+                const CtsDataView *view,
+                void              *user_data)
+{
+  CtsIngestStream *stream = user_data;
+
+  (void) client;
+
+  /* The frame matches the client's layout, and so ours, of the same CFG */
+  if (stream->layout)
+    queue_frame (stream, view);
+}
+
+static CtsIngestStream *
+stream_new (CtsIngestWorker *worker,
+            uint32_t         index,
+            uint16_t         id_code,
+            bool             udp)
+{
+  CtsClientHandlers handlers = {
+    .config = stream_config_cb,
+    .data = stream_data_cb,
+  };
+  CtsIngestStream *stream, **streams;
+
+  streams = append (worker->streams, worker->num_streams, sizeof *streams);
+
+  if (streams == NULL)
+    return NULL;
+
+  worker->streams = streams;
+  stream = calloc (1, sizeof *stream);
+
+  if (stream == NULL)
+    return NULL;
+
+  stream->client = cts_client_new (id_code);
+
+  if (stream->client == NULL)
+    {
+      free (stream);
+      return NULL;
+    }
+
+  stream->kind = WATCH_STREAM;
+  stream->worker = worker;
+  stream->index = index;
+  stream->id_code = id_code;
+  stream->udp = udp;
+  cts_client_set_handlers (stream->client, &handlers, stream);
+
+  streams[worker->num_streams++] = stream;
+
+  return stream;
+}
+
+/**
+ * cts_ingest_add_stream:
+ * @self: A #CtsIngest, not yet started
+ * @host: The host name or address of a PMU (or PDC)
+ * @port: Its TCP port or service name
+ * @id_code: Its ID code
+ *
+ * Receive the data frames of a PMU over TCP. The name is resolved
+ * now, once. The worker connects once started, and again 5 seconds
+ * after the connection is lost.
+ *
+ * Returns: The stream, as in #CtsIngestFrame, or -1 on error
+ */
+int
+cts_ingest_add_stream (CtsIngest  *self,
+                       const char *host,
+                       const char *port,
+                       uint16_t    id_code)
+{
+  struct addrinfo hints = { 0 }, *result = NULL;
+  CtsIngestWorker *worker;
+  CtsIngestStream *stream;
+  uint32_t index;
+
+  if (self->started)
+    return -1;
+
+  hints.ai_socktype = SOCK_STREAM;
+
+  if (getaddrinfo (host, port, &hints, &result) != 0 || result == NULL)
+    return -1;
+
+  index = atomic_load (&self->next_stream);
+  worker = self->workers[index % self->num_workers];
+  stream = stream_new (worker, index, id_code, false);
+
+  if (stream == NULL)
+    {
+      freeaddrinfo (result);
+      return -1;
+    }
+
+  memcpy (&stream->address, result->ai_addr, result->ai_addrlen);
+  stream->address_length = result->ai_addrlen;
+  freeaddrinfo (result);
+
+  atomic_store (&self->next_stream, index + 1);
+
+  return index;
+}
+
+/* Of the first @count workers, as if never listened */
+static void
+unlisten_udp (CtsIngest    *self,
+              unsigned int  count)
+{
+  int saved_errno = errno;
+
+  for (unsigned int i = 0; i < count; i++)
+    {
+      CtsIngestWorker *worker = self->workers[i];
+
+      if (worker->udp_fd >= 0)
+        {
+          epoll_ctl (worker->epoll_fd, EPOLL_CTL_DEL, worker->udp_fd, NULL);
+          close (worker->udp_fd);
+          worker->udp_fd = -1;
+        }
+
+      free (worker->datagrams);
+      worker->datagrams = NULL;
+    }
+
+  errno = saved_errno;
+}
+
+/**
+ * cts_ingest_listen_udp:
+ * @self: A #CtsIngest, not yet started
+ * @port: The UDP port or service name
+ *
+ * Receive the datagrams of any PMU sending to @port. A PMU is known
+ * from its address and ID code, and its CFG-2 asked for with a
+ * command sent back to where its datagrams come from.
+ *
+ * Returns: %true on success, else %false with errno set
+ */
+bool
+cts_ingest_listen_udp (CtsIngest  *self,
+                       const char *port)
+{
+  struct addrinfo hints = { 0 }, *result = NULL;
+  int one = 1, buffer_size = 4 << 20;
+
+  if (self->started)
+    {
+      errno = EBUSY;
+      return false;
+    }
+
+  hints.ai_family = AF_INET6;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = AI_PASSIVE;
+
+  /* Both IPv6 and IPv4 if the kernel can, else IPv4 alone */
+  if (getaddrinfo (NULL, port, &hints, &result) != 0)
+    {
+      hints.ai_family = AF_INET;
+
+      if (getaddrinfo (NULL, port, &hints, &result) != 0)
+        {
+          errno = EINVAL;
+          return false;
+        }
+    }
+
+  for (unsigned int i = 0; i < self->num_workers; i++)
+    {
+      CtsIngestWorker *worker = self->workers[i];
+      struct epoll_event event = { 0 };
+      int fd;
+
+      fd = socket (result->ai_family, result->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+      if (fd < 0)
+        {
+          unlisten_udp (self, i);
+          freeaddrinfo (result);
+          return false;
+        }
+
+      setsockopt (fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof one);
+      setsockopt (fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof buffer_size);
+
+      worker->udp_fd = fd;
+      worker->datagrams = malloc (UDP_BATCH * MAX_DATAGRAM_SIZE);
+      event.events = EPOLLIN;
+      event.data.ptr = &worker->udp_kind;
+
+      if (worker->datagrams == NULL ||
+          bind (fd, result->ai_addr, result->ai_addrlen) < 0 ||
+          epoll_ctl (worker->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+        {
+          /* DEL of a socket never added fails harmlessly */
+          unlisten_udp (self, i + 1);
+          freeaddrinfo (result);
+          return false;
+        }
+    }
+
+  freeaddrinfo (result);
+
+  return true;
+}
+
+static void
+stream_disconnect (CtsIngestStream *stream,
+                   int64_t          now)
+{
+  int fd = cts_client_get_fd (stream->client);
+
+  if (fd >= 0)
+    epoll_ctl (stream->worker->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+  cts_client_close (stream->client);
+  stream->state = STREAM_DISCONNECTED;
+  stream->retry_time = now + RETRY_INTERVAL_MS;
+}
+
+static void
+stream_connect (CtsIngestStream *stream,
+                int64_t          now)
+{
+  struct epoll_event event = { 0 };
+  int fd;
+
+  fd = socket (stream->address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if (fd < 0)
+    {
+      stream->retry_time = now + RETRY_INTERVAL_MS;
+      return;
+    }
+
+  if (connect (fd, (struct sockaddr *) &stream->address, stream->address_length) < 0 &&
+      errno != EINPROGRESS)
+    {
+      close (fd);
+      stream->retry_time = now + RETRY_INTERVAL_MS;
+      return;
+    }
+
+  cts_client_set_fd (stream->client, fd, CTS_TRANSPORT_TCP);
+  stream->state = STREAM_CONNECTING;
+  stream->retry_time = now + RETRY_INTERVAL_MS;
+
+  event.events = EPOLLIN | EPOLLOUT;
+  event.data.ptr = stream;
+  epoll_ctl (stream->worker->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+static void
+stream_connected (CtsIngestStream *stream,
+                  int64_t          now)
+{
+  struct epoll_event event = { 0 };
+  int fd = cts_client_get_fd (stream->client);
+  int error = 0, one = 1;
+  socklen_t length = sizeof error;
+
+  if (getsockopt (fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error)
+    {
+      stream_disconnect (stream, now);
+      return;
+    }
+
+  /* Commands are small, and are waited upon */
+  setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+  event.events = EPOLLIN;
+  event.data.ptr = stream;
+  epoll_ctl (stream->worker->epoll_fd, EPOLL_CTL_MOD, fd, &event);
+
+  atomic_fetch_add_explicit (&stream->worker->queue.connects, 1, memory_order_relaxed);
+  stream->state = STREAM_CONFIGURING;
+  stream->retry_time = now + RETRY_INTERVAL_MS;
+
+  if (!cts_client_send_command (stream->client, CTS_COMMAND_SEND_CONFIG2))
+    stream_disconnect (stream, now);
+}
+
+static void
+stream_event (CtsIngestStream *stream)
+{
+  int64_t now = get_monotonic_ms ();
+  ssize_t count;
+
+  if (stream->state == STREAM_CONNECTING)
+    {
+      stream_connected (stream, now);
+      return;
+    }
+
+  /* Once per event, for the streams of a worker to take turns */
+  count = cts_client_read (stream->client);
+
+  if (count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR))
+    stream_disconnect (stream, now);
+
+  update_stats (stream);
+}
+
+static CtsIngestStream *
+find_udp_stream (CtsIngestWorker               *worker,
+                 uint16_t                       id_code,
+                 const struct sockaddr_storage *address,
+                 socklen_t                      address_length)
+{
+  CtsIngestStream **bucket = &worker->buckets[id_code % UDP_BUCKETS];
+  CtsIngestStream *stream;
+
+  for (stream = *bucket; stream; stream = stream->next)
+    if (stream->id_code == id_code && stream->address_length == address_length &&
+        memcmp (&stream->address, address, address_length) == 0)
+      return stream;
+
+  stream = stream_new (worker, atomic_fetch_add (&worker->ingest->next_stream, 1),
+                       id_code, true);
+
+  if (stream == NULL)
+    return NULL;
+
+  memcpy (&stream->address, address, address_length);
+  stream->address_length = address_length;
+  stream->next = *bucket;
+  *bucket = stream;
+
+  return stream;
+}
+
+static void
+read_datagrams (CtsIngestWorker *worker)
+{
+  struct mmsghdr messages[UDP_BATCH];
+  struct sockaddr_storage addresses[UDP_BATCH];
+  struct iovec vectors[UDP_BATCH];
+  int count;
+
+  memset (messages, 0, sizeof messages);
+
+  for (int i = 0; i < UDP_BATCH; i++)
+    {
+      vectors[i].iov_base = worker->datagrams + i * MAX_DATAGRAM_SIZE;
+      vectors[i].iov_len = MAX_DATAGRAM_SIZE;
+      messages[i].msg_hdr.msg_iov = &vectors[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+      messages[i].msg_hdr.msg_name = &addresses[i];
+      messages[i].msg_hdr.msg_namelen = sizeof addresses[i];
+    }
+
+  count = recvmmsg (worker->udp_fd, messages, UDP_BATCH, MSG_DONTWAIT, NULL);
+
+  for (int i = 0; i < count; i++)
+    {
+      const byte *datagram = vectors[i].iov_base;
+      size_t size = messages[i].msg_len;
+      CtsIngestStream *stream;
+
+      if (size < 16 || datagram[0] != CTS_TYPE_SYNC)
+        continue;
+
+      stream = find_udp_stream (worker, datagram[4] << 8 | datagram[5],
+                                &addresses[i], messages[i].msg_hdr.msg_namelen);
+
+      if (stream == NULL)
+        continue;
+
+      cts_client_feed (stream->client, datagram, size);
+      update_stats (stream);
+
+      /* Ask for the CFG-2 of a PMU as soon as it is heard of */
+      if (stream->layout == NULL && get_monotonic_ms () >= stream->retry_time)
+        {
+          send_udp_command (stream, CTS_COMMAND_SEND_CONFIG2);
+          stream->retry_time = get_monotonic_ms () + CONFIG_INTERVAL_MS;
+        }
+    }
+}
+
+static void
+housekeeping (CtsIngestWorker *worker,
+              int64_t          now)
+{
+  for (size_t i = 0; i < worker->num_streams; i++)
+    {
+      CtsIngestStream *stream = worker->streams[i];
+
+      if (stream->udp || now < stream->retry_time)
+        continue;
+
+      if (stream->state == STREAM_DISCONNECTED)
+        {
+          stream_connect (stream, now);
+        }
+      else if (stream->state == STREAM_CONNECTING)
+        {
+          /* Given up on */
+          stream_disconnect (stream, now);
+        }
+      else if (stream->state == STREAM_CONFIGURING)
+        {
+          cts_client_send_command (stream->client, CTS_COMMAND_SEND_CONFIG2);
+          stream->retry_time = now + RETRY_INTERVAL_MS;
+        }
+    }
+}
+
+static void *
+worker_run (void *data)
+{
+  CtsIngestWorker *worker = data;
+  struct epoll_event events[MAX_EVENTS];
+  int64_t next_housekeeping = 0;
+
+  for (;;)
+    {
+      int64_t now = get_monotonic_ms ();
+      int count;
+
+      if (now >= next_housekeeping)
+        {
+          housekeeping (worker, now);
+          next_housekeeping = now + CONFIG_INTERVAL_MS;
+        }
+
+      count = epoll_wait (worker->epoll_fd, events, MAX_EVENTS,
+                          next_housekeeping - now);
+
+      if (count < 0 && errno != EINTR)
+        break;
+
+      for (int i = 0; i < count; i++)
+        {
+          int *kind = events[i].data.ptr;
+
+          if (*kind == WATCH_STOP)
+            return NULL;
+          else if (*kind == WATCH_UDP)
+            read_datagrams (worker);
+          else
+            stream_event ((CtsIngestStream *) kind);
+        }
+
+      if (worker->num_retired)
+        free_retired (worker);
+    }
+
+  return NULL;
+}
+
+/**
+ * cts_ingest_start:
+ * @self: A #CtsIngest
+ *
+ * Start the workers, each bound to a CPU of its own if there are as
+ * many. Streams can't be added after.
+ *
+ * Returns: %true on success, else %false with errno set
+ */
+bool
+cts_ingest_start (CtsIngest *self)
+{
+  long num_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+  if (self->started)
+    return true;
+
+  self->started = true;
+
+  for (unsigned int i = 0; i < self->num_workers; i++)
+    {
+      CtsIngestWorker *worker = self->workers[i];
+      int error;
+
+      error = pthread_create (&worker->thread, NULL, worker_run, worker);
+
+      if (error)
+        {
+          errno = error;
+          return false;
+        }
+
+      worker->started = true;
+
+      if (num_cpus >= self->num_workers)
+        {
+          cpu_set_t cpus;
+
+          CPU_ZERO (&cpus);
+          CPU_SET (i, &cpus);
+          pthread_setaffinity_np (worker->thread, sizeof cpus, &cpus);
+        }
+    }
+
+  return true;
+}
+
+unsigned int
+cts_ingest_get_num_queues (CtsIngest *self)
+{
+  return self->num_workers;
+}
+
+/**
+ * cts_ingest_get_queue_fd:
+ * @self: A #CtsIngest
+ * @queue: A queue, less than cts_ingest_get_num_queues()
+ *
+ * Returns: An eventfd readable once something is queued, to poll.
+ * Read by cts_ingest_peek().
+ */
+int
+cts_ingest_get_queue_fd (CtsIngest    *self,
+                         unsigned int  queue)
+{
+  if (queue >= self->num_workers)
+    return -1;
+
+  return self->workers[queue]->queue.event_fd;
+}
+
+/**
+ * cts_ingest_peek:
+ * @self: A #CtsIngest
+ * @queue: A queue, less than cts_ingest_get_num_queues()
+ *
+ * Get the oldest frame of @queue, without waiting. A queue is to be
+ * read by one thread at a time.
+ *
+ * Returns: (nullable) (transfer none): The oldest frame, valid till
+ * cts_ingest_release(), or %NULL if @queue is empty
+ */
+const CtsIngestFrame *
+cts_ingest_peek (CtsIngest    *self,
+                 unsigned int  queue)
+{
+  CtsIngestQueue *q;
+  size_t tail;
+  bool cleared = false;
+
+  if (queue >= self->num_workers)
+    return NULL;
+
+  q = &self->workers[queue]->queue;
+  tail = atomic_load_explicit (&q->tail, memory_order_relaxed);
+
+  for (;;)
+    {
+      CtsIngestRecord *record;
+
+      if (tail == atomic_load (&q->head))
+        {
+          uint64_t value;
+
+          if (cleared)
+            return NULL;
+
+          /* Cleared before looking again, not to miss a wake up */
+          if (read (q->event_fd, &value, sizeof value) < 0)
+            {
+              /* Not readable */
+            }
+
+          cleared = true;
+          continue;
+        }
+
+      record = (CtsIngestRecord *) (q->buffer + (tail & (q->size - 1)));
+
+      if (!record->padding)
+        return (const CtsIngestFrame *) (record + 1);
+
+      tail += record->size;
+      atomic_store (&q->tail, tail);
+    }
+}
+
+/**
+ * cts_ingest_release:
+ * @self: A #CtsIngest
+ * @queue: The queue of the frame of the last cts_ingest_peek()
+ *
+ * Done with the oldest frame of @queue, that was peeked at.
+ */
+void
+cts_ingest_release (CtsIngest    *self,
+                    unsigned int  queue)
+{
+  CtsIngestQueue *q;
+  CtsIngestRecord *record;
+  size_t tail;
+
+  if (queue >= self->num_workers)
+    return;
+
+  q = &self->workers[queue]->queue;
+  tail = atomic_load_explicit (&q->tail, memory_order_relaxed);
+
+  if (tail == atomic_load (&q->head))
+    return;
+
+  record = (CtsIngestRecord *) (q->buffer + (tail & (q->size - 1)));
+  atomic_store (&q->tail, tail + record->size);
+}
+
+void
+cts_ingest_get_stats (CtsIngest      *self,
+                      unsigned int    queue,
+                      CtsIngestStats *stats)
+{
+  CtsIngestQueue *q;
+
+  memset (stats, 0, sizeof *stats);
+
+  if (queue >= self->num_workers)
+    return;
+
+  q = &self->workers[queue]->queue;
+  stats->frames = atomic_load_explicit (&q->frames, memory_order_relaxed);
+  stats->dropped = atomic_load_explicit (&q->dropped, memory_order_relaxed);
+  stats->bad_crc = atomic_load_explicit (&q->bad_crc, memory_order_relaxed);
+  stats->unknown_data = atomic_load_explicit (&q->unknown_data, memory_order_relaxed);
+  stats->configs = atomic_load_explicit (&q->configs, memory_order_relaxed);
+  stats->connects = atomic_load_explicit (&q->connects, memory_order_relaxed);
+}
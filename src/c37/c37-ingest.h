@@ -0,0 +1,85 @@
+/* c37-ingest.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef C37_INGEST_H
+#define C37_INGEST_H
+
+
+#include "c37-common.h"
+#include "c37-view.h"
+
+typedef struct _CtsIngest CtsIngest;
+
+/*
+ * A data frame decoded by a worker, valid till cts_ingest_release().
+ *
+ * For each PMU in turn, @values has its frequency, ROCOF, the real
+ * and imaginary parts of each phasor and each analog value, and
+ * @words its STAT and each digital status word. How many of each a
+ * PMU has is told by @layout.
+ */
+typedef struct _CtsIngestFrame
+{
+  uint32_t             stream;
+  uint16_t             id_code;
+  CtsTime              time;
+
+  const CtsDataLayout *layout;
+  uint16_t             num_pmu;
+  uint32_t             num_values;
+  uint32_t             num_words;
+  const float         *values;
+  const uint16_t      *words;
+} CtsIngestFrame;
+
+typedef struct _CtsIngestStats
+{
+  uint64_t frames;          /* Data frames queued */
+  uint64_t dropped;         /* Data frames dropped, the queue being full */
+  uint64_t bad_crc;         /* Frames dropped for a wrong CHK */
+  uint64_t unknown_data;    /* Data frames without a matching configuration */
+  uint64_t configs;         /* CFG-2 and CFG-3 received */
+  uint64_t connects;        /* TCP connections made */
+} CtsIngestStats;
+
+CtsIngest *cts_ingest_new  (unsigned int  num_workers,
+                            size_t        queue_size);
+void       cts_ingest_free (CtsIngest    *self);
+
+int      cts_ingest_add_stream (CtsIngest  *self,
+                                const char *host,
+                                const char *port,
+                                uint16_t    id_code);
+bool     cts_ingest_listen_udp (CtsIngest  *self,
+                                const char *port);
+bool     cts_ingest_start      (CtsIngest  *self);
+
+unsigned int cts_ingest_get_num_queues (CtsIngest    *self);
+int          cts_ingest_get_queue_fd   (CtsIngest    *self,
+                                        unsigned int  queue);
+
+const CtsIngestFrame *cts_ingest_peek    (CtsIngest      *self,
+                                          unsigned int    queue);
+void                  cts_ingest_release (CtsIngest      *self,
+                                          unsigned int    queue);
+void                  cts_ingest_get_stats (CtsIngest      *self,
+                                            unsigned int    queue,
+                                            CtsIngestStats *stats);
+
+
+#endif /* C37_INGEST_H */
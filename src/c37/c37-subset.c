@@ -0,0 +1,783 @@
+/* c37-subset.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ctype.h>
+
+#include "c37-data.h"
+#include "c37-subset.h"
+
+/*
+ * A subset of the PMUs and channels of a configuration, as wanted by
+ * a single client.
+ *
+ * The subset has its own configuration, derived from the source one,
+ * to be sent as the CFG-2 of the client. Data frames of the source
+ * configuration are turned into data frames of the subset by copying
+ * the selected byte ranges, which are found once and cached. Frequency,
+ * ROCOF and STAT are always kept for a selected PMU.
+ */
+
+typedef struct _SubsetPmu
+{
+  bool selected;
+
+  /* num_phasors, then num_analogs, then num_status flags */
+  uint16_t num_phasors;
+  uint16_t num_analogs;
+  uint16_t num_status;
+  bool *channels;
+
+  /* NULL terminated, the strings are owned by the source */
+  char **channel_names;
+} SubsetPmu;
+
+/* A range of bytes to copy from the source frame */
+typedef struct _SubsetSegment
+{
+  uint16_t from;
+  uint16_t to;
+  uint16_t length;
+} SubsetSegment;
+
+struct _CtsSubset
+{
+  CtsConf *source;
+
+  uint16_t num_pmu;
+  SubsetPmu *pmus;
+
+  /* Incremented on every change, added to the change count */
+  uint16_t changes;
+
+  /* Cached, NULL till built */
+  CtsConf *conf;
+  SubsetSegment *segments;
+  uint16_t num_segments;
+  uint16_t source_frame_size;
+  uint16_t frame_size;
+};
+
+/**
+ * cts_subset_new:
+ * @source: The configuration the data frames are encoded with
+ *
+ * Create a new subset of @source, with nothing selected. @source
+ * should outlive the subset. If @source is changed, the subset
+ * should be invalidated with cts_subset_invalidate().
+ *
+ * Returns: (nullable) (transfer full): A new #CtsSubset, or %NULL if
+ * allocating memory failed. Free with cts_subset_free().
+ */
+CtsSubset *
+cts_subset_new (CtsConf *source)
+{
+  CtsSubset *self;
+
+  self = calloc (1, sizeof *self);
+
+  if (self == NULL)
+    return NULL;
+
+  self->source = source;
+  self->num_pmu = cts_conf_get_num_of_pmu (source);
+  self->pmus = calloc (self->num_pmu, sizeof *self->pmus);
+
+  if (self->pmus == NULL && self->num_pmu)
+    {
+      free (self);
+      return NULL;
+    }
+
+  for (uint16_t i = 0; i < self->num_pmu; i++)
+    {
+      SubsetPmu *pmu = self->pmus + i;
+
+      pmu->num_phasors = cts_conf_get_num_of_phasors_of_pmu (source, i + 1);
+      pmu->num_analogs = cts_conf_get_num_of_analogs_of_pmu (source, i + 1);
+      pmu->num_status = cts_conf_get_num_of_status_of_pmu (source, i + 1);
+      pmu->channels = calloc (pmu->num_phasors + pmu->num_analogs +
+                              pmu->num_status + 1, sizeof (bool));
+
+      if (pmu->channels == NULL)
+        {
+          cts_subset_free (self);
+          return NULL;
+        }
+    }
+
+  return self;
+}
+
+static void
+subset_clear_cache (CtsSubset *self)
+{
+  if (self->conf == NULL && self->segments == NULL)
+    return;
+
+  for (uint16_t i = 0; i < self->num_pmu; i++)
+    {
+      free (self->pmus[i].channel_names);
+      self->pmus[i].channel_names = NULL;
+    }
+
+  cts_conf_free (self->conf);
+  free (self->segments);
+
+  self->conf = NULL;
+  self->segments = NULL;
+  self->num_segments = 0;
+  self->changes++;
+}
+
+void
+cts_subset_free (CtsSubset *self)
+{
+  if (self == NULL)
+    return;
+
+  subset_clear_cache (self);
+
+  for (uint16_t i = 0; i < self->num_pmu; i++)
+    free (self->pmus[i].channels);
+
+  free (self->pmus);
+  free (self);
+}
+
+/**
+ * cts_subset_invalidate:
+ * @self: A #CtsSubset
+ *
+ * Drop the derived configuration and the cached layout, so that they
+ * are built again from the source configuration when next needed.
+ * The change count of the derived configuration is incremented.
+ */
+void
+cts_subset_invalidate (CtsSubset *self)
+{
+  subset_clear_cache (self);
+}
+
+static bool
+subset_select (CtsSubset *self,
+               uint16_t   pmu_index,
+               uint16_t   channel,
+               uint16_t   count,
+               uint16_t   index)
+{
+  SubsetPmu *pmu;
+
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  pmu = self->pmus + pmu_index - 1;
+
+  if (index == 0 || index > count)
+    return false;
+
+  subset_clear_cache (self);
+
+  pmu->selected = true;
+  pmu->channels[channel + index - 1] = true;
+
+  return true;
+}
+
+/**
+ * cts_subset_add_pmu:
+ * @self: A #CtsSubset
+ * @pmu_index: The index of PMU in the source, starting from 1
+ *
+ * Select every channel of the PMU.
+ *
+ * Returns: %true if @pmu_index is valid, %false otherwise.
+ */
+bool
+cts_subset_add_pmu (CtsSubset *self,
+                    uint16_t   pmu_index)
+{
+  SubsetPmu *pmu;
+
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  subset_clear_cache (self);
+
+  pmu = self->pmus + pmu_index - 1;
+  pmu->selected = true;
+
+  for (uint16_t i = 0; i < pmu->num_phasors + pmu->num_analogs + pmu->num_status; i++)
+    pmu->channels[i] = true;
+
+  return true;
+}
+
+/**
+ * cts_subset_add_phasor:
+ * @self: A #CtsSubset
+ * @pmu_index: The index of PMU in the source, starting from 1
+ * @phasor_index: The index of phasor in the PMU, starting from 1
+ *
+ * Select the phasor, and the PMU it belongs to. A selected PMU
+ * always has its STAT, frequency and ROCOF, and needs at least one
+ * phasor selected.
+ *
+ * Returns: %true if the phasor exists, %false otherwise.
+ */
+bool
+cts_subset_add_phasor (CtsSubset *self,
+                       uint16_t   pmu_index,
+                       uint16_t   phasor_index)
+{
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  return subset_select (self, pmu_index, 0,
+                        self->pmus[pmu_index - 1].num_phasors,
+                        phasor_index);
+}
+
+/**
+ * cts_subset_add_analog:
+ * @self: A #CtsSubset
+ * @pmu_index: The index of PMU in the source, starting from 1
+ * @analog_index: The index of analog value in the PMU, starting from 1
+ *
+ * Select the analog value, and the PMU it belongs to.
+ *
+ * Returns: %true if the analog value exists, %false otherwise.
+ */
+bool
+cts_subset_add_analog (CtsSubset *self,
+                       uint16_t   pmu_index,
+                       uint16_t   analog_index)
+{
+  SubsetPmu *pmu;
+
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  pmu = self->pmus + pmu_index - 1;
+
+  return subset_select (self, pmu_index, pmu->num_phasors,
+                        pmu->num_analogs, analog_index);
+}
+
+/**
+ * cts_subset_add_digital:
+ * @self: A #CtsSubset
+ * @pmu_index: The index of PMU in the source, starting from 1
+ * @status_index: The index of digital status word in the PMU,
+ * starting from 1
+ *
+ * Select the 16 bit digital status word, and the PMU it belongs to.
+ *
+ * Returns: %true if the status word exists, %false otherwise.
+ */
+bool
+cts_subset_add_digital (CtsSubset *self,
+                        uint16_t   pmu_index,
+                        uint16_t   status_index)
+{
+  SubsetPmu *pmu;
+
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  pmu = self->pmus + pmu_index - 1;
+
+  return subset_select (self, pmu_index, pmu->num_phasors + pmu->num_analogs,
+                        pmu->num_status, status_index);
+}
+
+static bool
+parse_index (const char    *text,
+             unsigned long *value)
+{
+  char *end;
+
+  while (isspace ((unsigned char)*text))
+    text++;
+
+  if (!isdigit ((unsigned char)*text))
+    return false;
+
+  *value = strtoul (text, &end, 10);
+
+  while (isspace ((unsigned char)*end))
+    end++;
+
+  return *end == '\0' && *value <= UINT16_MAX;
+}
+
+static bool
+parse_channel (CtsSubset  *self,
+               uint16_t    pmu_index,
+               const char *channel)
+{
+  unsigned long index;
+  char type;
+
+  while (isspace ((unsigned char)*channel))
+    channel++;
+
+  type = toupper ((unsigned char)*channel);
+
+  if (!parse_index (channel + 1, &index))
+    return false;
+
+  if (type == 'P')
+    return cts_subset_add_phasor (self, pmu_index, index);
+  else if (type == 'A')
+    return cts_subset_add_analog (self, pmu_index, index);
+  else if (type == 'D')
+    return cts_subset_add_digital (self, pmu_index, index);
+
+  return false;
+}
+
+/**
+ * cts_subset_parse:
+ * @self: A #CtsSubset
+ * @spec: The channels to select, need not be NUL terminated
+ * @length: The length of @spec in bytes
+ *
+ * Select the channels in @spec, a list of PMUs separated by ';' or
+ * new lines. Each PMU is given by its index, optionally followed by
+ * ':' and a comma separated list of channels. A channel is 'P' for a
+ * phasor, 'A' for an analog value or 'D' for a digital status word,
+ * followed by its index. A PMU without channels is selected as a
+ * whole. Every index starts from 1.
+ *
+ * Say, "1:P7,A13" selects the 7th phasor and the 13th analog value of
+ * the first PMU, and "1;2:P1" selects all of the first PMU and the
+ * first phasor of the second PMU.
+ *
+ * Returns: %true if @spec was valid. On %false, the selection may be
+ * partly done.
+ */
+bool
+cts_subset_parse (CtsSubset  *self,
+                  const char *spec,
+                  size_t      length)
+{
+  char *copy, *entry, *save_entry;
+  bool valid = true;
+
+  copy = malloc (length + 1);
+
+  if (copy == NULL)
+    return false;
+
+  memcpy (copy, spec, length);
+  copy[length] = '\0';
+
+  for (entry = strtok_r (copy, ";\n", &save_entry);
+       entry && valid;
+       entry = strtok_r (NULL, ";\n", &save_entry))
+    {
+      char *channels, *channel, *save_channel;
+      unsigned long pmu_index;
+
+      channels = strchr (entry, ':');
+
+      if (channels)
+        *channels++ = '\0';
+      else if (strspn (entry, " \t\r") == strlen (entry))
+        continue; /* Empty entry */
+
+      if (!parse_index (entry, &pmu_index))
+        {
+          valid = false;
+          break;
+        }
+
+      if (channels == NULL)
+        {
+          valid = cts_subset_add_pmu (self, pmu_index);
+          continue;
+        }
+
+      for (channel = strtok_r (channels, ",", &save_channel);
+           channel && valid;
+           channel = strtok_r (NULL, ",", &save_channel))
+        valid = parse_channel (self, pmu_index, channel);
+    }
+
+  free (copy);
+
+  return valid;
+}
+
+static void
+add_segment (CtsSubset *self,
+             uint16_t   from,
+             uint16_t   to,
+             uint16_t   length)
+{
+  SubsetSegment *last = NULL;
+
+  if (self->num_segments)
+    last = self->segments + self->num_segments - 1;
+
+  /* Merge with the previous range, if they follow each other */
+  if (last && last->from + last->length == from &&
+      last->to + last->length == to)
+    {
+      last->length += length;
+      return;
+    }
+
+  self->segments[self->num_segments].from = from;
+  self->segments[self->num_segments].to = to;
+  self->segments[self->num_segments].length = length;
+  self->num_segments++;
+}
+
+static void
+copy_channel_names (char     **names,
+                    char     **source_names,
+                    uint16_t   index,
+                    uint16_t   count,
+                    uint16_t  *num_names)
+{
+  if (source_names == NULL)
+    return;
+
+  for (uint16_t i = 0; i < count; i++)
+    names[(*num_names)++] = source_names[index + i];
+}
+
+static void
+get_value_sizes (CtsSubset *self,
+                 uint16_t   source_index,
+                 uint16_t  *phasor_size,
+                 uint16_t  *freq_size,
+                 uint16_t  *analog_size)
+{
+  CtsConf *source = self->source;
+
+  if (cts_conf_get_phasor_data_type_of_pmu (source, source_index) == VALUE_TYPE_FLOAT)
+    *phasor_size = 8;
+  else
+    *phasor_size = 4;
+
+  if (cts_conf_get_freq_data_type_of_pmu (source, source_index) == VALUE_TYPE_FLOAT)
+    *freq_size = 4;
+  else
+    *freq_size = 2;
+
+  if (cts_conf_get_analog_data_type_of_pmu (source, source_index) == VALUE_TYPE_FLOAT)
+    *analog_size = 4;
+  else
+    *analog_size = 2;
+}
+
+/* Size of the PMU in the source data frame */
+static uint16_t
+get_pmu_size (CtsSubset *self,
+              uint16_t   source_index)
+{
+  SubsetPmu *pmu = self->pmus + source_index - 1;
+  uint16_t phasor_size, freq_size, analog_size;
+
+  get_value_sizes (self, source_index, &phasor_size, &freq_size, &analog_size);
+
+  return DATA_COMMON_SIZE_PER_PMU + phasor_size * pmu->num_phasors +
+    2 * freq_size + analog_size * pmu->num_analogs + 2 * pmu->num_status;
+}
+
+/* Configure PMU @pmu_index of the derived configuration, and find its
+ * byte ranges in the source frame from @from.
+ */
+static bool
+build_pmu (CtsSubset *self,
+           uint16_t   source_index,
+           uint16_t   pmu_index,
+           uint16_t  *from,
+           uint16_t  *to)
+{
+  SubsetPmu *pmu = self->pmus + source_index - 1;
+  CtsConf *source = self->source;
+  CtsConf *conf = self->conf;
+  char **source_names;
+  uint16_t num_phasors = 0, num_analogs = 0, num_status = 0;
+  uint16_t num_names = 0;
+  uint16_t phasor_size, freq_size, analog_size;
+  uint16_t k;
+
+  for (uint16_t i = 0; i < pmu->num_phasors; i++)
+    num_phasors += pmu->channels[i];
+  for (uint16_t i = 0; i < pmu->num_analogs; i++)
+    num_analogs += pmu->channels[pmu->num_phasors + i];
+  for (uint16_t i = 0; i < pmu->num_status; i++)
+    num_status += pmu->channels[pmu->num_phasors + pmu->num_analogs + i];
+
+  /* A configuration can't have a PMU without phasors */
+  if (num_phasors == 0)
+    return false;
+
+  get_value_sizes (self, source_index, &phasor_size, &freq_size, &analog_size);
+
+  cts_conf_set_station_name_of_pmu (conf, pmu_index,
+                                    cts_conf_get_station_name_of_pmu (source, source_index),
+                                    16);
+  cts_conf_set_id_code_of_pmu (conf, pmu_index,
+                               cts_conf_get_id_code_of_pmu (source, source_index));
+  cts_conf_set_freq_data_type_of_pmu (conf, pmu_index,
+                                      cts_conf_get_freq_data_type_of_pmu (source, source_index));
+  cts_conf_set_analog_data_type_of_pmu (conf, pmu_index,
+                                        cts_conf_get_analog_data_type_of_pmu (source, source_index));
+  cts_conf_set_phasor_data_type_of_pmu (conf, pmu_index,
+                                        cts_conf_get_phasor_data_type_of_pmu (source, source_index));
+  cts_conf_set_phasor_complex_type_of_pmu (conf, pmu_index,
+                                           cts_conf_get_phasor_complex_type_of_pmu (source, source_index));
+  cts_conf_set_nominal_freq_of_pmu (conf, pmu_index,
+                                    cts_conf_get_nominal_freq_of_pmu (source, source_index));
+  cts_conf_set_change_count_of_pmu (conf, pmu_index,
+                                    cts_conf_get_change_count_of_pmu (source, source_index) +
+                                    self->changes);
+
+  if (cts_conf_set_num_of_phasors_of_pmu (conf, pmu_index, num_phasors) != num_phasors ||
+      cts_conf_set_num_of_analogs_of_pmu (conf, pmu_index, num_analogs) != num_analogs ||
+      cts_conf_set_num_of_status_of_pmu (conf, pmu_index, num_status) != num_status)
+    return false;
+
+  pmu->channel_names = calloc (num_phasors + num_analogs + 16 * num_status + 1,
+                               sizeof (char *));
+  if (pmu->channel_names == NULL)
+    return false;
+
+  source_names = cts_conf_get_channel_names_of_pmu (source, source_index);
+
+  /* STAT */
+  add_segment (self, *from, *to, DATA_COMMON_SIZE_PER_PMU);
+  *from += DATA_COMMON_SIZE_PER_PMU;
+  *to += DATA_COMMON_SIZE_PER_PMU;
+
+  k = 0;
+  for (uint16_t i = 0; i < pmu->num_phasors; i++)
+    {
+      if (pmu->channels[i])
+        {
+          k++;
+          cts_conf_set_phasor_measure_type_of_pmu (conf, pmu_index, k,
+                                                   cts_conf_get_phasor_measure_type_of_pmu (source, source_index, i + 1));
+          cts_conf_set_phasor_conv_of_pmu (conf, pmu_index, k,
+                                           cts_conf_get_phasor_conv_of_pmu (source, source_index, i + 1));
+          copy_channel_names (pmu->channel_names, source_names, i, 1, &num_names);
+
+          add_segment (self, *from, *to, phasor_size);
+          *to += phasor_size;
+        }
+
+      *from += phasor_size;
+    }
+
+  /* FREQ and DFREQ */
+  add_segment (self, *from, *to, 2 * freq_size);
+  *from += 2 * freq_size;
+  *to += 2 * freq_size;
+
+  k = 0;
+  for (uint16_t i = 0; i < pmu->num_analogs; i++)
+    {
+      if (pmu->channels[pmu->num_phasors + i])
+        {
+          k++;
+          cts_conf_set_analog_measure_type_of_pmu (conf, pmu_index, k,
+                                                   cts_conf_get_analog_measure_type_of_pmu (source, source_index, i + 1));
+          cts_conf_set_analog_conv_of_pmu (conf, pmu_index, k,
+                                           cts_conf_get_analog_conv_of_pmu (source, source_index, i + 1));
+          copy_channel_names (pmu->channel_names, source_names,
+                              pmu->num_phasors + i, 1, &num_names);
+
+          add_segment (self, *from, *to, analog_size);
+          *to += analog_size;
+        }
+
+      *from += analog_size;
+    }
+
+  k = 0;
+  for (uint16_t i = 0; i < pmu->num_status; i++)
+    {
+      if (pmu->channels[pmu->num_phasors + pmu->num_analogs + i])
+        {
+          uint32_t masks = cts_conf_get_status_masks_of_pmu (source, source_index, i + 1);
+
+          k++;
+          cts_conf_set_status_normal_masks_of_pmu (conf, pmu_index, k, masks >> 16);
+          cts_conf_set_status_validity_masks_of_pmu (conf, pmu_index, k, masks & 0xFFFF);
+          copy_channel_names (pmu->channel_names, source_names,
+                              pmu->num_phasors + pmu->num_analogs + 16 * i,
+                              16, &num_names);
+
+          add_segment (self, *from, *to, 2);
+          *to += 2;
+        }
+
+      *from += 2;
+    }
+
+  if (source_names)
+    cts_conf_set_channel_names_of_pmu (conf, pmu_index, pmu->channel_names);
+
+  return true;
+}
+
+static bool
+subset_build (CtsSubset *self)
+{
+  uint16_t num_pmu = 0;
+  uint16_t max_segments = 0;
+  uint16_t from, to;
+  uint16_t changes;
+
+  if (cts_conf_get_num_of_pmu (self->source) != self->num_pmu)
+    return false;
+
+  for (uint16_t i = 0; i < self->num_pmu; i++)
+    {
+      SubsetPmu *pmu = self->pmus + i;
+
+      if (!pmu->selected)
+        continue;
+
+      /* Stop if the source has changed under us */
+      if (cts_conf_get_num_of_phasors_of_pmu (self->source, i + 1) != pmu->num_phasors ||
+          cts_conf_get_num_of_analogs_of_pmu (self->source, i + 1) != pmu->num_analogs ||
+          cts_conf_get_num_of_status_of_pmu (self->source, i + 1) != pmu->num_status)
+        return false;
+
+      num_pmu++;
+      max_segments += pmu->num_phasors + pmu->num_analogs + pmu->num_status + 2;
+    }
+
+  if (num_pmu == 0)
+    return false;
+
+  self->conf = cts_conf_new ();
+  self->segments = malloc (max_segments * sizeof *self->segments);
+
+  if (self->conf == NULL || self->segments == NULL ||
+      cts_conf_set_num_of_pmu (self->conf, num_pmu) != num_pmu)
+    goto error;
+
+  cts_conf_set_id_code (self->conf, cts_conf_get_id_code (self->source));
+  cts_conf_set_time_base (self->conf, cts_conf_get_time_base (self->source));
+  cts_conf_set_data_rate (self->conf, cts_conf_get_data_rate (self->source));
+
+  /* The common part, excluding CHK, is copied as it is */
+  from = to = DATA_COMMON_SIZE - 2;
+  num_pmu = 0;
+
+  for (uint16_t i = 0; i < self->num_pmu; i++)
+    {
+      if (!self->pmus[i].selected)
+        from += get_pmu_size (self, i + 1);
+      else if (!build_pmu (self, i + 1, ++num_pmu, &from, &to))
+        goto error;
+    }
+
+  self->source_frame_size = from + 2;
+  self->frame_size = to + 2;
+
+  return true;
+
+ error:
+  changes = self->changes;
+  subset_clear_cache (self);
+  self->changes = changes;
+
+  return false;
+}
+
+/**
+ * cts_subset_get_conf:
+ * @self: A #CtsSubset
+ *
+ * Returns: (nullable) (transfer none): The configuration of the
+ * selected channels, to be sent as the CFG-2 of the client. %NULL if
+ * nothing is selected, a selected PMU has no phasors, or the source
+ * has changed since @self was created.
+ */
+CtsConf *
+cts_subset_get_conf (CtsSubset *self)
+{
+  if (self->conf == NULL && !subset_build (self))
+    return NULL;
+
+  return self->conf;
+}
+
+/**
+ * cts_subset_get_frame_size:
+ * @self: A #CtsSubset
+ *
+ * Returns: The size of the data frames written by
+ * cts_subset_write_frame(), or 0 if there is no configuration, see
+ * cts_subset_get_conf().
+ */
+uint16_t
+cts_subset_get_frame_size (CtsSubset *self)
+{
+  if (cts_subset_get_conf (self) == NULL)
+    return 0;
+
+  return self->frame_size;
+}
+
+/**
+ * cts_subset_write_frame:
+ * @self: A #CtsSubset
+ * @frame: A data frame of the source configuration
+ * @data: Where to write the data frame of the subset, of at least
+ * cts_subset_get_frame_size() bytes
+ *
+ * Write the data frame of the selected channels, with the time and
+ * values of @frame.
+ *
+ * Returns: The size of the frame written, or 0 if @frame is not of
+ * the size expected of the source, or there is no configuration.
+ */
+uint16_t
+cts_subset_write_frame (CtsSubset  *self,
+                        const byte *frame,
+                        byte       *data)
+{
+  uint16_t value;
+
+  if (cts_subset_get_conf (self) == NULL ||
+      cts_common_get_size (frame, 2) != self->source_frame_size)
+    return 0;
+
+  memcpy (data, frame, DATA_COMMON_SIZE - 2);
+
+  value = htons (self->frame_size);
+  memcpy (data + 2, &value, 2);
+
+  for (uint16_t i = 0; i < self->num_segments; i++)
+    memcpy (data + self->segments[i].to, frame + self->segments[i].from,
+            self->segments[i].length);
+
+  value = htons (cts_common_calc_crc (data, self->frame_size - 2, NULL));
+  memcpy (data + self->frame_size - 2, &value, 2);
+
+  return self->frame_size;
+}
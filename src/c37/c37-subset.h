@@ -0,0 +1,54 @@
+/* c37-subset.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef C37_SUBSET_H
+#define C37_SUBSET_H
+
+
+#include "c37-common.h"
+#include "c37-conf.h"
+
+typedef struct _CtsSubset CtsSubset;
+
+CtsSubset *cts_subset_new  (CtsConf   *source);
+void       cts_subset_free (CtsSubset *self);
+
+bool cts_subset_add_pmu     (CtsSubset *self,
+                             uint16_t   pmu_index);
+bool cts_subset_add_phasor  (CtsSubset *self,
+                             uint16_t   pmu_index,
+                             uint16_t   phasor_index);
+bool cts_subset_add_analog  (CtsSubset *self,
+                             uint16_t   pmu_index,
+                             uint16_t   analog_index);
+bool cts_subset_add_digital (CtsSubset *self,
+                             uint16_t   pmu_index,
+                             uint16_t   status_index);
+bool cts_subset_parse       (CtsSubset  *self,
+                             const char *spec,
+                             size_t      length);
+void cts_subset_invalidate  (CtsSubset *self);
+
+CtsConf  *cts_subset_get_conf       (CtsSubset *self);
+uint16_t  cts_subset_get_frame_size (CtsSubset *self);
+uint16_t  cts_subset_write_frame    (CtsSubset  *self,
+                                     const byte *frame,
+                                     byte       *data);
+
+
+#endif /* C37_SUBSET_H */
@@ -0,0 +1,896 @@
+/* c37-view.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "c37-view.h"
+#include "c37-data.h"
+
+/*
+ * Where everything of a data frame is, found once from the
+ * configuration, so that a frame can be read where it was received
+ * without copying. Offsets are from SYNC.
+ */
+
+typedef struct
+{
+  uint16_t id_code;
+
+  uint16_t stat_offset;
+  uint16_t phasor_offset;
+  uint16_t freq_offset;
+  uint16_t analog_offset;
+  uint16_t status_offset;
+  uint16_t end_offset;
+
+  uint16_t num_phasors;
+  uint16_t num_analogs;
+  uint16_t num_status_words;
+
+  bool phasor_is_float;
+  bool phasor_is_polar;
+  bool freq_is_float;
+  bool analog_is_float;
+
+  uint16_t nominal_freq;
+
+  /* Units per bit of integer values */
+  float *phasor_scale;
+  float *analog_scale;
+} CtsPmuLayout;
+
+struct _CtsDataLayout
+{
+  uint16_t id_code;
+  uint16_t frame_size;
+  uint32_t time_base;
+  uint16_t num_pmu;
+
+  CtsPmuLayout *pmu;
+  float *scales;
+};
+
+static inline uint16_t
+get_uint16 (const byte *data)
+{
+  return (uint16_t) (data[0] << 8 | data[1]);
+}
+
+static inline uint32_t
+get_uint32 (const byte *data)
+{
+  return (uint32_t) data[0] << 24 | (uint32_t) data[1] << 16 |
+         (uint32_t) data[2] << 8 | data[3];
+}
+
+static inline float
+get_float (const byte *data)
+{
+  uint32_t bits = get_uint32 (data);
+  float value;
+
+  memcpy (&value, &bits, 4);
+
+  return value;
+}
+
+/* As in c37-data.c, a factor of 0 is taken as 1 unit per bit */
+static float
+get_conv_factor (uint32_t conv_factor)
+{
+  if (conv_factor == 0)
+    conv_factor = 100000;
+
+  return conv_factor * 1e-5f;
+}
+
+/**
+ * cts_data_layout_new:
+ * @config: The CFG-2 (or CFG-3) configuration the data frames follow
+ *
+ * Nothing of @config is referred to after this returns.
+ *
+ * Returns: (nullable) (transfer full): A new #CtsDataLayout, or %NULL
+ * if the data frames of @config can't be more than 65535 bytes or out
+ * of memory. Free with cts_data_layout_free().
+ */
+CtsDataLayout *
+cts_data_layout_new (CtsConf *config)
+{
+  CtsDataLayout *self;
+  size_t num_scales = 0;
+  size_t offset;
+  float *scale;
+
+  self = calloc (1, sizeof *self);
+
+  if (self == NULL)
+    return NULL;
+
+  self->id_code = cts_conf_get_id_code (config);
+  self->time_base = cts_conf_get_time_base (config) & 0x00FFFFFF;
+  self->num_pmu = cts_conf_get_num_of_pmu (config);
+  self->pmu = calloc (self->num_pmu ? self->num_pmu : 1, sizeof *self->pmu);
+
+  for (uint16_t i = 1; i <= self->num_pmu; i++)
+    num_scales += cts_conf_get_num_of_phasors_of_pmu (config, i) +
+                  cts_conf_get_num_of_analogs_of_pmu (config, i);
+
+  self->scales = malloc ((num_scales ? num_scales : 1) * sizeof *self->scales);
+
+  if (self->pmu == NULL || self->scales == NULL)
+    {
+      cts_data_layout_free (self);
+      return NULL;
+    }
+
+  /* SYNC, FRAMESIZE, IDCODE, SOC and FRACSEC */
+  offset = DATA_COMMON_SIZE - 2;
+  scale = self->scales;
+
+  for (uint16_t i = 1; i <= self->num_pmu; i++)
+    {
+      CtsPmuLayout *pmu = self->pmu + i - 1;
+
+      pmu->id_code = cts_conf_get_id_code_of_pmu (config, i);
+      pmu->num_phasors = cts_conf_get_num_of_phasors_of_pmu (config, i);
+      pmu->num_analogs = cts_conf_get_num_of_analogs_of_pmu (config, i);
+      pmu->num_status_words = cts_conf_get_num_of_status_of_pmu (config, i);
+      pmu->phasor_is_float = cts_conf_get_phasor_data_type_of_pmu (config, i) == VALUE_TYPE_FLOAT;
+      pmu->phasor_is_polar = cts_conf_get_phasor_complex_type_of_pmu (config, i) == VALUE_TYPE_POLAR;
+      pmu->freq_is_float = cts_conf_get_freq_data_type_of_pmu (config, i) == VALUE_TYPE_FLOAT;
+      pmu->analog_is_float = cts_conf_get_analog_data_type_of_pmu (config, i) == VALUE_TYPE_FLOAT;
+      pmu->nominal_freq = cts_conf_get_nominal_freq_of_pmu (config, i);
+
+      pmu->phasor_scale = scale;
+      for (uint16_t j = 1; j <= pmu->num_phasors; j++)
+        *scale++ = get_conv_factor (cts_conf_get_phasor_conv_of_pmu (config, i, j));
+
+      pmu->analog_scale = scale;
+      for (uint16_t j = 1; j <= pmu->num_analogs; j++)
+        *scale++ = get_conv_factor (cts_conf_get_analog_conv_of_pmu (config, i, j));
+
+      pmu->stat_offset = offset;
+      offset += DATA_COMMON_SIZE_PER_PMU;
+
+      pmu->phasor_offset = offset;
+      offset += (pmu->phasor_is_float ? 8 : 4) * (size_t) pmu->num_phasors;
+
+      pmu->freq_offset = offset;
+      offset += pmu->freq_is_float ? 8 : 4;
+
+      pmu->analog_offset = offset;
+      offset += (pmu->analog_is_float ? 4 : 2) * (size_t) pmu->num_analogs;
+
+      pmu->status_offset = offset;
+      offset += 2 * (size_t) pmu->num_status_words;
+
+      if (offset + 2 > UINT16_MAX)
+        {
+          cts_data_layout_free (self);
+          return NULL;
+        }
+
+      pmu->end_offset = offset;
+    }
+
+  self->frame_size = offset + 2;
+
+  return self;
+}
+
+void
+cts_data_layout_free (CtsDataLayout *self)
+{
+  if (self == NULL)
+    return;
+
+  free (self->pmu);
+  free (self->scales);
+  free (self);
+}
+
+uint16_t
+cts_data_layout_get_id_code (const CtsDataLayout *self)
+{
+  return self->id_code;
+}
+
+uint16_t
+cts_data_layout_get_frame_size (const CtsDataLayout *self)
+{
+  return self->frame_size;
+}
+
+uint32_t
+cts_data_layout_get_time_base (const CtsDataLayout *self)
+{
+  return self->time_base;
+}
+
+uint16_t
+cts_data_layout_get_num_of_pmu (const CtsDataLayout *self)
+{
+  return self->num_pmu;
+}
+
+uint16_t
+cts_data_layout_get_id_code_of_pmu (const CtsDataLayout *self,
+                                    uint16_t             pmu_index)
+{
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return 0;
+
+  return self->pmu[pmu_index - 1].id_code;
+}
+
+uint16_t
+cts_data_layout_get_num_of_phasors_of_pmu (const CtsDataLayout *self,
+                                           uint16_t             pmu_index)
+{
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return 0;
+
+  return self->pmu[pmu_index - 1].num_phasors;
+}
+
+uint16_t
+cts_data_layout_get_num_of_analogs_of_pmu (const CtsDataLayout *self,
+                                           uint16_t             pmu_index)
+{
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return 0;
+
+  return self->pmu[pmu_index - 1].num_analogs;
+}
+
+uint16_t
+cts_data_layout_get_num_of_status_of_pmu (const CtsDataLayout *self,
+                                          uint16_t             pmu_index)
+{
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return 0;
+
+  return self->pmu[pmu_index - 1].num_status_words;
+}
+
+/**
+ * cts_data_layout_find_pmu:
+ * @self: A #CtsDataLayout
+ * @id_code: The ID code of a PMU
+ *
+ * Returns: The index of the PMU with @id_code, starting from 1, or 0
+ * if there is none.
+ */
+uint16_t
+cts_data_layout_find_pmu (const CtsDataLayout *self,
+                          uint16_t             id_code)
+{
+  for (uint16_t i = 0; i < self->num_pmu; i++)
+    if (self->pmu[i].id_code == id_code)
+      return i + 1;
+
+  return 0;
+}
+
+/**
+ * cts_data_layout_get_block_of_pmu:
+ * @self: A #CtsDataLayout
+ * @pmu_index: The index of PMU, starting from 1
+ * @offset: (out): Return location for the offset of STAT of the PMU
+ * @size: (out): Return location for the size of the data of the PMU
+ *
+ * See cts_data_view_get_block_of_pmu().
+ *
+ * Returns: %true if @pmu_index is valid, %false otherwise.
+ */
+bool
+cts_data_layout_get_block_of_pmu (const CtsDataLayout *self,
+                                  uint16_t             pmu_index,
+                                  uint16_t            *offset,
+                                  uint16_t            *size)
+{
+  const CtsPmuLayout *pmu;
+
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  pmu = self->pmu + pmu_index - 1;
+  *offset = pmu->stat_offset;
+  *size = pmu->end_offset - pmu->stat_offset;
+
+  return true;
+}
+
+static inline byte *
+put_uint16 (byte     *data,
+            uint16_t  value)
+{
+  data[0] = value >> 8;
+  data[1] = value & 0xFF;
+
+  return data + 2;
+}
+
+static inline byte *
+put_float (byte  *data,
+           float  value)
+{
+  uint32_t bits;
+
+  memcpy (&bits, &value, 4);
+  data = put_uint16 (data, bits >> 16);
+
+  return put_uint16 (data, bits & 0xFFFF);
+}
+
+/**
+ * cts_data_layout_write_absent:
+ * @self: A #CtsDataLayout
+ * @pmu_index: The index of PMU, starting from 1
+ * @frame: A data frame of cts_data_layout_get_frame_size() bytes
+ *
+ * Mark the data of the PMU in @frame as absent, as a PDC does for a
+ * PMU whose data did not arrive in time: STAT is set to
+ * %STAT_DATA_ABSENT, values to NaN if floats and to 0x8000 if
+ * integers, and digital status words to 0.
+ */
+void
+cts_data_layout_write_absent (const CtsDataLayout *self,
+                              uint16_t             pmu_index,
+                              byte                *frame)
+{
+  const CtsPmuLayout *pmu;
+  byte *data;
+
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return;
+
+  pmu = self->pmu + pmu_index - 1;
+  data = put_uint16 (frame + pmu->stat_offset, STAT_DATA_ABSENT);
+
+  for (uint32_t i = 0; i < 2 * (uint32_t) pmu->num_phasors; i++)
+    data = pmu->phasor_is_float ? put_float (data, NAN) : put_uint16 (data, 0x8000);
+
+  for (int i = 0; i < 2; i++)
+    data = pmu->freq_is_float ? put_float (data, NAN) : put_uint16 (data, 0x8000);
+
+  for (uint16_t i = 0; i < pmu->num_analogs; i++)
+    data = pmu->analog_is_float ? put_float (data, NAN) : put_uint16 (data, 0x8000);
+
+  memset (data, 0, 2 * (size_t) pmu->num_status_words);
+}
+
+/* Round to the nearest integer that fits, as a PMU does on overflow */
+static inline uint16_t
+to_int16 (float value)
+{
+  if (!(value > -32767.5f))
+    return value != value ? 0x8000 : (uint16_t) -32767;
+
+  if (value >= 32766.5f)
+    return 32767;
+
+  return (uint16_t) (int16_t) lrintf (value);
+}
+
+static inline uint16_t
+to_uint16 (float value)
+{
+  if (!(value > 0))
+    return 0;
+
+  if (value >= 65534.5f)
+    return 65535;
+
+  return (uint16_t) lrintf (value);
+}
+
+/**
+ * cts_data_layout_write_common:
+ * @self: A #CtsDataLayout
+ * @time: The timestamp of the frame
+ * @frame: A data frame of cts_data_layout_get_frame_size() bytes
+ *
+ * Write SYNC, FRAMESIZE, IDCODE, SOC and FRACSEC of @frame. Together
+ * with the other cts_data_layout_write_*() functions, a frame can be
+ * built in place, without a #CtsData, one value at a time; or built
+ * once and only the values that change written again for each frame.
+ */
+void
+cts_data_layout_write_common (const CtsDataLayout *self,
+                              const CtsTime       *time,
+                              byte                *frame)
+{
+  uint32_t frac_of_second;
+
+  frac_of_second = (uint64_t) time->nanoseconds * self->time_base / 1000000000;
+  frac_of_second |= (uint32_t) time->time_quality << 24;
+
+  put_uint16 (frame, SYNC_DATA);
+  put_uint16 (frame + 2, self->frame_size);
+  put_uint16 (frame + 4, self->id_code);
+  put_uint16 (frame + 6, time->soc >> 16);
+  put_uint16 (frame + 8, time->soc & 0xFFFF);
+  put_uint16 (frame + 10, frac_of_second >> 16);
+  put_uint16 (frame + 12, frac_of_second & 0xFFFF);
+}
+
+bool
+cts_data_layout_write_stat_of_pmu (const CtsDataLayout *self,
+                                   uint16_t             pmu_index,
+                                   uint16_t             stat,
+                                   byte                *frame)
+{
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  put_uint16 (frame + self->pmu[pmu_index - 1].stat_offset, stat);
+
+  return true;
+}
+
+/**
+ * cts_data_layout_write_phasor_of_pmu:
+ * @self: A #CtsDataLayout
+ * @pmu_index: The index of PMU, starting from 1
+ * @phasor_index: The index of phasor, starting from 1
+ * @real: The real part, in real world units
+ * @imaginary: The imaginary part, in real world units
+ * @frame: A data frame of cts_data_layout_get_frame_size() bytes
+ *
+ * The reverse of cts_data_view_get_phasor_of_pmu(): the phasor is
+ * converted to the format of the PMU. Integers out of range are
+ * clamped.
+ *
+ * Returns: %true if the value was written, %false otherwise.
+ */
+bool
+cts_data_layout_write_phasor_of_pmu (const CtsDataLayout *self,
+                                     uint16_t             pmu_index,
+                                     uint16_t             phasor_index,
+                                     float                real,
+                                     float                imaginary,
+                                     byte                *frame)
+{
+  const CtsPmuLayout *pmu;
+  float first = real, second = imaginary;
+  byte *data;
+
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  pmu = self->pmu + pmu_index - 1;
+
+  if (phasor_index == 0 || phasor_index > pmu->num_phasors)
+    return false;
+
+  phasor_index--;
+
+  if (pmu->phasor_is_polar)
+    {
+      first = hypotf (real, imaginary);
+      second = atan2f (imaginary, real);
+    }
+
+  if (pmu->phasor_is_float)
+    {
+      data = put_float (frame + pmu->phasor_offset + 8 * phasor_index, first);
+      put_float (data, second);
+    }
+  else
+    {
+      float scale = pmu->phasor_scale[phasor_index];
+
+      data = frame + pmu->phasor_offset + 4 * phasor_index;
+
+      if (pmu->phasor_is_polar)
+        {
+          data = put_uint16 (data, to_uint16 (first / scale));
+          put_uint16 (data, to_int16 (second * 1e4f));
+        }
+      else
+        {
+          data = put_uint16 (data, to_int16 (first / scale));
+          put_uint16 (data, to_int16 (second / scale));
+        }
+    }
+
+  return true;
+}
+
+/**
+ * cts_data_layout_write_freq_of_pmu:
+ * @self: A #CtsDataLayout
+ * @pmu_index: The index of PMU, starting from 1
+ * @freq: The frequency in Hz
+ * @rocof: ROCOF in Hz per second
+ * @frame: A data frame of cts_data_layout_get_frame_size() bytes
+ *
+ * Returns: %true if the values were written, %false otherwise.
+ */
+bool
+cts_data_layout_write_freq_of_pmu (const CtsDataLayout *self,
+                                   uint16_t             pmu_index,
+                                   float                freq,
+                                   float                rocof,
+                                   byte                *frame)
+{
+  const CtsPmuLayout *pmu;
+  byte *data;
+
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  pmu = self->pmu + pmu_index - 1;
+  data = frame + pmu->freq_offset;
+
+  if (pmu->freq_is_float)
+    {
+      data = put_float (data, freq);
+      put_float (data, rocof);
+    }
+  else
+    {
+      data = put_uint16 (data, to_int16 ((freq - pmu->nominal_freq) * 1000.0f));
+      put_uint16 (data, to_int16 (rocof * 100.0f));
+    }
+
+  return true;
+}
+
+bool
+cts_data_layout_write_analog_of_pmu (const CtsDataLayout *self,
+                                     uint16_t             pmu_index,
+                                     uint16_t             analog_index,
+                                     float                value,
+                                     byte                *frame)
+{
+  const CtsPmuLayout *pmu;
+
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  pmu = self->pmu + pmu_index - 1;
+
+  if (analog_index == 0 || analog_index > pmu->num_analogs)
+    return false;
+
+  analog_index--;
+
+  if (pmu->analog_is_float)
+    put_float (frame + pmu->analog_offset + 4 * analog_index, value);
+  else
+    put_uint16 (frame + pmu->analog_offset + 2 * analog_index,
+                to_int16 (value / pmu->analog_scale[analog_index]));
+
+  return true;
+}
+
+bool
+cts_data_layout_write_status_word_of_pmu (const CtsDataLayout *self,
+                                          uint16_t             pmu_index,
+                                          uint16_t             status_word_index,
+                                          uint16_t             status_word,
+                                          byte                *frame)
+{
+  const CtsPmuLayout *pmu;
+
+  if (pmu_index == 0 || pmu_index > self->num_pmu)
+    return false;
+
+  pmu = self->pmu + pmu_index - 1;
+
+  if (status_word_index == 0 || status_word_index > pmu->num_status_words)
+    return false;
+
+  put_uint16 (frame + pmu->status_offset + 2 * (status_word_index - 1), status_word);
+
+  return true;
+}
+
+/**
+ * cts_data_layout_write_crc:
+ * @self: A #CtsDataLayout
+ * @frame: A data frame of cts_data_layout_get_frame_size() bytes
+ *
+ * Write CHK of @frame, once everything else in it is.
+ */
+void
+cts_data_layout_write_crc (const CtsDataLayout *self,
+                           byte                *frame)
+{
+  put_uint16 (frame + self->frame_size - 2,
+              cts_common_calc_crc (frame, self->frame_size - 2, NULL));
+}
+
+/**
+ * cts_data_view_init:
+ * @view: The view to initialize
+ * @layout: The layout of the data frames
+ * @frame: A data frame, from SYNC
+ * @size: The number of bytes in @frame, at least
+ *
+ * Check that @frame is a data frame (of any version) of the size
+ * @layout tells, and view it. The ID code and CHK are not checked.
+ *
+ * Returns: %true if @frame can be read with @view, %false otherwise.
+ */
+bool
+cts_data_view_init (CtsDataView         *view,
+                    const CtsDataLayout *layout,
+                    const byte          *frame,
+                    size_t               size)
+{
+  if (size < layout->frame_size ||
+      frame[0] != CTS_TYPE_SYNC ||
+      (frame[1] & 0x70) != (CTS_TYPE_DATA & 0x70) ||
+      get_uint16 (frame + 2) != layout->frame_size)
+    return false;
+
+  view->layout = layout;
+  view->frame = frame;
+
+  return true;
+}
+
+uint16_t
+cts_data_view_get_id_code (const CtsDataView *view)
+{
+  return get_uint16 (view->frame + 4);
+}
+
+uint32_t
+cts_data_view_get_soc (const CtsDataView *view)
+{
+  return get_uint32 (view->frame + 6);
+}
+
+/**
+ * cts_data_view_get_frac_of_second:
+ * @view: A #CtsDataView
+ *
+ * Returns: FRACSEC, the time quality byte included.
+ */
+uint32_t
+cts_data_view_get_frac_of_second (const CtsDataView *view)
+{
+  return get_uint32 (view->frame + 10);
+}
+
+/**
+ * cts_data_view_get_time:
+ * @view: A #CtsDataView
+ * @time: (out): Return location for the timestamp of the frame
+ */
+void
+cts_data_view_get_time (const CtsDataView *view,
+                        CtsTime           *time)
+{
+  uint32_t frac_of_second = cts_data_view_get_frac_of_second (view);
+  uint32_t time_base = view->layout->time_base;
+
+  time->soc = cts_data_view_get_soc (view);
+  time->time_quality = frac_of_second >> 24;
+  time->nanoseconds = 0;
+
+  if (time_base)
+    time->nanoseconds = (uint64_t) (frac_of_second & 0x00FFFFFF) * 1000000000 / time_base;
+}
+
+static const CtsPmuLayout *
+get_pmu_layout (const CtsDataView *view,
+                uint16_t           pmu_index)
+{
+  if (pmu_index == 0 || pmu_index > view->layout->num_pmu)
+    return NULL;
+
+  return view->layout->pmu + pmu_index - 1;
+}
+
+/**
+ * cts_data_view_get_stat_of_pmu:
+ * @view: A #CtsDataView
+ * @pmu_index: The index of PMU, starting from 1
+ *
+ * Returns: The STAT word of the PMU, or 0 if @pmu_index is invalid.
+ */
+uint16_t
+cts_data_view_get_stat_of_pmu (const CtsDataView *view,
+                               uint16_t           pmu_index)
+{
+  const CtsPmuLayout *pmu = get_pmu_layout (view, pmu_index);
+
+  if (pmu == NULL)
+    return 0;
+
+  return get_uint16 (view->frame + pmu->stat_offset);
+}
+
+/**
+ * cts_data_view_get_phasor_of_pmu:
+ * @view: A #CtsDataView
+ * @pmu_index: The index of PMU, starting from 1
+ * @phasor_index: The index of phasor, starting from 1
+ * @real: (out): Return location for the real part
+ * @imaginary: (out): Return location for the imaginary part
+ *
+ * Like cts_data_get_phasor_of_pmu(), the phasor is in real world
+ * units and rectangular form whatever be the format in the frame.
+ *
+ * Returns: %true if the value was got, %false otherwise.
+ */
+bool
+cts_data_view_get_phasor_of_pmu (const CtsDataView *view,
+                                 uint16_t           pmu_index,
+                                 uint16_t           phasor_index,
+                                 float             *real,
+                                 float             *imaginary)
+{
+  const CtsPmuLayout *pmu = get_pmu_layout (view, pmu_index);
+  const byte *data;
+  float first, second;
+
+  if (pmu == NULL || phasor_index == 0 || phasor_index > pmu->num_phasors)
+    return false;
+
+  phasor_index--;
+
+  if (pmu->phasor_is_float)
+    {
+      data = view->frame + pmu->phasor_offset + 8 * phasor_index;
+      first = get_float (data);
+      second = get_float (data + 4);
+    }
+  else
+    {
+      float scale = pmu->phasor_scale[phasor_index];
+
+      data = view->frame + pmu->phasor_offset + 4 * phasor_index;
+
+      if (pmu->phasor_is_polar)
+        {
+          /* Magnitude is unsigned, angle is in radians * 10^4 */
+          first = get_uint16 (data) * scale;
+          second = (int16_t) get_uint16 (data + 2) * 1e-4f;
+        }
+      else
+        {
+          first = (int16_t) get_uint16 (data) * scale;
+          second = (int16_t) get_uint16 (data + 2) * scale;
+        }
+    }
+
+  if (pmu->phasor_is_polar)
+    {
+      *real = first * cosf (second);
+      *imaginary = first * sinf (second);
+    }
+  else
+    {
+      *real = first;
+      *imaginary = second;
+    }
+
+  return true;
+}
+
+/**
+ * cts_data_view_get_freq_of_pmu:
+ * @view: A #CtsDataView
+ * @pmu_index: The index of PMU, starting from 1
+ * @freq: (out): Return location for the frequency in Hz
+ * @rocof: (out): Return location for ROCOF in Hz per second
+ *
+ * See cts_data_get_freq_of_pmu().
+ *
+ * Returns: %true if the values were got, %false otherwise.
+ */
+bool
+cts_data_view_get_freq_of_pmu (const CtsDataView *view,
+                               uint16_t           pmu_index,
+                               float             *freq,
+                               float             *rocof)
+{
+  const CtsPmuLayout *pmu = get_pmu_layout (view, pmu_index);
+  const byte *data;
+
+  if (pmu == NULL)
+    return false;
+
+  data = view->frame + pmu->freq_offset;
+
+  if (pmu->freq_is_float)
+    {
+      *freq = get_float (data);
+      *rocof = get_float (data + 4);
+    }
+  else
+    {
+      *freq = pmu->nominal_freq + (int16_t) get_uint16 (data) / 1000.0f;
+      *rocof = (int16_t) get_uint16 (data + 2) / 100.0f;
+    }
+
+  return true;
+}
+
+bool
+cts_data_view_get_analog_of_pmu (const CtsDataView *view,
+                                 uint16_t           pmu_index,
+                                 uint16_t           analog_index,
+                                 float             *value)
+{
+  const CtsPmuLayout *pmu = get_pmu_layout (view, pmu_index);
+
+  if (pmu == NULL || analog_index == 0 || analog_index > pmu->num_analogs)
+    return false;
+
+  analog_index--;
+
+  if (pmu->analog_is_float)
+    *value = get_float (view->frame + pmu->analog_offset + 4 * analog_index);
+  else
+    *value = (int16_t) get_uint16 (view->frame + pmu->analog_offset + 2 * analog_index) *
+             pmu->analog_scale[analog_index];
+
+  return true;
+}
+
+bool
+cts_data_view_get_status_word_of_pmu (const CtsDataView *view,
+                                      uint16_t           pmu_index,
+                                      uint16_t           status_word_index,
+                                      uint16_t          *status_word)
+{
+  const CtsPmuLayout *pmu = get_pmu_layout (view, pmu_index);
+
+  if (pmu == NULL || status_word_index == 0 ||
+      status_word_index > pmu->num_status_words)
+    return false;
+
+  *status_word = get_uint16 (view->frame + pmu->status_offset +
+                             2 * (status_word_index - 1));
+
+  return true;
+}
+
+/**
+ * cts_data_view_get_block_of_pmu:
+ * @view: A #CtsDataView
+ * @pmu_index: The index of PMU, starting from 1
+ * @size: (out): Return location for the size of the block
+ *
+ * Get everything of a PMU in the frame, from STAT to the last
+ * digital status word, as it is. Useful to pass the data on without
+ * decoding.
+ *
+ * Returns: (nullable) (transfer none): The block of the PMU in the
+ * frame, or %NULL if @pmu_index is invalid.
+ */
+const byte *
+cts_data_view_get_block_of_pmu (const CtsDataView *view,
+                                uint16_t           pmu_index,
+                                uint16_t          *size)
+{
+  const CtsPmuLayout *pmu = get_pmu_layout (view, pmu_index);
+
+  if (pmu == NULL)
+    return NULL;
+
+  *size = pmu->end_offset - pmu->stat_offset;
+
+  return view->frame + pmu->stat_offset;
+}
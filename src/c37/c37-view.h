@@ -0,0 +1,129 @@
+/* c37-view.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef C37_VIEW_H
+#define C37_VIEW_H
+
+
+#include "c37-common.h"
+#include "c37-conf.h"
+
+typedef struct _CtsDataLayout CtsDataLayout;
+
+/*
+ * A data frame, read in place. Valid as long as both the layout and
+ * the frame are.
+ */
+typedef struct _CtsDataView
+{
+  const CtsDataLayout *layout;
+  const byte          *frame;
+} CtsDataView;
+
+CtsDataLayout *cts_data_layout_new  (CtsConf       *config);
+void           cts_data_layout_free (CtsDataLayout *self);
+
+uint16_t cts_data_layout_get_id_code        (const CtsDataLayout *self);
+uint16_t cts_data_layout_get_frame_size     (const CtsDataLayout *self);
+uint32_t cts_data_layout_get_time_base      (const CtsDataLayout *self);
+uint16_t cts_data_layout_get_num_of_pmu     (const CtsDataLayout *self);
+uint16_t cts_data_layout_get_id_code_of_pmu (const CtsDataLayout *self,
+                                             uint16_t             pmu_index);
+uint16_t cts_data_layout_get_num_of_phasors_of_pmu (const CtsDataLayout *self,
+                                                    uint16_t             pmu_index);
+uint16_t cts_data_layout_get_num_of_analogs_of_pmu (const CtsDataLayout *self,
+                                                    uint16_t             pmu_index);
+uint16_t cts_data_layout_get_num_of_status_of_pmu  (const CtsDataLayout *self,
+                                                    uint16_t             pmu_index);
+uint16_t cts_data_layout_find_pmu           (const CtsDataLayout *self,
+                                             uint16_t             id_code);
+bool     cts_data_layout_get_block_of_pmu   (const CtsDataLayout *self,
+                                             uint16_t             pmu_index,
+                                             uint16_t            *offset,
+                                             uint16_t            *size);
+void     cts_data_layout_write_absent       (const CtsDataLayout *self,
+                                             uint16_t             pmu_index,
+                                             byte                *frame);
+
+void     cts_data_layout_write_common       (const CtsDataLayout *self,
+                                             const CtsTime       *time,
+                                             byte                *frame);
+bool     cts_data_layout_write_stat_of_pmu  (const CtsDataLayout *self,
+                                             uint16_t             pmu_index,
+                                             uint16_t             stat,
+                                             byte                *frame);
+bool     cts_data_layout_write_phasor_of_pmu (const CtsDataLayout *self,
+                                              uint16_t             pmu_index,
+                                              uint16_t             phasor_index,
+                                              float                real,
+                                              float                imaginary,
+                                              byte                *frame);
+bool     cts_data_layout_write_freq_of_pmu   (const CtsDataLayout *self,
+                                              uint16_t             pmu_index,
+                                              float                freq,
+                                              float                rocof,
+                                              byte                *frame);
+bool     cts_data_layout_write_analog_of_pmu (const CtsDataLayout *self,
+                                              uint16_t             pmu_index,
+                                              uint16_t             analog_index,
+                                              float                value,
+                                              byte                *frame);
+bool     cts_data_layout_write_status_word_of_pmu (const CtsDataLayout *self,
+                                                   uint16_t             pmu_index,
+                                                   uint16_t             status_word_index,
+                                                   uint16_t             status_word,
+                                                   byte                *frame);
+void     cts_data_layout_write_crc          (const CtsDataLayout *self,
+                                             byte                *frame);
+
+bool     cts_data_view_init                 (CtsDataView         *view,
+                                             const CtsDataLayout *layout,
+                                             const byte          *frame,
+                                             size_t               size);
+
+uint16_t cts_data_view_get_id_code          (const CtsDataView *view);
+uint32_t cts_data_view_get_soc              (const CtsDataView *view);
+uint32_t cts_data_view_get_frac_of_second   (const CtsDataView *view);
+void     cts_data_view_get_time             (const CtsDataView *view,
+                                             CtsTime           *time);
+
+uint16_t cts_data_view_get_stat_of_pmu        (const CtsDataView *view,
+                                               uint16_t           pmu_index);
+bool     cts_data_view_get_phasor_of_pmu      (const CtsDataView *view,
+                                               uint16_t           pmu_index,
+                                               uint16_t           phasor_index,
+                                               float             *real,
+                                               float             *imaginary);
+bool     cts_data_view_get_freq_of_pmu        (const CtsDataView *view,
+                                               uint16_t           pmu_index,
+                                               float             *freq,
+                                               float             *rocof);
+bool     cts_data_view_get_analog_of_pmu      (const CtsDataView *view,
+                                               uint16_t           pmu_index,
+                                               uint16_t           analog_index,
+                                               float             *value);
+bool     cts_data_view_get_status_word_of_pmu (const CtsDataView *view,
+                                               uint16_t           pmu_index,
+                                               uint16_t           status_word_index,
+                                               uint16_t          *status_word);
+const byte *cts_data_view_get_block_of_pmu    (const CtsDataView *view,
+                                               uint16_t           pmu_index,
+                                               uint16_t          *size);
+
+
+#endif /* C37_VIEW_H */
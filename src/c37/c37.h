@@ -26,6 +26,11 @@
 #include "c37-header.h"
 #include "c37-data.h"
 #include "c37-bin.h"
+#include "c37-subset.h"
+#include "c37-view.h"
+#include "c37-align.h"
+#include "c37-ingest.h"
+#include "c37-client.h"
 
 
 #endif /* C37_H */
@@ -0,0 +1,118 @@
+/* dsp-common.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dsp-common.h"
+
+/**
+ * dsp_v4sf_atan2:
+ * @y: The imaginary parts
+ * @x: The real parts
+ *
+ * Same as atan2f() on each lane, with an error below 5e-7 radians.
+ * atan2 (0, 0) is 0.
+ *
+ * Returns: The angles in radians, in [-pi, pi]
+ */
+dsp_v4sf
+dsp_v4sf_atan2 (dsp_v4sf y,
+                dsp_v4sf x)
+{
+  const dsp_v4sf zero = { 0 };
+  const dsp_v4sf one = dsp_v4sf_set1 (1.0f);
+  dsp_v4sf ax, ay, num, den, t, t2, angle, poly;
+  dsp_v4si swap, reduce;
+
+  ax = dsp_v4sf_abs (x);
+  ay = dsp_v4sf_abs (y);
+
+  /* Fold to the first octant, t = tan (angle) in [0, 1] */
+  swap = ay > ax;
+  num = dsp_v4sf_select (swap, ax, ay);
+  den = dsp_v4sf_select (swap, ay, ax);
+  den = dsp_v4sf_select (den == zero, one, den);
+  t = num / den;
+
+  /* atan (t) = pi/4 + atan ((t - 1) / (t + 1)), to get |t| <= tan (pi/8) */
+  reduce = t > dsp_v4sf_set1 (0.41421356f);
+  t = dsp_v4sf_select (reduce, (t - one) / (t + one), t);
+
+  /* Taylor series, the first omitted term is below 2e-8 */
+  t2 = t * t;
+  poly = dsp_v4sf_set1 (-1.0f / 15);
+  poly = poly * t2 + 1.0f / 13;
+  poly = poly * t2 - 1.0f / 11;
+  poly = poly * t2 + 1.0f / 9;
+  poly = poly * t2 - 1.0f / 7;
+  poly = poly * t2 + 1.0f / 5;
+  poly = poly * t2 - 1.0f / 3;
+  poly = poly * t2 + 1.0f;
+  angle = poly * t;
+
+  angle = dsp_v4sf_select (reduce, angle + (float) (M_PI / 4), angle);
+  angle = dsp_v4sf_select (swap, (float) (M_PI / 2) - angle, angle);
+  angle = dsp_v4sf_select (x < zero, (float) M_PI - angle, angle);
+
+  /* Copy the sign of y */
+  return (dsp_v4sf) ((dsp_v4si) angle | ((dsp_v4si) y & (int32_t) 0x80000000));
+}
+
+/**
+ * dsp_malloc_aligned:
+ * @size: size of memory in bytes
+ *
+ * Allocate memory suitable for vector loads and stores. malloc()
+ * guarantees only 8 byte alignment on 32 bit ARM, which isn't enough
+ * for a #dsp_v4sf. Free with free().
+ *
+ * Returns: A pointer to the memory or %NULL on error.
+ */
+void *
+dsp_malloc_aligned (size_t size)
+{
+  void *mem = NULL;
+
+  /* Round up, so that the last vector never reads beyond */
+  size = (size + DSP_ALIGNMENT - 1) & ~(size_t)(DSP_ALIGNMENT - 1);
+
+  if (posix_memalign (&mem, DSP_ALIGNMENT, size ? size : DSP_ALIGNMENT))
+    return NULL;
+
+  return mem;
+}
+
+/**
+ * dsp_calloc_aligned:
+ * @size: size of memory in bytes
+ *
+ * Same as dsp_malloc_aligned(), but the memory is set to zero.
+ *
+ * Returns: A pointer to the memory or %NULL on error.
+ */
+void *
+dsp_calloc_aligned (size_t size)
+{
+  void *mem;
+
+  size = (size + DSP_ALIGNMENT - 1) & ~(size_t)(DSP_ALIGNMENT - 1);
+  mem = dsp_malloc_aligned (size);
+
+  if (mem)
+    memset (mem, 0, size);
+
+  return mem;
+}
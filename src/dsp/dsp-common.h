@@ -0,0 +1,82 @@
+/* dsp-common.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DSP_COMMON_H
+#define DSP_COMMON_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/*
+ * 4 floats processed at once. GCC and clang map this to NEON on ARM
+ * and SSE on x86, and to plain scalar code elsewhere, so the kernels
+ * are written once.
+ *
+ * Kernels work on "lanes": Independent signals (channels, PMUs) are
+ * packed 4 to a vector, and the vectors are processed one after the
+ * other.
+ */
+typedef float dsp_v4sf __attribute__ ((vector_size (16)));
+
+/* Result of comparing two dsp_v4sf: -1 (all bits set) where true */
+typedef int32_t dsp_v4si __attribute__ ((vector_size (16)));
+
+#define DSP_LANES 4
+#define DSP_ALIGNMENT 16
+
+/* Number of vectors needed for @count lanes */
+#define DSP_NUM_VECTORS(count) (((count) + DSP_LANES - 1) / DSP_LANES)
+
+static inline dsp_v4sf
+dsp_v4sf_set1 (float value)
+{
+  return (dsp_v4sf) { value, value, value, value };
+}
+
+/* @mask ? @a : @b, lane by lane */
+static inline dsp_v4sf
+dsp_v4sf_select (dsp_v4si mask,
+                 dsp_v4sf a,
+                 dsp_v4sf b)
+{
+  return (dsp_v4sf) ((mask & (dsp_v4si) a) | (~mask & (dsp_v4si) b));
+}
+
+static inline dsp_v4sf
+dsp_v4sf_abs (dsp_v4sf value)
+{
+  return (dsp_v4sf) ((dsp_v4si) value & 0x7fffffff);
+}
+
+dsp_v4sf dsp_v4sf_atan2 (dsp_v4sf y,
+                         dsp_v4sf x);
+
+void *dsp_malloc_aligned (size_t size);
+void *dsp_calloc_aligned (size_t size);
+
+
+#endif /* DSP_COMMON_H */
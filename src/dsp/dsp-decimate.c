@@ -0,0 +1,443 @@
+/* dsp-decimate.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dsp-decimate.h"
+
+/*
+ * A bank of decimators that turns a stream of rows (the values of a
+ * frame, say) at the input reporting rate into several lower
+ * reporting rates at once.
+ *
+ * Each output is fed from the output with the lowest rate that is
+ * still higher than it and a multiple of it, or from the input: With
+ * 200 fps in, 50 fps is decimated from 200 and 10 fps from 50. The
+ * lower rates cost little as they share the filtering done for the
+ * higher ones.
+ *
+ * Every stage is a linear phase FIR low pass filter (Hamming windowed
+ * sinc, corner at 0.36 times the output rate) of 2 * HALF_LENGTH * D + 1
+ * taps, for a decimation by D. Only the samples that are kept are
+ * computed, which is what a polyphase decimator does, so a stage costs
+ * (2 * HALF_LENGTH + 1/D) multiply-adds per input sample and lane.
+ *
+ * Rows are labelled with an index at the input rate (frames since the
+ * epoch, say). An output keeps the rows whose instant is a multiple of
+ * its period, so the outputs stay aligned to the top of the second.
+ * As the filters are causal, an output row is of an instant a few
+ * output periods before the input that produced it, see
+ * dsp_decimator_get_delay(). The delay is a whole number of output
+ * periods, so output rows are still on the reporting instants.
+ */
+
+/* Half the length of a filter, in periods of its output */
+#define HALF_LENGTH 6
+
+/* Corner of the filters, relative to the output rate */
+#define CORNER 0.36
+
+#define NO_PARENT ((size_t) -1)
+
+typedef struct
+{
+  unsigned int rate;
+  unsigned int step;    /* output period, in input rows */
+  unsigned int factor;  /* decimation from the parent */
+  unsigned int delay;   /* in input rows, including the parents */
+  size_t parent;        /* the stage feeding this, or NO_PARENT */
+
+  float *taps;
+  size_t num_taps;
+
+  dsp_v4sf *history;    /* 2 * num_taps * num_vectors */
+  size_t position;
+  size_t filled;
+
+  dsp_v4sf *output;     /* num_vectors */
+} Stage;
+
+struct _DspDecimator
+{
+  size_t num_lanes;
+  size_t num_vectors;
+  unsigned int input_rate;
+
+  /* Parents come before their children */
+  Stage stages[DSP_DECIMATE_MAX_OUTPUTS];
+  size_t num_stages;
+
+  /* Stage of each output, in the order given to dsp_decimator_new() */
+  size_t output_stage[DSP_DECIMATE_MAX_OUTPUTS];
+
+  uint64_t next_index;
+  bool started;
+};
+
+static bool
+design_stage (Stage  *stage,
+              size_t  num_vectors)
+{
+  unsigned int factor = stage->factor;
+  double corner = CORNER / factor;
+  double sum = 0;
+  size_t middle;
+
+  stage->num_taps = 2 * HALF_LENGTH * factor + 1;
+  middle = HALF_LENGTH * factor;
+
+  stage->taps = malloc (sizeof *stage->taps * stage->num_taps);
+  stage->history = dsp_calloc_aligned (sizeof *stage->history * num_vectors *
+                                       2 * stage->num_taps);
+
+  if (stage->taps == NULL || stage->history == NULL)
+    return false;
+
+  for (size_t i = 0; i < stage->num_taps; i++)
+    {
+      double k = (double) i - middle;
+      double window = 0.54 - 0.46 * cos (2 * M_PI * i / (stage->num_taps - 1));
+      double value;
+
+      if (i == middle)
+        value = 2 * corner;
+      else
+        value = sin (2 * M_PI * corner * k) / (M_PI * k);
+
+      stage->taps[i] = value * window;
+      sum += stage->taps[i];
+    }
+
+  /* Unity gain at DC */
+  for (size_t i = 0; i < stage->num_taps; i++)
+    stage->taps[i] /= sum;
+
+  return true;
+}
+
+/**
+ * dsp_decimator_new:
+ * @num_lanes: Number of values in a row
+ * @input_rate: Rows per second of the input
+ * @output_rates: Rows per second of each output, each should divide
+ * @input_rate and be lower than it
+ * @num_outputs: Number of outputs, at most %DSP_DECIMATE_MAX_OUTPUTS
+ *
+ * Returns: (transfer full) (nullable): A new #DspDecimator or %NULL if
+ * the rates are invalid or on error. Free with dsp_decimator_free().
+ */
+DspDecimator *
+dsp_decimator_new (size_t          num_lanes,
+                   unsigned int    input_rate,
+                   const unsigned *output_rates,
+                   size_t          num_outputs)
+{
+  DspDecimator *self;
+  size_t order[DSP_DECIMATE_MAX_OUTPUTS];
+
+  if (num_lanes == 0 || input_rate == 0 ||
+      num_outputs == 0 || num_outputs > DSP_DECIMATE_MAX_OUTPUTS)
+    return NULL;
+
+  for (size_t i = 0; i < num_outputs; i++)
+    if (output_rates[i] == 0 || output_rates[i] >= input_rate ||
+        input_rate % output_rates[i] != 0)
+      return NULL;
+
+  self = calloc (1, sizeof *self);
+
+  if (self == NULL)
+    return NULL;
+
+  self->num_lanes = num_lanes;
+  self->num_vectors = DSP_NUM_VECTORS (num_lanes);
+  self->input_rate = input_rate;
+  self->num_stages = num_outputs;
+
+  /* Highest rate first, so that parents are processed first */
+  for (size_t i = 0; i < num_outputs; i++)
+    order[i] = i;
+
+  for (size_t i = 1; i < num_outputs; i++)
+    for (size_t j = i; j > 0 && output_rates[order[j]] > output_rates[order[j - 1]]; j--)
+      {
+        size_t swap = order[j];
+
+        order[j] = order[j - 1];
+        order[j - 1] = swap;
+      }
+
+  for (size_t i = 0; i < num_outputs; i++)
+    {
+      Stage *stage = self->stages + i;
+      unsigned int parent_rate = input_rate;
+      unsigned int parent_delay = 0;
+
+      stage->rate = output_rates[order[i]];
+      stage->step = input_rate / stage->rate;
+      stage->parent = NO_PARENT;
+      self->output_stage[order[i]] = i;
+
+      /* The lowest higher rate that is a multiple, a duplicate rate
+       * is just a copy of the earlier one */
+      for (size_t j = 0; j < i; j++)
+        {
+          Stage *parent = self->stages + j;
+
+          if (parent->rate % stage->rate == 0 && parent->rate <= parent_rate)
+            {
+              stage->parent = j;
+              parent_rate = parent->rate;
+              parent_delay = parent->delay;
+            }
+        }
+
+      stage->factor = parent_rate / stage->rate;
+
+      if (stage->factor == 1)
+        stage->delay = parent_delay;
+      else
+        stage->delay = parent_delay + HALF_LENGTH * stage->step;
+
+      stage->output = dsp_calloc_aligned (sizeof *stage->output * self->num_vectors);
+
+      if (stage->output == NULL ||
+          (stage->factor > 1 && !design_stage (stage, self->num_vectors)))
+        {
+          dsp_decimator_free (self);
+          return NULL;
+        }
+    }
+
+  return self;
+}
+
+void
+dsp_decimator_free (DspDecimator *self)
+{
+  if (self == NULL)
+    return;
+
+  for (size_t i = 0; i < self->num_stages; i++)
+    {
+      free (self->stages[i].taps);
+      free (self->stages[i].history);
+      free (self->stages[i].output);
+    }
+
+  free (self);
+}
+
+/**
+ * dsp_decimator_reset:
+ * @self: A #DspDecimator
+ *
+ * Forget every row. Done by dsp_decimator_process() on a gap in the
+ * input.
+ */
+void
+dsp_decimator_reset (DspDecimator *self)
+{
+  for (size_t i = 0; i < self->num_stages; i++)
+    {
+      self->stages[i].position = 0;
+      self->stages[i].filled = 0;
+    }
+
+  self->started = false;
+}
+
+/**
+ * dsp_decimator_get_row_size:
+ * @self: A #DspDecimator
+ *
+ * Returns: The number of floats in a row, the number of lanes rounded
+ * up to a multiple of %DSP_LANES.
+ */
+size_t
+dsp_decimator_get_row_size (DspDecimator *self)
+{
+  return self->num_vectors * DSP_LANES;
+}
+
+size_t
+dsp_decimator_get_num_outputs (DspDecimator *self)
+{
+  return self->num_stages;
+}
+
+unsigned int
+dsp_decimator_get_rate (DspDecimator *self,
+                        size_t        output)
+{
+  if (output >= self->num_stages)
+    return 0;
+
+  return self->stages[self->output_stage[output]].rate;
+}
+
+/**
+ * dsp_decimator_get_delay:
+ * @self: A #DspDecimator
+ * @output: The output, in the order given to dsp_decimator_new()
+ *
+ * Get how old a row of @output is, when dsp_decimator_process()
+ * reports it. The row is of the instant index - delay, where index
+ * is the one given to dsp_decimator_process().
+ *
+ * Returns: The delay in input rows
+ */
+unsigned int
+dsp_decimator_get_delay (DspDecimator *self,
+                         size_t        output)
+{
+  if (output >= self->num_stages)
+    return 0;
+
+  return self->stages[self->output_stage[output]].delay;
+}
+
+/* Push @row, and compute the output if @keep */
+static bool
+stage_process (Stage          *stage,
+               const dsp_v4sf *row,
+               size_t          num_vectors,
+               bool            keep)
+{
+  size_t num_taps = stage->num_taps;
+  const dsp_v4sf *window;
+
+  /* The ring is stored twice, so the window is always contiguous */
+  memcpy (stage->history + stage->position * num_vectors,
+          row, sizeof *row * num_vectors);
+  memcpy (stage->history + (stage->position + num_taps) * num_vectors,
+          row, sizeof *row * num_vectors);
+
+  window = stage->history + (stage->position + 1) * num_vectors;
+
+  if (++stage->position == num_taps)
+    stage->position = 0;
+
+  if (stage->filled < num_taps)
+    stage->filled++;
+
+  if (!keep || stage->filled < num_taps)
+    return false;
+
+  for (size_t v = 0; v < num_vectors; v++)
+    {
+      dsp_v4sf sum = { 0 };
+
+      for (size_t i = 0; i < num_taps; i++)
+        sum += window[i * num_vectors + v] * stage->taps[i];
+
+      stage->output[v] = sum;
+    }
+
+  return true;
+}
+
+/**
+ * dsp_decimator_process:
+ * @self: A #DspDecimator
+ * @row: The next input row, dsp_decimator_get_row_size() floats
+ * aligned to %DSP_ALIGNMENT
+ * @index: The index of @row, counted at the input rate from the
+ * epoch (or any other top of a second)
+ *
+ * Add a row. If @index doesn't follow the previous one, the filters
+ * are reset, as the rows in between are lost.
+ *
+ * Returns: A bit mask of the outputs (bit i for output i) that have a
+ * new row, see dsp_decimator_get_row().
+ */
+uint32_t
+dsp_decimator_process (DspDecimator *self,
+                       const float  *row,
+                       uint64_t      index)
+{
+  size_t num_vectors = self->num_vectors;
+  bool produced[DSP_DECIMATE_MAX_OUTPUTS];
+  uint32_t mask = 0;
+
+  if (self->started && index != self->next_index)
+    dsp_decimator_reset (self);
+
+  self->started = true;
+  self->next_index = index + 1;
+
+  for (size_t i = 0; i < self->num_stages; i++)
+    {
+      Stage *stage = self->stages + i;
+      const dsp_v4sf *input;
+      uint64_t instant;
+
+      if (stage->parent == NO_PARENT)
+        {
+          input = (const dsp_v4sf *) row;
+          instant = index;
+        }
+      else if (produced[stage->parent])
+        {
+          input = self->stages[stage->parent].output;
+          instant = index - self->stages[stage->parent].delay;
+        }
+      else
+        {
+          produced[i] = false;
+          continue;
+        }
+
+      if (stage->factor == 1)
+        {
+          /* Same rate as the parent */
+          memcpy (stage->output, input, sizeof *input * num_vectors);
+          produced[i] = true;
+          continue;
+        }
+
+      /* Keep the rows on the reporting instants of this rate */
+      produced[i] = stage_process (stage, input, num_vectors,
+                                   instant % stage->step == 0);
+    }
+
+  for (size_t i = 0; i < self->num_stages; i++)
+    if (produced[self->output_stage[i]])
+      mask |= 1u << i;
+
+  return mask;
+}
+
+/**
+ * dsp_decimator_get_row:
+ * @self: A #DspDecimator
+ * @output: The output, in the order given to dsp_decimator_new()
+ *
+ * Get the latest row of @output, valid if the last call to
+ * dsp_decimator_process() reported it.
+ *
+ * Returns: (transfer none): dsp_decimator_get_row_size() floats, or
+ * %NULL if @output is invalid
+ */
+const float *
+dsp_decimator_get_row (DspDecimator *self,
+                       size_t        output)
+{
+  if (output >= self->num_stages)
+    return NULL;
+
+  return (const float *) self->stages[self->output_stage[output]].output;
+}
@@ -0,0 +1,51 @@
+/* dsp-decimate.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DSP_DECIMATE_H
+#define DSP_DECIMATE_H
+
+
+#include "dsp-common.h"
+
+/* Maximum number of output rates of a #DspDecimator */
+#define DSP_DECIMATE_MAX_OUTPUTS 16
+
+typedef struct _DspDecimator DspDecimator;
+
+DspDecimator *dsp_decimator_new   (size_t          num_lanes,
+                                   unsigned int    input_rate,
+                                   const unsigned *output_rates,
+                                   size_t          num_outputs);
+void          dsp_decimator_free  (DspDecimator   *self);
+void          dsp_decimator_reset (DspDecimator   *self);
+
+size_t        dsp_decimator_get_row_size    (DspDecimator *self);
+size_t        dsp_decimator_get_num_outputs (DspDecimator *self);
+unsigned int  dsp_decimator_get_rate        (DspDecimator *self,
+                                             size_t        output);
+unsigned int  dsp_decimator_get_delay       (DspDecimator *self,
+                                             size_t        output);
+
+uint32_t      dsp_decimator_process (DspDecimator *self,
+                                     const float  *row,
+                                     uint64_t      index);
+const float  *dsp_decimator_get_row (DspDecimator *self,
+                                     size_t        output);
+
+
+#endif /* DSP_DECIMATE_H */
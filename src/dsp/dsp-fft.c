@@ -0,0 +1,224 @@
+/* dsp-fft.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dsp-fft.h"
+
+/*
+ * FFT of real signals, 4 at a time: Every sample is a dsp_v4sf with a
+ * signal in each lane, so every butterfly works on 4 signals at once.
+ *
+ * A real FFT of N points is done as a complex FFT of N / 2 points, of
+ * the even samples as the real part and the odd samples as the
+ * imaginary part, split into the spectrum of the real signal after.
+ * The complex FFT is an iterative radix 2 decimation in time one. The
+ * bit reversed order and every twiddle factor are found when created.
+ */
+
+struct _DspFft
+{
+  size_t size;          /* N, real samples */
+  size_t half;          /* N / 2, complex samples */
+
+  size_t *reversed;     /* half, bit reversed indices */
+
+  /* e^(-2 pi j k / half), k < half / 2 */
+  float *twiddle_real;
+  float *twiddle_imaginary;
+
+  /* e^(-2 pi j k / size), k < half, for splitting */
+  float *split_real;
+  float *split_imaginary;
+
+  /* The complex FFT, half each */
+  dsp_v4sf *work_real;
+  dsp_v4sf *work_imaginary;
+};
+
+/**
+ * dsp_fft_new:
+ * @size: Number of real samples, a power of 2 not less than 4
+ *
+ * Returns: (transfer full) (nullable): A new #DspFft, or %NULL if
+ * @size is not valid or out of memory. Free with dsp_fft_free().
+ */
+DspFft *
+dsp_fft_new (size_t size)
+{
+  DspFft *self;
+  size_t bits = 0;
+
+  if (size < 4 || (size & (size - 1)) != 0)
+    return NULL;
+
+  self = calloc (1, sizeof *self);
+
+  if (self == NULL)
+    return NULL;
+
+  self->size = size;
+  self->half = size / 2;
+
+  while (((size_t) 1 << bits) < self->half)
+    bits++;
+
+  self->reversed = malloc (sizeof (size_t) * self->half);
+  self->twiddle_real = malloc (sizeof (float) * self->half / 2);
+  self->twiddle_imaginary = malloc (sizeof (float) * self->half / 2);
+  self->split_real = malloc (sizeof (float) * self->half);
+  self->split_imaginary = malloc (sizeof (float) * self->half);
+  self->work_real = dsp_malloc_aligned (sizeof (dsp_v4sf) * self->half);
+  self->work_imaginary = dsp_malloc_aligned (sizeof (dsp_v4sf) * self->half);
+
+  if (self->reversed == NULL || self->twiddle_real == NULL ||
+      self->twiddle_imaginary == NULL || self->split_real == NULL ||
+      self->split_imaginary == NULL || self->work_real == NULL ||
+      self->work_imaginary == NULL)
+    {
+      dsp_fft_free (self);
+      return NULL;
+    }
+
+  for (size_t i = 0; i < self->half; i++)
+    {
+      size_t reversed = 0;
+
+      for (size_t b = 0; b < bits; b++)
+        if (i & ((size_t) 1 << b))
+          reversed |= (size_t) 1 << (bits - 1 - b);
+
+      self->reversed[i] = reversed;
+    }
+
+  for (size_t k = 0; k < self->half / 2; k++)
+    {
+      double angle = -2 * M_PI * k / self->half;
+
+      self->twiddle_real[k] = cos (angle);
+      self->twiddle_imaginary[k] = sin (angle);
+    }
+
+  for (size_t k = 0; k < self->half; k++)
+    {
+      double angle = -2 * M_PI * k / size;
+
+      self->split_real[k] = cos (angle);
+      self->split_imaginary[k] = sin (angle);
+    }
+
+  return self;
+}
+
+void
+dsp_fft_free (DspFft *self)
+{
+  if (self == NULL)
+    return;
+
+  free (self->reversed);
+  free (self->twiddle_real);
+  free (self->twiddle_imaginary);
+  free (self->split_real);
+  free (self->split_imaginary);
+  free (self->work_real);
+  free (self->work_imaginary);
+  free (self);
+}
+
+size_t
+dsp_fft_get_size (DspFft *self)
+{
+  return self->size;
+}
+
+/**
+ * dsp_fft_process:
+ * @self: A #DspFft
+ * @input: dsp_fft_get_size() samples of 4 signals
+ * @real: Return location for the real part of bins 0 to
+ * dsp_fft_get_size() / 2, both included
+ * @imaginary: Return location for the imaginary part of the bins
+ *
+ * Compute the spectrum of 4 real signals. The bins are not scaled: A
+ * sinusoid of amplitude A in bin k (other than 0 and N / 2) gives a
+ * bin of magnitude A * N / 2.
+ */
+void
+dsp_fft_process (DspFft         *self,
+                 const dsp_v4sf *input,
+                 dsp_v4sf       *real,
+                 dsp_v4sf       *imaginary)
+{
+  dsp_v4sf *zr = self->work_real;
+  dsp_v4sf *zi = self->work_imaginary;
+  size_t half = self->half;
+  dsp_v4sf one_half = dsp_v4sf_set1 (0.5f);
+
+  /* Even samples as real, odd as imaginary, in bit reversed order */
+  for (size_t i = 0; i < half; i++)
+    {
+      size_t r = self->reversed[i];
+
+      zr[r] = input[2 * i];
+      zi[r] = input[2 * i + 1];
+    }
+
+  for (size_t length = 2; length <= half; length *= 2)
+    {
+      size_t stride = half / length;
+
+      for (size_t start = 0; start < half; start += length)
+        for (size_t k = 0; k < length / 2; k++)
+          {
+            dsp_v4sf wr = dsp_v4sf_set1 (self->twiddle_real[k * stride]);
+            dsp_v4sf wi = dsp_v4sf_set1 (self->twiddle_imaginary[k * stride]);
+            size_t a = start + k;
+            size_t b = a + length / 2;
+            dsp_v4sf tr = zr[b] * wr - zi[b] * wi;
+            dsp_v4sf ti = zr[b] * wi + zi[b] * wr;
+
+            zr[b] = zr[a] - tr;
+            zi[b] = zi[a] - ti;
+            zr[a] = zr[a] + tr;
+            zi[a] = zi[a] + ti;
+          }
+    }
+
+  /*
+   * Split: With E and O the spectra of the even and odd samples,
+   * E[k] = (Z[k] + conj Z[half - k]) / 2,
+   * O[k] = (Z[k] - conj Z[half - k]) / 2j and
+   * X[k] = E[k] + e^(-2 pi j k / N) O[k].
+   */
+  real[0] = zr[0] + zi[0];
+  imaginary[0] = dsp_v4sf_set1 (0);
+  real[half] = zr[0] - zi[0];
+  imaginary[half] = dsp_v4sf_set1 (0);
+
+  for (size_t k = 1; k < half; k++)
+    {
+      dsp_v4sf wr = dsp_v4sf_set1 (self->split_real[k]);
+      dsp_v4sf wi = dsp_v4sf_set1 (self->split_imaginary[k]);
+      dsp_v4sf er = (zr[k] + zr[half - k]) * one_half;
+      dsp_v4sf ei = (zi[k] - zi[half - k]) * one_half;
+      dsp_v4sf or = (zi[k] + zi[half - k]) * one_half;
+      dsp_v4sf oi = (zr[half - k] - zr[k]) * one_half;
+
+      real[k] = er + wr * or - wi * oi;
+      imaginary[k] = ei + wr * oi + wi * or;
+    }
+}
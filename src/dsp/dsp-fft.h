@@ -0,0 +1,37 @@
+/* dsp-fft.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DSP_FFT_H
+#define DSP_FFT_H
+
+
+#include "dsp-common.h"
+
+typedef struct _DspFft DspFft;
+
+DspFft *dsp_fft_new      (size_t  size);
+void    dsp_fft_free     (DspFft *self);
+size_t  dsp_fft_get_size (DspFft *self);
+
+void    dsp_fft_process  (DspFft         *self,
+                          const dsp_v4sf *input,
+                          dsp_v4sf       *real,
+                          dsp_v4sf       *imaginary);
+
+
+#endif /* DSP_FFT_H */
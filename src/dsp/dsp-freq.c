@@ -0,0 +1,403 @@
+/* dsp-freq.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dsp-freq.h"
+
+/*
+ * Frequency and ROCOF from a stream of (positive sequence) phasors.
+ *
+ * The phasors come from a non-rotating DFT at nominal frequency F0
+ * (see dsp-sdft.c), so a signal at F0 + df turns the phasor by
+ * 2*pi*df radians per second. The angle between two successive phasors
+ * gives the raw frequency, which is low pass filtered:
+ *
+ *  - P class: A triangular window over two nominal cycles, the same
+ *    response as the P class reference filter of C37.118.1.
+ *  - M class: A Hamming windowed sinc with its corner at about 0.164
+ *    times the reporting rate, the ratio of the M class reference
+ *    filter, so that out of band components don't alias into the
+ *    reported values.
+ *
+ * ROCOF is the slope of the filtered frequency over one nominal cycle.
+ * The filters are causal, so the filtered frequency lags by half the
+ * filter length. That lag is made up for by extrapolating with ROCOF,
+ * so a frequency ramp is reported without a bias.
+ *
+ * Every lane is an independent signal, usually a PMU, and DSP_LANES
+ * lanes are processed at once. The phasors must come at least twice a
+ * nominal cycle, so frames at the reporting rate won't do, only the
+ * phasors of samples, see pmu-estimator.c.
+ */
+
+/* Corner of the M class filter, relative to the reporting rate */
+#define M_CLASS_CORNER 0.164f
+
+/* Length of the M class filter, in reporting periods */
+#define M_CLASS_LENGTH 7
+
+struct _DspFreq
+{
+  size_t num_lanes;
+  size_t num_vectors;
+  size_t span;          /* inputs in a nominal cycle */
+  float nominal_freq;
+  float input_rate;     /* inputs per second */
+
+  float *taps;
+  size_t num_taps;
+
+  dsp_v4sf *previous_real;      /* num_vectors, the last phasor */
+  dsp_v4sf *previous_imaginary;
+  dsp_v4sf *raw;                /* 2 * num_taps * num_vectors */
+  dsp_v4sf *filtered;           /* (span + 1) * num_vectors */
+  dsp_v4sf *freq;               /* num_vectors */
+  dsp_v4sf *rocof;
+
+  size_t raw_position;
+  size_t filtered_position;
+  size_t count;                 /* inputs since the last reset */
+};
+
+static void
+design_p_class (DspFreq *self)
+{
+  size_t half = self->span;
+
+  self->num_taps = 2 * half - 1;
+
+  for (size_t i = 0; i < self->num_taps; i++)
+    {
+      size_t distance = i < half ? half - 1 - i : i - (half - 1);
+
+      self->taps[i] = (float) (half - distance) / (half * half);
+    }
+}
+
+static void
+design_m_class (DspFreq *self,
+                float    report_rate)
+{
+  double corner = M_CLASS_CORNER * report_rate / self->input_rate;
+  double sum = 0;
+  size_t num_taps, middle;
+
+  num_taps = (size_t) (M_CLASS_LENGTH * self->input_rate / report_rate) | 1;
+  middle = num_taps / 2;
+  self->num_taps = num_taps;
+
+  for (size_t i = 0; i < num_taps; i++)
+    {
+      double k = (double) i - middle;
+      double window = 0.54 - 0.46 * cos (2 * M_PI * i / (num_taps - 1));
+      double value;
+
+      if (i == middle)
+        value = 2 * corner;
+      else
+        value = sin (2 * M_PI * corner * k) / (M_PI * k);
+
+      self->taps[i] = value * window;
+      sum += self->taps[i];
+    }
+
+  /* Unity gain at DC, so that a steady frequency is exact */
+  for (size_t i = 0; i < num_taps; i++)
+    self->taps[i] /= sum;
+}
+
+/**
+ * dsp_freq_new:
+ * @num_lanes: Number of independent phasor streams
+ * @nominal_freq: The nominal frequency in Hz, the frequency at which
+ * the phasors don't turn
+ * @steps_per_cycle: Number of phasors given per nominal cycle
+ * @report_rate: The reporting rate in frames per second, used for
+ * %DSP_FREQ_CLASS_M only
+ * @freq_class: The performance class
+ *
+ * Returns: (transfer full) (nullable): A new #DspFreq or %NULL on error.
+ * Free with dsp_freq_free().
+ */
+DspFreq *
+dsp_freq_new (size_t       num_lanes,
+              float        nominal_freq,
+              size_t       steps_per_cycle,
+              float        report_rate,
+              DspFreqClass freq_class)
+{
+  DspFreq *self;
+  size_t num_vectors, max_taps;
+
+  if (num_lanes == 0 || nominal_freq <= 0 || steps_per_cycle < 2)
+    return NULL;
+
+  if (freq_class == DSP_FREQ_CLASS_M && report_rate <= 0)
+    return NULL;
+
+  self = calloc (1, sizeof *self);
+
+  if (self == NULL)
+    return NULL;
+
+  num_vectors = DSP_NUM_VECTORS (num_lanes);
+
+  self->num_lanes = num_lanes;
+  self->num_vectors = num_vectors;
+  self->span = steps_per_cycle;
+  self->nominal_freq = nominal_freq;
+  self->input_rate = nominal_freq * steps_per_cycle;
+
+  if (freq_class == DSP_FREQ_CLASS_M)
+    max_taps = (size_t) (M_CLASS_LENGTH * self->input_rate / report_rate) | 1;
+  else
+    max_taps = 2 * steps_per_cycle - 1;
+
+  self->taps = malloc (sizeof *self->taps * max_taps);
+  self->previous_real = dsp_calloc_aligned (sizeof (dsp_v4sf) * num_vectors);
+  self->previous_imaginary = dsp_calloc_aligned (sizeof (dsp_v4sf) * num_vectors);
+  self->raw = dsp_calloc_aligned (sizeof (dsp_v4sf) * num_vectors * 2 * max_taps);
+  self->filtered = dsp_calloc_aligned (sizeof (dsp_v4sf) * num_vectors *
+                                       (steps_per_cycle + 1));
+  self->freq = dsp_calloc_aligned (sizeof (dsp_v4sf) * num_vectors);
+  self->rocof = dsp_calloc_aligned (sizeof (dsp_v4sf) * num_vectors);
+
+  if (self->taps == NULL || self->previous_real == NULL ||
+      self->previous_imaginary == NULL || self->raw == NULL ||
+      self->filtered == NULL || self->freq == NULL || self->rocof == NULL)
+    {
+      dsp_freq_free (self);
+      return NULL;
+    }
+
+  if (freq_class == DSP_FREQ_CLASS_M)
+    design_m_class (self, report_rate);
+  else
+    design_p_class (self);
+
+  dsp_freq_reset (self);
+
+  return self;
+}
+
+void
+dsp_freq_free (DspFreq *self)
+{
+  if (self == NULL)
+    return;
+
+  free (self->taps);
+  free (self->previous_real);
+  free (self->previous_imaginary);
+  free (self->raw);
+  free (self->filtered);
+  free (self->freq);
+  free (self->rocof);
+  free (self);
+}
+
+/**
+ * dsp_freq_reset:
+ * @self: A #DspFreq
+ *
+ * Forget every phasor. Should be used when the phasor stream has a
+ * gap.
+ */
+void
+dsp_freq_reset (DspFreq *self)
+{
+  size_t num_vectors = self->num_vectors;
+
+  for (size_t v = 0; v < num_vectors; v++)
+    {
+      self->freq[v] = dsp_v4sf_set1 (self->nominal_freq);
+      self->rocof[v] = dsp_v4sf_set1 (0);
+    }
+
+  self->raw_position = 0;
+  self->filtered_position = 0;
+  self->count = 0;
+}
+
+size_t
+dsp_freq_get_num_lanes (DspFreq *self)
+{
+  return self->num_lanes;
+}
+
+/**
+ * dsp_freq_get_row_size:
+ * @self: A #DspFreq
+ *
+ * Returns: The number of floats in each array passed to
+ * dsp_freq_process(), the number of lanes rounded up to a multiple of
+ * %DSP_LANES.
+ */
+size_t
+dsp_freq_get_row_size (DspFreq *self)
+{
+  return self->num_vectors * DSP_LANES;
+}
+
+size_t
+dsp_freq_get_num_taps (DspFreq *self)
+{
+  return self->num_taps;
+}
+
+/**
+ * dsp_freq_get_delay:
+ * @self: A #DspFreq
+ *
+ * Get the group delay of the filter, relative to the input phasors.
+ * The reported frequency is extrapolated over it, ROCOF is delayed by
+ * it and a further half cycle.
+ *
+ * Returns: The delay in seconds
+ */
+float
+dsp_freq_get_delay (DspFreq *self)
+{
+  return self->num_taps / 2.0f / self->input_rate;
+}
+
+/**
+ * dsp_freq_is_ready:
+ * @self: A #DspFreq
+ *
+ * Returns: %true if enough phasors were processed since the last reset
+ * for both frequency and ROCOF to be valid.
+ */
+bool
+dsp_freq_is_ready (DspFreq *self)
+{
+  /* One phasor to start, then the filter, then a cycle for ROCOF */
+  return self->count > self->num_taps + self->span;
+}
+
+/**
+ * dsp_freq_process:
+ * @self: A #DspFreq
+ * @real: The real parts of the new phasor of each lane, aligned to
+ * %DSP_ALIGNMENT
+ * @imaginary: The imaginary parts
+ *
+ * Add the next phasor of each lane. The arrays are
+ * dsp_freq_get_row_size() floats long. Phasors must be given at
+ * steps_per_cycle per nominal cycle, evenly spaced.
+ */
+void
+dsp_freq_process (DspFreq     *self,
+                  const float *real,
+                  const float *imaginary)
+{
+  const dsp_v4sf *re = (const dsp_v4sf *) real;
+  const dsp_v4sf *im = (const dsp_v4sf *) imaginary;
+  size_t num_vectors = self->num_vectors;
+  size_t num_taps = self->num_taps;
+  dsp_v4sf *raw, *window, *filtered, *oldest;
+  float scale = self->input_rate / (2 * M_PI);
+  float delay = dsp_freq_get_delay (self);
+
+  self->count++;
+
+  if (self->count == 1)
+    {
+      memcpy (self->previous_real, re, sizeof *re * num_vectors);
+      memcpy (self->previous_imaginary, im, sizeof *im * num_vectors);
+      return;
+    }
+
+  /* The ring is stored twice, so the window is always contiguous */
+  raw = self->raw + self->raw_position * num_vectors;
+  window = self->raw + (self->raw_position + 1) * num_vectors;
+
+  if (++self->raw_position == num_taps)
+    self->raw_position = 0;
+
+  filtered = self->filtered + self->filtered_position * num_vectors;
+
+  if (++self->filtered_position == self->span + 1)
+    self->filtered_position = 0;
+
+  /* After the increment, this is the value from a cycle ago */
+  oldest = self->filtered + self->filtered_position * num_vectors;
+
+  for (size_t v = 0; v < num_vectors; v++)
+    {
+      dsp_v4sf pr = self->previous_real[v];
+      dsp_v4sf pi = self->previous_imaginary[v];
+      dsp_v4sf angle, value;
+
+      /* Angle of current * conj (previous) is the turn in a step */
+      angle = dsp_v4sf_atan2 (im[v] * pr - re[v] * pi,
+                              re[v] * pr + im[v] * pi);
+      value = self->nominal_freq + angle * scale;
+
+      raw[v] = value;
+      raw[v + num_taps * num_vectors] = value;
+
+      self->previous_real[v] = re[v];
+      self->previous_imaginary[v] = im[v];
+    }
+
+  if (self->count <= num_taps)
+    return;
+
+  for (size_t v = 0; v < num_vectors; v++)
+    {
+      dsp_v4sf sum = { 0 };
+
+      for (size_t i = 0; i < num_taps; i++)
+        sum += window[i * num_vectors + v] * self->taps[i];
+
+      filtered[v] = sum;
+
+      if (self->count > num_taps + self->span)
+        self->rocof[v] = (sum - oldest[v]) * (self->input_rate / self->span);
+
+      self->freq[v] = sum + self->rocof[v] * delay;
+    }
+}
+
+/**
+ * dsp_freq_get:
+ * @self: A #DspFreq
+ * @lane: The lane, starting from 0
+ * @freq: (out): return location for the frequency in Hz
+ * @rocof: (out): return location for the rate of change of frequency
+ * in Hz per second
+ *
+ * Get the latest estimate of @lane. Until enough phasors are processed
+ * after a reset, the nominal frequency and zero ROCOF are returned.
+ *
+ * Returns: %true if the values are valid, %false otherwise.
+ */
+bool
+dsp_freq_get (DspFreq *self,
+              size_t   lane,
+              float   *freq,
+              float   *rocof)
+{
+  if (lane >= self->num_lanes)
+    return false;
+
+  *freq = self->freq[lane / DSP_LANES][lane % DSP_LANES];
+  *rocof = self->rocof[lane / DSP_LANES][lane % DSP_LANES];
+
+  return dsp_freq_is_ready (self);
+}
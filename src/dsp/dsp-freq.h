@@ -0,0 +1,57 @@
+/* dsp-freq.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DSP_FREQ_H
+#define DSP_FREQ_H
+
+
+#include "dsp-common.h"
+
+/* Performance classes of C37.118.1 */
+typedef enum
+{
+  DSP_FREQ_CLASS_P, /* Protection: fast response */
+  DSP_FREQ_CLASS_M, /* Measurement: anti-aliased, slower */
+} DspFreqClass;
+
+typedef struct _DspFreq DspFreq;
+
+DspFreq *dsp_freq_new   (size_t        num_lanes,
+                         float         nominal_freq,
+                         size_t        steps_per_cycle,
+                         float         report_rate,
+                         DspFreqClass  freq_class);
+void     dsp_freq_free  (DspFreq      *self);
+void     dsp_freq_reset (DspFreq      *self);
+
+size_t   dsp_freq_get_num_lanes (DspFreq *self);
+size_t   dsp_freq_get_row_size  (DspFreq *self);
+size_t   dsp_freq_get_num_taps  (DspFreq *self);
+float    dsp_freq_get_delay     (DspFreq *self);
+bool     dsp_freq_is_ready      (DspFreq *self);
+
+void     dsp_freq_process (DspFreq     *self,
+                           const float *real,
+                           const float *imaginary);
+bool     dsp_freq_get     (DspFreq     *self,
+                           size_t       lane,
+                           float       *freq,
+                           float       *rocof);
+
+
+#endif /* DSP_FREQ_H */
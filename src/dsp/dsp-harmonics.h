@@ -0,0 +1,60 @@
+/* dsp-harmonics.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DSP_HARMONICS_H
+#define DSP_HARMONICS_H
+
+
+#include "dsp-common.h"
+
+/* Cycles in the window, a power of 2 for the FFT */
+#define DSP_HARMONICS_CYCLES 8
+
+/* Highest order in THD, as in IEC 61000-4-7 */
+#define DSP_HARMONICS_THD_ORDER 40
+
+/* Furthest off nominal frequency the window follows, as a ratio */
+#define DSP_HARMONICS_MAX_DEVIATION 0.2
+
+typedef struct _DspHarmonics DspHarmonics;
+
+DspHarmonics *dsp_harmonics_new  (size_t        num_channels,
+                                  size_t        samples_per_cycle,
+                                  size_t        max_order);
+void          dsp_harmonics_free  (DspHarmonics *self);
+void          dsp_harmonics_reset (DspHarmonics *self);
+
+size_t        dsp_harmonics_get_num_channels (DspHarmonics *self);
+size_t        dsp_harmonics_get_max_order    (DspHarmonics *self);
+size_t        dsp_harmonics_get_row_size     (DspHarmonics *self);
+bool          dsp_harmonics_is_ready         (DspHarmonics *self);
+
+void          dsp_harmonics_process (DspHarmonics *self,
+                                     const float  *samples,
+                                     size_t        num_samples,
+                                     uint64_t      first_index);
+bool          dsp_harmonics_update  (DspHarmonics *self,
+                                     double        deviation);
+float         dsp_harmonics_get_magnitude (DspHarmonics *self,
+                                           size_t        channel,
+                                           size_t        order);
+float         dsp_harmonics_get_thd       (DspHarmonics *self,
+                                           size_t        channel);
+
+
+#endif /* DSP_HARMONICS_H */
@@ -0,0 +1,910 @@
+/* dsp-lse.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <complex.h>
+
+#include "dsp-lse.h"
+
+/*
+ * Linear state estimation of the bus voltages of a network from PMU
+ * phasors: Bus voltages and branch currents are both linear in the bus
+ * voltages V, so the measurements are z = H V + e and the weighted
+ * least squares estimate is the solution of
+ *
+ *   G V = H^H W z,   G = H^H W H
+ *
+ * with W the inverse of the variance of each measurement. Branches are
+ * pi models, so the current leaving bus f of a branch to bus t is
+ * (y + j b / 2) V(f) - y V(t), with y the series admittance and b the
+ * total shunt susceptance.
+ *
+ * G only has entries between buses joined by a branch, so it is
+ * factorised as a sparse L D L^H, with the buses ordered by minimum
+ * degree to keep the fill low. The ordering (the pattern of L) is found
+ * once, for every branch whether in service or not. A branch going out
+ * of service or a measurement going missing only needs a numeric
+ * factorisation on the same pattern, and a frame is then a forward and
+ * a back substitution, O(entries of L).
+ *
+ * Bad data is flagged by the normalised residuals: The residual of a
+ * measurement divided by its standard deviation sqrt(R - H G^-1 H^H),
+ * as in the largest normalised residual test. The diagonal of
+ * H G^-1 H^H only needs the entries of G^-1 on the pattern of L, which
+ * are found with the factorisation, by the recurrence of Takahashi.
+ * Critical measurements, whose residual is always zero, are given a
+ * normalised residual of 0.
+ */
+
+/* Pivots below this fraction of the diagonal of G are taken as zero */
+#define PIVOT_TOLERANCE 1e-10
+
+/* Residual variances below this fraction of the variance are critical */
+#define CRITICAL_TOLERANCE 1e-6
+
+typedef struct
+{
+  size_t from;
+  size_t to;
+  double complex series;        /* y */
+  double complex shunt;         /* j b / 2 */
+  bool in_service;
+} Branch;
+
+typedef struct
+{
+  DspLseMeasurementType type;
+  size_t element;               /* Bus or branch */
+  double variance;
+  bool available;
+
+  /* Found by factorize(), the row of H */
+  bool used;
+  size_t num_buses;
+  size_t bus[2];                /* Ordered index */
+  double complex h[2];
+  double scale;                 /* 1 / standard deviation of the residual */
+} Measurement;
+
+/* The neighbours of a bus while ordering, sorted */
+typedef struct
+{
+  size_t *items;
+  size_t length;
+} Adjacency;
+
+typedef struct
+{
+  size_t degree;
+  size_t bus;
+} HeapItem;
+
+struct _DspLse
+{
+  size_t num_buses;
+
+  Branch *branches;
+  size_t num_branches;
+  size_t branches_size;
+
+  Measurement *measurements;
+  size_t num_measurements;
+  size_t measurements_size;
+
+  bool ordered;                 /* The pattern of L is valid */
+  bool factorized;              /* The values of L are valid */
+  bool observable;
+
+  size_t *permutation;          /* num_buses, bus of an ordered index */
+  size_t *inverse;              /* num_buses, ordered index of a bus */
+
+  /* L and the selected inverse Z of G, by columns, rows sorted */
+  size_t *column;               /* num_buses + 1 */
+  size_t *row;
+  double complex *lower;
+  double complex *inverse_lower;
+  double *diagonal;             /* D */
+  double *inverse_diagonal;     /* Of Z */
+  double *pivot_limit;
+
+  double complex *work;         /* num_buses */
+};
+
+/**
+ * dsp_lse_new:
+ * @num_buses: Number of buses of the network
+ *
+ * Returns: (transfer full) (nullable): A new #DspLse of no branches nor
+ * measurements, or %NULL if out of memory. Free with dsp_lse_free().
+ */
+DspLse *
+dsp_lse_new (size_t num_buses)
+{
+  DspLse *self;
+
+  if (num_buses == 0)
+    return NULL;
+
+  self = calloc (1, sizeof *self);
+
+  if (self == NULL)
+    return NULL;
+
+  self->num_buses = num_buses;
+  self->permutation = malloc (sizeof (size_t) * num_buses);
+  self->inverse = malloc (sizeof (size_t) * num_buses);
+  self->column = calloc (num_buses + 1, sizeof (size_t));
+  self->diagonal = malloc (sizeof (double) * num_buses);
+  self->inverse_diagonal = malloc (sizeof (double) * num_buses);
+  self->pivot_limit = malloc (sizeof (double) * num_buses);
+  self->work = malloc (sizeof (double complex) * num_buses);
+
+  if (self->permutation == NULL || self->inverse == NULL ||
+      self->column == NULL || self->diagonal == NULL ||
+      self->inverse_diagonal == NULL || self->pivot_limit == NULL ||
+      self->work == NULL)
+    {
+      dsp_lse_free (self);
+      return NULL;
+    }
+
+  return self;
+}
+
+void
+dsp_lse_free (DspLse *self)
+{
+  if (self == NULL)
+    return;
+
+  free (self->branches);
+  free (self->measurements);
+  free (self->permutation);
+  free (self->inverse);
+  free (self->column);
+  free (self->row);
+  free (self->lower);
+  free (self->inverse_lower);
+  free (self->diagonal);
+  free (self->inverse_diagonal);
+  free (self->pivot_limit);
+  free (self->work);
+  free (self);
+}
+
+size_t
+dsp_lse_get_num_buses (DspLse *self)
+{
+  return self->num_buses;
+}
+
+size_t
+dsp_lse_get_num_branches (DspLse *self)
+{
+  return self->num_branches;
+}
+
+size_t
+dsp_lse_get_num_measurements (DspLse *self)
+{
+  return self->num_measurements;
+}
+
+static bool
+grow (void   **array,
+      size_t  *size,
+      size_t   length,
+      size_t   item_size)
+{
+  void *items;
+  size_t new_size;
+
+  if (length < *size)
+    return true;
+
+  new_size = *size ? *size * 2 : 16;
+  items = realloc (*array, new_size * item_size);
+
+  if (items == NULL)
+    return false;
+
+  *array = items;
+  *size = new_size;
+
+  return true;
+}
+
+/**
+ * dsp_lse_add_branch:
+ * @self: A #DspLse
+ * @from: The bus at one end, from 0
+ * @to: The bus at the other end
+ * @resistance: Series resistance, per unit
+ * @reactance: Series reactance, per unit
+ * @susceptance: Total shunt susceptance, per unit
+ *
+ * Add a branch, in service. Branches can be added in parallel.
+ *
+ * Returns: The index of the branch, or %DSP_LSE_INVALID if an argument
+ * is not valid or out of memory.
+ */
+size_t
+dsp_lse_add_branch (DspLse *self,
+                    size_t  from,
+                    size_t  to,
+                    double  resistance,
+                    double  reactance,
+                    double  susceptance)
+{
+  Branch *branch;
+
+  if (from >= self->num_buses || to >= self->num_buses || from == to ||
+      (resistance == 0 && reactance == 0))
+    return DSP_LSE_INVALID;
+
+  if (!grow ((void **) &self->branches, &self->branches_size,
+             self->num_branches, sizeof (Branch)))
+    return DSP_LSE_INVALID;
+
+  branch = self->branches + self->num_branches;
+  branch->from = from;
+  branch->to = to;
+  branch->series = 1 / (resistance + reactance * I);
+  branch->shunt = susceptance / 2 * I;
+  branch->in_service = true;
+
+  self->ordered = self->factorized = false;
+
+  return self->num_branches++;
+}
+
+/**
+ * dsp_lse_add_measurement:
+ * @self: A #DspLse
+ * @type: The #DspLseMeasurementType
+ * @element: The bus of a voltage, the branch of a current
+ * @sigma: The standard deviation of the error of the phasor, per unit
+ *
+ * Add a measurement, available.
+ *
+ * Returns: The index of the measurement, or %DSP_LSE_INVALID if an
+ * argument is not valid or out of memory.
+ */
+size_t
+dsp_lse_add_measurement (DspLse                *self,
+                         DspLseMeasurementType  type,
+                         size_t                 element,
+                         double                 sigma)
+{
+  Measurement *measurement;
+
+  if (sigma <= 0 ||
+      (type == DSP_LSE_VOLTAGE && element >= self->num_buses) ||
+      (type != DSP_LSE_VOLTAGE && element >= self->num_branches))
+    return DSP_LSE_INVALID;
+
+  if (!grow ((void **) &self->measurements, &self->measurements_size,
+             self->num_measurements, sizeof (Measurement)))
+    return DSP_LSE_INVALID;
+
+  measurement = self->measurements + self->num_measurements;
+  memset (measurement, 0, sizeof *measurement);
+  measurement->type = type;
+  measurement->element = element;
+  measurement->variance = sigma * sigma;
+  measurement->available = true;
+
+  self->factorized = false;
+
+  return self->num_measurements++;
+}
+
+/**
+ * dsp_lse_set_branch_in_service:
+ * @self: A #DspLse
+ * @branch: The index of the branch
+ * @in_service: Whether the branch is closed
+ *
+ * Take a branch out of service or back. The currents measured on a
+ * branch out of service are not used. The next solve refactorises if
+ * this is a change.
+ */
+void
+dsp_lse_set_branch_in_service (DspLse *self,
+                               size_t  branch,
+                               bool    in_service)
+{
+  if (branch >= self->num_branches ||
+      self->branches[branch].in_service == in_service)
+    return;
+
+  self->branches[branch].in_service = in_service;
+  self->factorized = false;
+}
+
+/**
+ * dsp_lse_set_measurement_available:
+ * @self: A #DspLse
+ * @measurement: The index of the measurement
+ * @available: Whether the measurement is to be used
+ *
+ * Set whether the measurement is there, which it isn't when its PMU
+ * is missing from the frame or flags its data invalid say. The next
+ * solve refactorises if this is a change.
+ */
+void
+dsp_lse_set_measurement_available (DspLse *self,
+                                   size_t  measurement,
+                                   bool    available)
+{
+  if (measurement >= self->num_measurements ||
+      self->measurements[measurement].available == available)
+    return;
+
+  self->measurements[measurement].available = available;
+  self->factorized = false;
+}
+
+static void
+heap_push (HeapItem *heap,
+           size_t   *length,
+           size_t    degree,
+           size_t    bus)
+{
+  size_t i = (*length)++;
+
+  while (i > 0 && heap[(i - 1) / 2].degree > degree)
+    {
+      heap[i] = heap[(i - 1) / 2];
+      i = (i - 1) / 2;
+    }
+
+  heap[i].degree = degree;
+  heap[i].bus = bus;
+}
+
+static HeapItem
+heap_pop (HeapItem *heap,
+          size_t   *length)
+{
+  HeapItem top = heap[0];
+  HeapItem last = heap[--(*length)];
+  size_t i = 0;
+
+  while (2 * i + 1 < *length)
+    {
+      size_t child = 2 * i + 1;
+
+      if (child + 1 < *length && heap[child + 1].degree < heap[child].degree)
+        child++;
+
+      if (heap[child].degree >= last.degree)
+        break;
+
+      heap[i] = heap[child];
+      i = child;
+    }
+
+  if (*length > 0)
+    heap[i] = last;
+
+  return top;
+}
+
+static int
+compare_index (const void *a,
+               const void *b)
+{
+  size_t x = *(const size_t *) a;
+  size_t y = *(const size_t *) b;
+
+  return (x > y) - (x < y);
+}
+
+/*
+ * Set @adjacency to the union of @adjacency without @removed and
+ * @clique without @self_bus, both sorted.
+ */
+static bool
+merge_clique (Adjacency    *adjacency,
+              const size_t *clique,
+              size_t        clique_length,
+              size_t        self_bus,
+              size_t        removed)
+{
+  size_t *items;
+  size_t i = 0, j = 0, length = 0;
+
+  items = malloc (sizeof (size_t) * (adjacency->length + clique_length));
+
+  if (items == NULL)
+    return false;
+
+  while (i < adjacency->length || j < clique_length)
+    {
+      size_t next;
+
+      if (j == clique_length ||
+          (i < adjacency->length && adjacency->items[i] < clique[j]))
+        next = adjacency->items[i++];
+      else if (i == adjacency->length || clique[j] < adjacency->items[i])
+        next = clique[j++];
+      else
+        next = (i++, clique[j++]);
+
+      if (next != self_bus && next != removed)
+        items[length++] = next;
+    }
+
+  free (adjacency->items);
+  adjacency->items = items;
+  adjacency->length = length;
+
+  return true;
+}
+
+/*
+ * Order the buses by minimum degree, eliminating them one by one from
+ * the graph of the branches. The neighbours of a bus when eliminated
+ * are the rows of its column of L.
+ */
+static bool
+order_buses (DspLse *self)
+{
+  size_t n = self->num_buses;
+  Adjacency *graph;
+  HeapItem *heap;
+  size_t heap_length = 0, heap_size;
+  size_t *row = NULL;
+  size_t row_length = 0, row_size = 0;
+  bool *eliminated;
+  bool success = false;
+
+  graph = calloc (n, sizeof (Adjacency));
+  eliminated = calloc (n, sizeof (bool));
+  heap_size = n + 1;
+  heap = malloc (sizeof (HeapItem) * heap_size);
+
+  if (graph == NULL || eliminated == NULL || heap == NULL)
+    goto out;
+
+  for (size_t i = 0; i < self->num_branches; i++)
+    {
+      Branch *branch = self->branches + i;
+
+      if (!merge_clique (graph + branch->from, &branch->to, 1, branch->from, n) ||
+          !merge_clique (graph + branch->to, &branch->from, 1, branch->to, n))
+        goto out;
+    }
+
+  for (size_t i = 0; i < n; i++)
+    heap_push (heap, &heap_length, graph[i].length, i);
+
+  for (size_t k = 0; k < n; k++)
+    {
+      HeapItem item;
+      Adjacency *clique;
+
+      /* Skip the stale entries of buses whose degree changed */
+      do
+        item = heap_pop (heap, &heap_length);
+      while (eliminated[item.bus] || item.degree != graph[item.bus].length);
+
+      clique = graph + item.bus;
+      self->permutation[k] = item.bus;
+      self->inverse[item.bus] = k;
+      eliminated[item.bus] = true;
+
+      while (row_length + clique->length > row_size)
+        {
+          size_t *items;
+
+          row_size = row_size ? row_size * 2 : 4 * n;
+          items = realloc (row, sizeof (size_t) * row_size);
+
+          if (items == NULL)
+            goto out;
+
+          row = items;
+        }
+
+      if (clique->length)
+        memcpy (row + row_length, clique->items, sizeof (size_t) * clique->length);
+      row_length += clique->length;
+      self->column[k + 1] = row_length;
+
+      if (heap_length + clique->length > heap_size)
+        {
+          HeapItem *items;
+
+          heap_size = 2 * (heap_length + clique->length);
+          items = realloc (heap, sizeof (HeapItem) * heap_size);
+
+          if (items == NULL)
+            goto out;
+
+          heap = items;
+        }
+
+      for (size_t i = 0; i < clique->length; i++)
+        {
+          size_t bus = clique->items[i];
+
+          if (!merge_clique (graph + bus, clique->items, clique->length, bus, item.bus))
+            goto out;
+
+          heap_push (heap, &heap_length, graph[bus].length, bus);
+        }
+
+      free (clique->items);
+      clique->items = NULL;
+      clique->length = 0;
+    }
+
+  /* Rows as ordered indices, sorted in each column */
+  for (size_t k = 0; k < n; k++)
+    {
+      for (size_t p = self->column[k]; p < self->column[k + 1]; p++)
+        row[p] = self->inverse[row[p]];
+
+      qsort (row + self->column[k], self->column[k + 1] - self->column[k],
+             sizeof (size_t), compare_index);
+    }
+
+  free (self->row);
+  free (self->lower);
+  free (self->inverse_lower);
+  self->row = row;
+  self->lower = malloc (sizeof (double complex) * (row_length ? row_length : 1));
+  self->inverse_lower = malloc (sizeof (double complex) * (row_length ? row_length : 1));
+  row = NULL;
+
+  success = self->lower != NULL && self->inverse_lower != NULL;
+
+ out:
+  if (graph)
+    for (size_t i = 0; i < n; i++)
+      free (graph[i].items);
+
+  free (graph);
+  free (eliminated);
+  free (heap);
+  free (row);
+
+  return success;
+}
+
+/* The position of row @i of column @j in L, i > j */
+static size_t
+find_entry (DspLse *self,
+            size_t  i,
+            size_t  j)
+{
+  size_t low = self->column[j];
+  size_t high = self->column[j + 1];
+
+  while (low < high)
+    {
+      size_t middle = low + (high - low) / 2;
+
+      if (self->row[middle] < i)
+        low = middle + 1;
+      else
+        high = middle;
+    }
+
+  return low;
+}
+
+/* G(i, j) += value, of ordered indices */
+static void
+add_to_gain (DspLse         *self,
+             size_t          i,
+             size_t          j,
+             double complex  value)
+{
+  if (i == j)
+    self->diagonal[i] += creal (value);
+  else if (i > j)
+    self->lower[find_entry (self, i, j)] += value;
+  else
+    self->lower[find_entry (self, j, i)] += conj (value);
+}
+
+/* Z(i, j) of the selected inverse, i and j in a column of L or equal */
+static double complex
+get_inverse (DspLse *self,
+             size_t  i,
+             size_t  j)
+{
+  if (i == j)
+    return self->inverse_diagonal[i];
+  else if (i > j)
+    return self->inverse_lower[find_entry (self, i, j)];
+  else
+    return conj (self->inverse_lower[find_entry (self, j, i)]);
+}
+
+/* The rows of H of the measurements, and G from them */
+static void
+build_gain (DspLse *self)
+{
+  size_t num_entries = self->column[self->num_buses];
+
+  memset (self->diagonal, 0, sizeof (double) * self->num_buses);
+  memset (self->lower, 0, sizeof (double complex) * num_entries);
+
+  for (size_t m = 0; m < self->num_measurements; m++)
+    {
+      Measurement *measurement = self->measurements + m;
+      double weight = 1 / measurement->variance;
+
+      measurement->used = measurement->available;
+
+      if (measurement->type == DSP_LSE_VOLTAGE)
+        {
+          measurement->num_buses = 1;
+          measurement->bus[0] = self->inverse[measurement->element];
+          measurement->h[0] = 1;
+        }
+      else
+        {
+          Branch *branch = self->branches + measurement->element;
+          bool from = measurement->type == DSP_LSE_CURRENT_FROM;
+
+          measurement->used &= branch->in_service;
+          measurement->num_buses = 2;
+          measurement->bus[0] = self->inverse[from ? branch->from : branch->to];
+          measurement->bus[1] = self->inverse[from ? branch->to : branch->from];
+          measurement->h[0] = branch->series + branch->shunt;
+          measurement->h[1] = -branch->series;
+        }
+
+      if (!measurement->used)
+        continue;
+
+      /* G = H^H W H, each pair of buses once */
+      for (size_t a = 0; a < measurement->num_buses; a++)
+        for (size_t b = a; b < measurement->num_buses; b++)
+          add_to_gain (self, measurement->bus[a], measurement->bus[b],
+                       weight * conj (measurement->h[a]) * measurement->h[b]);
+    }
+}
+
+/* L D L^H = G, in place, right looking */
+static bool
+factorize_gain (DspLse *self)
+{
+  for (size_t k = 0; k < self->num_buses; k++)
+    self->pivot_limit[k] = PIVOT_TOLERANCE * self->diagonal[k];
+
+  for (size_t k = 0; k < self->num_buses; k++)
+    {
+      double d = self->diagonal[k];
+      size_t first = self->column[k];
+      size_t last = self->column[k + 1];
+
+      if (!(d > self->pivot_limit[k]) || d <= 0)
+        return false;
+
+      for (size_t p = first; p < last; p++)
+        self->lower[p] /= d;
+
+      for (size_t p = first; p < last; p++)
+        {
+          size_t i = self->row[p];
+          double complex l = self->lower[p];
+
+          self->diagonal[i] -= d * creal (l * conj (l));
+
+          for (size_t q = first; q < p; q++)
+            self->lower[find_entry (self, i, self->row[q])] -= l * d * conj (self->lower[q]);
+        }
+    }
+
+  return true;
+}
+
+/*
+ * Z = G^-1 on the pattern of L: With Z = D^-1 L^-1 + (I - L^H) Z, for
+ * the rows i of column k
+ *
+ *   Z(k, i) = -sum conj(L(j, k)) Z(j, i)
+ *   Z(k, k) = 1 / D(k) - sum conj(L(j, k)) Z(j, k)
+ *
+ * summed over the rows j of column k, all found before column k.
+ */
+static void
+invert_gain (DspLse *self)
+{
+  for (size_t k = self->num_buses; k-- > 0;)
+    {
+      size_t first = self->column[k];
+      size_t last = self->column[k + 1];
+      double z = 1 / self->diagonal[k];
+
+      for (size_t p = first; p < last; p++)
+        {
+          size_t i = self->row[p];
+          double complex sum = 0;
+
+          for (size_t q = first; q < last; q++)
+            sum += conj (self->lower[q]) * get_inverse (self, self->row[q], i);
+
+          /* Stored as Z(i, k), the conjugate of Z(k, i) */
+          self->inverse_lower[p] = -conj (sum);
+        }
+
+      for (size_t p = first; p < last; p++)
+        z -= creal (conj (self->lower[p]) * self->inverse_lower[p]);
+
+      self->inverse_diagonal[k] = z;
+    }
+}
+
+/* 1 / sqrt(R - h G^-1 h^H) of each measurement */
+static void
+scale_residuals (DspLse *self)
+{
+  for (size_t m = 0; m < self->num_measurements; m++)
+    {
+      Measurement *measurement = self->measurements + m;
+      double variance = measurement->variance;
+
+      if (!measurement->used)
+        continue;
+
+      for (size_t a = 0; a < measurement->num_buses; a++)
+        for (size_t b = 0; b < measurement->num_buses; b++)
+          variance -= creal (measurement->h[a] *
+                             get_inverse (self, measurement->bus[a], measurement->bus[b]) *
+                             conj (measurement->h[b]));
+
+      if (variance > CRITICAL_TOLERANCE * measurement->variance)
+        measurement->scale = 1 / sqrt (variance);
+      else
+        measurement->scale = 0;
+    }
+}
+
+/**
+ * dsp_lse_factorize:
+ * @self: A #DspLse
+ *
+ * Factorise the gain matrix of the branches in service and the
+ * measurements available, ordering the buses first if a branch or a
+ * measurement was added. Does nothing if nothing changed since the
+ * last call. Called by dsp_lse_solve() as needed; call it after a
+ * change to take the cost off the next frame.
+ *
+ * Returns: %TRUE if the network is observable, %FALSE if not or out of
+ * memory.
+ */
+bool
+dsp_lse_factorize (DspLse *self)
+{
+  if (self->factorized)
+    return self->observable;
+
+  if (!self->ordered)
+    {
+      if (!order_buses (self))
+        return false;
+
+      self->ordered = true;
+    }
+
+  build_gain (self);
+  self->observable = factorize_gain (self);
+  self->factorized = true;
+
+  if (self->observable)
+    {
+      invert_gain (self);
+      scale_residuals (self);
+    }
+
+  return self->observable;
+}
+
+/**
+ * dsp_lse_solve:
+ * @self: A #DspLse
+ * @real: The real part of every measurement, per unit
+ * @imaginary: The imaginary part of every measurement
+ * @voltage_real: Return location for the real part of the voltage of
+ * every bus, per unit
+ * @voltage_imaginary: Return location for the imaginary part
+ * @residual: (nullable): Return location for the normalised residual
+ * of every measurement, 0 for measurements not used or critical
+ *
+ * Estimate the bus voltages from a set of measurements. Values of
+ * measurements not available are not read.
+ *
+ * Returns: %TRUE on success, %FALSE if the network is not observable.
+ */
+bool
+dsp_lse_solve (DspLse      *self,
+               const float *real,
+               const float *imaginary,
+               float       *voltage_real,
+               float       *voltage_imaginary,
+               float       *residual)
+{
+  double complex *x = self->work;
+  size_t n = self->num_buses;
+
+  if (!dsp_lse_factorize (self))
+    return false;
+
+  memset (x, 0, sizeof (double complex) * n);
+
+  /* H^H W z */
+  for (size_t m = 0; m < self->num_measurements; m++)
+    {
+      Measurement *measurement = self->measurements + m;
+      double complex z;
+
+      if (!measurement->used)
+        continue;
+
+      z = (real[m] + imaginary[m] * I) / measurement->variance;
+
+      for (size_t a = 0; a < measurement->num_buses; a++)
+        x[measurement->bus[a]] += conj (measurement->h[a]) * z;
+    }
+
+  for (size_t k = 0; k < n; k++)
+    for (size_t p = self->column[k]; p < self->column[k + 1]; p++)
+      x[self->row[p]] -= self->lower[p] * x[k];
+
+  for (size_t k = 0; k < n; k++)
+    x[k] /= self->diagonal[k];
+
+  for (size_t k = n; k-- > 0;)
+    for (size_t p = self->column[k]; p < self->column[k + 1]; p++)
+      x[k] -= conj (self->lower[p]) * x[self->row[p]];
+
+  for (size_t bus = 0; bus < n; bus++)
+    {
+      voltage_real[bus] = creal (x[self->inverse[bus]]);
+      voltage_imaginary[bus] = cimag (x[self->inverse[bus]]);
+    }
+
+  if (residual == NULL)
+    return true;
+
+  for (size_t m = 0; m < self->num_measurements; m++)
+    {
+      Measurement *measurement = self->measurements + m;
+      double complex r;
+
+      residual[m] = 0;
+
+      if (!measurement->used)
+        continue;
+
+      r = real[m] + imaginary[m] * I;
+
+      for (size_t a = 0; a < measurement->num_buses; a++)
+        r -= measurement->h[a] * x[measurement->bus[a]];
+
+      residual[m] = cabs (r) * measurement->scale;
+    }
+
+  return true;
+}
@@ -0,0 +1,70 @@
+/* dsp-lse.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DSP_LSE_H
+#define DSP_LSE_H
+
+
+#include "dsp-common.h"
+
+/* Returned instead of an index on error */
+#define DSP_LSE_INVALID ((size_t) -1)
+
+typedef enum {
+  DSP_LSE_VOLTAGE,      /* Voltage of a bus */
+  DSP_LSE_CURRENT_FROM, /* Current of a branch, leaving its from bus */
+  DSP_LSE_CURRENT_TO,   /* Current of a branch, leaving its to bus */
+} DspLseMeasurementType;
+
+typedef struct _DspLse DspLse;
+
+DspLse *dsp_lse_new  (size_t  num_buses);
+void    dsp_lse_free (DspLse *self);
+
+size_t  dsp_lse_get_num_buses        (DspLse *self);
+size_t  dsp_lse_get_num_branches     (DspLse *self);
+size_t  dsp_lse_get_num_measurements (DspLse *self);
+
+size_t  dsp_lse_add_branch      (DspLse                *self,
+                                 size_t                 from,
+                                 size_t                 to,
+                                 double                 resistance,
+                                 double                 reactance,
+                                 double                 susceptance);
+size_t  dsp_lse_add_measurement (DspLse                *self,
+                                 DspLseMeasurementType  type,
+                                 size_t                 element,
+                                 double                 sigma);
+
+void    dsp_lse_set_branch_in_service      (DspLse *self,
+                                            size_t  branch,
+                                            bool    in_service);
+void    dsp_lse_set_measurement_available  (DspLse *self,
+                                            size_t  measurement,
+                                            bool    available);
+
+bool    dsp_lse_factorize (DspLse      *self);
+bool    dsp_lse_solve     (DspLse      *self,
+                           const float *real,
+                           const float *imaginary,
+                           float       *voltage_real,
+                           float       *voltage_imaginary,
+                           float       *residual);
+
+
+#endif /* DSP_LSE_H */
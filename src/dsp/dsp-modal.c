@@ -0,0 +1,602 @@
+/* dsp-modal.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <complex.h>
+
+#include "dsp-modal.h"
+
+/*
+ * Estimates the modes (frequency, damping and amplitude of the damped
+ * sinusoids) of slowly sampled signals, the inter-area oscillations in
+ * frequency or voltage decimated to a few samples per second say.
+ *
+ * Every lane is modelled as autoregressive,
+ *
+ *   y(n) = a1 y(n-1) + a2 y(n-2) + ... + ap y(n-p) + e(n)
+ *
+ * with the coefficients tracked by recursive least squares with a
+ * forgetting factor of 1 - 1 / window, so that the model follows about
+ * a window of samples. A sample costs O(p^2) per lane, done for 4
+ * lanes at a time. The mean is tracked with the same time constant and
+ * taken off first.
+ *
+ * The modes are only found when asked for, from the roots of the
+ * characteristic polynomial of the model: A root z is a mode of
+ * s = ln(z) * sample_rate, of frequency |Im s| / 2 pi and damping ratio
+ * -Re s / |s|. Their amplitudes are then fitted to the last window of
+ * samples by least squares. That is O(window * p^2) for a lane, so
+ * callers wanting a bounded cost per sample ask for a lane at a time.
+ *
+ * The covariance of a lane is reset if it blows up, which happens
+ * in single precision when a lane has no excitation for long.
+ */
+
+/* Initial covariance, for inputs of a few units */
+#define INITIAL_COVARIANCE 100.0f
+
+/* A lane whose covariance trace goes past this is reset */
+#define MAX_COVARIANCE_TRACE 1e8f
+
+/* Roots fitted to the window, outside are too fast to matter */
+#define MIN_ROOT_RADIUS 0.5
+#define MAX_ROOT_RADIUS 1.1
+
+#define ROOT_ITERATIONS 500
+
+struct _DspModal
+{
+  size_t num_lanes;
+  size_t num_vectors;
+  size_t order;         /* p */
+  float sample_rate;
+  size_t window;
+
+  dsp_v4sf lambda;      /* Forgetting factor */
+  dsp_v4sf alpha;       /* Of the running mean */
+
+  dsp_v4sf *mean;       /* num_vectors */
+  dsp_v4sf *theta;      /* order * num_vectors, a1 to ap */
+  dsp_v4sf *covariance; /* order * order * num_vectors */
+  dsp_v4sf *gain;       /* order * num_vectors, scratch */
+
+  dsp_v4sf *history;    /* window * num_vectors, without the mean */
+  size_t position;      /* The oldest sample in history */
+  size_t filled;
+  uint64_t count;       /* Samples since reset */
+
+  /* get_modes() scratch */
+  double *samples;      /* window */
+  double *normal;       /* order * order */
+  double *rhs;          /* order */
+};
+
+/**
+ * dsp_modal_new:
+ * @num_lanes: Number of lanes, signals to be watched
+ * @order: The order p of the model, at least twice the number of
+ * modes expected, up to %DSP_MODAL_MAX_ORDER
+ * @sample_rate: Samples per second
+ * @window: Number of samples the model follows, many times @order
+ *
+ * Returns: (transfer full) (nullable): A new #DspModal, or %NULL if
+ * an argument is not valid or out of memory. Free with
+ * dsp_modal_free().
+ */
+DspModal *
+dsp_modal_new (size_t num_lanes,
+               size_t order,
+               float  sample_rate,
+               size_t window)
+{
+  DspModal *self;
+  size_t num_vectors;
+
+  if (num_lanes == 0 || order < 2 || order > DSP_MODAL_MAX_ORDER ||
+      window <= 2 * order || sample_rate <= 0)
+    return NULL;
+
+  self = calloc (1, sizeof *self);
+
+  if (self == NULL)
+    return NULL;
+
+  num_vectors = DSP_NUM_VECTORS (num_lanes);
+
+  self->num_lanes = num_lanes;
+  self->num_vectors = num_vectors;
+  self->order = order;
+  self->sample_rate = sample_rate;
+  self->window = window;
+  self->lambda = dsp_v4sf_set1 (1.0f - 1.0f / window);
+  self->alpha = dsp_v4sf_set1 (1.0f / window);
+
+  self->mean = dsp_calloc_aligned (sizeof (dsp_v4sf) * num_vectors);
+  self->theta = dsp_calloc_aligned (sizeof (dsp_v4sf) * order * num_vectors);
+  self->covariance = dsp_calloc_aligned (sizeof (dsp_v4sf) * order * order * num_vectors);
+  self->gain = dsp_calloc_aligned (sizeof (dsp_v4sf) * order * num_vectors);
+  self->history = dsp_calloc_aligned (sizeof (dsp_v4sf) * window * num_vectors);
+  self->samples = malloc (sizeof (double) * window);
+  self->normal = malloc (sizeof (double) * order * order);
+  self->rhs = malloc (sizeof (double) * order);
+
+  if (self->mean == NULL || self->theta == NULL || self->covariance == NULL ||
+      self->gain == NULL || self->history == NULL || self->samples == NULL ||
+      self->normal == NULL || self->rhs == NULL)
+    {
+      dsp_modal_free (self);
+      return NULL;
+    }
+
+  dsp_modal_reset (self);
+
+  return self;
+}
+
+void
+dsp_modal_free (DspModal *self)
+{
+  if (self == NULL)
+    return;
+
+  free (self->mean);
+  free (self->theta);
+  free (self->covariance);
+  free (self->gain);
+  free (self->history);
+  free (self->samples);
+  free (self->normal);
+  free (self->rhs);
+  free (self);
+}
+
+/* Start lanes over where @mask is set */
+static void
+reset_lanes (DspModal *self,
+             size_t    v,
+             dsp_v4si  mask)
+{
+  size_t order = self->order;
+  size_t num_vectors = self->num_vectors;
+
+  for (size_t i = 0; i < order; i++)
+    {
+      dsp_v4sf *theta = self->theta + i * num_vectors + v;
+
+      *theta = dsp_v4sf_select (mask, dsp_v4sf_set1 (0), *theta);
+
+      for (size_t j = 0; j < order; j++)
+        {
+          dsp_v4sf *p = self->covariance + (i * order + j) * num_vectors + v;
+
+          *p = dsp_v4sf_select (mask, dsp_v4sf_set1 (i == j ? INITIAL_COVARIANCE : 0), *p);
+        }
+    }
+}
+
+/**
+ * dsp_modal_reset:
+ * @self: A #DspModal
+ *
+ * Forget every sample and the model, after a gap in samples say.
+ */
+void
+dsp_modal_reset (DspModal *self)
+{
+  for (size_t v = 0; v < self->num_vectors; v++)
+    reset_lanes (self, v, (dsp_v4si) { -1, -1, -1, -1 });
+
+  self->position = 0;
+  self->filled = 0;
+  self->count = 0;
+}
+
+size_t
+dsp_modal_get_num_lanes (DspModal *self)
+{
+  return self->num_lanes;
+}
+
+/**
+ * dsp_modal_get_row_size:
+ * @self: A #DspModal
+ *
+ * Returns: The number of floats of a row passed to
+ * dsp_modal_process(), the lanes rounded up to a multiple of
+ * %DSP_LANES.
+ */
+size_t
+dsp_modal_get_row_size (DspModal *self)
+{
+  return self->num_vectors * DSP_LANES;
+}
+
+/**
+ * dsp_modal_is_ready:
+ * @self: A #DspModal
+ *
+ * Returns: %true if a window of samples has been processed since the
+ * last reset, so that modes can be found.
+ */
+bool
+dsp_modal_is_ready (DspModal *self)
+{
+  return self->filled == self->window;
+}
+
+/* The sample @age samples before the latest one */
+static inline dsp_v4sf *
+get_history (DspModal *self,
+             size_t    age,
+             size_t    v)
+{
+  size_t slot = (self->position + self->window - 1 - age) % self->window;
+
+  return self->history + slot * self->num_vectors + v;
+}
+
+static void
+update_model (DspModal *self,
+              size_t    v,
+              dsp_v4sf  y)
+{
+  size_t order = self->order;
+  size_t num_vectors = self->num_vectors;
+  dsp_v4sf *gain = self->gain;
+  dsp_v4sf phi[DSP_MODAL_MAX_ORDER];
+  dsp_v4sf denominator = self->lambda;
+  dsp_v4sf error = y;
+  dsp_v4sf inverse_lambda = 1.0f / self->lambda;
+  dsp_v4sf trace = { 0 };
+
+  for (size_t i = 0; i < order; i++)
+    phi[i] = *get_history (self, i, v);
+
+  /* P phi, phi' P phi and the prediction error */
+  for (size_t i = 0; i < order; i++)
+    {
+      dsp_v4sf sum = { 0 };
+
+      for (size_t j = 0; j < order; j++)
+        sum += self->covariance[(i * order + j) * num_vectors + v] * phi[j];
+
+      gain[i] = sum;
+      denominator += phi[i] * sum;
+      error -= self->theta[i * num_vectors + v] * phi[i];
+    }
+
+  for (size_t i = 0; i < order; i++)
+    self->theta[i * num_vectors + v] += gain[i] / denominator * error;
+
+  /* P = (P - P phi phi' P / denominator) / lambda, kept symmetric */
+  for (size_t i = 0; i < order; i++)
+    {
+      dsp_v4sf scaled = gain[i] / denominator;
+
+      for (size_t j = i; j < order; j++)
+        {
+          dsp_v4sf *p = self->covariance + (i * order + j) * num_vectors + v;
+
+          *p = (*p - scaled * gain[j]) * inverse_lambda;
+          self->covariance[(j * order + i) * num_vectors + v] = *p;
+        }
+
+      trace += self->covariance[(i * order + i) * num_vectors + v];
+    }
+
+  /* NaN fails the compare too */
+  reset_lanes (self, v, ~(trace < dsp_v4sf_set1 (MAX_COVARIANCE_TRACE)));
+}
+
+/**
+ * dsp_modal_process:
+ * @self: A #DspModal
+ * @row: The next sample of every lane, dsp_modal_get_row_size()
+ * floats aligned to %DSP_ALIGNMENT
+ *
+ * Update the model of every lane with a sample.
+ */
+void
+dsp_modal_process (DspModal    *self,
+                   const float *row)
+{
+  const dsp_v4sf *x = (const dsp_v4sf *) row;
+  size_t num_vectors = self->num_vectors;
+
+  for (size_t v = 0; v < num_vectors; v++)
+    {
+      dsp_v4sf y;
+
+      if (self->count == 0)
+        self->mean[v] = x[v];
+      else
+        self->mean[v] += (x[v] - self->mean[v]) * self->alpha;
+
+      y = x[v] - self->mean[v];
+
+      if (self->count >= self->order)
+        update_model (self, v, y);
+
+      self->history[self->position * num_vectors + v] = y;
+    }
+
+  if (++self->position == self->window)
+    self->position = 0;
+
+  if (self->filled < self->window)
+    self->filled++;
+
+  self->count++;
+}
+
+/* Durand-Kerner, of z^p + c[0] z^(p-1) + ... + c[p-1] */
+static void
+find_roots (const double    *c,
+            size_t           order,
+            double complex  *roots)
+{
+  double complex seed = 0.4 + 0.9 * I;
+
+  roots[0] = 1;
+  for (size_t i = 0; i < order; i++)
+    roots[i] = cpow (seed, i);
+
+  for (size_t iteration = 0; iteration < ROOT_ITERATIONS; iteration++)
+    {
+      double change = 0;
+
+      for (size_t i = 0; i < order; i++)
+        {
+          double complex value = 1;
+          double complex product = 1;
+          double complex delta;
+
+          for (size_t k = 0; k < order; k++)
+            value = value * roots[i] + c[k];
+
+          for (size_t j = 0; j < order; j++)
+            if (j != i)
+              product *= roots[i] - roots[j];
+
+          if (product == 0)
+            product = 1e-12;
+
+          delta = value / product;
+          roots[i] -= delta;
+          change = fmax (change, cabs (delta));
+        }
+
+      if (change < 1e-12)
+        break;
+    }
+}
+
+/* Gaussian elimination with partial pivoting, in place */
+static bool
+solve (double *a,
+       double *b,
+       size_t  n)
+{
+  for (size_t col = 0; col < n; col++)
+    {
+      size_t pivot = col;
+
+      for (size_t row = col + 1; row < n; row++)
+        if (fabs (a[row * n + col]) > fabs (a[pivot * n + col]))
+          pivot = row;
+
+      if (a[pivot * n + col] == 0)
+        return false;
+
+      if (pivot != col)
+        {
+          double t;
+
+          for (size_t k = 0; k < n; k++)
+            {
+              t = a[col * n + k];
+              a[col * n + k] = a[pivot * n + k];
+              a[pivot * n + k] = t;
+            }
+
+          t = b[col];
+          b[col] = b[pivot];
+          b[pivot] = t;
+        }
+
+      for (size_t row = col + 1; row < n; row++)
+        {
+          double factor = a[row * n + col] / a[col * n + col];
+
+          for (size_t k = col; k < n; k++)
+            a[row * n + k] -= factor * a[col * n + k];
+
+          b[row] -= factor * b[col];
+        }
+    }
+
+  for (size_t col = n; col-- > 0;)
+    {
+      for (size_t k = col + 1; k < n; k++)
+        b[col] -= a[col * n + k] * b[k];
+
+      b[col] /= a[col * n + col];
+    }
+
+  return true;
+}
+
+static int
+compare_damping (const void *a,
+                 const void *b)
+{
+  const DspMode *first = a;
+  const DspMode *second = b;
+
+  return (first->damping > second->damping) - (first->damping < second->damping);
+}
+
+/**
+ * dsp_modal_get_modes:
+ * @self: A #DspModal
+ * @lane: The lane, starting from 0
+ * @freq_low: The lowest frequency of interest, in Hz
+ * @freq_high: The highest frequency of interest, in Hz
+ * @modes: (out caller-allocates): Return location for the modes
+ * @max_modes: The size of @modes
+ *
+ * Find the modes of @lane between @freq_low and @freq_high, the least
+ * damped (the dominant one) first. Heavily damped modes are often the
+ * model fitting noise, and their amplitudes are not to be trusted.
+ *
+ * Returns: The number of modes set in @modes, 0 if not ready.
+ */
+size_t
+dsp_modal_get_modes (DspModal *self,
+                     size_t    lane,
+                     float     freq_low,
+                     float     freq_high,
+                     DspMode  *modes,
+                     size_t    max_modes)
+{
+  size_t order = self->order;
+  size_t window = self->window;
+  size_t v = lane / DSP_LANES;
+  size_t l = lane % DSP_LANES;
+  double coefficients[DSP_MODAL_MAX_ORDER];
+  double complex roots[DSP_MODAL_MAX_ORDER];
+  /* The roots fitted, a column each (2 for a complex pair) */
+  double complex fitted[DSP_MODAL_MAX_ORDER];
+  size_t num_fitted = 0;
+  size_t num_columns = 0;
+  DspMode found[DSP_MODAL_MAX_ORDER];
+  size_t num_found = 0;
+  double ridge = 0;
+
+  if (lane >= self->num_lanes || !dsp_modal_is_ready (self))
+    return 0;
+
+  for (size_t i = 0; i < order; i++)
+    coefficients[i] = -self->theta[i * self->num_vectors + v][l];
+
+  find_roots (coefficients, order, roots);
+
+  for (size_t i = 0; i < order; i++)
+    {
+      double radius = cabs (roots[i]);
+
+      if (radius < MIN_ROOT_RADIUS || radius > MAX_ROOT_RADIUS ||
+          cimag (roots[i]) < -1e-9)
+        continue;
+
+      fitted[num_fitted++] = roots[i];
+      num_columns += cimag (roots[i]) > 1e-9 ? 2 : 1;
+    }
+
+  if (num_columns == 0)
+    return 0;
+
+  /* Oldest first */
+  for (size_t t = 0; t < window; t++)
+    self->samples[t] = (*get_history (self, window - 1 - t, v))[l];
+
+  memset (self->normal, 0, sizeof (double) * num_columns * num_columns);
+  memset (self->rhs, 0, sizeof (double) * num_columns);
+
+  {
+    double complex powers[DSP_MODAL_MAX_ORDER];
+    double basis[DSP_MODAL_MAX_ORDER];
+
+    for (size_t k = 0; k < num_fitted; k++)
+      powers[k] = 1;
+
+    for (size_t t = 0; t < window; t++)
+      {
+        size_t c = 0;
+
+        for (size_t k = 0; k < num_fitted; k++)
+          {
+            basis[c++] = creal (powers[k]);
+            if (cimag (fitted[k]) > 1e-9)
+              basis[c++] = cimag (powers[k]);
+            powers[k] *= fitted[k];
+          }
+
+        for (size_t i = 0; i < num_columns; i++)
+          {
+            for (size_t j = 0; j < num_columns; j++)
+              self->normal[i * num_columns + j] += basis[i] * basis[j];
+
+            self->rhs[i] += basis[i] * self->samples[t];
+          }
+      }
+  }
+
+  for (size_t i = 0; i < num_columns; i++)
+    ridge = fmax (ridge, self->normal[i * num_columns + i]);
+
+  for (size_t i = 0; i < num_columns; i++)
+    self->normal[i * num_columns + i] += ridge * 1e-9;
+
+  if (!solve (self->normal, self->rhs, num_columns))
+    return 0;
+
+  for (size_t k = 0, c = 0; k < num_fitted; k++)
+    {
+      double complex s;
+      double frequency, amplitude;
+
+      if (cimag (fitted[k]) <= 1e-9)
+        {
+          c++;
+          continue;
+        }
+
+      s = clog (fitted[k]) * self->sample_rate;
+      frequency = cimag (s) / (2 * M_PI);
+
+      /*
+       * The fitted amplitude is of the oldest sample, and the mode is
+       * driven by noise rather than free: Take the RMS of its envelope
+       * over the window, r^(2t) summed as a geometric series.
+       */
+      {
+        double r2 = cabs (fitted[k]) * cabs (fitted[k]);
+        double sum = fabs (r2 - 1) < 1e-12 ? window : (pow (r2, window) - 1) / (r2 - 1);
+
+        amplitude = hypot (self->rhs[c], self->rhs[c + 1]) * sqrt (sum / window);
+      }
+      c += 2;
+
+      if (frequency < freq_low || frequency > freq_high)
+        continue;
+
+      found[num_found].frequency = frequency;
+      found[num_found].damping = -creal (s) / cabs (s);
+      found[num_found].amplitude = amplitude;
+      num_found++;
+    }
+
+  qsort (found, num_found, sizeof (DspMode), compare_damping);
+
+  if (num_found > max_modes)
+    num_found = max_modes;
+
+  memcpy (modes, found, sizeof (DspMode) * num_found);
+
+  return num_found;
+}
@@ -0,0 +1,58 @@
+/* dsp-modal.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DSP_MODAL_H
+#define DSP_MODAL_H
+
+
+#include "dsp-common.h"
+
+/* Highest order of the autoregressive model */
+#define DSP_MODAL_MAX_ORDER 32
+
+typedef struct
+{
+  float frequency;      /* Hz */
+  float damping;        /* ratio, negative if growing */
+  float amplitude;      /* peak, in the units of the input, RMS over the window */
+} DspMode;
+
+typedef struct _DspModal DspModal;
+
+DspModal *dsp_modal_new   (size_t    num_lanes,
+                           size_t    order,
+                           float     sample_rate,
+                           size_t    window);
+void      dsp_modal_free  (DspModal *self);
+void      dsp_modal_reset (DspModal *self);
+
+size_t    dsp_modal_get_num_lanes (DspModal *self);
+size_t    dsp_modal_get_row_size  (DspModal *self);
+bool      dsp_modal_is_ready      (DspModal *self);
+
+void      dsp_modal_process   (DspModal    *self,
+                               const float *row);
+size_t    dsp_modal_get_modes (DspModal    *self,
+                               size_t       lane,
+                               float        freq_low,
+                               float        freq_high,
+                               DspMode     *modes,
+                               size_t       max_modes);
+
+
+#endif /* DSP_MODAL_H */
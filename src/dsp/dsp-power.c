@@ -0,0 +1,71 @@
+/* dsp-power.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dsp-power.h"
+
+/**
+ * dsp_power_process:
+ * @voltage: The voltage phasors, in RMS
+ * @current: The current phasors, in RMS
+ * @active: (nullable): Return location for active power
+ * @reactive: (nullable): Return location for reactive power
+ * @apparent: (nullable): Return location for apparent power
+ * @count: Number of phasors in each array
+ *
+ * Compute the complex power S = V * conj (I) = P + jQ of @count pairs
+ * of phasors, and its magnitude. The arrays are aligned to
+ * %DSP_ALIGNMENT and padded to a multiple of %DSP_LANES floats. A pair
+ * is usually a phase of a PMU, of a frame or of a batch of frames.
+ */
+void
+dsp_power_process (const DspPhasorArray *voltage,
+                   const DspPhasorArray *current,
+                   float                *active,
+                   float                *reactive,
+                   float                *apparent,
+                   size_t                count)
+{
+  const dsp_v4sf *vr = (const dsp_v4sf *) voltage->real;
+  const dsp_v4sf *vi = (const dsp_v4sf *) voltage->imaginary;
+  const dsp_v4sf *ir = (const dsp_v4sf *) current->real;
+  const dsp_v4sf *ii = (const dsp_v4sf *) current->imaginary;
+  size_t num_vectors = DSP_NUM_VECTORS (count);
+
+  for (size_t v = 0; v < num_vectors; v++)
+    {
+      dsp_v4sf p = vr[v] * ir[v] + vi[v] * ii[v];
+      dsp_v4sf q = vi[v] * ir[v] - vr[v] * ii[v];
+
+      if (active)
+        ((dsp_v4sf *) active)[v] = p;
+
+      if (reactive)
+        ((dsp_v4sf *) reactive)[v] = q;
+
+      if (apparent)
+        {
+          dsp_v4sf s2 = p * p + q * q;
+
+          /* No vector square root in the extension, leave it to libm */
+          for (int lane = 0; lane < DSP_LANES; lane++)
+            s2[lane] = sqrtf (s2[lane]);
+
+          ((dsp_v4sf *) apparent)[v] = s2;
+        }
+    }
+}
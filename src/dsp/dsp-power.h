@@ -0,0 +1,34 @@
+/* dsp-power.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DSP_POWER_H
+#define DSP_POWER_H
+
+
+#include "dsp-common.h"
+#include "dsp-seqcomp.h"
+
+void dsp_power_process (const DspPhasorArray *voltage,
+                        const DspPhasorArray *current,
+                        float                *active,
+                        float                *reactive,
+                        float                *apparent,
+                        size_t                count);
+
+
+#endif /* DSP_POWER_H */
@@ -0,0 +1,418 @@
+/* dsp-sdft.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dsp-sdft.h"
+
+/*
+ * Sliding DFT of the fundamental over a one cycle window.
+ *
+ * With N samples per nominal cycle, and n the index of a sample
+ * counted from the top of a UTC second, the phasor is
+ *
+ *   X(n) = sqrt(2)/N * sum (x(m) * e^(-j*2*pi*m/N)), m = n-N+1 .. n
+ *
+ * which is updated for every new sample by adding the new term and
+ * removing the oldest one. As the twiddle of each term depends on the
+ * absolute index m (and not on the position in the window), the angle
+ * is referred to a cosine at nominal frequency aligned to the UTC
+ * second, as C37.118.1 requires, without any further rotation.
+ *
+ * Off nominal frequency, X(n) is not the phasor at n: it is of the
+ * middle of the window, shrunk a little by the window, and has the
+ * negative frequency leaking into it, a term rotating at twice the
+ * line frequency. For a signal at (1 + d) times nominal, and P the
+ * phasor at the instant after the window:
+ *
+ *   X = K1 * P + K2 * conj (P)
+ *
+ *   K1 = 1/N * sum (e^(-j*2*pi*d*k/N)), k = 1 .. N
+ *   K2 = e^(-j*4*pi*r/N) * 1/N * sum (e^(j*2*pi*(2+d)*k/N)), k = 1 .. N
+ *
+ * where r = n + 1. Both are known once d is, and the equation with
+ * its conjugate gives P, see dsp_sdft_get_phasor_at_frequency().
+ *
+ * Only additions are done on the sums, so rounding errors don't grow
+ * multiplicatively, but they still accumulate. The sums are recomputed
+ * from the window every DSP_SDFT_RESYNC_CYCLES cycles to get rid of it.
+ *
+ * Channels are processed DSP_LANES at a time.
+ */
+struct _DspSdft
+{
+  size_t num_channels;
+  size_t num_vectors;
+  size_t window;        /* N, samples per cycle */
+
+  float *cos_table;     /* N entries */
+  float *sin_table;
+
+  dsp_v4sf *history;    /* window * num_vectors, the samples in window */
+  dsp_v4sf *real;       /* num_vectors */
+  dsp_v4sf *imaginary;
+
+  size_t position;      /* The oldest sample in history */
+  size_t filled;        /* Number of valid samples in history */
+  size_t since_resync;
+  uint64_t next_index;
+};
+
+/**
+ * dsp_sdft_new:
+ * @num_channels: Number of channels to be processed
+ * @samples_per_cycle: Number of samples in a cycle at nominal frequency
+ *
+ * Returns: (transfer full) (nullable): A new #DspSdft or %NULL on error.
+ * Free with dsp_sdft_free().
+ */
+DspSdft *
+dsp_sdft_new (size_t num_channels,
+              size_t samples_per_cycle)
+{
+  DspSdft *self;
+  size_t num_vectors;
+
+  if (num_channels == 0 || samples_per_cycle < 4)
+    return NULL;
+
+  self = calloc (1, sizeof *self);
+
+  if (self == NULL)
+    return NULL;
+
+  num_vectors = DSP_NUM_VECTORS (num_channels);
+
+  self->num_channels = num_channels;
+  self->num_vectors = num_vectors;
+  self->window = samples_per_cycle;
+
+  self->cos_table = malloc (sizeof *self->cos_table * samples_per_cycle);
+  self->sin_table = malloc (sizeof *self->sin_table * samples_per_cycle);
+  self->history = dsp_calloc_aligned (sizeof *self->history *
+                                      num_vectors * samples_per_cycle);
+  self->real = dsp_calloc_aligned (sizeof *self->real * num_vectors);
+  self->imaginary = dsp_calloc_aligned (sizeof *self->imaginary * num_vectors);
+
+  if (self->cos_table == NULL || self->sin_table == NULL ||
+      self->history == NULL || self->real == NULL ||
+      self->imaginary == NULL)
+    {
+      dsp_sdft_free (self);
+      return NULL;
+    }
+
+  for (size_t i = 0; i < samples_per_cycle; i++)
+    {
+      double angle = 2 * M_PI * i / samples_per_cycle;
+
+      self->cos_table[i] = cos (angle);
+      self->sin_table[i] = sin (angle);
+    }
+
+  return self;
+}
+
+void
+dsp_sdft_free (DspSdft *self)
+{
+  if (self == NULL)
+    return;
+
+  free (self->cos_table);
+  free (self->sin_table);
+  free (self->history);
+  free (self->real);
+  free (self->imaginary);
+  free (self);
+}
+
+/**
+ * dsp_sdft_reset:
+ * @self: A #DspSdft
+ *
+ * Forget every sample. Should be used when the sample stream has a
+ * gap, see dsp_sdft_process().
+ */
+void
+dsp_sdft_reset (DspSdft *self)
+{
+  memset (self->history, 0,
+          sizeof *self->history * self->num_vectors * self->window);
+  memset (self->real, 0, sizeof *self->real * self->num_vectors);
+  memset (self->imaginary, 0, sizeof *self->imaginary * self->num_vectors);
+
+  self->position = 0;
+  self->filled = 0;
+  self->since_resync = 0;
+}
+
+size_t
+dsp_sdft_get_num_channels (DspSdft *self)
+{
+  return self->num_channels;
+}
+
+size_t
+dsp_sdft_get_samples_per_cycle (DspSdft *self)
+{
+  return self->window;
+}
+
+/**
+ * dsp_sdft_get_row_size:
+ * @self: A #DspSdft
+ *
+ * Get the number of floats of a sample row passed to
+ * dsp_sdft_process(). This is the number of channels rounded up
+ * to a multiple of %DSP_LANES.
+ *
+ * Returns: the number of floats in a row
+ */
+size_t
+dsp_sdft_get_row_size (DspSdft *self)
+{
+  return self->num_vectors * DSP_LANES;
+}
+
+/**
+ * dsp_sdft_is_ready:
+ * @self: A #DspSdft
+ *
+ * Returns: %true if a full cycle of samples has been processed
+ * since the last reset, that is, if the phasors are valid.
+ */
+bool
+dsp_sdft_is_ready (DspSdft *self)
+{
+  return self->filled == self->window;
+}
+
+static void
+resync (DspSdft *self)
+{
+  size_t num_vectors = self->num_vectors;
+  size_t window = self->window;
+
+  for (size_t v = 0; v < num_vectors; v++)
+    {
+      dsp_v4sf real = { 0 };
+      dsp_v4sf imaginary = { 0 };
+
+      for (size_t i = 0; i < window; i++)
+        {
+          size_t slot = (self->position + i) % window;
+          /* The oldest sample has index next_index - N == next_index (mod N) */
+          size_t k = (self->next_index + i) % window;
+          dsp_v4sf x = self->history[slot * num_vectors + v];
+
+          real += x * self->cos_table[k];
+          imaginary -= x * self->sin_table[k];
+        }
+
+      self->real[v] = real;
+      self->imaginary[v] = imaginary;
+    }
+
+  self->since_resync = 0;
+}
+
+/**
+ * dsp_sdft_process:
+ * @self: A #DspSdft
+ * @samples: @num_samples rows of samples, aligned to %DSP_ALIGNMENT
+ * @num_samples: Number of rows in @samples
+ * @first_index: The index of the first row, counted from the top of
+ * the UTC second (or any instant that is a whole number of cycles
+ * away from it)
+ *
+ * Slide the window over @num_samples new samples. Each row has one
+ * sample of every channel, and is dsp_sdft_get_row_size() floats long.
+ * The padding floats are ignored.
+ *
+ * If @first_index doesn't follow the last sample processed, the
+ * window is reset, as the samples in between are lost.
+ */
+void
+dsp_sdft_process (DspSdft     *self,
+                  const float *samples,
+                  size_t       num_samples,
+                  uint64_t     first_index)
+{
+  const dsp_v4sf *rows = (const dsp_v4sf *) samples;
+  size_t num_vectors = self->num_vectors;
+  size_t window = self->window;
+  size_t k;
+
+  if (self->filled && first_index != self->next_index)
+    dsp_sdft_reset (self);
+
+  k = first_index % window;
+
+  for (size_t n = 0; n < num_samples; n++)
+    {
+      dsp_v4sf *history = self->history + self->position * num_vectors;
+      dsp_v4sf cos_k = dsp_v4sf_set1 (self->cos_table[k]);
+      dsp_v4sf sin_k = dsp_v4sf_set1 (self->sin_table[k]);
+
+      for (size_t v = 0; v < num_vectors; v++)
+        {
+          dsp_v4sf x = rows[v];
+          dsp_v4sf delta = x - history[v];
+
+          self->real[v] += delta * cos_k;
+          self->imaginary[v] -= delta * sin_k;
+          history[v] = x;
+        }
+
+      rows += num_vectors;
+
+      if (++self->position == window)
+        self->position = 0;
+
+      if (++k == window)
+        k = 0;
+
+      if (self->filled < window)
+        self->filled++;
+
+      self->since_resync++;
+    }
+
+  self->next_index = first_index + num_samples;
+
+  if (self->since_resync >= window * DSP_SDFT_RESYNC_CYCLES)
+    resync (self);
+}
+
+/**
+ * dsp_sdft_get_phasor:
+ * @self: A #DspSdft
+ * @channel: The channel index, starting from 0
+ * @real: (out): return location for the real part, in RMS
+ * @imaginary: (out): return location for the imaginary part, in RMS
+ *
+ * Get the phasor of @channel over the cycle ending with the last
+ * sample processed. The value is the best estimate of the phasor at
+ * the middle of that cycle.
+ *
+ * Returns: %true if the phasor is valid. %false if @channel is invalid
+ * or if less than a cycle of samples has been processed.
+ */
+bool
+dsp_sdft_get_phasor (DspSdft *self,
+                     size_t   channel,
+                     float   *real,
+                     float   *imaginary)
+{
+  float scale;
+
+  if (channel >= self->num_channels)
+    return false;
+
+  scale = M_SQRT2 / self->window;
+
+  *real = self->real[channel / DSP_LANES][channel % DSP_LANES] * scale;
+  *imaginary = self->imaginary[channel / DSP_LANES][channel % DSP_LANES] * scale;
+
+  return dsp_sdft_is_ready (self);
+}
+
+/* 1/N * sum (e^(j*angle*k)), k = 1 .. N */
+static void
+get_window_sum (double  angle,
+                size_t  window,
+                double *real,
+                double *imaginary)
+{
+  double gain = 1;
+
+  if (fabs (sin (angle / 2)) > 1e-12)
+    gain = sin (window * angle / 2) / (window * sin (angle / 2));
+
+  *real = gain * cos (angle * (window + 1) / 2);
+  *imaginary = gain * sin (angle * (window + 1) / 2);
+}
+
+/**
+ * dsp_sdft_get_phasor_at_frequency:
+ * @self: A #DspSdft
+ * @channel: The channel index, starting from 0
+ * @deviation: The frequency of the signal less nominal, over nominal
+ * @real: (out): return location for the real part, in RMS
+ * @imaginary: (out): return location for the imaginary part, in RMS
+ *
+ * Get the phasor of @channel at the instant right after the last
+ * sample processed, that is at the index given to the next
+ * dsp_sdft_process(), for a signal at (1 + @deviation) times the
+ * nominal frequency. Unlike dsp_sdft_get_phasor(), the half cycle the
+ * window lags by, its gain, and the leakage of the negative frequency
+ * are corrected for, so that off nominal frequency the error is only
+ * that of @deviation.
+ *
+ * Returns: %true if the phasor is valid, as for dsp_sdft_get_phasor().
+ */
+bool
+dsp_sdft_get_phasor_at_frequency (DspSdft *self,
+                                  size_t   channel,
+                                  double   deviation,
+                                  float   *real,
+                                  float   *imaginary)
+{
+  double k1_re, k1_im, k2_re, k2_im, sum_re, sum_im;
+  double x_re, x_im, rotation, determinant;
+  float x_real, x_imaginary;
+  bool valid;
+
+  if (channel >= self->num_channels)
+    return false;
+
+  valid = dsp_sdft_get_phasor (self, channel, &x_real, &x_imaginary);
+
+  if (deviation == 0)
+    {
+      /* A cycle of samples has no leakage, and no lag in angle */
+      *real = x_real;
+      *imaginary = x_imaginary;
+      return valid;
+    }
+
+  x_re = x_real;
+  x_im = x_imaginary;
+
+  get_window_sum (-2 * M_PI * deviation / self->window, self->window, &k1_re, &k1_im);
+  get_window_sum (2 * M_PI * (2 + deviation) / self->window, self->window, &sum_re, &sum_im);
+
+  rotation = -4 * M_PI * (double) (self->next_index % self->window) / self->window;
+  k2_re = cos (rotation) * sum_re - sin (rotation) * sum_im;
+  k2_im = cos (rotation) * sum_im + sin (rotation) * sum_re;
+
+  determinant = k1_re * k1_re + k1_im * k1_im - k2_re * k2_re - k2_im * k2_im;
+
+  /* Far enough off nominal, or before the frequency is known */
+  if (!(determinant > 0))
+    {
+      *real = x_real;
+      *imaginary = x_imaginary;
+      return false;
+    }
+
+  /* P = (conj (K1) * X - K2 * conj (X)) / (|K1|^2 - |K2|^2) */
+  *real = ((k1_re * x_re + k1_im * x_im) - (k2_re * x_re + k2_im * x_im)) / determinant;
+  *imaginary = ((k1_re * x_im - k1_im * x_re) - (k2_im * x_re - k2_re * x_im)) / determinant;
+
+  return valid;
+}
@@ -0,0 +1,55 @@
+/* dsp-sdft.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DSP_SDFT_H
+#define DSP_SDFT_H
+
+
+#include "dsp-common.h"
+
+/* Recompute the sums from the window once per these many cycles */
+#define DSP_SDFT_RESYNC_CYCLES 50
+
+typedef struct _DspSdft DspSdft;
+
+DspSdft *dsp_sdft_new  (size_t   num_channels,
+                        size_t   samples_per_cycle);
+void     dsp_sdft_free (DspSdft *self);
+void     dsp_sdft_reset (DspSdft *self);
+
+size_t   dsp_sdft_get_num_channels      (DspSdft *self);
+size_t   dsp_sdft_get_samples_per_cycle (DspSdft *self);
+size_t   dsp_sdft_get_row_size          (DspSdft *self);
+bool     dsp_sdft_is_ready              (DspSdft *self);
+
+void     dsp_sdft_process (DspSdft     *self,
+                           const float *samples,
+                           size_t       num_samples,
+                           uint64_t     first_index);
+bool     dsp_sdft_get_phasor (DspSdft *self,
+                              size_t   channel,
+                              float   *real,
+                              float   *imaginary);
+bool     dsp_sdft_get_phasor_at_frequency (DspSdft *self,
+                                           size_t   channel,
+                                           double   deviation,
+                                           float   *real,
+                                           float   *imaginary);
+
+
+#endif /* DSP_SDFT_H */
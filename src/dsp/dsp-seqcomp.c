@@ -0,0 +1,92 @@
+/* dsp-seqcomp.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dsp-seqcomp.h"
+
+/*
+ * Symmetrical components of three phase phasors A, B and C:
+ *
+ *   zero     = (A + B + C) / 3
+ *   positive = (A + a B + a^2 C) / 3
+ *   negative = (A + a^2 B + a C) / 3,  a = e^(j*2*pi/3)
+ *
+ * As a + a^2 = -1 and a - a^2 = j*sqrt(3), with S = B + C and
+ * D = B - C, these are
+ *
+ *   positive = (A - S/2 + j*sqrt(3)/2 * D) / 3
+ *   negative = (A - S/2 - j*sqrt(3)/2 * D) / 3
+ *
+ * which takes 2 multiplications per component instead of 8.
+ */
+
+static inline void
+store (float    *array,
+       size_t    v,
+       dsp_v4sf  value)
+{
+  if (array)
+    ((dsp_v4sf *) array)[v] = value;
+}
+
+/**
+ * dsp_seqcomp_process:
+ * @phases: The phasors of phase A, B and C
+ * @sequences: Return location for the zero, positive and negative
+ * sequence phasors, indexed by #DspSequence. Arrays that are %NULL
+ * are not computed.
+ * @count: Number of phasors in each array
+ *
+ * Compute the symmetrical components of @count sets of three phase
+ * phasors. The sets are independent, they can be PMUs of a frame or
+ * a phasor over a batch of frames.
+ */
+void
+dsp_seqcomp_process (const DspPhasorArray phases[3],
+                     DspPhasorArray       sequences[3],
+                     size_t               count)
+{
+  const dsp_v4sf *ar = (const dsp_v4sf *) phases[0].real;
+  const dsp_v4sf *ai = (const dsp_v4sf *) phases[0].imaginary;
+  const dsp_v4sf *br = (const dsp_v4sf *) phases[1].real;
+  const dsp_v4sf *bi = (const dsp_v4sf *) phases[1].imaginary;
+  const dsp_v4sf *cr = (const dsp_v4sf *) phases[2].real;
+  const dsp_v4sf *ci = (const dsp_v4sf *) phases[2].imaginary;
+  const float third = 1.0f / 3;
+  const float k = 0.8660254f / 3; /* sqrt(3)/2 / 3 */
+  size_t num_vectors = DSP_NUM_VECTORS (count);
+
+  for (size_t v = 0; v < num_vectors; v++)
+    {
+      dsp_v4sf sum_r = br[v] + cr[v];
+      dsp_v4sf sum_i = bi[v] + ci[v];
+      dsp_v4sf diff_r = br[v] - cr[v];
+      dsp_v4sf diff_i = bi[v] - ci[v];
+      dsp_v4sf common_r = (ar[v] - 0.5f * sum_r) * third;
+      dsp_v4sf common_i = (ai[v] - 0.5f * sum_i) * third;
+
+      store (sequences[DSP_SEQUENCE_ZERO].real, v, (ar[v] + sum_r) * third);
+      store (sequences[DSP_SEQUENCE_ZERO].imaginary, v, (ai[v] + sum_i) * third);
+
+      /* j * k * D = -k * D.imaginary + j * k * D.real */
+      store (sequences[DSP_SEQUENCE_POSITIVE].real, v, common_r - k * diff_i);
+      store (sequences[DSP_SEQUENCE_POSITIVE].imaginary, v, common_i + k * diff_r);
+
+      store (sequences[DSP_SEQUENCE_NEGATIVE].real, v, common_r + k * diff_i);
+      store (sequences[DSP_SEQUENCE_NEGATIVE].imaginary, v, common_i - k * diff_r);
+    }
+}
@@ -0,0 +1,47 @@
+/* dsp-seqcomp.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DSP_SEQCOMP_H
+#define DSP_SEQCOMP_H
+
+
+#include "dsp-common.h"
+
+typedef enum
+{
+  DSP_SEQUENCE_ZERO,
+  DSP_SEQUENCE_POSITIVE,
+  DSP_SEQUENCE_NEGATIVE,
+} DspSequence;
+
+/*
+ * Phasors stored as separate arrays of real and imaginary parts, each
+ * aligned to DSP_ALIGNMENT and padded to a multiple of DSP_LANES.
+ */
+typedef struct
+{
+  float *real;
+  float *imaginary;
+} DspPhasorArray;
+
+void dsp_seqcomp_process (const DspPhasorArray  phases[3],
+                          DspPhasorArray        sequences[3],
+                          size_t                count);
+
+
+#endif /* DSP_SEQCOMP_H */
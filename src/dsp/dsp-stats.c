@@ -0,0 +1,241 @@
+/* dsp-stats.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dsp-stats.h"
+
+/*
+ * Running minimum, maximum, mean and variance of every lane, with
+ * Welford's update: For the nth value x,
+ *
+ *   delta = x - mean
+ *   mean += delta / n
+ *   m2 += delta * (x - mean)
+ *
+ * so that the variance is m2 / n, without the loss of precision of
+ * summing squares. RMS is found from the mean and the variance. Two
+ * sets of statistics (of consecutive intervals, say) are merged with
+ * the pairwise form of the same update, so that longer intervals are
+ * rolled up from shorter ones without seeing the values again.
+ *
+ * Every lane has a value in every update, so the count is shared.
+ */
+
+struct _DspStats
+{
+  size_t num_lanes;
+  size_t num_vectors;
+
+  uint64_t count;
+
+  dsp_v4sf *min;        /* num_vectors each */
+  dsp_v4sf *max;
+  dsp_v4sf *mean;
+  dsp_v4sf *m2;
+};
+
+/**
+ * dsp_stats_new:
+ * @num_lanes: Number of lanes, one per channel say
+ *
+ * Returns: (transfer full) (nullable): A new #DspStats, or %NULL if
+ * out of memory. Free with dsp_stats_free().
+ */
+DspStats *
+dsp_stats_new (size_t num_lanes)
+{
+  DspStats *self;
+
+  self = calloc (1, sizeof *self);
+
+  if (self == NULL)
+    return NULL;
+
+  self->num_lanes = num_lanes;
+  self->num_vectors = DSP_NUM_VECTORS (num_lanes);
+
+  self->min = dsp_calloc_aligned (sizeof (dsp_v4sf) * self->num_vectors);
+  self->max = dsp_calloc_aligned (sizeof (dsp_v4sf) * self->num_vectors);
+  self->mean = dsp_calloc_aligned (sizeof (dsp_v4sf) * self->num_vectors);
+  self->m2 = dsp_calloc_aligned (sizeof (dsp_v4sf) * self->num_vectors);
+
+  if (self->min == NULL || self->max == NULL || self->mean == NULL ||
+      self->m2 == NULL)
+    {
+      dsp_stats_free (self);
+      return NULL;
+    }
+
+  dsp_stats_reset (self);
+
+  return self;
+}
+
+void
+dsp_stats_free (DspStats *self)
+{
+  if (self == NULL)
+    return;
+
+  free (self->min);
+  free (self->max);
+  free (self->mean);
+  free (self->m2);
+  free (self);
+}
+
+/**
+ * dsp_stats_reset:
+ * @self: A #DspStats
+ *
+ * Forget every value, to start a new interval say.
+ */
+void
+dsp_stats_reset (DspStats *self)
+{
+  for (size_t v = 0; v < self->num_vectors; v++)
+    {
+      self->min[v] = dsp_v4sf_set1 (INFINITY);
+      self->max[v] = dsp_v4sf_set1 (-INFINITY);
+      self->mean[v] = dsp_v4sf_set1 (0);
+      self->m2[v] = dsp_v4sf_set1 (0);
+    }
+
+  self->count = 0;
+}
+
+size_t
+dsp_stats_get_num_lanes (DspStats *self)
+{
+  return self->num_lanes;
+}
+
+uint64_t
+dsp_stats_get_count (DspStats *self)
+{
+  return self->count;
+}
+
+/**
+ * dsp_stats_add:
+ * @self: A #DspStats
+ * @values: A value for every lane, dsp_stats_get_num_lanes() rounded
+ * up to a multiple of %DSP_LANES, aligned to %DSP_ALIGNMENT
+ *
+ * Add a value to every lane. The padding lanes are ignored.
+ */
+void
+dsp_stats_add (DspStats    *self,
+               const float *values)
+{
+  const dsp_v4sf *x = (const dsp_v4sf *) values;
+  dsp_v4sf scale;
+
+  self->count++;
+  scale = dsp_v4sf_set1 (1.0f / self->count);
+
+  for (size_t v = 0; v < self->num_vectors; v++)
+    {
+      dsp_v4sf delta = x[v] - self->mean[v];
+
+      self->mean[v] += delta * scale;
+      self->m2[v] += delta * (x[v] - self->mean[v]);
+      self->min[v] = dsp_v4sf_select (x[v] < self->min[v], x[v], self->min[v]);
+      self->max[v] = dsp_v4sf_select (x[v] > self->max[v], x[v], self->max[v]);
+    }
+}
+
+/**
+ * dsp_stats_merge:
+ * @self: A #DspStats
+ * @other: A #DspStats of as many lanes
+ *
+ * Add the values seen by @other to @self, as if they were added with
+ * dsp_stats_add().
+ *
+ * Returns: %true if merged, %false if the number of lanes differ.
+ */
+bool
+dsp_stats_merge (DspStats       *self,
+                 const DspStats *other)
+{
+  dsp_v4sf weight;
+  dsp_v4sf product;
+  uint64_t count;
+
+  if (self->num_lanes != other->num_lanes)
+    return false;
+
+  if (other->count == 0)
+    return true;
+
+  count = self->count + other->count;
+  weight = dsp_v4sf_set1 ((float) other->count / count);
+  product = dsp_v4sf_set1 ((float) self->count * other->count / count);
+
+  for (size_t v = 0; v < self->num_vectors; v++)
+    {
+      dsp_v4sf delta = other->mean[v] - self->mean[v];
+
+      self->mean[v] += delta * weight;
+      self->m2[v] += other->m2[v] + delta * delta * product;
+      self->min[v] = dsp_v4sf_select (other->min[v] < self->min[v],
+                                      other->min[v], self->min[v]);
+      self->max[v] = dsp_v4sf_select (other->max[v] > self->max[v],
+                                      other->max[v], self->max[v]);
+    }
+
+  self->count = count;
+
+  return true;
+}
+
+/**
+ * dsp_stats_get:
+ * @self: A #DspStats
+ * @lane: The lane, starting from 0
+ * @summary: (out): Return location for the statistics of @lane
+ *
+ * The standard deviation is of the values seen, not an estimate of
+ * a population.
+ *
+ * Returns: %true if @summary was set, %false if @lane is invalid or no
+ * value was added.
+ */
+bool
+dsp_stats_get (DspStats        *self,
+               size_t           lane,
+               DspStatsSummary *summary)
+{
+  size_t v = lane / DSP_LANES;
+  size_t l = lane % DSP_LANES;
+  float variance;
+
+  if (lane >= self->num_lanes || self->count == 0)
+    return false;
+
+  variance = self->m2[v][l] / self->count;
+
+  summary->count = self->count;
+  summary->min = self->min[v][l];
+  summary->max = self->max[v][l];
+  summary->mean = self->mean[v][l];
+  summary->stddev = sqrtf (variance);
+  summary->rms = sqrtf (summary->mean * summary->mean + variance);
+
+  return true;
+}
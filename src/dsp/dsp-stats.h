@@ -0,0 +1,53 @@
+/* dsp-stats.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DSP_STATS_H
+#define DSP_STATS_H
+
+
+#include "dsp-common.h"
+
+typedef struct
+{
+  uint64_t count;
+  float min;
+  float max;
+  float mean;
+  float rms;
+  float stddev;
+} DspStatsSummary;
+
+typedef struct _DspStats DspStats;
+
+DspStats *dsp_stats_new   (size_t    num_lanes);
+void      dsp_stats_free  (DspStats *self);
+void      dsp_stats_reset (DspStats *self);
+
+size_t    dsp_stats_get_num_lanes (DspStats *self);
+uint64_t  dsp_stats_get_count     (DspStats *self);
+
+void      dsp_stats_add   (DspStats       *self,
+                           const float    *values);
+bool      dsp_stats_merge (DspStats       *self,
+                           const DspStats *other);
+bool      dsp_stats_get   (DspStats        *self,
+                           size_t           lane,
+                           DspStatsSummary *summary);
+
+
+#endif /* DSP_STATS_H */
@@ -0,0 +1,175 @@
+/* dsp-trigger.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dsp-trigger.h"
+
+/*
+ * Checks every frame for disturbances: ROCOF, frequency and magnitude
+ * out of limits, a step in magnitude or a change of a status word.
+ * Each condition is a compare or two per lane, with the previous
+ * magnitude and status word as the only state, so that it can run on
+ * every frame at the full reporting rate.
+ *
+ * Steps and status word changes can't be seen on the first frame after
+ * a reset, as there is nothing to compare with.
+ */
+
+struct _DspTrigger
+{
+  size_t num_lanes;
+  size_t num_vectors;
+
+  /* Disabled limits are turned into ones that can't be crossed */
+  dsp_v4sf rocof;
+  dsp_v4sf freq_low;
+  dsp_v4sf freq_high;
+  dsp_v4sf sag;
+  dsp_v4sf swell;
+  dsp_v4sf step;
+  dsp_v4si digital;
+
+  dsp_v4sf *previous_magnitude;
+  dsp_v4si *previous_digital;
+  bool primed;
+};
+
+static float
+limit_or (float limit,
+          float disabled)
+{
+  return limit != 0 ? limit : disabled;
+}
+
+/**
+ * dsp_trigger_new:
+ * @num_lanes: Number of lanes, one per PMU say
+ * @limits: The limits of the conditions
+ *
+ * Returns: (transfer full) (nullable): A new #DspTrigger, or %NULL if
+ * out of memory. Free with dsp_trigger_free().
+ */
+DspTrigger *
+dsp_trigger_new (size_t                  num_lanes,
+                 const DspTriggerLimits *limits)
+{
+  DspTrigger *self;
+
+  self = calloc (1, sizeof *self);
+
+  if (self == NULL)
+    return NULL;
+
+  self->num_lanes = num_lanes;
+  self->num_vectors = DSP_NUM_VECTORS (num_lanes);
+
+  self->rocof = dsp_v4sf_set1 (limit_or (limits->rocof, INFINITY));
+  self->freq_low = dsp_v4sf_set1 (limit_or (limits->freq_low, -INFINITY));
+  self->freq_high = dsp_v4sf_set1 (limit_or (limits->freq_high, INFINITY));
+  self->sag = dsp_v4sf_set1 (limit_or (limits->sag, -INFINITY));
+  self->swell = dsp_v4sf_set1 (limit_or (limits->swell, INFINITY));
+  self->step = dsp_v4sf_set1 (limit_or (limits->step, INFINITY));
+  self->digital = limits->digital ? (dsp_v4si) { -1, -1, -1, -1 } : (dsp_v4si) { 0 };
+
+  self->previous_magnitude = dsp_calloc_aligned (sizeof (dsp_v4sf) * self->num_vectors);
+  self->previous_digital = dsp_calloc_aligned (sizeof (dsp_v4si) * self->num_vectors);
+
+  if (self->previous_magnitude == NULL || self->previous_digital == NULL)
+    {
+      dsp_trigger_free (self);
+      return NULL;
+    }
+
+  return self;
+}
+
+void
+dsp_trigger_free (DspTrigger *self)
+{
+  if (self == NULL)
+    return;
+
+  free (self->previous_magnitude);
+  free (self->previous_digital);
+  free (self);
+}
+
+/**
+ * dsp_trigger_reset:
+ * @self: A #DspTrigger
+ *
+ * Forget the previous frame, after a gap in frames say.
+ */
+void
+dsp_trigger_reset (DspTrigger *self)
+{
+  self->primed = false;
+}
+
+size_t
+dsp_trigger_get_num_lanes (DspTrigger *self)
+{
+  return self->num_lanes;
+}
+
+/**
+ * dsp_trigger_process:
+ * @self: A #DspTrigger
+ * @input: The values of a frame
+ * @active: Return location for the #DspTriggerType of the conditions
+ * met in each lane, of dsp_trigger_get_num_lanes() rounded up to a
+ * multiple of %DSP_LANES, aligned to %DSP_ALIGNMENT
+ *
+ * Check the conditions on a frame. Conditions are reported for as long
+ * as they are met, a step or a status word change only for the frame
+ * it is seen in.
+ */
+void
+dsp_trigger_process (DspTrigger            *self,
+                     const DspTriggerInput *input,
+                     uint32_t              *active)
+{
+  const dsp_v4sf *freq = (const dsp_v4sf *) input->freq;
+  const dsp_v4sf *rocof = (const dsp_v4sf *) input->rocof;
+  const dsp_v4sf *magnitude_min = (const dsp_v4sf *) input->magnitude_min;
+  const dsp_v4sf *magnitude_max = (const dsp_v4sf *) input->magnitude_max;
+  const dsp_v4sf *magnitude = (const dsp_v4sf *) input->magnitude;
+  const dsp_v4si *digital = (const dsp_v4si *) input->digital;
+  dsp_v4si primed = self->primed ? (dsp_v4si) { -1, -1, -1, -1 } : (dsp_v4si) { 0 };
+
+  for (size_t v = 0; v < self->num_vectors; v++)
+    {
+      dsp_v4si bits;
+
+      bits = (dsp_v4sf_abs (rocof[v]) > self->rocof) & DSP_TRIGGER_ROCOF;
+      bits |= (freq[v] < self->freq_low) & DSP_TRIGGER_FREQ_LOW;
+      bits |= (freq[v] > self->freq_high) & DSP_TRIGGER_FREQ_HIGH;
+      bits |= (magnitude_min[v] < self->sag) & DSP_TRIGGER_SAG;
+      bits |= (magnitude_max[v] > self->swell) & DSP_TRIGGER_SWELL;
+      bits |= (dsp_v4sf_abs (magnitude[v] - self->previous_magnitude[v]) > self->step) &
+        primed & DSP_TRIGGER_STEP;
+      bits |= (digital[v] != self->previous_digital[v]) &
+        primed & self->digital & DSP_TRIGGER_DIGITAL;
+
+      self->previous_magnitude[v] = magnitude[v];
+      self->previous_digital[v] = digital[v];
+
+      ((dsp_v4si *) active)[v] = bits;
+    }
+
+  self->primed = true;
+}
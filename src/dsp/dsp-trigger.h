@@ -0,0 +1,80 @@
+/* dsp-trigger.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DSP_TRIGGER_H
+#define DSP_TRIGGER_H
+
+
+#include "dsp-common.h"
+
+typedef enum
+{
+  DSP_TRIGGER_ROCOF     = 1 << 0,
+  DSP_TRIGGER_FREQ_LOW  = 1 << 1,
+  DSP_TRIGGER_FREQ_HIGH = 1 << 2,
+  DSP_TRIGGER_SAG       = 1 << 3,
+  DSP_TRIGGER_SWELL     = 1 << 4,
+  DSP_TRIGGER_STEP      = 1 << 5,
+  DSP_TRIGGER_DIGITAL   = 1 << 6,
+} DspTriggerType;
+
+/*
+ * The limits of every condition. A limit of 0 disables its condition.
+ * Magnitudes are in any unit, as long as the input is of the same unit
+ * (per unit of the nominal voltage, say).
+ */
+typedef struct _DspTriggerLimits
+{
+  float rocof;          /* Highest absolute ROCOF, in Hz/s */
+  float freq_low;       /* Lowest frequency, in Hz */
+  float freq_high;      /* Highest frequency, in Hz */
+  float sag;            /* Lowest magnitude */
+  float swell;          /* Highest magnitude */
+  float step;           /* Highest change of magnitude in a frame */
+  bool  digital;        /* Whether a change of status word triggers */
+} DspTriggerLimits;
+
+/*
+ * The values of a frame, one per lane. The arrays are aligned to
+ * %DSP_ALIGNMENT and padded to a multiple of %DSP_LANES.
+ */
+typedef struct _DspTriggerInput
+{
+  const float    *freq;
+  const float    *rocof;
+  const float    *magnitude_min;  /* Checked for sags */
+  const float    *magnitude_max;  /* Checked for swells */
+  const float    *magnitude;      /* Checked for steps */
+  const uint32_t *digital;
+} DspTriggerInput;
+
+typedef struct _DspTrigger DspTrigger;
+
+DspTrigger *dsp_trigger_new   (size_t                  num_lanes,
+                               const DspTriggerLimits *limits);
+void        dsp_trigger_free  (DspTrigger             *self);
+void        dsp_trigger_reset (DspTrigger             *self);
+
+size_t      dsp_trigger_get_num_lanes (DspTrigger *self);
+
+void        dsp_trigger_process (DspTrigger            *self,
+                                 const DspTriggerInput *input,
+                                 uint32_t              *active);
+
+
+#endif /* DSP_TRIGGER_H */
@@ -0,0 +1,37 @@
+/* dsp.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DSP_H
+#define DSP_H
+
+
+#include "dsp-common.h"
+#include "dsp-sdft.h"
+#include "dsp-freq.h"
+#include "dsp-seqcomp.h"
+#include "dsp-power.h"
+#include "dsp-decimate.h"
+#include "dsp-trigger.h"
+#include "dsp-fft.h"
+#include "dsp-harmonics.h"
+#include "dsp-stats.h"
+#include "dsp-modal.h"
+#include "dsp-lse.h"
+
+
+#endif /* DSP_H */
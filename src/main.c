@@ -19,6 +19,7 @@
 
 #include <gtk/gtk.h>
 #include "pmu-app.h"
+#include "pmu-trace.h"
 
 int main (int argc, char *argv[])
 {
@@ -29,5 +30,8 @@ int main (int argc, char *argv[])
 
   status = g_application_run (app, argc, argv);
 
+  /* Save the records not yet written */
+  pmu_trace_shutdown ();
+
   return status;
 }
@@ -23,6 +23,8 @@
 #include "pmu-details.h"
 #include "pmu-server.h"
 #include "pmu-spi.h"
+#include "pmu-rt.h"
+#include "pmu-trace.h"
 #include "c37/c37.h"
 
 #include "pmu-app.h"
@@ -152,6 +154,11 @@ pmu_app_startup (GApplication *app)
                                    app);
   pmu_details_get_default ();
 
+  if (pmu_details_get_lock_memory ())
+    pmu_rt_lock_memory ();
+
+  pmu_trace_init (pmu_details_get_trace_level ());
+
   self->pmu_config_one = cts_conf_get_default_config_one ();
   self->pmu_config_two = cts_conf_get_default_config_two ();
 
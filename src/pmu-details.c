@@ -20,6 +20,8 @@
 #include "pmu-config.h"
 
 #include "pmu-details.h"
+#include "pmu-estimator.h"
+#include "pmu-server.h"
 
 
 struct _PmuDetails
@@ -31,6 +33,52 @@ struct _PmuDetails
   gboolean first_run;
   guint    pmu_id;
   guint    port_number;
+  gint     data_rate;
+
+  /* Real-time tuning, see pmu-rt.c */
+  gint     spi_priority;
+  gint     server_priority;
+  gint     spi_cpu;
+  gint     server_cpu;
+  gboolean lock_memory;
+
+  gchar   *clock_source;
+  gchar   *trace_level;
+
+  /* Frames made up in place of reading the device, see pmu-spi.c */
+  gboolean synthetic_source;
+
+  /* Phasor estimation from samples, see pmu-estimator.c */
+  gboolean estimate_phasors;
+  guint    nominal_freq;
+  guint    samples_per_cycle;
+  gdouble  voltage_scale;
+  gdouble  current_scale;
+  gboolean measurement_class;
+  guint    harmonic_order;
+
+  /* Disturbance triggers, see pmu-trigger.c */
+  gdouble  nominal_voltage;
+  gdouble  trigger_rocof;
+  gdouble  trigger_frequency;
+  gdouble  trigger_magnitude;
+  gdouble  trigger_step;
+  gboolean trigger_digital;
+  gdouble  capture_pre_trigger;
+  gdouble  capture_post_trigger;
+
+  /* Oscillation monitoring, see pmu-oscillation.c */
+  gdouble  oscillation_damping;
+  gdouble  oscillation_freq_low;
+  gdouble  oscillation_freq_high;
+  gdouble  oscillation_window;
+
+  /* Linear state estimation, see pmu-lse.c */
+  gchar   *lse_network;
+  gdouble  lse_residual;
+
+  /* Statistics, see pmu-stats.c */
+  GArray  *stats_intervals;
 };
 
 GSettings *settings;
@@ -57,6 +105,10 @@ pmu_details_finalize (GObject *object)
 
   g_free (self->station_name);
   g_free (self->admin_ip);
+  g_free (self->clock_source);
+  g_free (self->trace_level);
+  g_free (self->lse_network);
+  g_clear_pointer (&self->stats_intervals, g_array_unref);
 
   G_OBJECT_CLASS (pmu_details_parent_class)->finalize (object);
 }
@@ -186,6 +238,79 @@ pmu_details_populate (PmuDetails *self)
                 "admin-ip", admin_ip,
                 "port-number", g_settings_get_uint (settings, "port"),
                 NULL);
+
+  self->data_rate = g_settings_get_int (settings, "data-rate");
+  self->spi_priority = g_settings_get_int (settings, "spi-priority");
+  self->server_priority = g_settings_get_int (settings, "server-priority");
+  self->spi_cpu = g_settings_get_int (settings, "spi-cpu");
+  self->server_cpu = g_settings_get_int (settings, "server-cpu");
+  self->lock_memory = g_settings_get_boolean (settings, "lock-memory");
+
+  g_free (self->clock_source);
+  self->clock_source = g_settings_get_string (settings, "clock-source");
+
+  g_free (self->trace_level);
+  self->trace_level = g_settings_get_string (settings, "trace-level");
+
+  {
+    g_autofree gchar *mode = g_settings_get_string (settings, "acquisition-mode");
+
+    self->estimate_phasors = g_str_equal (mode, "samples");
+    self->synthetic_source = g_str_equal (mode, "synthetic");
+  }
+
+  self->nominal_freq = g_settings_get_uint (settings, "nominal-frequency");
+  self->samples_per_cycle = g_settings_get_uint (settings, "samples-per-cycle");
+  self->voltage_scale = g_settings_get_double (settings, "voltage-scale");
+  self->current_scale = g_settings_get_double (settings, "current-scale");
+
+  {
+    g_autofree gchar *class = g_settings_get_string (settings, "performance-class");
+
+    self->measurement_class = g_str_equal (class, "M");
+  }
+
+  self->harmonic_order = g_settings_get_uint (settings, "harmonic-order");
+
+  /* The FFT of harmonics needs a power of 2 window, below Nyquist */
+  if (self->harmonic_order &&
+      (!self->estimate_phasors ||
+       (self->samples_per_cycle & (self->samples_per_cycle - 1)) != 0 ||
+       self->harmonic_order >= self->samples_per_cycle / 2))
+    {
+      if (self->estimate_phasors)
+        g_warning ("Harmonics up to %u can't be found from %u samples per cycle, not reporting harmonics",
+                   self->harmonic_order, self->samples_per_cycle);
+      self->harmonic_order = 0;
+    }
+
+  self->nominal_voltage = g_settings_get_double (settings, "nominal-voltage");
+  self->trigger_rocof = g_settings_get_double (settings, "trigger-rocof");
+  self->trigger_frequency = g_settings_get_double (settings, "trigger-frequency");
+  self->trigger_magnitude = g_settings_get_double (settings, "trigger-magnitude");
+  self->trigger_step = g_settings_get_double (settings, "trigger-step");
+  self->trigger_digital = g_settings_get_boolean (settings, "trigger-digital");
+  self->capture_pre_trigger = g_settings_get_double (settings, "capture-pre-trigger");
+  self->capture_post_trigger = g_settings_get_double (settings, "capture-post-trigger");
+  self->oscillation_damping = g_settings_get_double (settings, "oscillation-damping");
+  self->oscillation_freq_low = g_settings_get_double (settings, "oscillation-frequency-low");
+  self->oscillation_freq_high = g_settings_get_double (settings, "oscillation-frequency-high");
+  self->oscillation_window = g_settings_get_double (settings, "oscillation-window");
+  g_free (self->lse_network);
+  self->lse_network = g_settings_get_string (settings, "state-estimator-network");
+  self->lse_residual = g_settings_get_double (settings, "state-estimator-residual");
+
+  {
+    g_autoptr(GVariant) value = g_settings_get_value (settings, "statistics-intervals");
+    const guint32 *intervals;
+    gsize length;
+
+    intervals = g_variant_get_fixed_array (value, &length, sizeof (guint32));
+
+    g_clear_pointer (&self->stats_intervals, g_array_unref);
+    self->stats_intervals = g_array_sized_new (FALSE, FALSE, sizeof (guint), length);
+    g_array_append_vals (self->stats_intervals, intervals, length);
+  }
 }
 
 static void
@@ -230,6 +355,308 @@ pmu_details_get_pmu_id (void)
   return 0;
 }
 
+gint
+pmu_details_get_spi_priority (void)
+{
+  if (default_details)
+    return default_details->spi_priority;
+
+  return 0;
+}
+
+gint
+pmu_details_get_server_priority (void)
+{
+  if (default_details)
+    return default_details->server_priority;
+
+  return 0;
+}
+
+gint
+pmu_details_get_spi_cpu (void)
+{
+  if (default_details)
+    return default_details->spi_cpu;
+
+  return -1;
+}
+
+gint
+pmu_details_get_server_cpu (void)
+{
+  if (default_details)
+    return default_details->server_cpu;
+
+  return -1;
+}
+
+gboolean
+pmu_details_get_lock_memory (void)
+{
+  if (default_details)
+    return default_details->lock_memory;
+
+  return FALSE;
+}
+
+gchar *
+pmu_details_get_clock_source (void)
+{
+  if (default_details)
+    return default_details->clock_source;
+
+  return NULL;
+}
+
+gchar *
+pmu_details_get_trace_level (void)
+{
+  if (default_details)
+    return default_details->trace_level;
+
+  return NULL;
+}
+
+gint
+pmu_details_get_data_rate (void)
+{
+  if (default_details && default_details->data_rate > 0)
+    return default_details->data_rate;
+
+  return 50;
+}
+
+gboolean
+pmu_details_get_synthetic_source (void)
+{
+  if (default_details)
+    return default_details->synthetic_source;
+
+  return FALSE;
+}
+
+gboolean
+pmu_details_get_estimate_phasors (void)
+{
+  if (default_details)
+    return default_details->estimate_phasors;
+
+  return FALSE;
+}
+
+guint
+pmu_details_get_nominal_freq (void)
+{
+  if (default_details && default_details->nominal_freq == 60)
+    return 60;
+
+  return 50;
+}
+
+guint
+pmu_details_get_samples_per_cycle (void)
+{
+  if (default_details)
+    return default_details->samples_per_cycle;
+
+  return 64;
+}
+
+gdouble
+pmu_details_get_voltage_scale (void)
+{
+  if (default_details)
+    return default_details->voltage_scale;
+
+  return 1.0;
+}
+
+gdouble
+pmu_details_get_current_scale (void)
+{
+  if (default_details)
+    return default_details->current_scale;
+
+  return 1.0;
+}
+
+gboolean
+pmu_details_get_measurement_class (void)
+{
+  if (default_details)
+    return default_details->measurement_class;
+
+  return FALSE;
+}
+
+/*
+ * The highest harmonic reported, 0 if none. Always 0 if not in
+ * samples mode.
+ */
+guint
+pmu_details_get_harmonic_order (void)
+{
+  if (default_details)
+    return default_details->harmonic_order;
+
+  return 0;
+}
+
+gdouble
+pmu_details_get_nominal_voltage (void)
+{
+  if (default_details && default_details->nominal_voltage > 0)
+    return default_details->nominal_voltage;
+
+  return 230.0;
+}
+
+gdouble
+pmu_details_get_trigger_rocof (void)
+{
+  if (default_details)
+    return default_details->trigger_rocof;
+
+  return 0;
+}
+
+gdouble
+pmu_details_get_trigger_frequency (void)
+{
+  if (default_details)
+    return default_details->trigger_frequency;
+
+  return 0;
+}
+
+gdouble
+pmu_details_get_trigger_magnitude (void)
+{
+  if (default_details)
+    return default_details->trigger_magnitude;
+
+  return 0;
+}
+
+gdouble
+pmu_details_get_trigger_step (void)
+{
+  if (default_details)
+    return default_details->trigger_step;
+
+  return 0;
+}
+
+gboolean
+pmu_details_get_trigger_digital (void)
+{
+  if (default_details)
+    return default_details->trigger_digital;
+
+  return FALSE;
+}
+
+gdouble
+pmu_details_get_capture_before (void)
+{
+  if (default_details)
+    return default_details->capture_pre_trigger;
+
+  return 1.0;
+}
+
+gdouble
+pmu_details_get_capture_after (void)
+{
+  if (default_details)
+    return default_details->capture_post_trigger;
+
+  return 2.0;
+}
+
+gdouble
+pmu_details_get_oscillation_damping (void)
+{
+  if (default_details)
+    return default_details->oscillation_damping;
+
+  return 0;
+}
+
+gdouble
+pmu_details_get_oscillation_freq_low (void)
+{
+  if (default_details)
+    return default_details->oscillation_freq_low;
+
+  return 0.1;
+}
+
+gdouble
+pmu_details_get_oscillation_freq_high (void)
+{
+  if (default_details)
+    return default_details->oscillation_freq_high;
+
+  return 2.5;
+}
+
+gdouble
+pmu_details_get_oscillation_window (void)
+{
+  if (default_details)
+    return default_details->oscillation_window;
+
+  return 30.0;
+}
+
+/**
+ * pmu_details_get_lse_network:
+ *
+ * Returns: (nullable): The path of the network of the state
+ * estimator, %NULL if not estimating.
+ */
+const gchar *
+pmu_details_get_lse_network (void)
+{
+  if (default_details && default_details->lse_network &&
+      *default_details->lse_network)
+    return default_details->lse_network;
+
+  return NULL;
+}
+
+gdouble
+pmu_details_get_lse_residual (void)
+{
+  if (default_details)
+    return default_details->lse_residual;
+
+  return 3.0;
+}
+
+/**
+ * pmu_details_get_stats_intervals:
+ * @num_intervals: (out): Return location for the number of intervals
+ *
+ * Returns: (transfer none): The statistics intervals, in seconds
+ */
+const guint *
+pmu_details_get_stats_intervals (guint *num_intervals)
+{
+  static const guint intervals[] = { 1, 60 };
+
+  if (default_details && default_details->stats_intervals)
+    {
+      *num_intervals = default_details->stats_intervals->len;
+      return (const guint *) default_details->stats_intervals->data;
+    }
+
+  *num_intervals = G_N_ELEMENTS (intervals);
+  return intervals;
+}
+
 gboolean
 pmu_details_get_is_first_run (void)
 {
@@ -240,23 +667,71 @@ pmu_details_get_is_first_run (void)
   return TRUE;
 }
 
+/*
+ * channel_names with the names of the harmonic analogs, laid out as in
+ * pmu_estimator_update_data(), after the other analogs.
+ */
+static char **
+get_channel_names (guint harmonic_order)
+{
+  /* Names of the estimator channels, in order */
+  static const char *phases[] = { "VR", "VY", "VB", "IR", "IY", "IB" };
+  static char **names = NULL;
+  guint first = 8 + PMU_ESTIMATOR_FIRST_HARMONIC_ANALOG - 1;
+  guint count = PMU_ESTIMATOR_NUM_HARMONIC_ANALOGS (harmonic_order);
+  guint n = 0;
+
+  if (count == 0)
+    return channel_names;
+
+  /* Kept for as long as the configuration is */
+  if (names)
+    return names;
+
+  names = g_new0 (char *, g_strv_length (channel_names) + count + 1);
+
+  for (guint i = 0; i < first; i++)
+    names[n++] = channel_names[i];
+
+  for (guint c = 0; c < G_N_ELEMENTS (phases); c++)
+    names[n++] = g_strdup_printf ("%s THD          ", phases[c]);
+
+  for (guint c = 0; c < G_N_ELEMENTS (phases); c++)
+    for (guint h = 2; h <= harmonic_order; h++)
+      names[n++] = g_strdup_printf ("%s H%-12u", phases[c], h);
+
+  for (guint i = first; channel_names[i]; i++)
+    names[n++] = channel_names[i];
+
+  return names;
+}
+
 void
 pmu_details_configure_pmu (PmuDetails *details)
 {
   CtsData *data;
   CtsConf *config1 = cts_conf_get_default_config_one ();
+  /* A new configuration has no PMU yet */
+  gboolean reconfigure = cts_conf_get_num_of_pmu (config1) > 0;
+  guint harmonic_order = pmu_details_get_harmonic_order ();
+  guint num_harmonics = PMU_ESTIMATOR_NUM_HARMONIC_ANALOGS (harmonic_order);
+
+  if (!cts_common_set_clock_source (pmu_details_get_clock_source ()))
+    g_warning ("Using clock source '%s' failed, using system clock",
+               pmu_details_get_clock_source ());
 
   cts_conf_set_id_code (config1, pmu_details_get_pmu_id ());
   cts_conf_set_time_base (config1, 100000);
-  cts_conf_set_data_rate (config1, 50);
+  cts_conf_set_data_rate (config1, pmu_details_get_data_rate ());
   cts_conf_set_num_of_pmu (config1, 1);
   cts_conf_set_station_name_of_pmu (config1, 1,
                                     pmu_details_get_station_name (),
                                     strlen (pmu_details_get_station_name ()));
   cts_conf_set_id_code_of_pmu (config1, 1, pmu_details_get_pmu_id ());
+  cts_conf_set_nominal_freq_of_pmu (config1, 1, pmu_details_get_nominal_freq ());
 
   cts_conf_set_num_of_phasors_of_pmu (config1, 1, 8);
-  cts_conf_set_num_of_analogs_of_pmu (config1, 1, 14);
+  cts_conf_set_num_of_analogs_of_pmu (config1, 1, 14 + num_harmonics);
   cts_conf_set_num_of_status_of_pmu (config1, 1, 1);
 
   cts_conf_set_freq_data_type_of_pmu (config1, 1, VALUE_TYPE_INT);
@@ -264,6 +739,16 @@ pmu_details_configure_pmu (PmuDetails *details)
   cts_conf_set_analog_data_type_of_pmu (config1, 1, VALUE_TYPE_INT);
   cts_conf_set_all_analog_measure_type_of_pmu (config1, 1, VALUE_TYPE_RMS);
   cts_conf_set_all_analog_conv_of_pmu (config1, 1, 10000);
+  /* Power, in steps of 1 W (var, VA) */
+  for (int i = 1; i <= 12; i++)
+    cts_conf_set_analog_conv_of_pmu (config1, 1, i, 100000);
+  /* Frequency and ROCOF, in steps of 0.01 Hz and 0.01 Hz/s */
+  cts_conf_set_analog_conv_of_pmu (config1, 1, 13, 1000);
+  cts_conf_set_analog_conv_of_pmu (config1, 1, 14, 1000);
+  /* THD in steps of 0.01 %, harmonics of 0.01 V (A) */
+  for (guint i = 0; i < num_harmonics; i++)
+    cts_conf_set_analog_conv_of_pmu (config1, 1,
+                                     PMU_ESTIMATOR_FIRST_HARMONIC_ANALOG + i, 1000);
 
   cts_conf_set_phasor_data_type_of_pmu (config1, 1, VALUE_TYPE_INT);
   cts_conf_set_phasor_complex_type_of_pmu (config1, 1, VALUE_TYPE_RECTANGULAR);
@@ -279,11 +764,18 @@ pmu_details_configure_pmu (PmuDetails *details)
 
   cts_conf_set_all_phasor_conv_of_pmu (config1, 1, 100000);
 
-  cts_conf_set_channel_names_of_pmu (config1, 1, channel_names);
+  cts_conf_set_channel_names_of_pmu (config1, 1, get_channel_names (harmonic_order));
   cts_conf_update_time (config1);
 
   data = cts_data_get_default ();
   cts_data_set_config (data, config1);
+
+  /* Tell the clients, whose CFG-2 and subsets are of the old one */
+  if (reconfigure)
+    {
+      cts_conf_increment_change_count_of_pmu (config1, 1);
+      pmu_server_config_changed ();
+    }
 }
 
 static PmuDetails *
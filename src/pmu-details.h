@@ -26,12 +26,43 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (PmuDetails, pmu_details, PMU, DETAILS, GObject)
 
-void        pmu_details_save_settings    (void);
-gchar      *pmu_details_get_station_name (void);
-gchar      *pmu_details_get_admin_ip     (void);
-guint       pmu_details_get_port_number  (void);
-guint       pmu_details_get_pmu_id       (void);
-gboolean    pmu_details_get_is_first_run (void);
-PmuDetails *pmu_details_get_default      (void);
+void        pmu_details_save_settings         (void);
+gchar      *pmu_details_get_station_name      (void);
+gchar      *pmu_details_get_admin_ip          (void);
+guint       pmu_details_get_port_number       (void);
+guint       pmu_details_get_pmu_id            (void);
+gint        pmu_details_get_spi_priority      (void);
+gint        pmu_details_get_server_priority   (void);
+gint        pmu_details_get_spi_cpu           (void);
+gint        pmu_details_get_server_cpu        (void);
+gboolean    pmu_details_get_lock_memory       (void);
+gchar      *pmu_details_get_clock_source      (void);
+gchar      *pmu_details_get_trace_level       (void);
+gint        pmu_details_get_data_rate         (void);
+gboolean    pmu_details_get_synthetic_source  (void);
+gboolean    pmu_details_get_estimate_phasors  (void);
+guint       pmu_details_get_nominal_freq      (void);
+guint       pmu_details_get_samples_per_cycle (void);
+gdouble     pmu_details_get_voltage_scale     (void);
+gdouble     pmu_details_get_current_scale     (void);
+gboolean    pmu_details_get_measurement_class (void);
+guint       pmu_details_get_harmonic_order    (void);
+gdouble     pmu_details_get_nominal_voltage   (void);
+gdouble     pmu_details_get_trigger_rocof     (void);
+gdouble     pmu_details_get_trigger_frequency (void);
+gdouble     pmu_details_get_trigger_magnitude (void);
+gdouble     pmu_details_get_trigger_step      (void);
+gboolean    pmu_details_get_trigger_digital   (void);
+gdouble     pmu_details_get_capture_before    (void);
+gdouble     pmu_details_get_capture_after     (void);
+gdouble     pmu_details_get_oscillation_damping   (void);
+gdouble     pmu_details_get_oscillation_freq_low  (void);
+gdouble     pmu_details_get_oscillation_freq_high (void);
+gdouble     pmu_details_get_oscillation_window    (void);
+const gchar *pmu_details_get_lse_network     (void);
+gdouble     pmu_details_get_lse_residual    (void);
+const guint *pmu_details_get_stats_intervals  (guint *num_intervals);
+gboolean    pmu_details_get_is_first_run      (void);
+PmuDetails *pmu_details_get_default           (void);
 
 G_END_DECLS
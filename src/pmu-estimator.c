@@ -0,0 +1,399 @@
+/* pmu-estimator.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dsp/dsp.h"
+
+#include "pmu-estimator.h"
+
+/*
+ * Estimates synchrophasors from raw samples of the voltage and current
+ * waveforms, for devices that can't do it themselves.
+ *
+ * The device samples every channel at samples_per_cycle * nominal_freq
+ * samples per second, with the sampling clock locked to the UTC second,
+ * so that sample 0 of every second is at the top of the second.
+ *
+ * Frequency and ROCOF are estimated from the positive sequence voltage,
+ * taken FREQ_STEPS_PER_CYCLE times a cycle as the window slides. That
+ * is a single lane of DspFreq, the one local PMU: frames of phasors
+ * from the device have its own FREQ and DFREQ, which are sent as they
+ * are.
+ *
+ * Harmonics, if asked for, are found from the FFT of the last
+ * DSP_HARMONICS_CYCLES cycles once per frame, in update_data. For 6
+ * channels of 64 samples a cycle, that is 2 FFTs of 512 points, well
+ * within the time of a frame even on a Pi 4.
+ */
+
+#define FREQ_STEPS_PER_CYCLE 8
+
+struct _PmuEstimator
+{
+  DspSdft *sdft;
+  DspFreq *freq;
+  DspHarmonics *harmonics;
+
+  guint samples_per_cycle;
+  guint nominal_freq;
+  gsize max_samples;
+
+  /* Samples between two phasors given to freq */
+  guint freq_step;
+  guint64 next_index;
+
+  /* Voltage phasors for freq, one lane each */
+  DspPhasorArray phases[3];
+  DspPhasorArray sequences[3];
+  gfloat *phasors;
+
+  gfloat scale[PMU_ESTIMATOR_NUM_CHANNELS];
+
+  /* max_samples rows of dsp_sdft_get_row_size() floats each */
+  gfloat *rows;
+};
+
+/**
+ * pmu_estimator_new:
+ * @samples_per_cycle: Number of samples per cycle at nominal frequency
+ * @nominal_freq: The nominal frequency in Hz
+ * @data_rate: The number of frames reported per second, or if
+ * negative, the number of seconds per frame, as in a CFG frame
+ * @measurement_class: %TRUE for M class frequency filtering, %FALSE
+ * for P class
+ * @max_samples: The maximum number of samples given at once to
+ * pmu_estimator_process()
+ *
+ * Returns: (transfer full) (nullable): A new #PmuEstimator, or %NULL
+ * on error. Free with pmu_estimator_free().
+ */
+PmuEstimator *
+pmu_estimator_new (guint    samples_per_cycle,
+                   guint    nominal_freq,
+                   gint     data_rate,
+                   gboolean measurement_class,
+                   gsize    max_samples)
+{
+  PmuEstimator *self;
+  gfloat report_rate;
+  guint steps;
+
+  if (data_rate == 0)
+    return NULL;
+
+  /* In frames per second, for the M class filter */
+  report_rate = data_rate > 0 ? data_rate : -1.0f / data_rate;
+
+  self = g_new0 (PmuEstimator, 1);
+  self->samples_per_cycle = samples_per_cycle;
+  self->nominal_freq = nominal_freq;
+  self->max_samples = max_samples;
+
+  for (guint i = 0; i < PMU_ESTIMATOR_NUM_CHANNELS; i++)
+    self->scale[i] = 1.0;
+
+  /* The steps should divide the cycle evenly, else step every sample */
+  for (steps = FREQ_STEPS_PER_CYCLE; steps > 1; steps--)
+    if (samples_per_cycle % steps == 0)
+      break;
+
+  if (steps == 1)
+    steps = samples_per_cycle;
+
+  self->freq_step = samples_per_cycle / steps;
+
+  self->sdft = dsp_sdft_new (PMU_ESTIMATOR_NUM_CHANNELS, samples_per_cycle);
+  self->freq = dsp_freq_new (1, nominal_freq, steps, report_rate,
+                             measurement_class ? DSP_FREQ_CLASS_M : DSP_FREQ_CLASS_P);
+
+  if (self->sdft)
+    self->rows = dsp_calloc_aligned (sizeof (gfloat) * max_samples *
+                                     dsp_sdft_get_row_size (self->sdft));
+
+  /* 3 phases and the positive sequence, real and imaginary */
+  self->phasors = dsp_calloc_aligned (sizeof (gfloat) * DSP_LANES * 8);
+
+  if (self->sdft == NULL || self->rows == NULL || self->freq == NULL ||
+      self->phasors == NULL)
+    {
+      pmu_estimator_free (self);
+      return NULL;
+    }
+
+  for (guint i = 0; i < 3; i++)
+    {
+      self->phases[i].real = self->phasors + DSP_LANES * (2 * i);
+      self->phases[i].imaginary = self->phasors + DSP_LANES * (2 * i + 1);
+    }
+
+  self->sequences[DSP_SEQUENCE_POSITIVE].real = self->phasors + DSP_LANES * 6;
+  self->sequences[DSP_SEQUENCE_POSITIVE].imaginary = self->phasors + DSP_LANES * 7;
+
+  return self;
+}
+
+void
+pmu_estimator_free (PmuEstimator *self)
+{
+  if (self == NULL)
+    return;
+
+  dsp_sdft_free (self->sdft);
+  dsp_freq_free (self->freq);
+  dsp_harmonics_free (self->harmonics);
+  free (self->rows);
+  free (self->phasors);
+  g_free (self);
+}
+
+/**
+ * pmu_estimator_set_scale:
+ * @self: A #PmuEstimator
+ * @channel: The channel index, starting from 0
+ * @scale: Volts (or Amperes) per unit of the raw sample
+ */
+void
+pmu_estimator_set_scale (PmuEstimator *self,
+                         guint         channel,
+                         gfloat        scale)
+{
+  g_return_if_fail (channel < PMU_ESTIMATOR_NUM_CHANNELS);
+
+  self->scale[channel] = scale;
+}
+
+/**
+ * pmu_estimator_set_harmonic_order:
+ * @self: A #PmuEstimator
+ * @order: The highest harmonic to report, 0 for none
+ *
+ * Report the THD and harmonics up to @order from
+ * pmu_estimator_update_data(), see %PMU_ESTIMATOR_FIRST_HARMONIC_ANALOG.
+ * The samples per cycle should be a power of 2, and more than twice
+ * @order.
+ *
+ * Returns: %TRUE on success, %FALSE if the harmonics can't be found.
+ */
+gboolean
+pmu_estimator_set_harmonic_order (PmuEstimator *self,
+                                  guint         order)
+{
+  g_clear_pointer (&self->harmonics, dsp_harmonics_free);
+
+  if (order == 0)
+    return TRUE;
+
+  self->harmonics = dsp_harmonics_new (PMU_ESTIMATOR_NUM_CHANNELS,
+                                       self->samples_per_cycle, order);
+
+  return self->harmonics != NULL;
+}
+
+/**
+ * pmu_estimator_get_sample_rate:
+ * @self: A #PmuEstimator
+ *
+ * Returns: The number of samples per second of each channel.
+ */
+guint
+pmu_estimator_get_sample_rate (PmuEstimator *self)
+{
+  return self->samples_per_cycle * self->nominal_freq;
+}
+
+gsize
+pmu_estimator_get_max_samples (PmuEstimator *self)
+{
+  return self->max_samples;
+}
+
+/**
+ * pmu_estimator_get_sample_index:
+ * @self: A #PmuEstimator
+ * @time: An instant
+ *
+ * Returns: The index of the first sample taken at or after @time,
+ * counted from the epoch.
+ */
+guint64
+pmu_estimator_get_sample_index (PmuEstimator  *self,
+                                const CtsTime *time)
+{
+  guint64 sample_rate = pmu_estimator_get_sample_rate (self);
+
+  return time->soc * sample_rate +
+    (time->nanoseconds * sample_rate + 999999999) / 1000000000;
+}
+
+void
+pmu_estimator_reset (PmuEstimator *self)
+{
+  dsp_sdft_reset (self->sdft);
+  dsp_freq_reset (self->freq);
+
+  if (self->harmonics)
+    dsp_harmonics_reset (self->harmonics);
+}
+
+/* Give the positive sequence of VR, VY and VB to freq */
+static void
+update_frequency (PmuEstimator *self)
+{
+  DspPhasorArray *positive = self->sequences + DSP_SEQUENCE_POSITIVE;
+
+  for (guint i = 0; i < 3; i++)
+    dsp_sdft_get_phasor (self->sdft, i,
+                         self->phases[i].real, self->phases[i].imaginary);
+
+  dsp_seqcomp_process (self->phases, self->sequences, 1);
+  dsp_freq_process (self->freq, positive->real, positive->imaginary);
+}
+
+/**
+ * pmu_estimator_process:
+ * @self: A #PmuEstimator
+ * @samples: @num_samples rows of %PMU_ESTIMATOR_ROW_SIZE bytes
+ * @num_samples: Number of sample rows, not more than the maximum
+ * given to pmu_estimator_new()
+ * @first_index: The index of the first row, see
+ * pmu_estimator_get_sample_index()
+ *
+ * Feed new samples to the estimator.
+ */
+void
+pmu_estimator_process (PmuEstimator *self,
+                       const guchar *samples,
+                       gsize         num_samples,
+                       guint64       first_index)
+{
+  gsize row_size = dsp_sdft_get_row_size (self->sdft);
+  gfloat *row = self->rows;
+  guint64 index = first_index;
+  gsize done = 0;
+
+  g_return_if_fail (num_samples <= self->max_samples);
+
+  for (gsize i = 0; i < num_samples; i++)
+    {
+      for (guint j = 0; j < PMU_ESTIMATOR_NUM_CHANNELS; j++)
+        {
+          gint16 value = (gint16)(samples[0] << 8 | samples[1]);
+
+          row[j] = value * self->scale[j];
+          samples += 2;
+        }
+
+      row += row_size;
+    }
+
+  /* A gap in samples is a gap in the phasors given to freq */
+  if (first_index != self->next_index)
+    dsp_freq_reset (self->freq);
+
+  /* Stop at every step to take the phasors for freq */
+  while (done < num_samples)
+    {
+      gsize count = self->freq_step - index % self->freq_step;
+
+      count = MIN (count, num_samples - done);
+      dsp_sdft_process (self->sdft, self->rows + done * row_size, count, index);
+
+      done += count;
+      index += count;
+
+      if (index % self->freq_step == 0 && dsp_sdft_is_ready (self->sdft))
+        update_frequency (self);
+    }
+
+  if (self->harmonics)
+    dsp_harmonics_process (self->harmonics, self->rows, num_samples, first_index);
+
+  self->next_index = index;
+}
+
+static void
+update_harmonics (PmuEstimator *self,
+                  CtsData      *data)
+{
+  guint order = dsp_harmonics_get_max_order (self->harmonics);
+  guint analog = PMU_ESTIMATOR_FIRST_HARMONIC_ANALOG;
+
+  for (guint i = 0; i < PMU_ESTIMATOR_NUM_CHANNELS; i++)
+    cts_data_set_analog_of_pmu (data, 1, analog++,
+                                dsp_harmonics_get_thd (self->harmonics, i) * 100);
+
+  for (guint i = 0; i < PMU_ESTIMATOR_NUM_CHANNELS; i++)
+    for (guint h = 2; h <= order; h++)
+      cts_data_set_analog_of_pmu (data, 1, analog++,
+                                  dsp_harmonics_get_magnitude (self->harmonics, i, h));
+}
+
+/**
+ * pmu_estimator_update_data:
+ * @self: A #PmuEstimator
+ * @data: The data frame to update
+ *
+ * Set the phasors of VR, VY, VB, IR, IY and IB (phasors 1 to 6), the
+ * frequency, ROCOF and their analog values (analogs 13 and 14) of
+ * the first PMU in @data from the latest samples.
+ *
+ * Frequency and ROCOF take a few cycles more than the phasors to
+ * settle after a reset. Till then, the nominal frequency is reported.
+ *
+ * With pmu_estimator_set_harmonic_order(), the THD and harmonics are
+ * set too, from %PMU_ESTIMATOR_FIRST_HARMONIC_ANALOG, over whole
+ * cycles of the estimated frequency. They are left as they were till
+ * a window of harmonics is filled after a reset.
+ *
+ * Returns: %TRUE if the phasors are valid. %FALSE if not enough
+ * samples were processed after a reset.
+ */
+gboolean
+pmu_estimator_update_data (PmuEstimator *self,
+                           CtsData      *data)
+{
+  gboolean valid = TRUE;
+  gfloat freq, rocof;
+  gdouble deviation;
+
+  dsp_freq_get (self->freq, 0, &freq, &rocof);
+
+  /* The phasors are of the middle of the last cycle, move to its end */
+  freq += rocof * 0.5f / self->nominal_freq;
+
+  /* Off nominal, the angle lags by half a cycle, see dsp-sdft.c */
+  deviation = (freq - self->nominal_freq) / self->nominal_freq;
+
+  for (guint i = 0; i < PMU_ESTIMATOR_NUM_CHANNELS; i++)
+    {
+      gfloat real, imaginary;
+
+      valid &= dsp_sdft_get_phasor_at_frequency (self->sdft, i, deviation,
+                                                 &real, &imaginary);
+      cts_data_set_phasor_of_pmu (data, 1, i + 1, real, imaginary);
+    }
+
+  cts_data_set_freq_of_pmu (data, 1, freq, rocof);
+  cts_data_set_analog_of_pmu (data, 1, 13, freq);
+  cts_data_set_analog_of_pmu (data, 1, 14, rocof);
+
+  /* Over whole cycles of the same frequency */
+  if (self->harmonics && dsp_harmonics_update (self->harmonics, deviation))
+    update_harmonics (self, data);
+
+  return valid;
+}
@@ -0,0 +1,70 @@
+/* pmu-estimator.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "c37/c37.h"
+
+G_BEGIN_DECLS
+
+/* VR, VY, VB, IR, IY, IB, in the order of phasors in pmu-config.h */
+#define PMU_ESTIMATOR_NUM_CHANNELS 6
+
+/* Bytes per sample row: a 16 bit signed big endian integer per channel */
+#define PMU_ESTIMATOR_ROW_SIZE (PMU_ESTIMATOR_NUM_CHANNELS * 2)
+
+/*
+ * With harmonics up to order n, the THD of every channel (in percent)
+ * from analog 15, then the magnitudes of orders 2 to n of a channel
+ * after the other. Off nominal frequency, the higher orders read low,
+ * see dsp-harmonics.c: at 64 samples per cycle, less than 0.5% up to
+ * order 7 and 2% at order 10.
+ */
+#define PMU_ESTIMATOR_FIRST_HARMONIC_ANALOG 15
+#define PMU_ESTIMATOR_NUM_HARMONIC_ANALOGS(order) (PMU_ESTIMATOR_NUM_CHANNELS * (order))
+
+typedef struct _PmuEstimator PmuEstimator;
+
+PmuEstimator *pmu_estimator_new             (guint          samples_per_cycle,
+                                             guint          nominal_freq,
+                                             gint           data_rate,
+                                             gboolean       measurement_class,
+                                             gsize          max_samples);
+void          pmu_estimator_free            (PmuEstimator  *self);
+void          pmu_estimator_set_scale       (PmuEstimator  *self,
+                                             guint          channel,
+                                             gfloat         scale);
+gboolean      pmu_estimator_set_harmonic_order (PmuEstimator *self,
+                                                guint         order);
+guint         pmu_estimator_get_sample_rate (PmuEstimator  *self);
+gsize         pmu_estimator_get_max_samples (PmuEstimator  *self);
+guint64       pmu_estimator_get_sample_index (PmuEstimator  *self,
+                                              const CtsTime *time);
+void          pmu_estimator_reset           (PmuEstimator  *self);
+void          pmu_estimator_process         (PmuEstimator  *self,
+                                             const guchar  *samples,
+                                             gsize          num_samples,
+                                             guint64        first_index);
+gboolean      pmu_estimator_update_data     (PmuEstimator  *self,
+                                             CtsData       *data);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PmuEstimator, pmu_estimator_free)
+
+G_END_DECLS
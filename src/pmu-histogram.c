@@ -0,0 +1,190 @@
+/* pmu-histogram.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "pmu-histogram.h"
+
+/*
+ * A histogram of non-negative integers (say, latencies in
+ * nanoseconds), for percentiles without keeping every value.
+ *
+ * Buckets are log-linear: values below 16 have one each, and every
+ * power of two above is split into 16, so that a percentile is off
+ * by at most 1/16 of itself. Values beyond 2^40 (about 18 minutes in
+ * nanoseconds) are counted in the last bucket, their maximum kept
+ * exact.
+ */
+
+#define SUB_BUCKET_BITS  4
+#define SUB_BUCKETS      (1 << SUB_BUCKET_BITS)
+#define MAX_EXPONENT     40
+#define NUM_BUCKETS      ((MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS)
+
+struct _PmuHistogram
+{
+  guint64 count;
+  gint64  min;
+  gint64  max;
+  gdouble sum;
+
+  guint64 buckets[NUM_BUCKETS];
+};
+
+static guint
+get_bucket (guint64 value)
+{
+  guint exponent;
+
+  if (value < SUB_BUCKETS)
+    return value;
+
+  exponent = 63 - __builtin_clzll (value);
+
+  if (exponent > MAX_EXPONENT)
+    return NUM_BUCKETS - 1;
+
+  return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS +
+         ((value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+}
+
+/* The largest value that goes into @bucket */
+static gint64
+get_bucket_limit (guint bucket)
+{
+  guint exponent, shift;
+
+  if (bucket < SUB_BUCKETS)
+    return bucket;
+
+  exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+  shift = exponent - SUB_BUCKET_BITS;
+
+  return ((gint64) (SUB_BUCKETS + bucket % SUB_BUCKETS + 1) << shift) - 1;
+}
+
+PmuHistogram *
+pmu_histogram_new (void)
+{
+  PmuHistogram *self = g_new (PmuHistogram, 1);
+
+  pmu_histogram_reset (self);
+
+  return self;
+}
+
+void
+pmu_histogram_free (PmuHistogram *self)
+{
+  g_free (self);
+}
+
+void
+pmu_histogram_reset (PmuHistogram *self)
+{
+  memset (self, 0, sizeof *self);
+  self->min = G_MAXINT64;
+}
+
+/**
+ * pmu_histogram_add:
+ * @self: A #PmuHistogram
+ * @value: The value to count, taken as 0 if negative
+ */
+void
+pmu_histogram_add (PmuHistogram *self,
+                   gint64        value)
+{
+  value = MAX (value, 0);
+
+  self->buckets[get_bucket (value)]++;
+  self->count++;
+  self->sum += value;
+  self->min = MIN (self->min, value);
+  self->max = MAX (self->max, value);
+}
+
+void
+pmu_histogram_merge (PmuHistogram       *self,
+                     const PmuHistogram *other)
+{
+  for (guint i = 0; i < NUM_BUCKETS; i++)
+    self->buckets[i] += other->buckets[i];
+
+  self->count += other->count;
+  self->sum += other->sum;
+  self->min = MIN (self->min, other->min);
+  self->max = MAX (self->max, other->max);
+}
+
+guint64
+pmu_histogram_get_count (const PmuHistogram *self)
+{
+  return self->count;
+}
+
+/* Returns: The least value, or 0 if there are none */
+gint64
+pmu_histogram_get_min (const PmuHistogram *self)
+{
+  return self->count ? self->min : 0;
+}
+
+gint64
+pmu_histogram_get_max (const PmuHistogram *self)
+{
+  return self->max;
+}
+
+gdouble
+pmu_histogram_get_mean (const PmuHistogram *self)
+{
+  return self->count ? self->sum / self->count : 0;
+}
+
+/**
+ * pmu_histogram_get_percentile:
+ * @self: A #PmuHistogram
+ * @percent: From 0 to 100
+ *
+ * Returns: A value that at least @percent of the values are not
+ * above, rounded up to the limit of its bucket, and never above the
+ * maximum. 0 if there are no values.
+ */
+gint64
+pmu_histogram_get_percentile (const PmuHistogram *self,
+                              gdouble             percent)
+{
+  guint64 rank, seen = 0;
+
+  if (self->count == 0)
+    return 0;
+
+  rank = MAX (1, (guint64) ceil (CLAMP (percent, 0, 100) / 100 * self->count));
+
+  for (guint i = 0; i < NUM_BUCKETS; i++)
+    {
+      seen += self->buckets[i];
+
+      if (seen >= rank && i < NUM_BUCKETS - 1)
+        return CLAMP (get_bucket_limit (i), self->min, self->max);
+    }
+
+  return self->max;
+}
@@ -0,0 +1,44 @@
+/* pmu-histogram.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PmuHistogram PmuHistogram;
+
+PmuHistogram *pmu_histogram_new    (void);
+void          pmu_histogram_free   (PmuHistogram       *self);
+void          pmu_histogram_reset  (PmuHistogram       *self);
+void          pmu_histogram_add    (PmuHistogram       *self,
+                                    gint64              value);
+void          pmu_histogram_merge  (PmuHistogram       *self,
+                                    const PmuHistogram *other);
+
+guint64       pmu_histogram_get_count      (const PmuHistogram *self);
+gint64        pmu_histogram_get_min        (const PmuHistogram *self);
+gint64        pmu_histogram_get_max        (const PmuHistogram *self);
+gdouble       pmu_histogram_get_mean       (const PmuHistogram *self);
+gint64        pmu_histogram_get_percentile (const PmuHistogram *self,
+                                            gdouble             percent);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PmuHistogram, pmu_histogram_free)
+
+G_END_DECLS
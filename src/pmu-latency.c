@@ -0,0 +1,767 @@
+/* pmu-latency.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+/*
+ * A latency harness: How long a data frame takes from its reporting
+ * instant, when the acquisition thread takes it, to a client on the
+ * other end of a socket, over every data rate and number of clients
+ * asked for.
+ *
+ * With --exec, the server is started for each of --rates, "%r" in the
+ * command replaced by the rate, and stopped with SIGTERM after. For
+ * the whole path of pmu without the device, set acquisition-mode to
+ * "synthetic", so that a frame is made up every slot and goes through
+ * the scheduler, the frame queue and the server as a read frame would:
+ *
+ *   pmu-latency -r 10,25,50 -x "sh -c 'gsettings set org.sadiqpk.pmu
+ *     data-rate %r && exec pmu'" 127.0.0.1:4713
+ *
+ * pmu has one session at a time, so for more than one client put
+ * pmu-relay in front of it in the command, and connect to the relay.
+ * Without --exec, the server already running is measured, at the rate
+ * it sends.
+ *
+ * For each rate, the number of clients is stepped up through
+ * --clients. Each client asks for CFG-2, then DATA ON. Once every
+ * client gets data, a level is let settle, then measured for
+ * --seconds, and reported in a line: clients up, frames per second,
+ * frames lost going by their timestamps, and percentiles of when a
+ * frame was received less its timestamp. --histogram adds the whole
+ * distribution, and each --limit is checked against every level, the
+ * exit status failing if any is over, to keep an eye on regressions.
+ *
+ * The clients run in one thread around epoll, a frame costing a parse
+ * and a clock read. The timestamps are of the clock of the server, so
+ * both ends should be on the same machine, or on clocks in sync.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <glib.h>
+
+#include "c37/c37.h"
+#include "pmu-histogram.h"
+
+#define NSEC_PER_SEC        G_GINT64_CONSTANT (1000000000)
+#define CONNECT_TIMEOUT     (5 * G_USEC_PER_SEC)
+#define COMMAND_TIMEOUT     (5 * G_USEC_PER_SEC)
+#define RETRY_INTERVAL      (G_USEC_PER_SEC / 2)
+#define STARTUP_TIMEOUT     (30 * G_USEC_PER_SEC)
+#define SETTLE_TIME         (2 * G_USEC_PER_SEC)
+
+static gint id_code = 1;
+static gchar *rate_list = NULL;
+static gchar *client_list = NULL;
+static gint seconds = 10;
+static gchar *server_command = NULL;
+static gchar **limit_list = NULL;
+static gboolean show_histogram = FALSE;
+
+static GOptionEntry entries[] = {
+  { "id-code", 'i', 0, G_OPTION_ARG_INT, &id_code,
+    "ID code to send commands to (default: 1)", "ID" },
+  { "rates", 'r', 0, G_OPTION_ARG_STRING, &rate_list,
+    "Data rates to start the server at, with --exec (default: 50)", "R,R,…" },
+  { "clients", 'c', 0, G_OPTION_ARG_STRING, &client_list,
+    "Numbers of clients to step through (default: 1)", "N,N,…" },
+  { "seconds", 'S', 0, G_OPTION_ARG_INT, &seconds,
+    "Seconds to measure each level for (default: 10)", "SECONDS" },
+  { "exec", 'x', 0, G_OPTION_ARG_STRING, &server_command,
+    "Command starting the server, %r being the data rate", "COMMAND" },
+  { "limit", 'l', 0, G_OPTION_ARG_STRING_ARRAY, &limit_list,
+    "Fail if the percentile P of a level is above MS milliseconds", "P:MS" },
+  { "histogram", 'H', 0, G_OPTION_ARG_NONE, &show_histogram,
+    "Print the distribution of the latency of every level", NULL },
+  { NULL }
+};
+
+typedef enum {
+  CLIENT_CONNECTING,
+  CLIENT_CONFIGURING,
+  CLIENT_RUNNING,
+  CLIENT_CLOSED,
+} ClientState;
+
+typedef struct _Harness Harness;
+
+typedef struct
+{
+  Harness     *harness;
+  CtsClient   *client;
+  ClientState  state;
+
+  gint64       command_time; /* Of CFG-2, while configuring */
+  gint64       connect_time;
+  gint64       retry_time;
+  gint64       period;       /* Of data frames, in ns */
+  gint64       last_frame;   /* Timestamp, in ns, or 0 */
+  gboolean     got_data;
+} Client;
+
+typedef struct
+{
+  guint64 frames;
+  guint64 lost;
+  guint64 failed;       /* Connections failed or lost */
+} Counters;
+
+struct _Harness
+{
+  int              epoll_fd;
+  struct addrinfo *address;
+
+  GPtrArray       *clients;
+  guint            num_wanted;
+  guint            num_up;
+  gint             data_rate;   /* As sent in CFG-2 */
+
+  Counters         counters;
+  PmuHistogram    *latency;
+};
+
+typedef struct
+{
+  gdouble percent;
+  gdouble milliseconds;
+} Limit;
+
+static gint64
+get_realtime_ns (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_REALTIME, &now);
+
+  return now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+static void
+client_close (Client   *client,
+              gboolean  failed)
+{
+  Harness *harness = client->harness;
+
+  if (client->state == CLIENT_CLOSED)
+    return;
+
+  if (client->state != CLIENT_CONNECTING)
+    harness->num_up--;
+
+  if (failed)
+    harness->counters.failed++;
+
+  cts_client_close (client->client);
+  client->state = CLIENT_CLOSED;
+  client->got_data = FALSE;
+  client->last_frame = 0;
+  client->retry_time = g_get_monotonic_time () + RETRY_INTERVAL;
+}
+
+static void
+client_command (Client  *client,
+                guint16  command)
+{
+  if (!cts_client_send_command (client->client, command))
+    client_close (client, TRUE);
+}
+
+static void
+config_cb (CtsClient *cts_client,
+           CtsConf   *config,
+           byte       type,
+           void      *user_data)
+{
+  Client *client = user_data;
+  gint data_rate;
+
+  if (type != CTS_TYPE_CONFIG2 || client->state != CLIENT_CONFIGURING)
+    return;
+
+  data_rate = cts_conf_get_data_rate (config);
+
+  if (data_rate > 0)
+    client->period = NSEC_PER_SEC / data_rate;
+  else
+    client->period = -data_rate * NSEC_PER_SEC;
+
+  client->harness->data_rate = data_rate;
+  client->state = CLIENT_RUNNING;
+  client_command (client, CTS_COMMAND_DATA_ON);
+}
+
+static void
+data_cb (CtsClient         *cts_client,
+         const CtsDataView *view,
+         void              *user_data)
+{
+  Client *client = user_data;
+  Harness *harness = client->harness;
+  gint64 now = get_realtime_ns ();
+  gint64 timestamp;
+  CtsTime time;
+
+  cts_data_view_get_time (view, &time);
+  timestamp = time.soc * NSEC_PER_SEC + time.nanoseconds;
+
+  /* Frames in between that never came, give or take half a period */
+  if (client->last_frame && client->period > 0 &&
+      timestamp - client->last_frame > client->period + client->period / 2)
+    harness->counters.lost += (timestamp - client->last_frame + client->period / 2) /
+                              client->period - 1;
+
+  if (timestamp > client->last_frame)
+    client->last_frame = timestamp;
+
+  client->got_data = TRUE;
+  harness->counters.frames++;
+  pmu_histogram_add (harness->latency, now - timestamp);
+}
+
+static void
+client_connect (Client *client)
+{
+  Harness *harness = client->harness;
+  struct addrinfo *address = harness->address;
+  struct epoll_event event = { 0 };
+  int fd;
+
+  client->connect_time = g_get_monotonic_time ();
+  fd = socket (address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+               address->ai_protocol);
+
+  if (fd < 0)
+    {
+      client->retry_time = client->connect_time + RETRY_INTERVAL;
+      harness->counters.failed++;
+      return;
+    }
+
+  if (connect (fd, address->ai_addr, address->ai_addrlen) < 0 && errno != EINPROGRESS)
+    {
+      close (fd);
+      client->retry_time = client->connect_time + RETRY_INTERVAL;
+      harness->counters.failed++;
+      return;
+    }
+
+  cts_client_set_fd (client->client, fd, CTS_TRANSPORT_TCP);
+  client->state = CLIENT_CONNECTING;
+
+  event.events = EPOLLIN | EPOLLOUT;
+  event.data.ptr = client;
+  epoll_ctl (harness->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+static void
+client_connected (Client *client)
+{
+  struct epoll_event event = { 0 };
+  int fd = cts_client_get_fd (client->client);
+  socklen_t length = sizeof (int);
+  int error = 0, one = 1;
+
+  if (getsockopt (fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error)
+    {
+      client_close (client, TRUE);
+      return;
+    }
+
+  setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+  event.events = EPOLLIN;
+  event.data.ptr = client;
+  epoll_ctl (client->harness->epoll_fd, EPOLL_CTL_MOD, fd, &event);
+
+  client->state = CLIENT_CONFIGURING;
+  client->harness->num_up++;
+  client->command_time = g_get_monotonic_time ();
+  client_command (client, CTS_COMMAND_SEND_CONFIG2);
+}
+
+static Client *
+client_new (Harness *harness)
+{
+  CtsClientHandlers handlers = {
+    .config = config_cb,
+    .data = data_cb,
+  };
+  Client *client;
+
+  client = g_new0 (Client, 1);
+  client->harness = harness;
+  client->state = CLIENT_CLOSED;
+  client->client = cts_client_new (id_code);
+
+  if (client->client == NULL)
+    {
+      g_free (client);
+      return NULL;
+    }
+
+  cts_client_set_handlers (client->client, &handlers, client);
+
+  return client;
+}
+
+static void
+client_free (Client *client)
+{
+  cts_client_free (client->client);
+  g_free (client);
+}
+
+static void
+handle_client (Client *client)
+{
+  ssize_t count;
+
+  if (client->state == CLIENT_CONNECTING)
+    {
+      client_connected (client);
+      return;
+    }
+
+  count = cts_client_read (client->client);
+
+  if (count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR))
+    client_close (client, TRUE);
+}
+
+/* Timeouts, and connecting again the clients lost */
+static void
+client_tick (Client *client,
+             gint64  now)
+{
+  switch (client->state)
+    {
+    case CLIENT_CONNECTING:
+      if (now - client->connect_time > CONNECT_TIMEOUT)
+        client_close (client, TRUE);
+      break;
+
+    case CLIENT_CONFIGURING:
+      if (now - client->command_time > COMMAND_TIMEOUT)
+        {
+          client->command_time = now;
+          client_command (client, CTS_COMMAND_SEND_CONFIG2);
+        }
+      break;
+
+    case CLIENT_CLOSED:
+      if (now >= client->retry_time)
+        client_connect (client);
+      break;
+
+    case CLIENT_RUNNING:
+      break;
+    }
+}
+
+static gboolean
+all_get_data (Harness *harness)
+{
+  for (guint i = 0; i < harness->num_wanted; i++)
+    {
+      Client *client = g_ptr_array_index (harness->clients, i);
+
+      if (!client->got_data)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Run for @duration, or until every client gets data if @until_data */
+static gboolean
+run_for (Harness  *harness,
+         gint64    duration,
+         gboolean  until_data)
+{
+  gint64 end = g_get_monotonic_time () + duration;
+  gint64 next_tick = 0;
+  struct epoll_event events[256];
+
+  for (;;)
+    {
+      gint64 now = g_get_monotonic_time ();
+      int count;
+
+      if (until_data && all_get_data (harness))
+        return TRUE;
+
+      if (now >= end)
+        return !until_data;
+
+      if (now >= next_tick)
+        {
+          for (guint i = 0; i < harness->num_wanted; i++)
+            client_tick (g_ptr_array_index (harness->clients, i), now);
+
+          next_tick = now + G_USEC_PER_SEC / 10;
+        }
+
+      count = epoll_wait (harness->epoll_fd, events, G_N_ELEMENTS (events),
+                          MIN (next_tick, end) / 1000 - now / 1000 + 1);
+
+      for (int i = 0; i < count; i++)
+        handle_client (events[i].data.ptr);
+    }
+}
+
+static void
+set_num_clients (Harness *harness,
+                 guint    num_clients)
+{
+  for (guint i = num_clients; i < harness->clients->len; i++)
+    client_close (g_ptr_array_index (harness->clients, i), FALSE);
+
+  while (harness->clients->len < num_clients)
+    {
+      Client *client = client_new (harness);
+
+      if (client == NULL)
+        break;
+
+      g_ptr_array_add (harness->clients, client);
+    }
+
+  harness->num_wanted = MIN (num_clients, harness->clients->len);
+
+  for (guint i = 0; i < harness->num_wanted; i++)
+    {
+      Client *client = g_ptr_array_index (harness->clients, i);
+
+      if (client->state == CLIENT_CLOSED)
+        client_connect (client);
+    }
+}
+
+static void
+print_level (Harness *harness,
+             guint    num_clients,
+             gdouble  elapsed)
+{
+  Counters *counters = &harness->counters;
+  PmuHistogram *latency = harness->latency;
+
+  g_print ("%6d %8u %8u %10.0f %8" G_GUINT64_FORMAT " %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %8"
+           G_GUINT64_FORMAT "\n",
+           harness->data_rate, num_clients, harness->num_up,
+           counters->frames / elapsed, counters->lost,
+           pmu_histogram_get_percentile (latency, 50) / 1e6,
+           pmu_histogram_get_percentile (latency, 90) / 1e6,
+           pmu_histogram_get_percentile (latency, 99) / 1e6,
+           pmu_histogram_get_percentile (latency, 99.9) / 1e6,
+           pmu_histogram_get_percentile (latency, 99.99) / 1e6,
+           pmu_histogram_get_max (latency) / 1e6,
+           counters->failed);
+}
+
+static void
+print_histogram (PmuHistogram *latency)
+{
+  static const gdouble percents[] = {
+    0, 1, 5, 10, 25, 50, 75, 90, 95, 99, 99.5, 99.9, 99.99, 99.999, 100,
+  };
+
+  if (pmu_histogram_get_count (latency) == 0)
+    return;
+
+  for (guint i = 0; i < G_N_ELEMENTS (percents); i++)
+    g_print ("%24s%-8g %8.3f ms\n", "p", percents[i],
+             pmu_histogram_get_percentile (latency, percents[i]) / 1e6);
+}
+
+/* Print the limits a level is over, and return whether it is within */
+static gboolean
+check_limits (Harness  *harness,
+              guint     num_clients,
+              GArray   *limits)
+{
+  gboolean within = TRUE;
+
+  if (pmu_histogram_get_count (harness->latency) == 0)
+    {
+      g_printerr ("%d frames/s, %u clients: No frames received\n",
+                  harness->data_rate, num_clients);
+      return FALSE;
+    }
+
+  for (guint i = 0; i < limits->len; i++)
+    {
+      Limit *limit = &g_array_index (limits, Limit, i);
+      gdouble value = pmu_histogram_get_percentile (harness->latency, limit->percent) / 1e6;
+
+      if (value <= limit->milliseconds)
+        continue;
+
+      g_printerr ("%d frames/s, %u clients: p%g is %.2f ms, over %g ms\n",
+                  harness->data_rate, num_clients, limit->percent,
+                  value, limit->milliseconds);
+      within = FALSE;
+    }
+
+  return within;
+}
+
+static gboolean
+parse_limits (GArray *limits)
+{
+  for (guint i = 0; limit_list && limit_list[i]; i++)
+    {
+      Limit limit;
+      gchar *end;
+
+      limit.percent = g_ascii_strtod (limit_list[i], &end);
+
+      if (end == limit_list[i] || *end != ':' ||
+          limit.percent < 0 || limit.percent > 100)
+        return FALSE;
+
+      limit.milliseconds = g_ascii_strtod (end + 1, &end);
+
+      if (*end != '\0' || limit.milliseconds <= 0)
+        return FALSE;
+
+      g_array_append_val (limits, limit);
+    }
+
+  return TRUE;
+}
+
+static gboolean
+parse_steps (GStrv   steps,
+             guint64 max)
+{
+  for (guint i = 0; steps[i]; i++)
+    if (!g_ascii_string_to_unsigned (steps[i], 10, 1, max, NULL, NULL))
+      return FALSE;
+
+  return TRUE;
+}
+
+/* In a group of its own, so that whatever it starts is stopped with it */
+static void
+server_child_setup (gpointer user_data)
+{
+  setpgid (0, 0);
+}
+
+static GPid
+start_server (const gchar  *rate,
+              GError      **error)
+{
+  g_auto(GStrv) parts = NULL;
+  g_auto(GStrv) argv = NULL;
+  g_autofree gchar *command = NULL;
+  GPid pid = 0;
+
+  parts = g_strsplit (server_command, "%r", -1);
+  command = g_strjoinv (rate, parts);
+
+  if (!g_shell_parse_argv (command, NULL, &argv, error))
+    return 0;
+
+  if (!g_spawn_async (NULL, argv, NULL,
+                      G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                      server_child_setup, NULL, &pid, error))
+    return 0;
+
+  return pid;
+}
+
+static gboolean
+server_exited (GPid pid)
+{
+  return waitpid (pid, NULL, WNOHANG) == pid;
+}
+
+static void
+stop_server (GPid pid)
+{
+  kill (-pid, SIGTERM);
+  waitpid (pid, NULL, 0);
+  g_spawn_close_pid (pid);
+}
+
+static void
+raise_file_limit (void)
+{
+  struct rlimit limit;
+
+  if (getrlimit (RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+      limit.rlim_cur = limit.rlim_max;
+      setrlimit (RLIMIT_NOFILE, &limit);
+    }
+}
+
+static gboolean
+parse_address (Harness     *harness,
+               const gchar *address)
+{
+  g_autofree gchar *host = NULL;
+  struct addrinfo hints = { 0 };
+  const gchar *colon = strrchr (address, ':');
+
+  if (colon == NULL || colon == address || colon[1] == '\0')
+    return FALSE;
+
+  if (address[0] == '[' && colon[-1] == ']')
+    host = g_strndup (address + 1, colon - address - 2);
+  else
+    host = g_strndup (address, colon - address);
+
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  return getaddrinfo (host, colon + 1, &hints, &harness->address) == 0;
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GArray) limits = NULL;
+  g_auto(GStrv) rates = NULL;
+  g_auto(GStrv) steps = NULL;
+  Harness harness = { 0 };
+  gboolean within = TRUE;
+
+  context = g_option_context_new ("HOST:PORT");
+  g_option_context_set_summary (context, "Measure the latency of data frames from a PMU server, "
+                                         "over data rates and numbers of clients");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  limits = g_array_new (FALSE, FALSE, sizeof (Limit));
+  rates = g_strsplit (rate_list ? rate_list : "50", ",", -1);
+  steps = g_strsplit (client_list ? client_list : "1", ",", -1);
+
+  if (!parse_limits (limits) || !parse_steps (rates, G_MAXINT16) ||
+      !parse_steps (steps, 1000000) || (rate_list && server_command == NULL))
+    argc = 0;
+
+  if (argc != 2 || seconds < 1 || id_code < 1 || id_code > G_MAXUINT16)
+    {
+      g_printerr ("%s", g_option_context_get_help (context, TRUE, NULL));
+      return EXIT_FAILURE;
+    }
+
+  if (!parse_address (&harness, argv[1]))
+    {
+      g_printerr ("Can't resolve '%s', expected HOST:PORT\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+
+  /* A server gone is seen as a closed socket, not a signal */
+  signal (SIGPIPE, SIG_IGN);
+  raise_file_limit ();
+
+  harness.epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+  harness.clients = g_ptr_array_new_with_free_func ((GDestroyNotify) client_free);
+  harness.latency = pmu_histogram_new ();
+
+  g_print ("%6s %8s %8s %10s %8s %8s %8s %8s %8s %8s %8s %8s\n",
+           "rate", "clients", "up", "frames/s", "lost", "p50 ms", "p90 ms", "p99 ms",
+           "p99.9 ms", "p99.99", "max ms", "failed");
+
+  /* Without --exec, a single pass over the server already running */
+  for (guint r = 0; rates[r]; r++)
+    {
+      GPid pid = 0;
+
+      if (server_command)
+        {
+          pid = start_server (rates[r], &error);
+
+          if (pid == 0)
+            {
+              g_printerr ("Starting the server failed: %s\n", error->message);
+              return EXIT_FAILURE;
+            }
+        }
+
+      for (guint i = 0; steps[i]; i++)
+        {
+          guint num_clients = g_ascii_strtoull (steps[i], NULL, 10);
+          gint64 start;
+
+          set_num_clients (&harness, num_clients);
+
+          if (!run_for (&harness, STARTUP_TIMEOUT, TRUE))
+            {
+              if (pid && server_exited (pid))
+                {
+                  g_printerr ("The server exited at %s frames/s\n", rates[r]);
+                  kill (-pid, SIGTERM);
+                  return EXIT_FAILURE;
+                }
+
+              g_printerr ("Not every client got data in %d s, measuring anyway\n",
+                          (gint) (STARTUP_TIMEOUT / G_USEC_PER_SEC));
+            }
+
+          run_for (&harness, SETTLE_TIME, FALSE);
+
+          memset (&harness.counters, 0, sizeof harness.counters);
+          pmu_histogram_reset (harness.latency);
+          start = g_get_monotonic_time ();
+
+          run_for (&harness, seconds * G_USEC_PER_SEC, FALSE);
+
+          print_level (&harness, num_clients,
+                       (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC);
+
+          if (show_histogram)
+            print_histogram (harness.latency);
+
+          if (!check_limits (&harness, num_clients, limits))
+            within = FALSE;
+        }
+
+      /* The next server starts with no clients */
+      set_num_clients (&harness, 0);
+
+      if (pid)
+        stop_server (pid);
+    }
+
+  return within ? EXIT_SUCCESS : EXIT_FAILURE;
+}
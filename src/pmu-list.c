@@ -31,9 +31,14 @@ struct _PmuList
 
   GtkWidget *tree_view_data;
   GtkWidget *tree_view_details;
+  GtkWidget *tree_view_stats;
+  GtkWidget *stats_label;
 
   GtkListStore *pmu_data_store;
   GtkListStore *pmu_details_store;
+  GtkListStore *pmu_stats_store;
+
+  guint32 stats_soc;       /* SOC of the statistics shown */
 
   guint update_time;       /* in seconds */
   guint update_timeout_id;
@@ -113,6 +118,9 @@ pmu_list_class_init (PmuListClass *klass)
   gtk_widget_class_bind_template_child (widget_class, PmuList, tree_view_details);
   gtk_widget_class_bind_template_child (widget_class, PmuList, pmu_details_store);
   gtk_widget_class_bind_template_child (widget_class, PmuList, pmu_data_store);
+  gtk_widget_class_bind_template_child (widget_class, PmuList, tree_view_stats);
+  gtk_widget_class_bind_template_child (widget_class, PmuList, stats_label);
+  gtk_widget_class_bind_template_child (widget_class, PmuList, pmu_stats_store);
 }
 
 static void
@@ -153,6 +161,56 @@ pmu_list_setup_details (PmuList *self)
   return G_SOURCE_REMOVE;
 }
 
+/* Show the statistics of the shortest interval, if a new one ended */
+static void
+update_stats (PmuList *self)
+{
+  g_autoptr(PmuStatsRecord) record = NULL;
+  g_autofree gchar *label = NULL;
+  GtkTreeModel *model = GTK_TREE_MODEL (self->pmu_stats_store);
+  GtkTreeIter iter;
+  gboolean valid;
+
+  record = pmu_spi_dup_latest_stats (0);
+
+  if (record == NULL || record->soc == self->stats_soc)
+    return;
+
+  self->stats_soc = record->soc;
+
+  if ((guint) gtk_tree_model_iter_n_children (model, NULL) != record->num_channels)
+    {
+      gtk_list_store_clear (self->pmu_stats_store);
+
+      for (guint i = 0; i < record->num_channels; i++)
+        gtk_list_store_append (self->pmu_stats_store, &iter);
+    }
+
+  valid = gtk_tree_model_get_iter_first (model, &iter);
+
+  for (guint i = 0; valid && i < record->num_channels; i++)
+    {
+      const DspStatsSummary *summary = record->summaries + i;
+      g_autofree gchar *min = g_strdup_printf ("%.3f", summary->min);
+      g_autofree gchar *max = g_strdup_printf ("%.3f", summary->max);
+      g_autofree gchar *mean = g_strdup_printf ("%.3f", summary->mean);
+      g_autofree gchar *rms = g_strdup_printf ("%.3f", summary->rms);
+
+      gtk_list_store_set (self->pmu_stats_store, &iter,
+                          0, record->names[i],
+                          1, min,
+                          2, max,
+                          3, mean,
+                          4, rms,
+                          -1);
+
+      valid = gtk_tree_model_iter_next (model, &iter);
+    }
+
+  label = g_strdup_printf ("Statistics (%u s)", record->interval);
+  gtk_label_set_label (GTK_LABEL (self->stats_label), label);
+}
+
 static gboolean
 update_list (gpointer user_data)
 {
@@ -167,6 +225,9 @@ update_list (gpointer user_data)
   int           count;
   gshort        value[2];
 
+  if (PMU_IS_LIST (list))
+    update_stats (list);
+
   bytes = pmu_spi_data_pop_head ();
 
   if (bytes == NULL || !PMU_IS_LIST (list))
@@ -301,6 +362,9 @@ pmu_list_init (PmuList *self)
   selection = gtk_tree_view_get_selection(GTK_TREE_VIEW (self->tree_view_data));
   gtk_tree_selection_set_mode (selection, GTK_SELECTION_NONE);
 
+  selection = gtk_tree_view_get_selection(GTK_TREE_VIEW (self->tree_view_stats));
+  gtk_tree_selection_set_mode (selection, GTK_SELECTION_NONE);
+
   pmu_list_setup_details (self);
 
   self->update_timeout_id = 0;
@@ -0,0 +1,1357 @@
+/* pmu-loadgen.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+/*
+ * A load generator: Any number of simulated PMUs, each answering
+ * commands and sending data frames as a PMU does, to find how many a
+ * PDC or server can take.
+ *
+ * PMU k (counting from 0) has ID code --id-code + k. It listens on
+ * TCP port --port + k, or with --udp receives commands on that UDP
+ * port and sends data to whoever sent DATA_ON. With --to, data is
+ * sent over UDP to a collector from the start, without waiting for
+ * commands, though those that come are answered. CFG-1, CFG-2 and
+ * header frames are served; CFG-3 is not, having no encoder here.
+ *
+ * The grid simulated is three phase, its frequency swinging slowly
+ * around nominal with a phase of its own for each PMU, with a little
+ * noise on every value. Frames are built in place with the
+ * cts_data_layout_write_*() functions, the cost of a frame being
+ * mostly its CHK.
+ *
+ * Frames can be lost, delayed by up to --jitter ms, or held back to
+ * go after the next one, each at random as given. The PMUs are shared
+ * out among worker threads, each with its own epoll and sockets, so
+ * that the load spreads over every CPU. With --to, each worker sends
+ * the frames of a reporting instant with as few sendmmsg() as it can.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <glib.h>
+
+#include "c37/c37.h"
+#include "pmu-rt.h"
+
+#define PMU_TIME_BASE       1000000
+#define STATS_INTERVAL      (10 * G_USEC_PER_SEC)
+#define NSEC_PER_SEC        G_GINT64_CONSTANT (1000000000)
+#define MAX_PENDING         (1 << 20)
+#define MAX_DELAYED         64
+#define UDP_BATCH           64
+#define MAX_DATAGRAM        65536
+
+/* The frequency swings this many Hz either way, over this many seconds */
+#define FREQ_SWING          0.05
+#define FREQ_SWING_PERIOD   10.0
+#define NOISE               1e-3f
+
+static gint count = 100;
+static gint id_code = 1;
+static gint port = 4712;
+static gboolean use_udp = FALSE;
+static gchar *target = NULL;
+static gint data_rate = 50;
+static gint nominal_freq = 50;
+static gint num_phasors = 6;
+static gint num_analogs = 0;
+static gint num_digitals = 0;
+static gchar *format = NULL;
+static gdouble jitter_ms = 0;
+static gdouble loss_percent = 0;
+static gdouble reorder_percent = 0;
+static gint num_workers = 0;
+static gboolean pin = FALSE;
+static gint duration = 0;
+static gboolean verbose = FALSE;
+
+static GOptionEntry entries[] = {
+  { "count", 'n', 0, G_OPTION_ARG_INT, &count,
+    "Number of PMUs (default: 100)", "N" },
+  { "id-code", 'i', 0, G_OPTION_ARG_INT, &id_code,
+    "ID code of the first PMU, the rest following (default: 1)", "ID" },
+  { "port", 'p', 0, G_OPTION_ARG_INT, &port,
+    "Port of the first PMU, the rest following (default: 4712)", "PORT" },
+  { "udp", 'u', 0, G_OPTION_ARG_NONE, &use_udp,
+    "Serve the PMUs over UDP instead of TCP", NULL },
+  { "to", 0, 0, G_OPTION_ARG_STRING, &target,
+    "Send data over UDP to HOST:PORT without waiting for commands", "HOST:PORT" },
+  { "data-rate", 'r', 0, G_OPTION_ARG_INT, &data_rate,
+    "Frames per second (default: 50)", "RATE" },
+  { "nominal-freq", 0, 0, G_OPTION_ARG_INT, &nominal_freq,
+    "Nominal frequency, 50 or 60 (default: 50)", "HZ" },
+  { "phasors", 'P', 0, G_OPTION_ARG_INT, &num_phasors,
+    "Phasors of each PMU, voltages then currents (default: 6)", "N" },
+  { "analogs", 'A', 0, G_OPTION_ARG_INT, &num_analogs,
+    "Analog values of each PMU (default: 0)", "N" },
+  { "digitals", 'D', 0, G_OPTION_ARG_INT, &num_digitals,
+    "Digital status words of each PMU (default: 0)", "N" },
+  { "format", 'f', 0, G_OPTION_ARG_STRING, &format,
+    "float, integer, polar, or mixed to cycle through integer and float, "
+    "rectangular and polar among the PMUs (default: float)", "FORMAT" },
+  { "jitter", 'j', 0, G_OPTION_ARG_DOUBLE, &jitter_ms,
+    "Delay each frame by up to this many ms, at random (default: 0)", "MS" },
+  { "loss", 'l', 0, G_OPTION_ARG_DOUBLE, &loss_percent,
+    "Percent of frames lost (default: 0)", "PERCENT" },
+  { "reorder", 'o', 0, G_OPTION_ARG_DOUBLE, &reorder_percent,
+    "Percent of frames sent after the next one (default: 0)", "PERCENT" },
+  { "threads", 't', 0, G_OPTION_ARG_INT, &num_workers,
+    "Worker threads (default: one per CPU)", "N" },
+  { "pin", 0, 0, G_OPTION_ARG_NONE, &pin,
+    "Pin each worker thread to a CPU of its own", NULL },
+  { "duration", 'd', 0, G_OPTION_ARG_INT, &duration,
+    "Stop after this many seconds and print totals (default: run forever)", "SECONDS" },
+  { "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+    "Print statistics every 10 seconds", NULL },
+  { NULL }
+};
+
+/* What an epoll event is about, the first member of each */
+typedef enum {
+  WATCH_LISTENER,
+  WATCH_PEER,
+  WATCH_UDP,
+  WATCH_TARGET,
+} WatchKind;
+
+/* The formats --format mixed cycles through */
+typedef enum {
+  FORMAT_FLOAT,
+  FORMAT_INTEGER,
+  FORMAT_POLAR,
+  FORMAT_INTEGER_POLAR,
+  N_FORMATS,
+  FORMAT_MIXED = N_FORMATS,
+} Format;
+
+typedef struct _Worker Worker;
+typedef struct _Sim Sim;
+
+/* A TCP connection to a PMU */
+typedef struct
+{
+  WatchKind   kind;
+  Sim        *sim;
+
+  CtsClient  *commands;
+  gboolean    data_on;
+  gboolean    closed;
+
+  /* What the socket did not take yet, whole frames */
+  GByteArray *pending;
+} Peer;
+
+typedef struct
+{
+  gint64  due;
+  byte   *frame;
+} Delayed;
+
+struct _Sim
+{
+  WatchKind      kind;
+  Worker        *worker;
+  guint          number;
+
+  int            fd;            /* TCP listener or UDP socket, -1 with --to */
+  CtsConf       *config;
+  CtsDataLayout *layout;
+  guint16        frame_size;
+  byte          *frame;
+
+  GPtrArray     *peers;
+
+  /* Where data goes over UDP, once asked for */
+  struct sockaddr_storage address;
+  socklen_t      address_length;
+  gboolean       data_on;
+
+  double         swing_phase;
+
+  /* Frames held back, earliest first, and the buffers not in use */
+  Delayed        delayed[MAX_DELAYED];
+  guint          num_delayed;
+  byte          *free_frames[MAX_DELAYED];
+  guint          num_free;
+  byte          *pool;
+};
+
+typedef struct
+{
+  guint64 frames;       /* Data frames sent */
+  guint64 bytes;
+  guint64 lost;         /* Dropped as --loss asked */
+  guint64 dropped;      /* Dropped, a socket being full */
+  guint64 skipped;      /* Reporting instants skipped, the worker being behind */
+  guint64 peers;        /* Connections accepted */
+} LoadStats;
+
+struct _Worker
+{
+  guint        index;
+  GThread     *thread;
+  int          epoll_fd;
+  GPtrArray   *sims;
+
+  /* Commands of UDP, for whichever PMU they are to */
+  CtsClient   *commands;
+  Sim         *receiving;
+  struct sockaddr_storage sender;
+  socklen_t    sender_length;
+  byte        *datagram;
+
+  /* --to */
+  WatchKind    target_kind;
+  int          target_fd;
+  struct mmsghdr batch[UDP_BATCH];
+  struct iovec   iov[UDP_BATCH];
+  guint        batch_len;
+
+  guint64      random;
+
+  LoadStats    local;
+  GMutex       lock;
+  LoadStats    stats;
+};
+
+static Format pmu_format = FORMAT_FLOAT;
+static char **channel_names = NULL;
+static struct addrinfo *target_address = NULL;
+static gint stopping = FALSE;
+
+/* Nominal phasors, rectangular pairs, for the angle of the grid at 0 */
+static float *nominal_phasors = NULL;
+
+static gint64
+get_realtime_ns (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_REALTIME, &now);
+
+  return now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+/* Reporting instants are counted from the epoch */
+static gint64
+get_time_of_index (gint64 index)
+{
+  return index / data_rate * NSEC_PER_SEC +
+         ((index % data_rate) * NSEC_PER_SEC + data_rate / 2) / data_rate;
+}
+
+static gint64
+get_index_of_time (gint64 ns)
+{
+  return ns / NSEC_PER_SEC * data_rate + ns % NSEC_PER_SEC * data_rate / NSEC_PER_SEC;
+}
+
+/* xorshift64*, uniform in [0, 1) */
+static double
+worker_random (Worker *worker)
+{
+  guint64 x = worker->random;
+
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  worker->random = x;
+
+  return ((x * G_GUINT64_CONSTANT (2685821657736338717)) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static float
+worker_noise (Worker *worker)
+{
+  return 1.0f + NOISE * (float) (2 * worker_random (worker) - 1);
+}
+
+static void
+peer_update_events (Peer *peer)
+{
+  struct epoll_event event = { 0 };
+
+  event.events = EPOLLIN | (peer->pending->len ? EPOLLOUT : 0);
+  event.data.ptr = peer;
+  epoll_ctl (peer->sim->worker->epoll_fd, EPOLL_CTL_MOD,
+             cts_client_get_fd (peer->commands), &event);
+}
+
+/* Whole frames or nothing, so that the stream stays valid */
+static gboolean
+peer_send (Peer       *peer,
+           const byte *frame,
+           gsize       size)
+{
+  gboolean was_empty = peer->pending->len == 0;
+  ssize_t sent = 0;
+
+  if (peer->closed)
+    return FALSE;
+
+  if (!was_empty)
+    {
+      if (peer->pending->len + size > MAX_PENDING)
+        return FALSE;
+
+      g_byte_array_append (peer->pending, frame, size);
+      return TRUE;
+    }
+
+  sent = send (cts_client_get_fd (peer->commands), frame, size,
+               MSG_NOSIGNAL | MSG_DONTWAIT);
+
+  if (sent < 0 && errno != EAGAIN && errno != EINTR)
+    {
+      peer->closed = TRUE;
+      return FALSE;
+    }
+
+  sent = MAX (sent, 0);
+
+  if ((gsize) sent < size)
+    {
+      g_byte_array_append (peer->pending, frame + sent, size - sent);
+      peer_update_events (peer);
+    }
+
+  return TRUE;
+}
+
+static void
+peer_flush (Peer *peer)
+{
+  ssize_t sent;
+
+  sent = send (cts_client_get_fd (peer->commands), peer->pending->data,
+               peer->pending->len, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+  if (sent < 0 && errno != EAGAIN && errno != EINTR)
+    {
+      peer->closed = TRUE;
+      return;
+    }
+
+  if (sent > 0)
+    g_byte_array_remove_range (peer->pending, 0, sent);
+
+  if (peer->pending->len == 0)
+    peer_update_events (peer);
+}
+
+static void
+peer_free (Peer *peer)
+{
+  cts_client_free (peer->commands);
+  g_byte_array_unref (peer->pending);
+  g_free (peer);
+}
+
+/* A frame other than data, to @peer, or else back to where the command came from */
+static void
+sim_reply (Sim        *sim,
+           Peer       *peer,
+           const byte *frame,
+           gsize       size)
+{
+  Worker *worker = sim->worker;
+
+  if (peer)
+    peer_send (peer, frame, size);
+  else if (sim->fd >= 0)
+    sendto (sim->fd, frame, size, MSG_DONTWAIT,
+            (struct sockaddr *) &worker->sender, worker->sender_length);
+  else
+    send (worker->target_fd, frame, size, MSG_DONTWAIT);
+}
+
+static void
+sim_reply_config (Sim      *sim,
+                  Peer     *peer,
+                  uint16_t  sync)
+{
+  byte *frame;
+
+  frame = cts_conf_get_raw_data (sim->config, sync);
+
+  if (frame)
+    sim_reply (sim, peer, frame, cts_conf_calc_total_size (sim->config));
+
+  free (frame);
+}
+
+static void
+sim_reply_header (Sim  *sim,
+                  Peer *peer)
+{
+  g_autofree gchar *text = NULL;
+  byte *frame;
+
+  text = g_strdup_printf ("pmu-loadgen: simulated PMU %u of %d", sim->number + 1, count);
+  frame = cts_header_get_bin (sim->config, text);
+
+  if (frame)
+    sim_reply (sim, peer, frame, cts_common_get_size (frame, 2));
+
+  free (frame);
+}
+
+static void
+sim_handle_command (Sim        *sim,
+                    Peer       *peer,
+                    const byte *frame)
+{
+  Worker *worker = sim->worker;
+
+  switch (cts_bin_get_command_type (frame, TRUE))
+    {
+    case CTS_COMMAND_DATA_OFF:
+      if (peer)
+        peer->data_on = FALSE;
+      else if (sim->fd >= 0)
+        sim->data_on = FALSE;
+      break;
+
+    case CTS_COMMAND_DATA_ON:
+      if (peer)
+        {
+          peer->data_on = TRUE;
+        }
+      else if (sim->fd >= 0)
+        {
+          memcpy (&sim->address, &worker->sender, worker->sender_length);
+          sim->address_length = worker->sender_length;
+          sim->data_on = TRUE;
+        }
+      break;
+
+    case CTS_COMMAND_SEND_HDR:
+      sim_reply_header (sim, peer);
+      break;
+
+    case CTS_COMMAND_SEND_CONFIG1:
+      sim_reply_config (sim, peer, SYNC_CONFIG_ONE);
+      break;
+
+    case CTS_COMMAND_SEND_CONFIG2:
+      sim_reply_config (sim, peer, SYNC_CONFIG_TWO);
+      break;
+
+    default:
+      break;
+    }
+}
+
+static gboolean
+is_command_for (const byte *frame,
+                uint16_t    size,
+                Sim        *sim)
+{
+  return (frame[1] & 0x70) == (CTS_TYPE_COMMAND & 0x70) &&
+         size == COMMAND_MINIMUM_FRAME_SIZE &&
+         cts_common_get_size (frame, 4) == cts_conf_get_id_code (sim->config);
+}
+
+static void
+peer_frame_cb (CtsClient  *client,
+               const byte *frame,
+               uint16_t    size,
+               void        *user_data)
+{
+  Peer *peer = user_data;
+
+  if (is_command_for (frame, size, peer->sim))
+    sim_handle_command (peer->sim, peer, frame);
+}
+
+/* The PMU a datagram came to, or with --to, that of its ID code */
+static Sim *
+worker_find_sim (Worker  *worker,
+                 guint16  id)
+{
+  guint number = id - id_code;
+  guint num = worker->sims->len;
+
+  if (id < id_code || number >= (guint) count || number % num_workers != worker->index)
+    return NULL;
+
+  number /= num_workers;
+
+  return number < num ? g_ptr_array_index (worker->sims, number) : NULL;
+}
+
+static void
+worker_frame_cb (CtsClient  *client,
+                 const byte *frame,
+                 uint16_t    size,
+                 void        *user_data)
+{
+  Worker *worker = user_data;
+  Sim *sim = worker->receiving;
+
+  if (sim == NULL)
+    sim = worker_find_sim (worker, cts_common_get_size (frame, 4));
+
+  if (sim && is_command_for (frame, size, sim))
+    sim_handle_command (sim, NULL, frame);
+}
+
+static void
+accept_peer (Sim *sim)
+{
+  CtsClientHandlers handlers = { .frame = peer_frame_cb };
+  struct epoll_event event = { 0 };
+  Peer *peer;
+  int fd, one = 1;
+
+  fd = accept4 (sim->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+  if (fd < 0)
+    return;
+
+  setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+  peer = g_new0 (Peer, 1);
+  peer->kind = WATCH_PEER;
+  peer->sim = sim;
+  peer->pending = g_byte_array_new ();
+  peer->commands = cts_client_new (cts_conf_get_id_code (sim->config));
+
+  if (peer->commands == NULL)
+    {
+      close (fd);
+      peer_free (peer);
+      return;
+    }
+
+  cts_client_set_fd (peer->commands, fd, CTS_TRANSPORT_TCP);
+  cts_client_set_handlers (peer->commands, &handlers, peer);
+
+  event.events = EPOLLIN;
+  event.data.ptr = peer;
+  epoll_ctl (sim->worker->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+
+  g_ptr_array_add (sim->peers, peer);
+  sim->worker->local.peers++;
+}
+
+static void
+handle_peer (Peer    *peer,
+             guint32  events)
+{
+  ssize_t count;
+
+  if (events & EPOLLOUT)
+    peer_flush (peer);
+
+  if (peer->closed || !(events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+    return;
+
+  count = cts_client_read (peer->commands);
+
+  if (count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR))
+    peer->closed = TRUE;
+}
+
+static void
+receive_commands (Worker *worker,
+                  Sim    *sim,
+                  int     fd)
+{
+  for (;;)
+    {
+      ssize_t size;
+
+      worker->sender_length = sizeof worker->sender;
+      size = recvfrom (fd, worker->datagram, MAX_DATAGRAM, MSG_DONTWAIT,
+                       (struct sockaddr *) &worker->sender, &worker->sender_length);
+
+      if (size < 0)
+        return;
+
+      worker->receiving = sim;
+      cts_client_feed (worker->commands, worker->datagram, size);
+    }
+}
+
+static void
+worker_flush_batch (Worker *worker)
+{
+  guint done = 0;
+
+  while (done < worker->batch_len)
+    {
+      int sent = sendmmsg (worker->target_fd, worker->batch + done,
+                           worker->batch_len - done, MSG_DONTWAIT);
+
+      if (sent <= 0)
+        {
+          /* The first message failed, or nothing was taken */
+          if (sent == 0 || errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+              worker->local.dropped += worker->batch_len - done;
+              worker->local.frames -= worker->batch_len - done;
+              break;
+            }
+
+          worker->local.dropped++;
+          worker->local.frames--;
+          done++;
+          continue;
+        }
+
+      for (int i = 0; i < sent; i++)
+        worker->local.bytes += worker->batch[done + i].msg_len;
+
+      done += sent;
+    }
+
+  worker->batch_len = 0;
+}
+
+static void
+sim_send (Sim  *sim,
+          byte *frame)
+{
+  Worker *worker = sim->worker;
+  gsize size = sim->frame_size;
+
+  if (target_address)
+    {
+      struct iovec *iov = worker->iov + worker->batch_len;
+
+      iov->iov_base = frame;
+      iov->iov_len = size;
+      worker->batch[worker->batch_len].msg_hdr.msg_iov = iov;
+      worker->batch[worker->batch_len].msg_hdr.msg_iovlen = 1;
+      worker->local.frames++;
+
+      if (++worker->batch_len == UDP_BATCH)
+        worker_flush_batch (worker);
+    }
+  else if (sim->fd >= 0 && use_udp)
+    {
+      if (sendto (sim->fd, frame, size, MSG_DONTWAIT,
+                  (struct sockaddr *) &sim->address, sim->address_length) == (ssize_t) size)
+        {
+          worker->local.frames++;
+          worker->local.bytes += size;
+        }
+      else
+        {
+          worker->local.dropped++;
+        }
+    }
+  else
+    {
+      for (guint i = 0; i < sim->peers->len; i++)
+        {
+          Peer *peer = g_ptr_array_index (sim->peers, i);
+
+          if (!peer->data_on)
+            continue;
+
+          if (peer_send (peer, frame, size))
+            {
+              worker->local.frames++;
+              worker->local.bytes += size;
+            }
+          else
+            {
+              worker->local.dropped++;
+            }
+        }
+    }
+}
+
+static gboolean
+sim_wants_data (Sim *sim)
+{
+  if (target_address || use_udp)
+    return sim->data_on;
+
+  for (guint i = 0; i < sim->peers->len; i++)
+    if (((Peer *) g_ptr_array_index (sim->peers, i))->data_on)
+      return TRUE;
+
+  return FALSE;
+}
+
+/* The data frame of the reporting instant @index into @frame */
+static void
+sim_build (Sim    *sim,
+           gint64  index,
+           byte   *frame)
+{
+  Worker *worker = sim->worker;
+  const CtsDataLayout *layout = sim->layout;
+  CtsTime time = { 0 };
+  double t, swing, angle, freq, rocof;
+  float rotation_re, rotation_im;
+
+  time.soc = index / data_rate;
+  time.nanoseconds = get_time_of_index (index) - time.soc * NSEC_PER_SEC;
+
+  /* The angle of the grid is the integral of its frequency deviation */
+  t = (double) index / data_rate;
+  swing = 2 * G_PI / FREQ_SWING_PERIOD * t + sim->swing_phase;
+  freq = nominal_freq + FREQ_SWING * sin (swing);
+  rocof = FREQ_SWING * 2 * G_PI / FREQ_SWING_PERIOD * cos (swing);
+  angle = -FREQ_SWING * FREQ_SWING_PERIOD * cos (swing);
+  rotation_re = cos (angle);
+  rotation_im = sin (angle);
+
+  cts_data_layout_write_common (layout, &time, frame);
+  cts_data_layout_write_stat_of_pmu (layout, 1, 0, frame);
+
+  for (guint16 i = 0; i < num_phasors; i++)
+    {
+      float re = nominal_phasors[2 * i], im = nominal_phasors[2 * i + 1];
+      float noise = worker_noise (worker);
+
+      cts_data_layout_write_phasor_of_pmu (layout, 1, i + 1,
+                                           (re * rotation_re - im * rotation_im) * noise,
+                                           (re * rotation_im + im * rotation_re) * noise,
+                                           frame);
+    }
+
+  cts_data_layout_write_freq_of_pmu (layout, 1, freq, rocof, frame);
+
+  for (guint16 i = 1; i <= num_analogs; i++)
+    cts_data_layout_write_analog_of_pmu (layout, 1, i, 100.0f * worker_noise (worker), frame);
+
+  /* A breaker opening and closing every second */
+  for (guint16 i = 1; i <= num_digitals; i++)
+    cts_data_layout_write_status_word_of_pmu (layout, 1, i, i == 1 ? time.soc & 1 : 0, frame);
+
+  cts_data_layout_write_crc (layout, frame);
+}
+
+static void
+sim_send_delayed (Sim    *sim,
+                  gint64  now)
+{
+  guint num_due = 0;
+
+  while (num_due < sim->num_delayed && sim->delayed[num_due].due <= now)
+    sim_send (sim, sim->delayed[num_due++].frame);
+
+  if (num_due == 0)
+    return;
+
+  /* The batch points into the buffers, which are reused from here */
+  if (target_address)
+    worker_flush_batch (sim->worker);
+
+  for (guint i = 0; i < num_due; i++)
+    sim->free_frames[sim->num_free++] = sim->delayed[i].frame;
+
+  sim->num_delayed -= num_due;
+  memmove (sim->delayed, sim->delayed + num_due, sim->num_delayed * sizeof (Delayed));
+}
+
+static void
+sim_hold (Sim    *sim,
+          gint64  index,
+          gint64  due)
+{
+  guint position;
+  byte *frame;
+
+  /* Out of buffers, the earliest goes now */
+  if (sim->num_free == 0)
+    sim_send_delayed (sim, sim->delayed[0].due);
+
+  frame = sim->free_frames[--sim->num_free];
+  sim_build (sim, index, frame);
+
+  position = sim->num_delayed;
+
+  while (position > 0 && sim->delayed[position - 1].due > due)
+    position--;
+
+  memmove (sim->delayed + position + 1, sim->delayed + position,
+           (sim->num_delayed - position) * sizeof (Delayed));
+  sim->delayed[position].due = due;
+  sim->delayed[position].frame = frame;
+  sim->num_delayed++;
+}
+
+static void
+worker_tick (Worker *worker,
+             gint64  index)
+{
+  gint64 period = NSEC_PER_SEC / data_rate;
+
+  for (guint i = 0; i < worker->sims->len; i++)
+    {
+      Sim *sim = g_ptr_array_index (worker->sims, i);
+      gint64 delay = 0;
+
+      if (!sim_wants_data (sim))
+        continue;
+
+      if (loss_percent > 0 && worker_random (worker) * 100 < loss_percent)
+        {
+          worker->local.lost++;
+          continue;
+        }
+
+      if (jitter_ms > 0)
+        delay += worker_random (worker) * jitter_ms * 1000000;
+
+      if (reorder_percent > 0 && worker_random (worker) * 100 < reorder_percent)
+        delay += period + period / 2;
+
+      if (delay == 0)
+        {
+          sim_build (sim, index, sim->frame);
+          sim_send (sim, sim->frame);
+        }
+      else
+        {
+          sim_hold (sim, index, get_time_of_index (index) + delay);
+        }
+    }
+
+  /* sim->frame of each PMU is built again by the next tick */
+  if (target_address)
+    worker_flush_batch (worker);
+}
+
+static gint64
+worker_get_next_due (Worker *worker)
+{
+  gint64 due = G_MAXINT64;
+
+  for (guint i = 0; i < worker->sims->len; i++)
+    {
+      Sim *sim = g_ptr_array_index (worker->sims, i);
+
+      if (sim->num_delayed)
+        due = MIN (due, sim->delayed[0].due);
+    }
+
+  return due;
+}
+
+static void
+worker_sweep_peers (Worker *worker)
+{
+  for (guint i = 0; i < worker->sims->len; i++)
+    {
+      Sim *sim = g_ptr_array_index (worker->sims, i);
+
+      for (guint j = 0; j < sim->peers->len; )
+        {
+          Peer *peer = g_ptr_array_index (sim->peers, j);
+
+          if (peer->closed)
+            g_ptr_array_remove_index_fast (sim->peers, j);
+          else
+            j++;
+        }
+    }
+}
+
+static void
+worker_publish_stats (Worker *worker)
+{
+  g_mutex_lock (&worker->lock);
+  worker->stats = worker->local;
+  g_mutex_unlock (&worker->lock);
+}
+
+static gpointer
+worker_run (gpointer data)
+{
+  Worker *worker = data;
+  g_autofree gchar *name = NULL;
+  struct epoll_event events[64];
+  gboolean impaired = jitter_ms > 0 || reorder_percent > 0;
+  gint64 next_index;
+
+  name = g_strdup_printf ("worker %u", worker->index);
+  pmu_rt_setup_thread (name, 0, pin ? (gint) (worker->index % g_get_num_processors ()) : -1);
+
+  next_index = get_index_of_time (get_realtime_ns ()) + 1;
+
+  while (!g_atomic_int_get (&stopping))
+    {
+      gint64 now = get_realtime_ns ();
+      gint64 wake = get_time_of_index (next_index);
+      gint64 timeout;
+      int num_events;
+
+      if (impaired)
+        wake = MIN (wake, worker_get_next_due (worker));
+
+      timeout = wake > now ? (wake - now + 999999) / 1000000 : 0;
+      num_events = epoll_wait (worker->epoll_fd, events, G_N_ELEMENTS (events),
+                               MIN (timeout, 1000));
+
+      for (int i = 0; i < num_events; i++)
+        {
+          WatchKind *kind = events[i].data.ptr;
+
+          if (*kind == WATCH_LISTENER)
+            accept_peer ((Sim *) kind);
+          else if (*kind == WATCH_PEER)
+            handle_peer ((Peer *) kind, events[i].events);
+          else if (*kind == WATCH_UDP)
+            receive_commands (worker, (Sim *) kind, ((Sim *) kind)->fd);
+          else
+            receive_commands (worker, NULL, worker->target_fd);
+        }
+
+      now = get_realtime_ns ();
+
+      /* More than a second behind, there's no catching up */
+      if (now - get_time_of_index (next_index) > NSEC_PER_SEC)
+        {
+          gint64 index = get_index_of_time (now);
+
+          worker->local.skipped += index - next_index;
+          next_index = index;
+        }
+
+      while (get_time_of_index (next_index) <= now)
+        worker_tick (worker, next_index++);
+
+      if (impaired)
+        for (guint i = 0; i < worker->sims->len; i++)
+          sim_send_delayed (g_ptr_array_index (worker->sims, i), now);
+
+      worker_sweep_peers (worker);
+      worker_publish_stats (worker);
+    }
+
+  return NULL;
+}
+
+static int
+open_socket (int port_number,
+             int type)
+{
+  struct sockaddr_in6 address = { 0 };
+  int fd, one = 1;
+
+  fd = socket (AF_INET6, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if (fd < 0)
+    return -1;
+
+  setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
+  address.sin6_family = AF_INET6;
+  address.sin6_addr = in6addr_any;
+  address.sin6_port = htons (port_number);
+
+  if (bind (fd, (struct sockaddr *) &address, sizeof address) < 0 ||
+      (type == SOCK_STREAM && listen (fd, 16) < 0))
+    {
+      close (fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+/* Voltages at 230 kV, currents at 1 kA lagging by 30 degrees, ABC in turn */
+static void
+make_nominal_phasors (void)
+{
+  gint num_voltages = (num_phasors + 1) / 2;
+
+  nominal_phasors = g_new (float, 2 * num_phasors);
+
+  for (gint i = 0; i < num_phasors; i++)
+    {
+      gboolean is_voltage = i < num_voltages;
+      gint phase = (is_voltage ? i : i - num_voltages) % 3;
+      double magnitude = is_voltage ? 230000 / sqrt (3) : 1000;
+      double angle = -2 * G_PI / 3 * phase - (is_voltage ? 0 : G_PI / 6);
+
+      nominal_phasors[2 * i] = magnitude * cos (angle);
+      nominal_phasors[2 * i + 1] = magnitude * sin (angle);
+    }
+}
+
+/* Channel names are 16 bytes, padded with spaces */
+static char *
+pad_name (gchar *name)
+{
+  char *padded = g_strdup_printf ("%-16.16s", name);
+
+  g_free (name);
+
+  return padded;
+}
+
+static void
+make_channel_names (void)
+{
+  gint num_voltages = (num_phasors + 1) / 2;
+  gint num_names = num_phasors + num_analogs + 16 * num_digitals;
+  gint n = 0;
+
+  channel_names = g_new0 (char *, num_names + 1);
+
+  for (gint i = 0; i < num_phasors; i++)
+    {
+      gboolean is_voltage = i < num_voltages;
+      gint j = is_voltage ? i : i - num_voltages;
+
+      channel_names[n++] = pad_name (g_strdup_printf ("%c%c%d", is_voltage ? 'V' : 'I',
+                                                      "ABC"[j % 3], j / 3 + 1));
+    }
+
+  for (gint i = 0; i < num_analogs; i++)
+    channel_names[n++] = pad_name (g_strdup_printf ("ANALOG%d", i + 1));
+
+  for (gint i = 0; i < num_digitals; i++)
+    for (gint j = 0; j < 16; j++)
+      channel_names[n++] = pad_name (g_strdup_printf ("DIGITAL%d.%d", i + 1, j));
+}
+
+static CtsConf *
+make_config (guint16 id,
+             guint   number)
+{
+  Format pmu = pmu_format == FORMAT_MIXED ? number % N_FORMATS : pmu_format;
+  gboolean is_float = pmu == FORMAT_FLOAT || pmu == FORMAT_POLAR;
+  g_autofree gchar *station = g_strdup_printf ("SIM%05u", number + 1);
+  gint num_voltages = (num_phasors + 1) / 2;
+  CtsConf *config = cts_conf_new ();
+
+  cts_conf_set_id_code (config, id);
+  cts_conf_set_num_of_pmu (config, 1);
+  cts_conf_set_time_base (config, PMU_TIME_BASE);
+  cts_conf_set_data_rate (config, data_rate);
+  cts_conf_set_station_name_of_pmu (config, 1, station, strlen (station));
+  cts_conf_set_id_code_of_pmu (config, 1, id);
+  cts_conf_set_num_of_phasors_of_pmu (config, 1, num_phasors);
+  cts_conf_set_num_of_analogs_of_pmu (config, 1, num_analogs);
+  cts_conf_set_num_of_status_of_pmu (config, 1, num_digitals);
+  cts_conf_set_nominal_freq_of_pmu (config, 1, nominal_freq);
+
+  cts_conf_set_phasor_data_type_of_pmu (config, 1, is_float ? VALUE_TYPE_FLOAT : VALUE_TYPE_INT);
+  cts_conf_set_freq_data_type_of_pmu (config, 1, is_float ? VALUE_TYPE_FLOAT : VALUE_TYPE_INT);
+  cts_conf_set_analog_data_type_of_pmu (config, 1, is_float ? VALUE_TYPE_FLOAT : VALUE_TYPE_INT);
+  cts_conf_set_phasor_complex_type_of_pmu (config, 1,
+                                           pmu == FORMAT_POLAR || pmu == FORMAT_INTEGER_POLAR);
+
+  /* 5 V and 0.05 A per bit as integers, 0.01 units for analog values */
+  for (gint i = 1; i <= num_phasors; i++)
+    {
+      gboolean is_voltage = i <= num_voltages;
+
+      cts_conf_set_phasor_measure_type_of_pmu (config, 1, i,
+                                               is_voltage ? VALUE_TYPE_VOLTAGE : VALUE_TYPE_CURRENT);
+      cts_conf_set_phasor_conv_of_pmu (config, 1, i, is_voltage ? 500000 : 5000);
+    }
+
+  cts_conf_set_all_analog_conv_of_pmu (config, 1, 1000);
+  cts_conf_set_channel_names_of_pmu (config, 1, channel_names);
+  cts_conf_update_frame_size (config);
+
+  return config;
+}
+
+static Sim *
+sim_new (Worker *worker,
+         guint   number)
+{
+  struct epoll_event event = { 0 };
+  guint16 id = id_code + number;
+  Sim *sim;
+
+  sim = g_new0 (Sim, 1);
+  sim->worker = worker;
+  sim->number = number;
+  sim->fd = -1;
+  sim->peers = g_ptr_array_new_with_free_func ((GDestroyNotify) peer_free);
+  sim->config = make_config (id, number);
+  sim->layout = cts_data_layout_new (sim->config);
+  sim->swing_phase = 2 * G_PI * worker_random (worker);
+
+  if (sim->layout == NULL)
+    return sim;
+
+  sim->frame_size = cts_data_layout_get_frame_size (sim->layout);
+  sim->frame = g_malloc0 (sim->frame_size);
+
+  if (jitter_ms > 0 || reorder_percent > 0)
+    {
+      sim->pool = g_malloc0 ((gsize) sim->frame_size * MAX_DELAYED);
+
+      for (guint i = 0; i < MAX_DELAYED; i++)
+        sim->free_frames[sim->num_free++] = sim->pool + (gsize) sim->frame_size * i;
+    }
+
+  if (target_address)
+    {
+      sim->data_on = TRUE;
+      return sim;
+    }
+
+  sim->kind = use_udp ? WATCH_UDP : WATCH_LISTENER;
+  sim->fd = open_socket (port + number, use_udp ? SOCK_DGRAM : SOCK_STREAM);
+
+  if (sim->fd >= 0)
+    {
+      event.events = EPOLLIN;
+      event.data.ptr = sim;
+      epoll_ctl (worker->epoll_fd, EPOLL_CTL_ADD, sim->fd, &event);
+    }
+
+  return sim;
+}
+
+static gboolean
+worker_init (Worker *worker,
+             guint   index)
+{
+  CtsClientHandlers handlers = { .frame = worker_frame_cb };
+
+  worker->index = index;
+  worker->epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+  worker->sims = g_ptr_array_new ();
+  worker->random = g_random_int () | (guint64) g_random_int () << 32 | 1;
+  worker->datagram = g_malloc (MAX_DATAGRAM);
+  worker->commands = cts_client_new (0);
+  worker->target_kind = WATCH_TARGET;
+  worker->target_fd = -1;
+  g_mutex_init (&worker->lock);
+
+  if (worker->epoll_fd < 0 || worker->commands == NULL)
+    return FALSE;
+
+  cts_client_set_handlers (worker->commands, &handlers, worker);
+
+  if (target_address)
+    {
+      struct epoll_event event = { 0 };
+
+      worker->target_fd = socket (target_address->ai_family,
+                                  SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+      if (worker->target_fd < 0 ||
+          connect (worker->target_fd, target_address->ai_addr, target_address->ai_addrlen) < 0)
+        return FALSE;
+
+      event.events = EPOLLIN;
+      event.data.ptr = &worker->target_kind;
+      epoll_ctl (worker->epoll_fd, EPOLL_CTL_ADD, worker->target_fd, &event);
+    }
+
+  return TRUE;
+}
+
+static void
+get_stats (Worker    *workers,
+           LoadStats *total)
+{
+  memset (total, 0, sizeof *total);
+
+  for (gint i = 0; i < num_workers; i++)
+    {
+      g_mutex_lock (&workers[i].lock);
+      total->frames += workers[i].stats.frames;
+      total->bytes += workers[i].stats.bytes;
+      total->lost += workers[i].stats.lost;
+      total->dropped += workers[i].stats.dropped;
+      total->skipped += workers[i].stats.skipped;
+      total->peers += workers[i].stats.peers;
+      g_mutex_unlock (&workers[i].lock);
+    }
+}
+
+static void
+print_stats (const LoadStats *stats,
+             const LoadStats *last,
+             double           seconds)
+{
+  g_printerr ("%.0f frames/s, %.1f Mbit/s; %" G_GUINT64_FORMAT " frames, %"
+              G_GUINT64_FORMAT " lost, %" G_GUINT64_FORMAT " dropped, %"
+              G_GUINT64_FORMAT " instants skipped, %" G_GUINT64_FORMAT " connections\n",
+              (stats->frames - last->frames) / seconds,
+              (stats->bytes - last->bytes) * 8 / seconds / 1e6,
+              stats->frames, stats->lost, stats->dropped, stats->skipped, stats->peers);
+}
+
+static gboolean
+parse_target (const gchar *address)
+{
+  g_autofree gchar *host = NULL;
+  struct addrinfo hints = { 0 };
+  const gchar *colon = strrchr (address, ':');
+
+  if (colon == NULL || colon == address || colon[1] == '\0')
+    return FALSE;
+
+  if (address[0] == '[' && colon[-1] == ']')
+    host = g_strndup (address + 1, colon - address - 2);
+  else
+    host = g_strndup (address, colon - address);
+
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+
+  return getaddrinfo (host, colon + 1, &hints, &target_address) == 0;
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  Worker *workers;
+  LoadStats last = { 0 }, stats;
+  gint64 start, last_time;
+
+  context = g_option_context_new (NULL);
+  g_option_context_set_summary (context, "Simulate many PMUs, to load a PDC or server with");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (format == NULL || g_str_equal (format, "float"))
+    pmu_format = FORMAT_FLOAT;
+  else if (g_str_equal (format, "integer"))
+    pmu_format = FORMAT_INTEGER;
+  else if (g_str_equal (format, "polar"))
+    pmu_format = FORMAT_POLAR;
+  else if (g_str_equal (format, "mixed"))
+    pmu_format = FORMAT_MIXED;
+  else
+    pmu_format = N_FORMATS + 1;
+
+  if (num_workers <= 0)
+    num_workers = g_get_num_processors ();
+
+  if (argc > 1 || pmu_format > FORMAT_MIXED ||
+      count < 1 || id_code < 1 || id_code + count - 1 > G_MAXUINT16 ||
+      (target == NULL && (port < 1 || port + count - 1 > G_MAXUINT16)) ||
+      data_rate < 1 || data_rate > 1000 ||
+      (nominal_freq != 50 && nominal_freq != 60) ||
+      num_phasors < 1 || num_analogs < 0 || num_digitals < 0 ||
+      num_phasors + num_analogs + num_digitals > 4096 ||
+      jitter_ms < 0 || loss_percent < 0 || loss_percent > 100 ||
+      reorder_percent < 0 || reorder_percent > 100 || duration < 0)
+    {
+      g_printerr ("%s", g_option_context_get_help (context, TRUE, NULL));
+      return EXIT_FAILURE;
+    }
+
+  /* Frames held back are bounded; longer delays go out early */
+  if (jitter_ms * data_rate / 1000 > MAX_DELAYED / 2)
+    g_printerr ("Jitter is more than %d frames, frames will be sent early\n", MAX_DELAYED / 2);
+
+  if (target && !parse_target (target))
+    {
+      g_printerr ("Can't resolve '%s', expected HOST:PORT\n", target);
+      return EXIT_FAILURE;
+    }
+
+  num_workers = MIN (num_workers, count);
+  make_nominal_phasors ();
+  make_channel_names ();
+  workers = g_new0 (Worker, num_workers);
+
+  for (gint i = 0; i < num_workers; i++)
+    if (!worker_init (&workers[i], i))
+      {
+        g_printerr ("Can't set up worker %d: %s\n", i, g_strerror (errno));
+        return EXIT_FAILURE;
+      }
+
+  for (gint i = 0; i < count; i++)
+    {
+      Worker *worker = &workers[i % num_workers];
+      Sim *sim = sim_new (worker, i);
+
+      if (sim->layout == NULL)
+        {
+          g_printerr ("Data frames would be more than 65535 bytes\n");
+          return EXIT_FAILURE;
+        }
+
+      if (target == NULL && sim->fd < 0)
+        {
+          g_printerr ("Can't listen on port %d: %s\n", port + i, g_strerror (errno));
+          return EXIT_FAILURE;
+        }
+
+      g_ptr_array_add (worker->sims, sim);
+    }
+
+  for (gint i = 0; i < num_workers; i++)
+    workers[i].thread = g_thread_new ("loadgen", worker_run, &workers[i]);
+
+  start = last_time = g_get_monotonic_time ();
+
+  for (;;)
+    {
+      gint64 now = g_get_monotonic_time ();
+      gint64 end = start + duration * G_USEC_PER_SEC;
+
+      if (duration && now >= end)
+        break;
+
+      g_usleep (duration ? MIN (STATS_INTERVAL, end - now) : STATS_INTERVAL);
+
+      now = g_get_monotonic_time ();
+
+      if (verbose)
+        {
+          get_stats (workers, &stats);
+          print_stats (&stats, &last, (double) (now - last_time) / G_USEC_PER_SEC);
+          last = stats;
+          last_time = now;
+        }
+    }
+
+  g_atomic_int_set (&stopping, TRUE);
+
+  for (gint i = 0; i < num_workers; i++)
+    g_thread_join (workers[i].thread);
+
+  memset (&last, 0, sizeof last);
+  get_stats (workers, &stats);
+  print_stats (&stats, &last, (double) (g_get_monotonic_time () - start) / G_USEC_PER_SEC);
+
+  return EXIT_SUCCESS;
+}
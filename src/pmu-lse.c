@@ -0,0 +1,614 @@
+/* pmu-lse.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gio/gio.h>
+#include <math.h>
+
+#include "pmu-trace.h"
+
+#include "pmu-lse.h"
+
+/*
+ * Estimates the bus voltages of a network from the phasors of every
+ * PMU in a data frame, with a #DspLse. The network is read from a text
+ * file of a line per item, words separated by spaces, '#' starting a
+ * comment:
+ *
+ *   base VOLTAGE CURRENT
+ *     The base of the phasors of the measurements that follow, in the
+ *     units of the PMUs. 1 and 1 (phasors in per unit) till set.
+ *
+ *   branch FROM TO R X B [PMU WORD BIT]
+ *     A branch between buses FROM and TO, of series impedance R + jX
+ *     and total shunt susceptance B, per unit. With PMU, the branch is
+ *     in service while bit BIT (0 - 15) of digital status word WORD of
+ *     that PMU is set, else always.
+ *
+ *   voltage BUS PMU PHASOR SIGMA
+ *     The voltage of BUS is phasor PHASOR of PMU, with a standard
+ *     deviation of error of SIGMA, per unit.
+ *
+ *   current FROM TO PMU PHASOR SIGMA
+ *     The current leaving FROM on the first branch between FROM and TO
+ *     given before.
+ *
+ * Buses are named by any word. PMUs are counted from 1, in the order
+ * of the data frame, as are phasors and status words.
+ *
+ * A measurement is not used while its PMU is missing from the frame or
+ * flags its data as not to be used in STAT. Such a change, or a
+ * branch going in or out of service, refactorises the gain matrix on
+ * the frame it is seen in; other frames are a solve only.
+ */
+
+typedef struct
+{
+  guint pmu;                    /* 0 if always in service */
+  guint word;
+  guint bit;
+} BranchStatus;
+
+typedef struct
+{
+  guint pmu;
+  guint phasor;
+  gfloat base;
+} Source;
+
+typedef struct
+{
+  guint from;
+  guint to;
+  gdouble resistance;
+  gdouble reactance;
+  gdouble susceptance;
+  BranchStatus status;
+} BranchLine;
+
+typedef struct
+{
+  DspLseMeasurementType type;
+  guint element;
+  gdouble sigma;
+  Source source;
+} MeasurementLine;
+
+struct _PmuLse
+{
+  DspLse *lse;
+  gfloat residual_limit;
+
+  gchar **buses;
+  guint num_buses;
+  BranchStatus *status;
+  guint num_branches;
+  Source *sources;
+  guint num_measurements;
+
+  /* num_measurements each */
+  gfloat *real;
+  gfloat *imaginary;
+  gfloat *residuals;
+  gboolean *bad;
+
+  /* num_buses each */
+  gfloat *voltage_real;
+  gfloat *voltage_imaginary;
+
+  gboolean observable;
+
+  GMutex mutex;                 /* For latest */
+  PmuLseEstimate *latest;
+};
+
+static gboolean
+parse_double (const gchar *word,
+              gdouble     *value)
+{
+  gchar *end;
+
+  *value = g_ascii_strtod (word, &end);
+
+  return *end == '\0' && end != word && isfinite (*value);
+}
+
+static gboolean
+parse_uint (const gchar *word,
+            guint        max,
+            guint       *value)
+{
+  gchar *end;
+  guint64 number;
+
+  number = g_ascii_strtoull (word, &end, 10);
+  *value = number;
+
+  return *end == '\0' && end != word && number <= max;
+}
+
+static guint
+get_bus (GHashTable  *indices,
+         GPtrArray   *names,
+         const gchar *name)
+{
+  gpointer index;
+
+  if (g_hash_table_lookup_extended (indices, name, NULL, &index))
+    return GPOINTER_TO_UINT (index);
+
+  g_ptr_array_add (names, g_strdup (name));
+  g_hash_table_insert (indices, g_ptr_array_index (names, names->len - 1),
+                       GUINT_TO_POINTER (names->len - 1));
+
+  return names->len - 1;
+}
+
+/* The non empty words of @line, till a '#' */
+static gchar **
+split_words (gchar *line)
+{
+  gchar **words;
+  guint length = 0;
+
+  line[strcspn (line, "#")] = '\0';
+  words = g_strsplit_set (line, " \t\r", -1);
+
+  for (guint i = 0; words[i]; i++)
+    {
+      if (*words[i])
+        words[length++] = words[i];
+      else
+        g_free (words[i]);
+    }
+
+  words[length] = NULL;
+
+  return words;
+}
+
+static gboolean
+parse_line (gchar      **words,
+            GHashTable  *indices,
+            GPtrArray   *names,
+            GArray      *branches,
+            GArray      *measurements,
+            gfloat      *bases)
+{
+  guint num_words = g_strv_length (words);
+
+  if (g_str_equal (words[0], "base") && num_words == 3)
+    {
+      gdouble voltage, current;
+
+      if (!parse_double (words[1], &voltage) || !parse_double (words[2], &current) ||
+          voltage <= 0 || current <= 0)
+        return FALSE;
+
+      bases[0] = voltage;
+      bases[1] = current;
+
+      return TRUE;
+    }
+
+  if (g_str_equal (words[0], "branch") && (num_words == 6 || num_words == 9))
+    {
+      BranchLine branch = { 0 };
+
+      if (!parse_double (words[3], &branch.resistance) ||
+          !parse_double (words[4], &branch.reactance) ||
+          !parse_double (words[5], &branch.susceptance) ||
+          g_str_equal (words[1], words[2]) ||
+          (branch.resistance == 0 && branch.reactance == 0))
+        return FALSE;
+
+      if (num_words == 9 &&
+          (!parse_uint (words[6], G_MAXUINT16, &branch.status.pmu) ||
+           !parse_uint (words[7], G_MAXUINT16, &branch.status.word) ||
+           !parse_uint (words[8], 15, &branch.status.bit) ||
+           branch.status.pmu == 0 || branch.status.word == 0))
+        return FALSE;
+
+      branch.from = get_bus (indices, names, words[1]);
+      branch.to = get_bus (indices, names, words[2]);
+      g_array_append_val (branches, branch);
+
+      return TRUE;
+    }
+
+  if ((g_str_equal (words[0], "voltage") && num_words == 5) ||
+      (g_str_equal (words[0], "current") && num_words == 6))
+    {
+      MeasurementLine measurement = { 0 };
+      gboolean is_voltage = num_words == 5;
+      gchar **source = words + num_words - 3;
+
+      if (!parse_uint (source[0], G_MAXUINT16, &measurement.source.pmu) ||
+          !parse_uint (source[1], G_MAXUINT16, &measurement.source.phasor) ||
+          !parse_double (source[2], &measurement.sigma) ||
+          measurement.source.pmu == 0 || measurement.source.phasor == 0 ||
+          measurement.sigma <= 0)
+        return FALSE;
+
+      measurement.source.base = bases[is_voltage ? 0 : 1];
+
+      if (is_voltage)
+        {
+          measurement.type = DSP_LSE_VOLTAGE;
+          measurement.element = get_bus (indices, names, words[1]);
+        }
+      else
+        {
+          guint from = get_bus (indices, names, words[1]);
+          guint to = get_bus (indices, names, words[2]);
+          guint i;
+
+          for (i = 0; i < branches->len; i++)
+            {
+              BranchLine *branch = &g_array_index (branches, BranchLine, i);
+
+              if ((branch->from == from && branch->to == to) ||
+                  (branch->from == to && branch->to == from))
+                break;
+            }
+
+          if (i == branches->len)
+            return FALSE;
+
+          measurement.element = i;
+          measurement.type = g_array_index (branches, BranchLine, i).from == from ?
+            DSP_LSE_CURRENT_FROM : DSP_LSE_CURRENT_TO;
+        }
+
+      g_array_append_val (measurements, measurement);
+
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+build_network (PmuLse  *self,
+               GArray  *branches,
+               GArray  *measurements)
+{
+  self->lse = dsp_lse_new (self->num_buses);
+
+  if (self->lse == NULL)
+    return FALSE;
+
+  self->num_branches = branches->len;
+  self->status = g_new0 (BranchStatus, branches->len);
+
+  for (guint i = 0; i < branches->len; i++)
+    {
+      BranchLine *branch = &g_array_index (branches, BranchLine, i);
+
+      if (dsp_lse_add_branch (self->lse, branch->from, branch->to,
+                              branch->resistance, branch->reactance,
+                              branch->susceptance) == DSP_LSE_INVALID)
+        return FALSE;
+
+      self->status[i] = branch->status;
+    }
+
+  self->num_measurements = measurements->len;
+  self->sources = g_new0 (Source, measurements->len);
+
+  for (guint i = 0; i < measurements->len; i++)
+    {
+      MeasurementLine *measurement = &g_array_index (measurements, MeasurementLine, i);
+
+      if (dsp_lse_add_measurement (self->lse, measurement->type,
+                                   measurement->element,
+                                   measurement->sigma) == DSP_LSE_INVALID)
+        return FALSE;
+
+      self->sources[i] = measurement->source;
+    }
+
+  self->real = g_new0 (gfloat, self->num_measurements);
+  self->imaginary = g_new0 (gfloat, self->num_measurements);
+  self->residuals = g_new0 (gfloat, self->num_measurements);
+  self->bad = g_new0 (gboolean, self->num_measurements);
+  self->voltage_real = g_new0 (gfloat, self->num_buses);
+  self->voltage_imaginary = g_new0 (gfloat, self->num_buses);
+
+  return TRUE;
+}
+
+/**
+ * pmu_lse_new_from_file:
+ * @path: The network file, see the top of pmu-lse.c
+ * @residual_limit: Normalised residuals past this flag bad data, 3 say
+ * @error: Return location for a #GError
+ *
+ * Returns: (transfer full) (nullable): A new #PmuLse, or %NULL with
+ * @error set if the file can't be read or is not valid. Free with
+ * pmu_lse_free().
+ */
+PmuLse *
+pmu_lse_new_from_file (const gchar  *path,
+                       gfloat        residual_limit,
+                       GError      **error)
+{
+  g_autoptr(PmuLse) self = NULL;
+  g_autoptr(GHashTable) indices = NULL;
+  g_autoptr(GPtrArray) names = NULL;
+  g_autoptr(GArray) branches = NULL;
+  g_autoptr(GArray) measurements = NULL;
+  g_autofree gchar *contents = NULL;
+  g_auto(GStrv) lines = NULL;
+  gfloat bases[2] = { 1, 1 };
+
+  if (!g_file_get_contents (path, &contents, NULL, error))
+    return NULL;
+
+  indices = g_hash_table_new (g_str_hash, g_str_equal);
+  names = g_ptr_array_new_with_free_func (g_free);
+  branches = g_array_new (FALSE, FALSE, sizeof (BranchLine));
+  measurements = g_array_new (FALSE, FALSE, sizeof (MeasurementLine));
+  lines = g_strsplit (contents, "\n", -1);
+
+  self = g_new0 (PmuLse, 1);
+  self->residual_limit = residual_limit;
+  g_mutex_init (&self->mutex);
+
+  for (guint i = 0; lines[i]; i++)
+    {
+      g_auto(GStrv) words = split_words (lines[i]);
+
+      if (words[0] == NULL)
+        continue;
+
+      if (!parse_line (words, indices, names, branches, measurements, bases))
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "%s:%u: Invalid %s", path, i + 1, words[0]);
+          return NULL;
+        }
+    }
+
+  self->num_buses = names->len;
+  g_ptr_array_add (names, NULL);
+  self->buses = (gchar **) g_ptr_array_free (g_steal_pointer (&names), FALSE);
+
+  if (self->num_buses == 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "%s: No buses", path);
+      return NULL;
+    }
+
+  if (!build_network (self, branches, measurements))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "%s: Creating the network failed", path);
+      return NULL;
+    }
+
+  /* The ordering and first factorisation off the frame path */
+  if (!dsp_lse_factorize (self->lse))
+    g_warning ("%s: The network is not observable from every measurement", path);
+
+  return g_steal_pointer (&self);
+}
+
+void
+pmu_lse_free (PmuLse *self)
+{
+  if (self == NULL)
+    return;
+
+  dsp_lse_free (self->lse);
+  g_strfreev (self->buses);
+  g_free (self->status);
+  g_free (self->sources);
+  g_free (self->real);
+  g_free (self->imaginary);
+  g_free (self->residuals);
+  g_free (self->bad);
+  g_free (self->voltage_real);
+  g_free (self->voltage_imaginary);
+  pmu_lse_estimate_free (self->latest);
+  g_mutex_clear (&self->mutex);
+  g_free (self);
+}
+
+static void
+read_topology (PmuLse  *self,
+               CtsData *data)
+{
+  for (guint i = 0; i < self->num_branches; i++)
+    {
+      BranchStatus *status = self->status + i;
+      guint16 word;
+
+      /* Left as last seen if the PMU is missing */
+      if (status->pmu &&
+          cts_data_get_status_word_of_pmu (data, status->pmu, status->word, &word) &&
+          !(cts_data_get_stat_of_pmu (data, status->pmu) & STAT_DATA_ERROR_MASK))
+        dsp_lse_set_branch_in_service (self->lse, i, word & (1 << status->bit));
+    }
+}
+
+static void
+read_measurements (PmuLse  *self,
+                   CtsData *data,
+                   guint    num_pmu)
+{
+  for (guint i = 0; i < self->num_measurements; i++)
+    {
+      Source *source = self->sources + i;
+      gfloat real, imaginary;
+      gboolean available;
+
+      available = source->pmu <= num_pmu &&
+        !(cts_data_get_stat_of_pmu (data, source->pmu) & STAT_DATA_ERROR_MASK) &&
+        cts_data_get_phasor_of_pmu (data, source->pmu, source->phasor, &real, &imaginary) &&
+        isfinite (real) && isfinite (imaginary);
+
+      if (available)
+        {
+          self->real[i] = real / source->base;
+          self->imaginary[i] = imaginary / source->base;
+        }
+
+      dsp_lse_set_measurement_available (self->lse, i, available);
+    }
+}
+
+static void
+update_latest (PmuLse  *self,
+               guint32  soc)
+{
+  PmuLseEstimate *latest;
+
+  g_mutex_lock (&self->mutex);
+
+  if (self->latest == NULL)
+    {
+      latest = self->latest = g_new0 (PmuLseEstimate, 1);
+      latest->num_buses = self->num_buses;
+      latest->buses = g_strdupv (self->buses);
+      latest->magnitudes = g_new0 (gfloat, self->num_buses);
+      latest->angles = g_new0 (gfloat, self->num_buses);
+      latest->num_measurements = self->num_measurements;
+      latest->residuals = g_new0 (gfloat, self->num_measurements);
+      latest->bad = g_new0 (gboolean, self->num_measurements);
+    }
+
+  latest = self->latest;
+  latest->soc = soc;
+  latest->observable = self->observable;
+
+  for (guint i = 0; i < self->num_buses; i++)
+    {
+      latest->magnitudes[i] = hypotf (self->voltage_real[i], self->voltage_imaginary[i]);
+      latest->angles[i] = atan2f (self->voltage_imaginary[i], self->voltage_real[i]);
+    }
+
+  memcpy (latest->residuals, self->residuals, sizeof (gfloat) * self->num_measurements);
+  memcpy (latest->bad, self->bad, sizeof (gboolean) * self->num_measurements);
+
+  g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * pmu_lse_update_data:
+ * @self: A #PmuLse
+ * @data: The data frame
+ *
+ * Estimate the bus voltages from @data, and flag the measurements of
+ * a normalised residual past the limit. Measurements flagged are
+ * traced when they become bad. The estimate is then the latest, see
+ * pmu_lse_dup_latest().
+ *
+ * Returns: %TRUE if estimated, %FALSE if the network is not observable
+ * from the measurements in @data.
+ */
+gboolean
+pmu_lse_update_data (PmuLse  *self,
+                     CtsData *data)
+{
+  guint num_pmu = cts_conf_get_num_of_pmu (cts_data_get_conf (data));
+  guint32 soc = cts_data_get_soc (data);
+  gboolean observable;
+
+  read_topology (self, data);
+  read_measurements (self, data, num_pmu);
+
+  observable = dsp_lse_solve (self->lse, self->real, self->imaginary,
+                              self->voltage_real, self->voltage_imaginary,
+                              self->residuals);
+
+  if (!observable)
+    {
+      if (self->observable)
+        pmu_trace (PMU_TRACE_LEVEL_WARNING, PMU_TRACE_LSE_UNOBSERVABLE,
+                   num_pmu, self->num_measurements, soc);
+
+      memset (self->residuals, 0, sizeof (gfloat) * self->num_measurements);
+    }
+
+  self->observable = observable;
+
+  for (guint i = 0; i < self->num_measurements; i++)
+    {
+      gboolean bad = self->residuals[i] > self->residual_limit;
+
+      if (bad && !self->bad[i])
+        pmu_trace (PMU_TRACE_LEVEL_WARNING, PMU_TRACE_LSE_BAD_DATA,
+                   i + 1, self->residuals[i] * 100, soc);
+
+      self->bad[i] = bad;
+    }
+
+  update_latest (self, soc);
+
+  return observable;
+}
+
+/**
+ * pmu_lse_dup_latest:
+ * @self: A #PmuLse
+ *
+ * Can be called from any thread.
+ *
+ * Returns: (transfer full) (nullable): A copy of the estimate of the
+ * last frame, %NULL if none yet. Free with pmu_lse_estimate_free().
+ */
+PmuLseEstimate *
+pmu_lse_dup_latest (PmuLse *self)
+{
+  PmuLseEstimate *copy = NULL;
+  PmuLseEstimate *latest;
+
+  g_mutex_lock (&self->mutex);
+
+  latest = self->latest;
+
+  if (latest)
+    {
+      copy = g_memdup (latest, sizeof *latest);
+      copy->buses = g_strdupv (latest->buses);
+      copy->magnitudes = g_memdup (latest->magnitudes, sizeof (gfloat) * latest->num_buses);
+      copy->angles = g_memdup (latest->angles, sizeof (gfloat) * latest->num_buses);
+      copy->residuals = g_memdup (latest->residuals,
+                                  sizeof (gfloat) * latest->num_measurements);
+      copy->bad = g_memdup (latest->bad, sizeof (gboolean) * latest->num_measurements);
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  return copy;
+}
+
+void
+pmu_lse_estimate_free (PmuLseEstimate *estimate)
+{
+  if (estimate == NULL)
+    return;
+
+  g_strfreev (estimate->buses);
+  g_free (estimate->magnitudes);
+  g_free (estimate->angles);
+  g_free (estimate->residuals);
+  g_free (estimate->bad);
+  g_free (estimate);
+}
@@ -0,0 +1,57 @@
+/* pmu-lse.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "c37/c37.h"
+#include "dsp/dsp-lse.h"
+
+G_BEGIN_DECLS
+
+typedef struct _PmuLse PmuLse;
+
+/* The bus voltages estimated from a data frame */
+typedef struct
+{
+  guint32 soc;
+  gboolean observable;          /* FALSE if not estimated */
+  guint num_buses;
+  gchar **buses;                /* num_buses, as named in the network */
+  gfloat *magnitudes;           /* num_buses, per unit */
+  gfloat *angles;               /* num_buses, radians */
+  guint num_measurements;
+  gfloat *residuals;            /* num_measurements, normalised */
+  gboolean *bad;                /* num_measurements, residual past the limit */
+} PmuLseEstimate;
+
+PmuLse         *pmu_lse_new_from_file (const gchar  *path,
+                                       gfloat        residual_limit,
+                                       GError      **error);
+void            pmu_lse_free          (PmuLse       *self);
+gboolean        pmu_lse_update_data   (PmuLse       *self,
+                                       CtsData      *data);
+PmuLseEstimate *pmu_lse_dup_latest    (PmuLse       *self);
+
+void            pmu_lse_estimate_free (PmuLseEstimate *estimate);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PmuLse, pmu_lse_free)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PmuLseEstimate, pmu_lse_estimate_free)
+
+G_END_DECLS
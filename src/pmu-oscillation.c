@@ -0,0 +1,391 @@
+/* pmu-oscillation.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dsp/dsp.h"
+#include "pmu-trace.h"
+
+#include "pmu-oscillation.h"
+
+/*
+ * Watches every PMU for poorly damped low frequency oscillations, the
+ * inter-area modes, in its frequency, the magnitude of V Pos and the
+ * angle of V Pos from that of the first PMU.
+ *
+ * The signals are decimated to MODAL_RATE (or less if the data rate
+ * is not a multiple of it) and followed by a #DspModal, a lane each.
+ * The modes of a lane are found every frame, for a lane at a time in
+ * turn, so that the cost of a frame is bounded whatever the number of
+ * PMUs, and the dominant (least damped) mode of every lane is kept.
+ *
+ * A PMU is in alarm while the dominant mode of any of its signals in
+ * the band is damped less than the limit, and is large enough to
+ * matter (see min_amplitude). Alarms are flagged in STAT as a trigger,
+ * unless a trigger is already flagged, with a reason of their own.
+ */
+
+/* Samples per second of the modal analysis */
+#define MODAL_RATE 10
+
+/* Order of the models, enough for a few modes in noise */
+#define MODAL_ORDER 16
+
+/* STAT reason of an oscillation, the second user defined one */
+#define OSCILLATION_REASON (CTS_TRIGGER_REASON_USER + 1)
+
+/* Modes smaller than these are ignored, in the units of the signals */
+static const gfloat min_amplitude[PMU_OSCILLATION_N_SIGNALS] =
+{
+  [PMU_OSCILLATION_FREQUENCY] = 5,      /* 5 mHz */
+  [PMU_OSCILLATION_MAGNITUDE] = 2,      /* 0.2 % */
+  [PMU_OSCILLATION_ANGLE] = 10,         /* 0.1 degree */
+};
+
+struct _PmuOscillation
+{
+  guint data_rate;
+  guint modal_rate;
+  gfloat nominal_voltage;
+  gfloat freq_low;
+  gfloat freq_high;
+  gfloat damping;
+  gfloat window;
+
+  DspDecimator *decimator;      /* NULL if not decimating */
+  DspModal *modal;
+  guint capacity;               /* PMUs */
+  guint num_lanes;
+
+  gfloat *row;
+  guint64 index;                /* Frames, for the decimator */
+
+  /* The dominant mode of every lane, and if it is valid */
+  DspMode *modes;
+  gboolean *valid;
+  guint next_lane;
+
+  /* PMUs in alarm, as of the previous frame */
+  gboolean *alarm;
+};
+
+/**
+ * pmu_oscillation_new:
+ * @data_rate: The data rate, as in the configuration
+ * @nominal_voltage: The nominal RMS phase voltage, in Volts
+ * @freq_low: The lowest frequency of the modes watched, in Hz
+ * @freq_high: The highest frequency of the modes watched, in Hz
+ * @damping: The damping ratio below which a mode is in alarm
+ * @window: Seconds of data the modes are estimated from
+ *
+ * Returns: (transfer full) (nullable): A new #PmuOscillation, or %NULL
+ * if the data rate is too low for @freq_high. Free with
+ * pmu_oscillation_free().
+ */
+PmuOscillation *
+pmu_oscillation_new (gint   data_rate,
+                     gfloat nominal_voltage,
+                     gfloat freq_low,
+                     gfloat freq_high,
+                     gfloat damping,
+                     gfloat window)
+{
+  PmuOscillation *self;
+  guint modal_rate;
+
+  if (data_rate <= 0)
+    return NULL;
+
+  if (data_rate % MODAL_RATE == 0)
+    modal_rate = MODAL_RATE;
+  else if (data_rate < MODAL_RATE)
+    modal_rate = data_rate;
+  else if (data_rate % (MODAL_RATE / 2) == 0)
+    modal_rate = MODAL_RATE / 2;
+  else
+    modal_rate = data_rate;
+
+  /* The decimators pass up to 0.36 times their rate */
+  if (freq_high >= (modal_rate == (guint) data_rate ? 0.5 : 0.36) * modal_rate)
+    return NULL;
+
+  self = g_new0 (PmuOscillation, 1);
+  self->data_rate = data_rate;
+  self->modal_rate = modal_rate;
+  self->nominal_voltage = nominal_voltage;
+  self->freq_low = freq_low;
+  self->freq_high = freq_high;
+  self->damping = damping;
+  self->window = window;
+
+  return self;
+}
+
+static void
+clear_lanes (PmuOscillation *self)
+{
+  g_clear_pointer (&self->decimator, dsp_decimator_free);
+  g_clear_pointer (&self->modal, dsp_modal_free);
+  g_clear_pointer (&self->row, free);
+  g_clear_pointer (&self->modes, g_free);
+  g_clear_pointer (&self->valid, g_free);
+  g_clear_pointer (&self->alarm, g_free);
+  self->capacity = 0;
+  self->num_lanes = 0;
+}
+
+void
+pmu_oscillation_free (PmuOscillation *self)
+{
+  if (self == NULL)
+    return;
+
+  clear_lanes (self);
+  g_free (self);
+}
+
+/**
+ * pmu_oscillation_reserve:
+ * @self: A #PmuOscillation
+ * @num_pmu: The number of PMUs
+ *
+ * Allocate memory for frames of @num_pmu PMUs, so that
+ * pmu_oscillation_update_data() doesn't have to. Watching starts
+ * over if more PMUs are reserved for.
+ *
+ * Returns: %TRUE on success, %FALSE if out of memory
+ */
+gboolean
+pmu_oscillation_reserve (PmuOscillation *self,
+                         guint           num_pmu)
+{
+  guint num_lanes = num_pmu * PMU_OSCILLATION_N_SIGNALS;
+  gsize window = ceil (self->window * self->modal_rate);
+  gsize row_size;
+
+  if (num_pmu <= self->capacity)
+    return TRUE;
+
+  clear_lanes (self);
+
+  self->modal = dsp_modal_new (num_lanes, MODAL_ORDER, self->modal_rate, window);
+
+  if (self->modal_rate != self->data_rate)
+    {
+      guint rate = self->modal_rate;
+
+      self->decimator = dsp_decimator_new (num_lanes, self->data_rate, &rate, 1);
+    }
+
+  row_size = DSP_NUM_VECTORS (num_lanes) * DSP_LANES;
+  self->row = dsp_calloc_aligned (sizeof (gfloat) * row_size);
+
+  if (self->modal == NULL || self->row == NULL ||
+      (self->modal_rate != self->data_rate && self->decimator == NULL))
+    {
+      clear_lanes (self);
+      return FALSE;
+    }
+
+  self->modes = g_new0 (DspMode, num_lanes);
+  self->valid = g_new0 (gboolean, num_lanes);
+  self->alarm = g_new0 (gboolean, num_pmu);
+  self->capacity = num_pmu;
+  self->num_lanes = num_lanes;
+  self->next_lane = 0;
+
+  return TRUE;
+}
+
+static void
+read_signals (PmuOscillation *self,
+              CtsData        *data,
+              guint           num_pmu)
+{
+  CtsConf *config = cts_data_get_conf (data);
+  gfloat reference = 0;
+
+  for (guint i = 0; i < num_pmu; i++)
+    {
+      gfloat *row = self->row + i * PMU_OSCILLATION_N_SIGNALS;
+      guint nominal_freq = cts_conf_get_nominal_freq_of_pmu (config, i + 1);
+      gfloat freq = nominal_freq, rocof = 0;
+      gfloat real = 0, imaginary = 0;
+      guint positive = 7;
+      gfloat angle;
+
+      if (cts_conf_get_num_of_phasors_of_pmu (config, i + 1) < positive)
+        positive = 1;
+
+      cts_data_get_freq_of_pmu (data, i + 1, &freq, &rocof);
+      cts_data_get_phasor_of_pmu (data, i + 1, positive, &real, &imaginary);
+
+      angle = atan2f (imaginary, real);
+
+      if (i == 0)
+        reference = angle;
+
+      /* The difference, in (-pi, pi] */
+      angle = remainderf (angle - reference, 2 * G_PI);
+
+      row[PMU_OSCILLATION_FREQUENCY] = (freq - nominal_freq) * 1000;
+      row[PMU_OSCILLATION_MAGNITUDE] = hypotf (real, imaginary) / self->nominal_voltage * 1000;
+      row[PMU_OSCILLATION_ANGLE] = angle * 18000 / G_PI;
+    }
+}
+
+/* Find the modes of the next lane */
+static void
+update_next_lane (PmuOscillation *self)
+{
+  guint lane = self->next_lane;
+  DspMode mode;
+
+  self->valid[lane] = dsp_modal_get_modes (self->modal, lane,
+                                           self->freq_low, self->freq_high,
+                                           &mode, 1) == 1;
+  if (self->valid[lane])
+    self->modes[lane] = mode;
+
+  self->next_lane = (lane + 1) % self->num_lanes;
+}
+
+static gboolean
+is_alarm (PmuOscillation *self,
+          guint           pmu)
+{
+  for (guint s = 0; s < PMU_OSCILLATION_N_SIGNALS; s++)
+    {
+      guint lane = pmu * PMU_OSCILLATION_N_SIGNALS + s;
+
+      if (self->valid[lane] &&
+          self->modes[lane].damping < self->damping &&
+          self->modes[lane].amplitude >= min_amplitude[s])
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* The mode that raised the alarm of @pmu, for the trace */
+static const DspMode *
+get_alarm_mode (PmuOscillation *self,
+                guint           pmu)
+{
+  const DspMode *least = NULL;
+
+  for (guint s = 0; s < PMU_OSCILLATION_N_SIGNALS; s++)
+    {
+      guint lane = pmu * PMU_OSCILLATION_N_SIGNALS + s;
+
+      if (self->valid[lane] && (least == NULL ||
+                                self->modes[lane].damping < least->damping))
+        least = self->modes + lane;
+    }
+
+  return least;
+}
+
+/**
+ * pmu_oscillation_update_data:
+ * @self: A #PmuOscillation
+ * @data: The data frame
+ *
+ * Follow the signals of every PMU in @data, and flag the PMUs in
+ * alarm in their STAT. Should be called for every frame, in the order
+ * of time, after the other stages that set STAT.
+ *
+ * Returns: %TRUE if an alarm started in this frame.
+ */
+gboolean
+pmu_oscillation_update_data (PmuOscillation *self,
+                             CtsData        *data)
+{
+  guint num_pmu = cts_conf_get_num_of_pmu (cts_data_get_conf (data));
+  gboolean started = FALSE;
+
+  if (!pmu_oscillation_reserve (self, num_pmu))
+    return FALSE;
+
+  read_signals (self, data, num_pmu);
+
+  if (self->decimator == NULL)
+    dsp_modal_process (self->modal, self->row);
+  else if (dsp_decimator_process (self->decimator, self->row, self->index) & 1)
+    dsp_modal_process (self->modal, dsp_decimator_get_row (self->decimator, 0));
+
+  self->index++;
+
+  if (!dsp_modal_is_ready (self->modal))
+    return FALSE;
+
+  update_next_lane (self);
+
+  for (guint i = 0; i < num_pmu; i++)
+    {
+      gboolean alarm = is_alarm (self, i);
+
+      if (alarm)
+        {
+          guint16 stat = cts_data_get_stat_of_pmu (data, i + 1);
+
+          if (!(stat & (1 << STAT_TRIGGER_DETECTED_BIT)))
+            {
+              SET_BIT (stat, STAT_TRIGGER_DETECTED_BIT);
+              stat = (stat & ~CTS_TRIGGER_REASON_MASK) | OSCILLATION_REASON;
+              cts_data_set_stat_of_pmu (data, i + 1, stat);
+            }
+        }
+
+      if (alarm && !self->alarm[i])
+        {
+          const DspMode *mode = get_alarm_mode (self, i);
+
+          pmu_trace (PMU_TRACE_LEVEL_WARNING, PMU_TRACE_OSCILLATION,
+                     mode->frequency * 1000, MAX (mode->damping, 0) * 1000, i + 1);
+          started = TRUE;
+        }
+
+      self->alarm[i] = alarm;
+    }
+
+  return started;
+}
+
+/**
+ * pmu_oscillation_get_mode:
+ * @self: A #PmuOscillation
+ * @pmu_index: The index of the PMU, starting from 1
+ * @signal: The signal
+ * @mode: (out): Return location for the dominant mode
+ *
+ * Returns: %TRUE if @mode was set, %FALSE if no mode in the band was
+ * found (yet).
+ */
+gboolean
+pmu_oscillation_get_mode (PmuOscillation       *self,
+                          guint                 pmu_index,
+                          PmuOscillationSignal  signal,
+                          DspMode              *mode)
+{
+  guint lane = (pmu_index - 1) * PMU_OSCILLATION_N_SIGNALS + signal;
+
+  if (pmu_index == 0 || pmu_index > self->capacity || !self->valid[lane])
+    return FALSE;
+
+  *mode = self->modes[lane];
+  return TRUE;
+}
@@ -0,0 +1,57 @@
+/* pmu-oscillation.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "c37/c37.h"
+#include "dsp/dsp-modal.h"
+
+G_BEGIN_DECLS
+
+/* The signals of a PMU watched for oscillations */
+typedef enum
+{
+  PMU_OSCILLATION_FREQUENCY,    /* mHz from nominal */
+  PMU_OSCILLATION_MAGNITUDE,    /* V Pos, per mille of nominal */
+  PMU_OSCILLATION_ANGLE,        /* V Pos from that of the first PMU, centidegrees */
+  PMU_OSCILLATION_N_SIGNALS,
+} PmuOscillationSignal;
+
+typedef struct _PmuOscillation PmuOscillation;
+
+PmuOscillation *pmu_oscillation_new         (gint            data_rate,
+                                             gfloat          nominal_voltage,
+                                             gfloat          freq_low,
+                                             gfloat          freq_high,
+                                             gfloat          damping,
+                                             gfloat          window);
+void            pmu_oscillation_free        (PmuOscillation *self);
+gboolean        pmu_oscillation_reserve     (PmuOscillation *self,
+                                             guint           num_pmu);
+gboolean        pmu_oscillation_update_data (PmuOscillation *self,
+                                             CtsData        *data);
+gboolean        pmu_oscillation_get_mode    (PmuOscillation       *self,
+                                             guint                 pmu_index,
+                                             PmuOscillationSignal  signal,
+                                             DspMode              *mode);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PmuOscillation, pmu_oscillation_free)
+
+G_END_DECLS
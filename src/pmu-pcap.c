@@ -0,0 +1,1449 @@
+/* pmu-pcap.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+/*
+ * An analyzer of C37.118 traffic in a capture. It reads pcap and
+ * pcapng files (as written by tcpdump, dumpcap or wireshark) on its
+ * own, without libpcap, and for every stream that carries frames
+ * reports:
+ *
+ *   frames: of each type, and what was dropped for a wrong CHK or a
+ *   size that doesn't match the configuration
+ *   gaps: data frames missing from the sequence the data rate makes,
+ *   duplicates, and frames arriving after later ones. A gap later
+ *   filled by a late frame is still counted as a gap.
+ *   timestamp jitter: how far timestamps are from the reporting
+ *   instant nearest to them
+ *   latency: when a data frame was captured less its timestamp, only
+ *   as good as the clocks of the PMU and the capturing host
+ *
+ * A stream is a direction of a TCP connection, or the datagrams from
+ * one address and port to another. TCP is reassembled: segments are
+ * put back in order, retransmissions dropped, and a hole the capture
+ * missed is skipped once MAX_PENDING segments have piled up past it.
+ * IP fragments are not reassembled, and are counted as ignored.
+ *
+ * The file is mapped and read through once in the main thread, which
+ * only decodes packet headers. Payloads are handed by reference, in
+ * batches, to worker threads, each stream always to the same one,
+ * which reassemble, check and parse the frames.
+ *
+ * The data rate and time base come from a CFG-2 or CFG-3 in the
+ * stream. If the capture started after it, from --rate (or else the
+ * least interval between the first INFER_FRAMES timestamps, which
+ * are not checked for gaps) and --time-base.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+
+#include <glib.h>
+
+#include "c37/c37.h"
+#include "pmu-histogram.h"
+
+#define NSEC_PER_SEC      G_GINT64_CONSTANT (1000000000)
+#define BATCH_SIZE        4096
+#define BATCHES_PER_WORKER 4
+#define MAX_PENDING       256
+#define INFER_FRAMES      32
+#define MAX_JUMP_SECONDS  3600
+
+#define PCAP_MAGIC        0xA1B2C3D4
+#define PCAP_MAGIC_NSEC   0xA1B23C4D
+#define PCAPNG_SHB        0x0A0D0D0A
+#define PCAPNG_BYTE_ORDER 0x1A2B3C4D
+#define PCAPNG_IDB        1
+#define PCAPNG_PB         2
+#define PCAPNG_SPB        3
+#define PCAPNG_EPB        6
+
+#define LINKTYPE_NULL     0
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW      101
+#define LINKTYPE_LOOP     108
+#define LINKTYPE_SLL      113
+#define LINKTYPE_IPV4     228
+#define LINKTYPE_IPV6     229
+#define LINKTYPE_SLL2     276
+
+#define TCP_SYN           0x02
+
+static gint num_threads = 0;
+static gint port = 0;
+static gint rate = 0;
+static gint time_base = 1000000;
+static gboolean list_gaps = FALSE;
+
+static GOptionEntry entries[] = {
+  { "threads", 't', 0, G_OPTION_ARG_INT, &num_threads,
+    "Worker threads (default: one per processor)", "N" },
+  { "port", 'p', 0, G_OPTION_ARG_INT, &port,
+    "Only streams from or to PORT (default: every stream)", "PORT" },
+  { "rate", 'r', 0, G_OPTION_ARG_INT, &rate,
+    "Data rate of streams without a configuration (default: inferred)", "RATE" },
+  { "time-base", 'b', 0, G_OPTION_ARG_INT, &time_base,
+    "Time base of streams without a configuration (default: 1000000)", "TIME_BASE" },
+  { "gaps", 'g', 0, G_OPTION_ARG_NONE, &list_gaps,
+    "List every gap", NULL },
+  { NULL }
+};
+
+static const gchar *frame_names[] = {
+  "data", "header", "CFG-1", "CFG-2", "command", "CFG-3",
+};
+
+typedef struct
+{
+  guint8  family;
+  guint8  protocol;
+  guint16 src_port;
+  guint16 dst_port;
+  guint8  src[16];
+  guint8  dst[16];
+} StreamKey;
+
+typedef struct
+{
+  gint64  time;         /* Of the first frame missing, in ns */
+  guint64 count;
+} Gap;
+
+typedef struct
+{
+  guint32       seq;
+  guint32       length;
+  const guint8 *payload;
+  gint64        time;
+} Segment;
+
+typedef struct
+{
+  StreamKey     key;
+  guint         worker;
+
+  /* Everything below is only touched by the worker */
+  CtsClient    *client;
+  gint64        time;           /* Capture time of the bytes being fed */
+  gint64        first_time;
+  guint64       packets;
+  guint64       bytes;
+
+  gboolean      synced;
+  guint32       next_seq;
+  GArray       *pending;        /* Segments past a hole, by seq */
+  guint64       retransmitted;
+  guint64       holes;
+  guint64       missing_bytes;
+
+  guint16       id_code;
+  guint64       frames[G_N_ELEMENTS (frame_names)];
+  guint64       stat_errors;
+
+  gint          rate;           /* As a CFG has it, 0 until known */
+  gboolean      rate_inferred;
+  guint         num_inferring;
+  gint64        least_interval;
+  gint64        last_timestamp;
+
+  gboolean      have_slot;
+  gint64        first_slot;     /* Since the sequence was last lost */
+  gint64        last_slot;
+  guint64       seen;           /* Bit n: slot last_slot - n was seen */
+  guint64       missing;
+  guint64       late;
+  guint64       duplicates;
+  guint64       time_jumps;
+  GArray       *gaps;
+  Gap           largest_gap;
+
+  PmuHistogram *jitter;
+  PmuHistogram *latency;
+  guint64       early;          /* Captured before their timestamp */
+} Stream;
+
+typedef struct
+{
+  Stream       *stream;
+  const guint8 *payload;
+  guint32       length;
+  guint32       seq;
+  gint64        time;
+  guint8        flags;
+} Packet;
+
+typedef struct
+{
+  guint  length;
+  Packet packets[BATCH_SIZE];
+} Batch;
+
+typedef struct
+{
+  GThread     *thread;
+  GAsyncQueue *queue;
+  GAsyncQueue *free_batches;
+  Batch       *batch;           /* Being filled by the main thread */
+  GPtrArray   *streams;
+} Worker;
+
+typedef struct
+{
+  guint16 linktype;
+  guint64 units;                /* Of timestamps, per second */
+  gint64  offset;
+} Interface;
+
+typedef struct
+{
+  gboolean     swapped;
+  gint64       last_time;
+  guint64      packets;
+  guint64      ignored;
+  gboolean     truncated;
+
+  GHashTable  *streams;
+  GPtrArray   *stream_list;
+
+  Worker      *workers;
+  guint        num_workers;
+  guint        next_worker;
+  GAsyncQueue *free_batches;
+} Analyzer;
+
+static guint16
+read16 (const guint8 *data,
+        gboolean      swapped)
+{
+  guint16 value;
+
+  memcpy (&value, data, sizeof value);
+
+  return swapped ? GUINT16_SWAP_LE_BE (value) : value;
+}
+
+static guint32
+read32 (const guint8 *data,
+        gboolean      swapped)
+{
+  guint32 value;
+
+  memcpy (&value, data, sizeof value);
+
+  return swapped ? GUINT32_SWAP_LE_BE (value) : value;
+}
+
+static guint64
+read64 (const guint8 *data,
+        gboolean      swapped)
+{
+  guint64 value;
+
+  memcpy (&value, data, sizeof value);
+
+  return swapped ? GUINT64_SWAP_LE_BE (value) : value;
+}
+
+static guint16
+get_be16 (const guint8 *data)
+{
+  return (guint16) data[0] << 8 | data[1];
+}
+
+static guint32
+get_be32 (const guint8 *data)
+{
+  return (guint32) data[0] << 24 | (guint32) data[1] << 16 |
+         (guint32) data[2] << 8 | data[3];
+}
+
+static guint
+stream_key_hash (gconstpointer key)
+{
+  const guint8 *bytes = key;
+  guint32 hash = 2166136261u;
+
+  for (gsize i = 0; i < sizeof (StreamKey); i++)
+    hash = (hash ^ bytes[i]) * 16777619u;
+
+  return hash;
+}
+
+static gboolean
+stream_key_equal (gconstpointer a,
+                  gconstpointer b)
+{
+  return memcmp (a, b, sizeof (StreamKey)) == 0;
+}
+
+static void
+format_time (gint64  time,
+             gchar  *buffer,
+             gsize   size)
+{
+  time_t seconds = time / NSEC_PER_SEC;
+  struct tm tm;
+  gsize length;
+
+  gmtime_r (&seconds, &tm);
+  length = strftime (buffer, size, "%Y-%m-%d %H:%M:%S", &tm);
+  g_snprintf (buffer + length, size - length, ".%06d",
+              (gint) (time % NSEC_PER_SEC / 1000));
+}
+
+static gchar *
+format_endpoint (const StreamKey *key,
+                 const guint8    *address,
+                 guint16          address_port)
+{
+  gchar text[INET6_ADDRSTRLEN];
+
+  inet_ntop (key->family == 4 ? AF_INET : AF_INET6, address, text, sizeof text);
+
+  if (key->family == 4)
+    return g_strdup_printf ("%s:%u", text, address_port);
+
+  return g_strdup_printf ("[%s]:%u", text, address_port);
+}
+
+/* Returns: The frames per second of @data_rate */
+static gdouble
+get_frames_per_second (gint data_rate)
+{
+  return data_rate > 0 ? data_rate : -1.0 / data_rate;
+}
+
+/*
+ * The reporting instant nearest to @timestamp, counted from the
+ * epoch, and in @offset how far @timestamp is from it.
+ */
+static gint64
+get_slot (gint    data_rate,
+          gint64  timestamp,
+          gint64 *offset)
+{
+  gint64 soc = timestamp / NSEC_PER_SEC;
+  gint64 nanoseconds = timestamp % NSEC_PER_SEC;
+
+  if (data_rate > 0)
+    {
+      gint64 index = (nanoseconds * data_rate + NSEC_PER_SEC / 2) / NSEC_PER_SEC;
+
+      *offset = nanoseconds - (index * NSEC_PER_SEC + data_rate / 2) / data_rate;
+
+      return soc * data_rate + index;
+    }
+  else
+    {
+      gint64 period = -data_rate * NSEC_PER_SEC;
+      gint64 slot = (timestamp + period / 2) / period;
+
+      *offset = timestamp - slot * period;
+
+      return slot;
+    }
+}
+
+static gint64
+get_slot_time (gint   data_rate,
+               gint64 slot)
+{
+  if (data_rate > 0)
+    return slot / data_rate * NSEC_PER_SEC +
+           (slot % data_rate * NSEC_PER_SEC + data_rate / 2) / data_rate;
+
+  return slot * -data_rate * NSEC_PER_SEC;
+}
+
+static void
+stream_infer_rate (Stream *stream,
+                   gint64  timestamp)
+{
+  gint64 interval = timestamp - stream->last_timestamp;
+
+  if (stream->num_inferring++ > 0 && interval > 0 &&
+      (stream->least_interval == 0 || interval < stream->least_interval))
+    stream->least_interval = interval;
+
+  stream->last_timestamp = timestamp;
+
+  if (stream->num_inferring < INFER_FRAMES || stream->least_interval == 0)
+    return;
+
+  if (stream->least_interval < NSEC_PER_SEC)
+    stream->rate = MAX (1, llround ((gdouble) NSEC_PER_SEC / stream->least_interval));
+  else
+    stream->rate = -MIN (G_MAXINT16, llround ((gdouble) stream->least_interval / NSEC_PER_SEC));
+
+  stream->rate_inferred = TRUE;
+}
+
+static void
+stream_add_gap (Stream *stream,
+                gint64  slot,
+                guint64 count)
+{
+  Gap gap = { get_slot_time (stream->rate, slot), count };
+
+  stream->missing += count;
+  g_array_append_val (stream->gaps, gap);
+
+  if (count > stream->largest_gap.count)
+    stream->largest_gap = gap;
+}
+
+static void
+stream_handle_data (Stream     *stream,
+                    const byte *frame)
+{
+  const CtsDataLayout *layout = cts_client_get_layout (stream->client);
+  guint32 base = layout ? cts_data_layout_get_time_base (layout) : (guint32) time_base;
+  guint32 soc = get_be32 (frame + 6);
+  guint32 frac_of_second = get_be32 (frame + 10) & 0x00FFFFFF;
+  gint64 timestamp, offset, slot, delta, max_jump;
+
+  if (base == 0)
+    return;
+
+  timestamp = soc * NSEC_PER_SEC + (gint64) frac_of_second * NSEC_PER_SEC / base;
+
+  if (stream->time < timestamp)
+    stream->early++;
+
+  pmu_histogram_add (stream->latency, stream->time - timestamp);
+
+  if (stream->rate == 0)
+    {
+      stream_infer_rate (stream, timestamp);
+      return;
+    }
+
+  slot = get_slot (stream->rate, timestamp, &offset);
+  pmu_histogram_add (stream->jitter, ABS (offset));
+
+  if (!stream->have_slot)
+    {
+      stream->have_slot = TRUE;
+      stream->first_slot = slot;
+      stream->last_slot = slot;
+      stream->seen = 1;
+      return;
+    }
+
+  delta = slot - stream->last_slot;
+  max_jump = MAX_JUMP_SECONDS * get_frames_per_second (stream->rate);
+
+  if (delta > max_jump || -delta > max_jump)
+    {
+      /* The PMU clock, not frames, went missing */
+      stream->time_jumps++;
+      stream->first_slot = slot;
+      stream->last_slot = slot;
+      stream->seen = 1;
+    }
+  else if (delta > 0)
+    {
+      if (delta > 1)
+        stream_add_gap (stream, stream->last_slot + 1, delta - 1);
+
+      stream->seen = delta < 64 ? stream->seen << delta | 1 : 1;
+      stream->last_slot = slot;
+    }
+  else if (delta > -64 && (stream->seen & G_GUINT64_CONSTANT (1) << -delta))
+    {
+      stream->duplicates++;
+    }
+  else
+    {
+      if (delta > -64)
+        stream->seen |= G_GUINT64_CONSTANT (1) << -delta;
+
+      if (delta > -64 && slot > stream->first_slot)
+        stream->missing--;
+
+      stream->late++;
+    }
+}
+
+static void
+on_frame (CtsClient  *client,
+          const byte *frame,
+          uint16_t    size,
+          void       *user_data)
+{
+  Stream *stream = user_data;
+  guint type = (frame[1] & 0x70) >> 4;
+
+  stream->frames[type]++;
+  stream->id_code = cts_common_get_size (frame, 4);
+
+  if (type == (CTS_TYPE_DATA & 0x70) >> 4)
+    stream_handle_data (stream, frame);
+}
+
+static void
+on_config (CtsClient *client,
+           CtsConf   *config,
+           byte       type,
+           void      *user_data)
+{
+  Stream *stream = user_data;
+  gint data_rate;
+
+  if (type == CTS_TYPE_CONFIG1)
+    return;
+
+  data_rate = cts_conf_get_data_rate (config);
+
+  if (data_rate != stream->rate || stream->rate_inferred)
+    {
+      stream->rate = data_rate;
+      stream->rate_inferred = FALSE;
+      stream->have_slot = FALSE;
+    }
+}
+
+static void
+on_data (CtsClient         *client,
+         const CtsDataView *view,
+         void              *user_data)
+{
+  Stream *stream = user_data;
+  guint16 num_pmu = cts_data_layout_get_num_of_pmu (view->layout);
+
+  /* Data error, or PMU sync lost */
+  for (guint16 i = 1; i <= num_pmu; i++)
+    if (cts_data_view_get_stat_of_pmu (view, i) & 0xE000)
+      {
+        stream->stat_errors++;
+        break;
+      }
+}
+
+static const CtsClientHandlers handlers = {
+  .frame = on_frame,
+  .config = on_config,
+  .data = on_data,
+};
+
+static Stream *
+stream_new (const StreamKey *key,
+            guint            worker)
+{
+  Stream *stream = g_new0 (Stream, 1);
+
+  stream->key = *key;
+  stream->worker = worker;
+
+  return stream;
+}
+
+static void
+stream_free (Stream *stream)
+{
+  if (stream->client)
+    {
+      cts_client_free (stream->client);
+      g_array_unref (stream->pending);
+      g_array_unref (stream->gaps);
+      pmu_histogram_free (stream->jitter);
+      pmu_histogram_free (stream->latency);
+    }
+
+  g_free (stream);
+}
+
+/* Done by the worker, at the first packet of @stream */
+static void
+stream_start (Stream *stream,
+              gint64  time)
+{
+  stream->client = cts_client_new (0);
+  cts_client_set_handlers (stream->client, &handlers, stream);
+  stream->pending = g_array_new (FALSE, FALSE, sizeof (Segment));
+  stream->gaps = g_array_new (FALSE, FALSE, sizeof (Gap));
+  stream->jitter = pmu_histogram_new ();
+  stream->latency = pmu_histogram_new ();
+  stream->rate = rate;
+  stream->first_time = time;
+}
+
+/*
+ * Feed what can be of the segments pending. Past a hole the capture
+ * missed, each is taken as received when captured; when a segment
+ * fills a hole, they are all received with it.
+ */
+static void
+stream_drain_pending (Stream   *stream,
+                      gboolean  skipped)
+{
+  while (stream->pending->len > 0)
+    {
+      Segment *segment = &g_array_index (stream->pending, Segment, 0);
+      gint32 offset = segment->seq - stream->next_seq;
+      const guint8 *payload = segment->payload;
+      guint32 length = segment->length;
+      gint64 segment_time = segment->time;
+
+      if (offset > 0)
+        break;
+
+      g_array_remove_index (stream->pending, 0);
+
+      if (offset + (gint64) length <= 0)
+        {
+          stream->retransmitted++;
+          continue;
+        }
+
+      if (skipped)
+        stream->time = segment_time;
+
+      stream->next_seq += length + offset;
+      cts_client_feed_stream (stream->client, payload - offset, length + offset);
+    }
+}
+
+/* Give up on the bytes before the first segment pending */
+static void
+stream_skip_hole (Stream *stream)
+{
+  Segment *segment = &g_array_index (stream->pending, Segment, 0);
+
+  stream->holes++;
+  stream->missing_bytes += (guint32) (segment->seq - stream->next_seq);
+  stream->next_seq = segment->seq;
+
+  /* Forget the partial frame, rather than have it fail the CHK */
+  cts_client_close (stream->client);
+  stream_drain_pending (stream, TRUE);
+}
+
+static void
+stream_add_pending (Stream       *stream,
+                    const Packet *packet)
+{
+  Segment segment = { packet->seq, packet->length, packet->payload, packet->time };
+  guint index = stream->pending->len;
+
+  while (index > 0 &&
+         (gint32) (g_array_index (stream->pending, Segment, index - 1).seq - packet->seq) > 0)
+    index--;
+
+  g_array_insert_val (stream->pending, index, segment);
+
+  if (stream->pending->len > MAX_PENDING)
+    stream_skip_hole (stream);
+}
+
+static void
+stream_handle_segment (Stream       *stream,
+                       const Packet *packet)
+{
+  guint32 seq = packet->seq;
+  gint32 offset;
+
+  if (packet->flags & TCP_SYN)
+    {
+      /* A new connection between the same ports */
+      while (stream->pending->len > 0)
+        stream_skip_hole (stream);
+
+      cts_client_close (stream->client);
+      stream->synced = TRUE;
+      stream->next_seq = ++seq;
+    }
+
+  if (packet->length == 0)
+    return;
+
+  if (!stream->synced)
+    {
+      stream->synced = TRUE;
+      stream->next_seq = seq;
+    }
+
+  offset = seq - stream->next_seq;
+
+  if (offset > 0)
+    {
+      stream_add_pending (stream, packet);
+      return;
+    }
+
+  if (offset + (gint64) packet->length <= 0)
+    {
+      stream->retransmitted++;
+      return;
+    }
+
+  stream->next_seq += packet->length + offset;
+  cts_client_feed_stream (stream->client, packet->payload - offset, packet->length + offset);
+  stream_drain_pending (stream, FALSE);
+}
+
+static void
+stream_handle_packet (Stream       *stream,
+                      const Packet *packet,
+                      Worker       *worker)
+{
+  if (stream->packets++ == 0)
+    {
+      stream_start (stream, packet->time);
+      g_ptr_array_add (worker->streams, stream);
+    }
+
+  stream->bytes += packet->length;
+  stream->time = packet->time;
+
+  if (stream->key.protocol == IPPROTO_UDP)
+    cts_client_feed (stream->client, packet->payload, packet->length);
+  else
+    stream_handle_segment (stream, packet);
+}
+
+static gpointer
+worker_run (gpointer data)
+{
+  Worker *worker = data;
+  Batch *batch;
+
+  while ((batch = g_async_queue_pop (worker->queue))->length > 0)
+    {
+      for (guint i = 0; i < batch->length; i++)
+        stream_handle_packet (batch->packets[i].stream, &batch->packets[i], worker);
+
+      batch->length = 0;
+      g_async_queue_push (worker->free_batches, batch);
+    }
+
+  g_async_queue_push (worker->free_batches, batch);
+
+  /* Whatever is left past a hole at the end of the capture */
+  for (guint i = 0; i < worker->streams->len; i++)
+    {
+      Stream *stream = g_ptr_array_index (worker->streams, i);
+
+      while (stream->pending->len > 0)
+        stream_skip_hole (stream);
+    }
+
+  return NULL;
+}
+
+static void
+dispatch (Analyzer        *self,
+          const StreamKey *key,
+          const guint8    *payload,
+          guint32          length,
+          guint32          seq,
+          guint8           flags,
+          gint64           time)
+{
+  Stream *stream = g_hash_table_lookup (self->streams, key);
+  Worker *worker;
+  Packet *packet;
+
+  if (stream == NULL)
+    {
+      stream = stream_new (key, self->next_worker++ % self->num_workers);
+      g_hash_table_insert (self->streams, &stream->key, stream);
+      g_ptr_array_add (self->stream_list, stream);
+    }
+
+  worker = &self->workers[stream->worker];
+
+  if (worker->batch == NULL)
+    worker->batch = g_async_queue_pop (self->free_batches);
+
+  packet = &worker->batch->packets[worker->batch->length++];
+  packet->stream = stream;
+  packet->payload = payload;
+  packet->length = length;
+  packet->seq = seq;
+  packet->flags = flags;
+  packet->time = time;
+
+  if (worker->batch->length == BATCH_SIZE)
+    {
+      g_async_queue_push (worker->queue, worker->batch);
+      worker->batch = NULL;
+    }
+}
+
+static void
+handle_transport (Analyzer     *self,
+                  StreamKey    *key,
+                  const guint8 *data,
+                  gsize         length,
+                  gint64        time)
+{
+  guint32 seq = 0;
+  guint8 flags = 0;
+  gsize header_length;
+
+  if (key->protocol == IPPROTO_TCP && length >= 20)
+    {
+      header_length = MAX (20, (data[12] >> 4) * 4);
+      seq = get_be32 (data + 4);
+      flags = data[13];
+    }
+  else if (key->protocol == IPPROTO_UDP && length >= 8)
+    {
+      guint16 udp_length = get_be16 (data + 4);
+
+      header_length = 8;
+
+      if (udp_length >= 8 && udp_length < length)
+        length = udp_length;
+    }
+  else
+    {
+      self->ignored++;
+      return;
+    }
+
+  key->src_port = get_be16 (data);
+  key->dst_port = get_be16 (data + 2);
+
+  if (header_length > length ||
+      (port && key->src_port != port && key->dst_port != port))
+    {
+      self->ignored++;
+      return;
+    }
+
+  if (length == header_length && !(flags & TCP_SYN))
+    return;
+
+  dispatch (self, key, data + header_length, length - header_length, seq, flags, time);
+}
+
+static void
+handle_ipv4 (Analyzer     *self,
+             const guint8 *data,
+             gsize         length,
+             gint64        time)
+{
+  StreamKey key = { 0 };
+  gsize header_length, total_length;
+
+  if (length < 20 || data[0] >> 4 != 4)
+    {
+      self->ignored++;
+      return;
+    }
+
+  header_length = (data[0] & 0x0F) * 4;
+  total_length = get_be16 (data + 2);
+
+  /* Fragments, with more to follow or an offset */
+  if (header_length < 20 || total_length < header_length || header_length > length ||
+      (get_be16 (data + 6) & 0x3FFF))
+    {
+      self->ignored++;
+      return;
+    }
+
+  /* Less than the packet is Ethernet padding, more a short snapshot */
+  length = MIN (length, total_length);
+
+  key.family = 4;
+  key.protocol = data[9];
+  memcpy (key.src, data + 12, 4);
+  memcpy (key.dst, data + 16, 4);
+
+  handle_transport (self, &key, data + header_length, length - header_length, time);
+}
+
+static void
+handle_ipv6 (Analyzer     *self,
+             const guint8 *data,
+             gsize         length,
+             gint64        time)
+{
+  StreamKey key = { 0 };
+  gsize payload_length;
+  guint8 next_header;
+
+  if (length < 40 || data[0] >> 4 != 6)
+    {
+      self->ignored++;
+      return;
+    }
+
+  payload_length = get_be16 (data + 4);
+  next_header = data[6];
+  key.family = 6;
+  memcpy (key.src, data + 8, 16);
+  memcpy (key.dst, data + 24, 16);
+
+  data += 40;
+  length = MIN (length - 40, payload_length);
+
+  /* Hop-by-hop, routing and destination options */
+  while (next_header == 0 || next_header == 43 || next_header == 60)
+    {
+      gsize header_length;
+
+      if (length < 8 || (header_length = (data[1] + 1) * 8) > length)
+        {
+          self->ignored++;
+          return;
+        }
+
+      next_header = data[0];
+      data += header_length;
+      length -= header_length;
+    }
+
+  key.protocol = next_header;
+  handle_transport (self, &key, data, length, time);
+}
+
+static void
+handle_packet (Analyzer     *self,
+               guint         linktype,
+               gint64        time,
+               const guint8 *data,
+               gsize         length)
+{
+  gsize header_length = 0;
+  guint16 ethertype = 0;
+
+  self->packets++;
+  self->last_time = time;
+
+  switch (linktype)
+    {
+    case LINKTYPE_ETHERNET:
+      header_length = 14;
+
+      if (length < header_length)
+        break;
+
+      ethertype = get_be16 (data + 12);
+
+      /* 802.1Q and 802.1ad tags */
+      while ((ethertype == 0x8100 || ethertype == 0x88A8 || ethertype == 0x9100) &&
+             length >= header_length + 4)
+        {
+          ethertype = get_be16 (data + header_length + 2);
+          header_length += 4;
+        }
+      break;
+
+    case LINKTYPE_SLL:
+      header_length = 16;
+
+      if (length >= header_length)
+        ethertype = get_be16 (data + 14);
+      break;
+
+    case LINKTYPE_SLL2:
+      header_length = 20;
+
+      if (length >= header_length)
+        ethertype = get_be16 (data);
+      break;
+
+    /* The IP version tells the rest */
+    case LINKTYPE_NULL:
+    case LINKTYPE_LOOP:
+      header_length = 4;
+      /* fallthrough */
+    case LINKTYPE_RAW:
+    case LINKTYPE_IPV4:
+    case LINKTYPE_IPV6:
+      if (length > header_length)
+        ethertype = data[header_length] >> 4 == 4 ? 0x0800 : 0x86DD;
+      break;
+
+    default:
+      break;
+    }
+
+  if (ethertype == 0x0800)
+    handle_ipv4 (self, data + header_length, length - header_length, time);
+  else if (ethertype == 0x86DD)
+    handle_ipv6 (self, data + header_length, length - header_length, time);
+  else
+    self->ignored++;
+}
+
+static gboolean
+read_pcap (Analyzer      *self,
+           const guint8  *data,
+           gsize          size,
+           GError       **error)
+{
+  guint32 magic = read32 (data, FALSE);
+  gboolean nanoseconds;
+  guint linktype;
+  gsize offset;
+
+  self->swapped = magic == GUINT32_SWAP_LE_BE (PCAP_MAGIC) ||
+                  magic == GUINT32_SWAP_LE_BE (PCAP_MAGIC_NSEC);
+  nanoseconds = magic == PCAP_MAGIC_NSEC || magic == GUINT32_SWAP_LE_BE (PCAP_MAGIC_NSEC);
+
+  if (size < 24)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Truncated pcap header");
+      return FALSE;
+    }
+
+  /* The upper bits may tell of frame check sequences */
+  linktype = read32 (data + 20, self->swapped) & 0xFFFF;
+
+  for (offset = 24; size - offset >= 16;)
+    {
+      const guint8 *record = data + offset;
+      guint32 captured = read32 (record + 8, self->swapped);
+      gint64 time;
+
+      if (captured > size - offset - 16)
+        break;
+
+      time = read32 (record, self->swapped) * NSEC_PER_SEC;
+      time += read32 (record + 4, self->swapped) * (nanoseconds ? 1 : 1000);
+
+      handle_packet (self, linktype, time, record + 16, captured);
+      offset += 16 + captured;
+    }
+
+  self->truncated = offset != size;
+
+  return TRUE;
+}
+
+static gint64
+get_interface_time (const Interface *interface,
+                    guint64          timestamp)
+{
+  guint64 seconds = timestamp / interface->units;
+  guint64 fraction = timestamp % interface->units;
+
+  return (seconds + interface->offset) * NSEC_PER_SEC +
+         (gint64) ((gdouble) fraction * NSEC_PER_SEC / interface->units);
+}
+
+static void
+read_interface (Analyzer     *self,
+                const guint8 *body,
+                gsize         length,
+                GArray       *interfaces)
+{
+  Interface interface = { read16 (body, self->swapped), 1000000, 0 };
+  gsize offset = 8;
+
+  while (length - offset >= 4)
+    {
+      guint16 code = read16 (body + offset, self->swapped);
+      guint16 option_length = read16 (body + offset + 2, self->swapped);
+      const guint8 *value = body + offset + 4;
+
+      if (code == 0 || option_length > length - offset - 4)
+        break;
+
+      /* if_tsresol: a negative power of 10, or of 2 if the MSB is set */
+      if (code == 9 && option_length >= 1 &&
+          (value[0] & 0x7F) < (value[0] & 0x80 ? 64 : 20))
+        {
+          interface.units = 1;
+
+          for (guint i = 0; i < (value[0] & 0x7F); i++)
+            interface.units *= value[0] & 0x80 ? 2 : 10;
+        }
+      /* if_tsoffset, in seconds */
+      else if (code == 14 && option_length == 8)
+        {
+          interface.offset = read64 (value, self->swapped);
+        }
+
+      offset += 4 + ((option_length + 3) & ~3);
+    }
+
+  g_array_append_val (interfaces, interface);
+}
+
+static gboolean
+read_pcapng (Analyzer      *self,
+             const guint8  *data,
+             gsize          size,
+             GError       **error)
+{
+  g_autoptr(GArray) interfaces = g_array_new (FALSE, FALSE, sizeof (Interface));
+  gsize offset = 0;
+
+  while (size - offset >= 12)
+    {
+      const guint8 *block = data + offset;
+      const guint8 *body = block + 8;
+      const Interface *interface = NULL;
+      guint32 type, length, captured = 0;
+      gsize body_length;
+      gint64 time = self->last_time;
+
+      if (read32 (block, FALSE) == PCAPNG_SHB)
+        {
+          if (size - offset < 12 + 16)
+            break;
+
+          self->swapped = read32 (body, FALSE) != PCAPNG_BYTE_ORDER;
+          g_array_set_size (interfaces, 0);
+        }
+
+      type = read32 (block, self->swapped);
+      length = read32 (block + 4, self->swapped);
+
+      if (length < 12 || length % 4 || length > size - offset)
+        break;
+
+      body_length = length - 12;
+
+      switch (type)
+        {
+        case PCAPNG_IDB:
+          if (body_length >= 8)
+            read_interface (self, body, body_length, interfaces);
+          break;
+
+        case PCAPNG_EPB:
+          if (body_length < 20 || read32 (body, self->swapped) >= interfaces->len)
+            break;
+
+          interface = &g_array_index (interfaces, Interface, read32 (body, self->swapped));
+          time = get_interface_time (interface,
+                                     (guint64) read32 (body + 4, self->swapped) << 32 |
+                                     read32 (body + 8, self->swapped));
+          captured = MIN (read32 (body + 12, self->swapped), body_length - 20);
+          body += 20;
+          break;
+
+        /* Obsolete, but still around */
+        case PCAPNG_PB:
+          if (body_length < 20 || read16 (body, self->swapped) >= interfaces->len)
+            break;
+
+          interface = &g_array_index (interfaces, Interface, read16 (body, self->swapped));
+          time = get_interface_time (interface,
+                                     (guint64) read32 (body + 4, self->swapped) << 32 |
+                                     read32 (body + 8, self->swapped));
+          captured = MIN (read32 (body + 12, self->swapped), body_length - 20);
+          body += 20;
+          break;
+
+        /* No timestamp: taken as that of the packet before */
+        case PCAPNG_SPB:
+          if (body_length < 4 || interfaces->len == 0)
+            break;
+
+          interface = &g_array_index (interfaces, Interface, 0);
+          captured = MIN (read32 (body, self->swapped), body_length - 4);
+          body += 4;
+          break;
+
+        default:
+          break;
+        }
+
+      if (interface)
+        handle_packet (self, interface->linktype, time, body, captured);
+
+      offset += length;
+    }
+
+  self->truncated = offset != size;
+
+  return TRUE;
+}
+
+static gboolean
+read_capture (Analyzer      *self,
+              const guint8  *data,
+              gsize          size,
+              GError       **error)
+{
+  guint32 magic = size >= 4 ? read32 (data, FALSE) : 0;
+
+  if (magic == PCAPNG_SHB)
+    return read_pcapng (self, data, size, error);
+
+  if (magic == PCAP_MAGIC || magic == PCAP_MAGIC_NSEC ||
+      magic == GUINT32_SWAP_LE_BE (PCAP_MAGIC) ||
+      magic == GUINT32_SWAP_LE_BE (PCAP_MAGIC_NSEC))
+    return read_pcap (self, data, size, error);
+
+  g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Neither a pcap nor a pcapng file");
+
+  return FALSE;
+}
+
+static void
+print_stream (Stream *stream)
+{
+  CtsClientStats stats;
+  g_autofree gchar *src = format_endpoint (&stream->key, stream->key.src, stream->key.src_port);
+  g_autofree gchar *dst = format_endpoint (&stream->key, stream->key.dst, stream->key.dst_port);
+  g_autoptr(GString) frames = g_string_new (NULL);
+  gchar start[64];
+
+  cts_client_get_stats (stream->client, &stats);
+  format_time (stream->first_time, start, sizeof start);
+
+  for (guint i = 0; i < G_N_ELEMENTS (frame_names); i++)
+    if (stream->frames[i])
+      g_string_append_printf (frames, "%s%" G_GUINT64_FORMAT " %s",
+                              frames->len ? ", " : "", stream->frames[i], frame_names[i]);
+
+  g_print ("%s > %s %s, ID %u\n", src, dst,
+           stream->key.protocol == IPPROTO_TCP ? "TCP" : "UDP", stream->id_code);
+  g_print ("  %" G_GUINT64_FORMAT " packets, %.1f MB from %s for %.1f s\n",
+           stream->packets, stream->bytes / 1e6, start,
+           (stream->time - stream->first_time) / 1e9);
+  g_print ("  Frames: %s\n", frames->len ? frames->str : "none");
+  g_print ("  Dropped: %" G_GUINT64_FORMAT " bad CHK, %" G_GUINT64_FORMAT " bytes skipped\n",
+           stats.bad_crc, stats.skipped_bytes);
+
+  if (stats.unknown_data)
+    g_print ("  No configuration for %" G_GUINT64_FORMAT " data frames: time base %d taken, "
+             "STAT not checked\n", stats.unknown_data, time_base);
+
+  if (stream->key.protocol == IPPROTO_TCP)
+    g_print ("  TCP: %" G_GUINT64_FORMAT " retransmitted, %" G_GUINT64_FORMAT
+             " holes (%" G_GUINT64_FORMAT " bytes not captured)\n",
+             stream->retransmitted, stream->holes, stream->missing_bytes);
+
+  if (stream->frames[0] == 0)
+    return;
+
+  if (stream->rate == 0)
+    {
+      g_print ("  Data: too few frames to tell the rate, try --rate\n");
+    }
+  else
+    {
+      g_print ("  Data at %g frames/s%s: %" G_GUINT64_FORMAT " missing in %u gaps, %"
+               G_GUINT64_FORMAT " duplicates, %" G_GUINT64_FORMAT " late, %"
+               G_GUINT64_FORMAT " time jumps, %" G_GUINT64_FORMAT " with STAT errors\n",
+               get_frames_per_second (stream->rate), stream->rate_inferred ? " (inferred)" : "",
+               stream->missing, stream->gaps->len, stream->duplicates, stream->late,
+               stream->time_jumps, stream->stat_errors);
+
+      if (stream->largest_gap.count)
+        {
+          gchar time[64];
+
+          format_time (stream->largest_gap.time, time, sizeof time);
+          g_print ("  Largest gap: %" G_GUINT64_FORMAT " frames from %s\n",
+                   stream->largest_gap.count, time);
+        }
+
+      g_print ("  Timestamp jitter (us): p50 %.1f, p99 %.1f, max %.1f\n",
+               pmu_histogram_get_percentile (stream->jitter, 50) / 1e3,
+               pmu_histogram_get_percentile (stream->jitter, 99) / 1e3,
+               pmu_histogram_get_max (stream->jitter) / 1e3);
+    }
+
+  g_print ("  Latency (ms): p50 %.2f, p90 %.2f, p99 %.2f, p99.9 %.2f, max %.2f",
+           pmu_histogram_get_percentile (stream->latency, 50) / 1e6,
+           pmu_histogram_get_percentile (stream->latency, 90) / 1e6,
+           pmu_histogram_get_percentile (stream->latency, 99) / 1e6,
+           pmu_histogram_get_percentile (stream->latency, 99.9) / 1e6,
+           pmu_histogram_get_max (stream->latency) / 1e6);
+
+  if (stream->early)
+    g_print (", %" G_GUINT64_FORMAT " captured before their timestamp", stream->early);
+
+  g_print ("\n");
+
+  if (list_gaps)
+    for (guint i = 0; i < stream->gaps->len; i++)
+      {
+        Gap *gap = &g_array_index (stream->gaps, Gap, i);
+        gchar time[64];
+
+        format_time (gap->time, time, sizeof time);
+        g_print ("    %s: %" G_GUINT64_FORMAT " missing\n", time, gap->count);
+      }
+}
+
+static void
+print_report (Analyzer *self)
+{
+  g_autoptr(PmuHistogram) latency = pmu_histogram_new ();
+  guint64 data_frames = 0, missing = 0, duplicates = 0, bad_crc = 0;
+  guint num_streams = 0;
+
+  for (guint i = 0; i < self->stream_list->len; i++)
+    {
+      Stream *stream = g_ptr_array_index (self->stream_list, i);
+      CtsClientStats stats;
+
+      if (stream->client == NULL)
+        continue;
+
+      cts_client_get_stats (stream->client, &stats);
+
+      if (stats.frames == 0 && stats.bad_crc == 0)
+        continue;
+
+      print_stream (stream);
+      g_print ("\n");
+
+      num_streams++;
+      data_frames += stream->frames[0];
+      missing += stream->missing;
+      duplicates += stream->duplicates;
+      bad_crc += stats.bad_crc;
+      pmu_histogram_merge (latency, stream->latency);
+    }
+
+  g_print ("%" G_GUINT64_FORMAT " packets, %" G_GUINT64_FORMAT " ignored; %u of %u streams with "
+           "C37.118 frames\n", self->packets, self->ignored, num_streams, self->stream_list->len);
+  g_print ("%" G_GUINT64_FORMAT " data frames, %" G_GUINT64_FORMAT " missing, %"
+           G_GUINT64_FORMAT " duplicates, %" G_GUINT64_FORMAT " bad CHK; latency p50 %.2f ms, "
+           "p99 %.2f ms\n", data_frames, missing, duplicates, bad_crc,
+           pmu_histogram_get_percentile (latency, 50) / 1e6,
+           pmu_histogram_get_percentile (latency, 99) / 1e6);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GMappedFile) file = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GPtrArray) batches = NULL;
+  Analyzer analyzer = { 0 };
+  const guint8 *data;
+  gsize size;
+  gint64 start;
+  gboolean success;
+
+  context = g_option_context_new ("FILE");
+  g_option_context_set_summary (context, "Report gaps, jitter and latency of C37.118 streams in a pcap or pcapng file");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (argc != 2 || num_threads < 0 || port < 0 || port > G_MAXUINT16 ||
+      rate < G_MININT16 || rate > G_MAXINT16 || time_base < 1)
+    {
+      g_printerr ("%s", g_option_context_get_help (context, TRUE, NULL));
+      return EXIT_FAILURE;
+    }
+
+  file = g_mapped_file_new (argv[1], FALSE, &error);
+
+  if (file == NULL)
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  data = (const guint8 *) g_mapped_file_get_contents (file);
+  size = g_mapped_file_get_length (file);
+
+  if (size > 0)
+    madvise ((void *) data, size, MADV_SEQUENTIAL);
+
+  analyzer.streams = g_hash_table_new (stream_key_hash, stream_key_equal);
+  analyzer.stream_list = g_ptr_array_new_with_free_func ((GDestroyNotify) stream_free);
+  analyzer.num_workers = num_threads ? num_threads : g_get_num_processors ();
+  analyzer.workers = g_new0 (Worker, analyzer.num_workers);
+  analyzer.free_batches = g_async_queue_new ();
+  batches = g_ptr_array_new_with_free_func (g_free);
+
+  for (guint i = 0; i < analyzer.num_workers * BATCHES_PER_WORKER; i++)
+    {
+      Batch *batch = g_new (Batch, 1);
+
+      batch->length = 0;
+      g_ptr_array_add (batches, batch);
+      g_async_queue_push (analyzer.free_batches, batch);
+    }
+
+  for (guint i = 0; i < analyzer.num_workers; i++)
+    {
+      Worker *worker = &analyzer.workers[i];
+
+      worker->queue = g_async_queue_new ();
+      worker->free_batches = analyzer.free_batches;
+      worker->streams = g_ptr_array_new ();
+      worker->thread = g_thread_new ("pcap-worker", worker_run, worker);
+    }
+
+  start = g_get_monotonic_time ();
+  success = read_capture (&analyzer, data, size, &error);
+
+  /* An empty batch ends the capture */
+  for (guint i = 0; i < analyzer.num_workers; i++)
+    {
+      Worker *worker = &analyzer.workers[i];
+
+      if (worker->batch && worker->batch->length > 0)
+        g_async_queue_push (worker->queue, worker->batch);
+      else if (worker->batch)
+        g_async_queue_push (analyzer.free_batches, worker->batch);
+
+      g_async_queue_push (worker->queue, g_async_queue_pop (analyzer.free_batches));
+    }
+
+  for (guint i = 0; i < analyzer.num_workers; i++)
+    {
+      Worker *worker = &analyzer.workers[i];
+
+      g_thread_join (worker->thread);
+      g_async_queue_unref (worker->queue);
+      g_ptr_array_unref (worker->streams);
+    }
+
+  if (!success)
+    {
+      g_printerr ("%s: %s\n", argv[1], error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (analyzer.truncated)
+    g_printerr ("%s: Ends in the middle of a packet\n", argv[1]);
+
+  g_printerr ("Read %.1f MB in %.2f s\n", size / 1e6,
+              (g_get_monotonic_time () - start) / 1e6);
+
+  print_report (&analyzer);
+
+  g_hash_table_unref (analyzer.streams);
+  g_ptr_array_unref (analyzer.stream_list);
+  g_async_queue_unref (analyzer.free_batches);
+  g_free (analyzer.workers);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,1153 @@
+/* pmu-pdc.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A phasor data concentrator: Data frames of many PMUs (or PDCs) of
+ * the same time are put together in a single frame, served as a PMU
+ * serves its own.
+ *
+ * Frames are aligned in reporting slots of a CtsAlign, the time of
+ * the frame rounded to the data rate, each input copying the data of
+ * its PMUs to where they go in the PDC frame. A slot is sent as soon
+ * as every input is in, or once the wait window after the time of the
+ * slot is over. The PMUs not in by then are marked absent, STAT bits
+ * 14 - 15 set to 10 and the values to NaN (or 0x8000). Frames that
+ * arrive after their slot was sent are late, and dropped.
+ *
+ * The PMUs of every input, in the order given, make the CFG-2 of the
+ * PDC. It is built once every input has sent its CFG-2, or when the
+ * startup time is over. Should an input change its configuration or
+ * come up late, the CFG-2 is built again and STAT bit 10 is set in
+ * the frames of the next minute.
+ *
+ * Everything runs in one thread around epoll. A frame costs its CHK
+ * and a copy of the data of each PMU in it, little enough for
+ * hundreds of inputs at 60 frames per second.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <glib.h>
+
+#include "c37/c37.h"
+
+#define PDC_TIME_BASE       1000000
+#define RETRY_INTERVAL      (5 * G_USEC_PER_SEC)
+#define STATS_INTERVAL      (10 * G_USEC_PER_SEC)
+#define MAX_PENDING         (1 << 20)
+#define NSEC_PER_SEC        G_GINT64_CONSTANT (1000000000)
+#define MAX_WAIT_MS         4000
+
+static gint id_code = 1;
+static gint port = 4712;
+static gint data_rate = 0;
+static gint wait_ms = 100;
+static gint startup_seconds = 5;
+static gboolean use_udp = FALSE;
+static gboolean verbose = FALSE;
+
+static GOptionEntry entries[] = {
+  { "id-code", 'i', 0, G_OPTION_ARG_INT, &id_code,
+    "ID code of the PDC (default: 1)", "ID" },
+  { "port", 'p', 0, G_OPTION_ARG_INT, &port,
+    "TCP port to serve the combined stream on (default: 4712)", "PORT" },
+  { "data-rate", 'r', 0, G_OPTION_ARG_INT, &data_rate,
+    "Frames per second (default: that of the first input)", "RATE" },
+  { "wait", 'w', 0, G_OPTION_ARG_INT, &wait_ms,
+    "Milliseconds to wait for late PMUs, up to 4000 (default: 100)", "MS" },
+  { "startup", 's', 0, G_OPTION_ARG_INT, &startup_seconds,
+    "Seconds to wait for the configuration of every input (default: 5)", "SECONDS" },
+  { "udp", 'u', 0, G_OPTION_ARG_NONE, &use_udp,
+    "Connect to the inputs over UDP", NULL },
+  { "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+    "Print statistics every 10 seconds", NULL },
+  { NULL }
+};
+
+/* What an epoll event is about, the first member of each */
+typedef enum {
+  WATCH_LISTENER,
+  WATCH_INPUT,
+  WATCH_OUTPUT,
+} WatchKind;
+
+typedef enum {
+  INPUT_DISCONNECTED,
+  INPUT_CONNECTING,
+  INPUT_CONFIGURING,
+  INPUT_RUNNING,
+} InputState;
+
+typedef struct _Pdc Pdc;
+
+typedef struct
+{
+  WatchKind  kind;
+  Pdc       *pdc;
+
+  gchar     *host;
+  gchar     *port;
+  guint16    id_code;
+
+  CtsClient  *client;
+  InputState  state;
+  gint64      retry_time;
+
+  /* The last CFG-2 received, and that the PDC CFG-2 was built with */
+  GBytes   *config_bytes;
+  GBytes   *merged_bytes;
+  gboolean  config_matches;
+
+  /* The PMUs of the input in the PDC CFG-2, from 1, or 0 if not in */
+  guint16   first_pmu;
+  guint16   num_pmu;
+  guint16   source;     /* In the alignment buffer, if in */
+
+  guint64   frames;
+  guint64   missing;
+  guint64   late;
+  guint64   early;
+} Input;
+
+typedef struct
+{
+  WatchKind   kind;
+  Pdc        *pdc;
+
+  CtsClient  *commands;
+  gboolean    data_on;
+  gboolean    closed;
+
+  /* SYNC of a CFG asked for before there was one, or 0 */
+  uint16_t    config_wanted;
+
+  /* What is left of a frame, that the socket did not take */
+  GByteArray *pending;
+  guint64     dropped;
+} Output;
+
+struct _Pdc
+{
+  int        epoll_fd;
+  int        listen_fd;
+  WatchKind  listener;
+
+  GPtrArray *inputs;
+  GPtrArray *outputs;
+
+  gint64     wait_ns;
+  gint64     startup_end;
+  gboolean   rebuild;
+
+  /* NULL till the CFG-2 is built */
+  CtsConf       *config;
+  CtsDataLayout *layout;
+  guint16        frame_size;
+  guint          num_in_config;
+
+  /* Slots start as a frame with every PMU absent */
+  CtsAlign *align;
+  gint64    config_change_end;
+
+  guint64 frames_sent;
+  guint64 frames_complete;
+};
+
+static gint64
+get_now_ns (void)
+{
+  return g_get_real_time () * 1000;
+}
+
+/* The last slot that started at or before @ns */
+static gint64
+get_index_before (gint64 ns)
+{
+  return ns / NSEC_PER_SEC * data_rate + ns % NSEC_PER_SEC * data_rate / NSEC_PER_SEC;
+}
+
+static gint64
+get_deadline (Pdc *pdc)
+{
+  CtsTime time;
+
+  cts_align_get_time_of_index (pdc->align, cts_align_get_next_index (pdc->align), &time);
+
+  return time.soc * NSEC_PER_SEC + time.nanoseconds + pdc->wait_ns;
+}
+
+static void
+get_time_of_ns (gint64   ns,
+                CtsTime *time)
+{
+  time->soc = ns / NSEC_PER_SEC;
+  time->nanoseconds = ns % NSEC_PER_SEC;
+  time->time_quality = 0;
+}
+
+static void
+output_close (Output *output)
+{
+  output->closed = TRUE;
+  output->data_on = FALSE;
+}
+
+static void
+output_update_events (Output *output)
+{
+  struct epoll_event event = { 0 };
+
+  event.events = EPOLLIN | (output->pending->len ? EPOLLOUT : 0);
+  event.data.ptr = output;
+  epoll_ctl (output->pdc->epoll_fd, EPOLL_CTL_MOD,
+             cts_client_get_fd (output->commands), &event);
+}
+
+static void
+output_flush (Output *output)
+{
+  ssize_t sent;
+
+  sent = send (cts_client_get_fd (output->commands), output->pending->data,
+               output->pending->len, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+  if (sent < 0 && errno != EAGAIN && errno != EINTR)
+    {
+      output_close (output);
+      return;
+    }
+
+  if (sent > 0)
+    g_byte_array_remove_range (output->pending, 0, sent);
+
+  if (output->pending->len == 0)
+    output_update_events (output);
+}
+
+/*
+ * Send @data, or keep it to send once the socket can take it. Data
+ * frames are dropped instead while anything is kept, so that a slow
+ * client can't hold the others back.
+ */
+static void
+output_send (Output     *output,
+             const byte *data,
+             gsize       size,
+             gboolean    droppable)
+{
+  ssize_t sent = 0;
+
+  if (output->closed)
+    return;
+
+  if (output->pending->len)
+    {
+      if (droppable)
+        output->dropped++;
+      else if (output->pending->len + size > MAX_PENDING)
+        output_close (output);
+      else
+        g_byte_array_append (output->pending, data, size);
+
+      return;
+    }
+
+  sent = send (cts_client_get_fd (output->commands), data, size,
+               MSG_NOSIGNAL | MSG_DONTWAIT);
+
+  if (sent < 0 && errno != EAGAIN && errno != EINTR)
+    {
+      output_close (output);
+      return;
+    }
+
+  if (sent < 0)
+    sent = 0;
+
+  if ((gsize) sent < size)
+    {
+      g_byte_array_append (output->pending, data + sent, size - sent);
+      output_update_events (output);
+    }
+}
+
+static void
+send_config (Pdc      *pdc,
+             Output   *output,
+             uint16_t  sync)
+{
+  byte *frame;
+
+  if (pdc->config == NULL)
+    {
+      output->config_wanted = sync;
+      return;
+    }
+
+  frame = cts_conf_get_raw_data (pdc->config, sync);
+
+  if (frame)
+    output_send (output, frame, cts_conf_calc_total_size (pdc->config), FALSE);
+
+  free (frame);
+}
+
+static void
+send_header (Pdc    *pdc,
+             Output *output)
+{
+  g_autofree gchar *text = NULL;
+  byte *frame;
+
+  if (pdc->config == NULL)
+    return;
+
+  text = g_strdup_printf ("pmu-pdc: %u PMUs of %u inputs, %d frames per second, %d ms wait",
+                          cts_conf_get_num_of_pmu (pdc->config), pdc->num_in_config,
+                          data_rate, wait_ms);
+  frame = cts_header_get_bin (pdc->config, text);
+
+  if (frame)
+    output_send (output, frame, cts_common_get_size (frame, 2), FALSE);
+
+  free (frame);
+}
+
+static void
+output_frame_cb (CtsClient  *client,
+                 const byte *frame,
+                 uint16_t    size,
+                 void        *user_data)
+{
+  Output *output = user_data;
+  Pdc *pdc = output->pdc;
+
+  if ((frame[1] & 0x70) != (CTS_TYPE_COMMAND & 0x70) ||
+      size != COMMAND_MINIMUM_FRAME_SIZE)
+    return;
+
+  switch (cts_bin_get_command_type (frame, TRUE))
+    {
+    case CTS_COMMAND_DATA_OFF:
+      output->data_on = FALSE;
+      break;
+
+    case CTS_COMMAND_DATA_ON:
+      output->data_on = TRUE;
+      break;
+
+    case CTS_COMMAND_SEND_HDR:
+      send_header (pdc, output);
+      break;
+
+    case CTS_COMMAND_SEND_CONFIG1:
+      send_config (pdc, output, SYNC_CONFIG_ONE);
+      break;
+
+    case CTS_COMMAND_SEND_CONFIG2:
+      send_config (pdc, output, SYNC_CONFIG_TWO);
+      break;
+
+    default:
+      break;
+    }
+}
+
+static void
+output_free (Output *output)
+{
+  cts_client_free (output->commands);
+  g_byte_array_unref (output->pending);
+  g_free (output);
+}
+
+static void
+accept_output (Pdc *pdc)
+{
+  CtsClientHandlers handlers = { .frame = output_frame_cb };
+  struct epoll_event event = { 0 };
+  Output *output;
+  int fd;
+
+  fd = accept4 (pdc->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+  if (fd < 0)
+    return;
+
+  output = g_new0 (Output, 1);
+  output->kind = WATCH_OUTPUT;
+  output->pdc = pdc;
+  output->pending = g_byte_array_new ();
+  output->commands = cts_client_new (id_code);
+
+  if (output->commands == NULL)
+    {
+      close (fd);
+      g_byte_array_unref (output->pending);
+      g_free (output);
+      return;
+    }
+
+  cts_client_set_fd (output->commands, fd, CTS_TRANSPORT_TCP);
+  cts_client_set_handlers (output->commands, &handlers, output);
+
+  event.events = EPOLLIN;
+  event.data.ptr = output;
+  epoll_ctl (pdc->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+
+  g_ptr_array_add (pdc->outputs, output);
+}
+
+static void
+sweep_outputs (Pdc *pdc)
+{
+  for (guint i = 0; i < pdc->outputs->len; )
+    {
+      Output *output = g_ptr_array_index (pdc->outputs, i);
+
+      if (output->closed)
+        g_ptr_array_remove_index_fast (pdc->outputs, i);
+      else
+        i++;
+    }
+}
+
+/* Send the next slot if anything arrived in it, and empty it */
+static void
+emit_slot (Pdc *pdc)
+{
+  gint64 index = cts_align_get_next_index (pdc->align);
+  guint32 soc, fracsec;
+  guint16 num_in, crc;
+  byte *frame;
+
+  frame = cts_align_take (pdc->align, &num_in);
+
+  if (num_in == 0)
+    {
+      cts_align_release (pdc->align);
+      return;
+    }
+
+  soc = index / data_rate;
+  fracsec = ((index % data_rate) * (gint64) PDC_TIME_BASE + data_rate / 2) / data_rate;
+
+  soc = htonl (soc);
+  fracsec = htonl (fracsec);
+  memcpy (frame + 6, &soc, 4);
+  memcpy (frame + 10, &fracsec, 4);
+
+  if (index < pdc->config_change_end)
+    for (guint16 i = 1; i <= cts_conf_get_num_of_pmu (pdc->config); i++)
+      {
+        guint16 offset, size;
+
+        cts_data_layout_get_block_of_pmu (pdc->layout, i, &offset, &size);
+        frame[offset] |= 1 << (STAT_CONFIG_CHANGE_BIT - 8);
+      }
+
+  crc = htons (cts_common_calc_crc (frame, pdc->frame_size - 2, NULL));
+  memcpy (frame + pdc->frame_size - 2, &crc, 2);
+
+  for (guint i = 0; i < pdc->outputs->len; i++)
+    {
+      Output *output = g_ptr_array_index (pdc->outputs, i);
+
+      if (output->data_on)
+        output_send (output, frame, pdc->frame_size, TRUE);
+    }
+
+  pdc->frames_sent++;
+
+  if (num_in == pdc->num_in_config)
+    pdc->frames_complete++;
+
+  for (guint i = 0; i < pdc->inputs->len; i++)
+    {
+      Input *input = g_ptr_array_index (pdc->inputs, i);
+
+      if (input->first_pmu && !cts_align_has_source (pdc->align, input->source))
+        input->missing++;
+    }
+
+  cts_align_release (pdc->align);
+}
+
+/* Send every slot whose deadline is over, in order */
+static void
+advance_slots (Pdc    *pdc,
+               gint64  now)
+{
+  guint32 num_slots;
+  CtsTime time;
+  gint64 last;
+
+  if (pdc->config == NULL)
+    return;
+
+  get_time_of_ns (now, &time);
+  num_slots = cts_align_get_num_slots (pdc->align);
+
+  for (guint32 i = 0; i < num_slots && cts_align_is_due (pdc->align, &time); i++)
+    emit_slot (pdc);
+
+  /* Behind by more than the slots kept, those in between are lost */
+  last = get_index_before (now - pdc->wait_ns);
+
+  if (cts_align_get_next_index (pdc->align) <= last)
+    cts_align_start (pdc->align, last + 1);
+}
+
+/* Send the slots in order for as long as they are complete */
+static void
+emit_complete_slots (Pdc *pdc)
+{
+  while (cts_align_is_due (pdc->align, NULL))
+    emit_slot (pdc);
+}
+
+static void
+insert_frame (Pdc               *pdc,
+              Input             *input,
+              const CtsDataView *view)
+{
+  const byte *block;
+  CtsTime time;
+  guint16 size;
+
+  cts_data_view_get_time (view, &time);
+  input->frames++;
+
+  /* The PMUs of the input follow each other, as in the PDC frame */
+  block = cts_data_view_get_block_of_pmu (view, 1, &size);
+
+  if (block == NULL)
+    return;
+
+  switch (cts_align_insert (pdc->align, input->source,
+                            cts_align_get_index (pdc->align, &time), block))
+    {
+    case CTS_ALIGN_COMPLETE:
+      emit_complete_slots (pdc);
+      break;
+
+    case CTS_ALIGN_LATE:
+      input->late++;
+      break;
+
+    case CTS_ALIGN_EARLY:
+      /* Further ahead than the slots kept, a clock gone wrong */
+      input->early++;
+      break;
+
+    default:
+      break;
+    }
+}
+/*
+ * Build the CFG-2 of the PDC from the inputs whose configuration is
+ * known, after sending what is waiting with the previous one.
+ */
+static gboolean
+build_config (Pdc *pdc)
+{
+  CtsConf *config;
+  guint num_pmu = 0;
+  guint16 pmu_index = 1;
+  g_autofree byte *absent = NULL;
+  guint16 header[3];
+  gboolean changed;
+
+  pdc->rebuild = FALSE;
+  changed = pdc->config != NULL;
+
+  if (pdc->config)
+    {
+      for (guint32 i = cts_align_get_num_slots (pdc->align); i > 0; i--)
+        emit_slot (pdc);
+
+      g_clear_pointer (&pdc->align, cts_align_free);
+      g_clear_pointer (&pdc->layout, cts_data_layout_free);
+      g_clear_pointer (&pdc->config, cts_conf_free);
+    }
+
+  for (guint i = 0; i < pdc->inputs->len; i++)
+    {
+      Input *input = g_ptr_array_index (pdc->inputs, i);
+      CtsConf *input_config = cts_client_get_config (input->client);
+
+      if (input_config)
+        num_pmu += cts_conf_get_num_of_pmu (input_config);
+    }
+
+  if (num_pmu == 0)
+    return TRUE;
+
+  if (num_pmu > G_MAXUINT16)
+    {
+      g_printerr ("Too many PMUs for a frame: %u\n", num_pmu);
+      return FALSE;
+    }
+
+  config = cts_conf_new ();
+  cts_conf_set_id_code (config, id_code);
+  cts_conf_set_time_base (config, PDC_TIME_BASE);
+
+  if (cts_conf_set_num_of_pmu (config, num_pmu) != num_pmu)
+    {
+      cts_conf_free (config);
+      return FALSE;
+    }
+
+  pdc->num_in_config = 0;
+
+  for (guint i = 0; i < pdc->inputs->len; i++)
+    {
+      Input *input = g_ptr_array_index (pdc->inputs, i);
+      CtsConf *input_config = cts_client_get_config (input->client);
+
+      input->first_pmu = 0;
+      input->num_pmu = 0;
+      g_clear_pointer (&input->merged_bytes, g_bytes_unref);
+
+      if (input_config == NULL)
+        continue;
+
+      if (data_rate == 0)
+        data_rate = cts_conf_get_data_rate (input_config);
+
+      input->first_pmu = pmu_index;
+      input->num_pmu = cts_conf_get_num_of_pmu (input_config);
+      input->source = pdc->num_in_config;
+      input->merged_bytes = g_bytes_ref (input->config_bytes);
+      input->config_matches = TRUE;
+      pdc->num_in_config++;
+
+      for (guint16 j = 1; j <= input->num_pmu; j++)
+        if (!cts_conf_copy_pmu (config, pmu_index++, input_config, j))
+          {
+            cts_conf_free (config);
+            return FALSE;
+          }
+    }
+
+  if (data_rate <= 0)
+    {
+      g_printerr ("Only data rates of at least a frame per second are supported\n");
+      cts_conf_free (config);
+      return FALSE;
+    }
+
+  cts_conf_set_data_rate (config, data_rate);
+  cts_conf_update_frame_size (config);
+
+  pdc->config = config;
+  pdc->layout = cts_data_layout_new (config);
+
+  if (pdc->layout == NULL)
+    {
+      g_printerr ("The data of %u PMUs does not fit in a frame\n", num_pmu);
+      return FALSE;
+    }
+
+  pdc->frame_size = cts_data_layout_get_frame_size (pdc->layout);
+  absent = g_malloc0 (pdc->frame_size);
+
+  header[0] = htons (SYNC_DATA);
+  header[1] = htons (pdc->frame_size);
+  header[2] = htons (id_code);
+  memcpy (absent, header, sizeof header);
+
+  for (guint16 i = 1; i <= num_pmu; i++)
+    cts_data_layout_write_absent (pdc->layout, i, absent);
+
+  pdc->align = cts_align_new (pdc->num_in_config, data_rate, pdc->wait_ns,
+                              absent, pdc->frame_size);
+
+  if (pdc->align == NULL)
+    {
+      g_printerr ("Can't keep frames of %u bytes\n", pdc->frame_size);
+      return FALSE;
+    }
+
+  for (guint i = 0; i < pdc->inputs->len; i++)
+    {
+      Input *input = g_ptr_array_index (pdc->inputs, i);
+      guint16 first_offset, last_offset, size;
+
+      if (input->first_pmu == 0)
+        continue;
+
+      cts_data_layout_get_block_of_pmu (pdc->layout, input->first_pmu,
+                                        &first_offset, &size);
+      cts_data_layout_get_block_of_pmu (pdc->layout, input->first_pmu + input->num_pmu - 1,
+                                        &last_offset, &size);
+      cts_align_set_source (pdc->align, input->source, first_offset,
+                            last_offset + size - first_offset);
+    }
+
+  cts_align_start (pdc->align, get_index_before (get_now_ns () - pdc->wait_ns) + 1);
+
+  if (changed)
+    pdc->config_change_end = cts_align_get_next_index (pdc->align) + 60 * (gint64) data_rate;
+
+  if (verbose)
+    g_printerr ("CFG-2 of %u PMUs from %u inputs, %u bytes per frame\n",
+                num_pmu, pdc->num_in_config, pdc->frame_size);
+
+  for (guint i = 0; i < pdc->outputs->len; i++)
+    {
+      Output *output = g_ptr_array_index (pdc->outputs, i);
+
+      if (output->config_wanted)
+        send_config (pdc, output, output->config_wanted);
+
+      output->config_wanted = 0;
+    }
+
+  return TRUE;
+}
+
+static void
+input_disconnect (Input *input)
+{
+  int fd = cts_client_get_fd (input->client);
+
+  if (fd >= 0)
+    epoll_ctl (input->pdc->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+  cts_client_close (input->client);
+  input->state = INPUT_DISCONNECTED;
+  input->retry_time = g_get_monotonic_time () + RETRY_INTERVAL;
+}
+
+static void
+input_frame_cb (CtsClient  *client,
+                const byte *frame,
+                uint16_t    size,
+                void        *user_data)
+{
+  Input *input = user_data;
+  byte frame_type = frame[1] & 0x70;
+
+  if (frame_type != (CTS_TYPE_CONFIG2 & 0x70) &&
+      frame_type != (CTS_TYPE_CONFIG3 & 0x70))
+    return;
+
+  /* Everything after the time and before CHK */
+  g_clear_pointer (&input->config_bytes, g_bytes_unref);
+  input->config_bytes = g_bytes_new (frame + 14, size - 16);
+}
+
+static void
+input_config_cb (CtsClient *client,
+                 CtsConf   *config,
+                 byte       type,
+                 void      *user_data)
+{
+  Input *input = user_data;
+  Pdc *pdc = input->pdc;
+
+  if (type == CTS_TYPE_CONFIG1)
+    return;
+
+  if (input->state == INPUT_CONFIGURING)
+    {
+      cts_client_send_command (client, CTS_COMMAND_DATA_ON);
+      input->state = INPUT_RUNNING;
+    }
+
+  input->config_matches = input->merged_bytes &&
+                          g_bytes_equal (input->merged_bytes, input->config_bytes);
+
+  if (pdc->config && !input->config_matches)
+    pdc->rebuild = TRUE;
+}
+
+static void
+input_data_cb (CtsClient         *client,
+               const CtsDataView *view,
+               void              *user_data)
+{
+  Input *input = user_data;
+  Pdc *pdc = input->pdc;
+
+  /* Not in the CFG-2, or not as it is now */
+  if (pdc->config == NULL || input->first_pmu == 0 || !input->config_matches)
+    return;
+
+  insert_frame (pdc, input, view);
+}
+
+static void
+input_connect (Input *input)
+{
+  struct addrinfo hints = { 0 };
+  struct addrinfo *result;
+  struct epoll_event event = { 0 };
+  int fd, status;
+
+  input->retry_time = g_get_monotonic_time () + RETRY_INTERVAL;
+
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = use_udp ? SOCK_DGRAM : SOCK_STREAM;
+
+  if (getaddrinfo (input->host, input->port, &hints, &result) != 0)
+    return;
+
+  fd = socket (result->ai_family, result->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+               result->ai_protocol);
+
+  if (fd < 0)
+    {
+      freeaddrinfo (result);
+      return;
+    }
+
+  status = connect (fd, result->ai_addr, result->ai_addrlen);
+  freeaddrinfo (result);
+
+  if (status < 0 && errno != EINPROGRESS)
+    {
+      close (fd);
+      return;
+    }
+
+  cts_client_set_fd (input->client, fd, use_udp ? CTS_TRANSPORT_UDP : CTS_TRANSPORT_TCP);
+  input->state = INPUT_CONNECTING;
+
+  event.events = EPOLLIN | EPOLLOUT;
+  event.data.ptr = input;
+  epoll_ctl (input->pdc->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+static void
+input_connected (Input *input)
+{
+  struct epoll_event event = { 0 };
+  int fd = cts_client_get_fd (input->client);
+  socklen_t length = sizeof (int);
+  int error = 0, one = 1;
+
+  if (getsockopt (fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error)
+    {
+      input_disconnect (input);
+      return;
+    }
+
+  if (!use_udp)
+    setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+  event.events = EPOLLIN;
+  event.data.ptr = input;
+  epoll_ctl (input->pdc->epoll_fd, EPOLL_CTL_MOD, fd, &event);
+
+  input->state = INPUT_CONFIGURING;
+  input->retry_time = g_get_monotonic_time () + RETRY_INTERVAL;
+
+  if (!cts_client_send_command (input->client, CTS_COMMAND_SEND_CONFIG2))
+    input_disconnect (input);
+}
+
+static void
+handle_input (Input    *input,
+              guint32   events)
+{
+  ssize_t count;
+
+  if (input->state == INPUT_CONNECTING)
+    {
+      input_connected (input);
+      return;
+    }
+
+  count = cts_client_read (input->client);
+
+  /* A UDP socket reports a PMU not listening as an error */
+  if (count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR))
+    input_disconnect (input);
+}
+
+static void
+handle_output (Output   *output,
+               guint32   events)
+{
+  ssize_t count;
+
+  if (events & EPOLLOUT)
+    output_flush (output);
+
+  if (output->closed || !(events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+    return;
+
+  count = cts_client_read (output->commands);
+
+  if (count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR))
+    output_close (output);
+}
+
+/* Connections to retry, configurations to ask again and statistics */
+static void
+housekeeping (Pdc    *pdc,
+              gint64  now)
+{
+  gboolean all_configured = TRUE;
+
+  for (guint i = 0; i < pdc->inputs->len; i++)
+    {
+      Input *input = g_ptr_array_index (pdc->inputs, i);
+
+      if (cts_client_get_config (input->client) == NULL)
+        all_configured = FALSE;
+
+      if (now < input->retry_time)
+        continue;
+
+      if (input->state == INPUT_DISCONNECTED)
+        {
+          input_connect (input);
+        }
+      else if (input->state == INPUT_CONFIGURING)
+        {
+          input->retry_time = now + RETRY_INTERVAL;
+          cts_client_send_command (input->client, CTS_COMMAND_SEND_CONFIG2);
+        }
+    }
+
+  if (pdc->config == NULL && (all_configured || now >= pdc->startup_end))
+    pdc->rebuild = TRUE;
+}
+
+static void
+print_stats (Pdc *pdc)
+{
+  g_printerr ("%" G_GUINT64_FORMAT " frames sent, %" G_GUINT64_FORMAT " complete, %u clients\n",
+              pdc->frames_sent, pdc->frames_complete, pdc->outputs->len);
+
+  for (guint i = 0; i < pdc->inputs->len; i++)
+    {
+      Input *input = g_ptr_array_index (pdc->inputs, i);
+      CtsClientStats stats;
+
+      cts_client_get_stats (input->client, &stats);
+      g_printerr ("  %s:%s/%u: %s, %" G_GUINT64_FORMAT " frames, %" G_GUINT64_FORMAT " missing, "
+                  "%" G_GUINT64_FORMAT " late, %" G_GUINT64_FORMAT " early, %" G_GUINT64_FORMAT " bad CHK\n",
+                  input->host, input->port, input->id_code,
+                  input->state == INPUT_RUNNING ? "running" :
+                  input->state == INPUT_DISCONNECTED ? "disconnected" : "connecting",
+                  input->frames, input->missing, input->late, input->early, stats.bad_crc);
+    }
+}
+
+/* HOST:PORT/ID, HOST may be an IPv6 address in brackets */
+static Input *
+input_new (Pdc         *pdc,
+           const gchar *argument)
+{
+  CtsClientHandlers handlers = {
+    .frame = input_frame_cb,
+    .config = input_config_cb,
+    .data = input_data_cb,
+  };
+  g_autofree gchar *address = NULL;
+  const gchar *slash, *colon;
+  guint64 id = 0;
+  Input *input;
+
+  slash = strrchr (argument, '/');
+
+  if (slash == NULL || !g_ascii_string_to_unsigned (slash + 1, 10, 1, G_MAXUINT16, &id, NULL))
+    return NULL;
+
+  address = g_strndup (argument, slash - argument);
+  colon = strrchr (address, ':');
+
+  if (colon == NULL || colon == address || colon[1] == '\0')
+    return NULL;
+
+  input = g_new0 (Input, 1);
+  input->kind = WATCH_INPUT;
+  input->pdc = pdc;
+  input->id_code = id;
+  input->port = g_strdup (colon + 1);
+
+  if (address[0] == '[' && colon[-1] == ']')
+    input->host = g_strndup (address + 1, colon - address - 2);
+  else
+    input->host = g_strndup (address, colon - address);
+
+  input->client = cts_client_new (id);
+  cts_client_set_handlers (input->client, &handlers, input);
+
+  return input;
+}
+
+static int
+listen_on (int port_number)
+{
+  struct sockaddr_in6 address = { 0 };
+  int fd, one = 1;
+
+  fd = socket (AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if (fd < 0)
+    return -1;
+
+  setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
+  address.sin6_family = AF_INET6;
+  address.sin6_addr = in6addr_any;
+  address.sin6_port = htons (port_number);
+
+  if (bind (fd, (struct sockaddr *) &address, sizeof address) < 0 ||
+      listen (fd, 16) < 0)
+    {
+      close (fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  struct epoll_event events[64];
+  struct epoll_event event = { 0 };
+  gint64 next_housekeeping, next_stats;
+  Pdc pdc = { 0 };
+
+  context = g_option_context_new ("HOST:PORT/ID…");
+  g_option_context_set_summary (context, "Concentrate the data of PMUs into a single stream");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (argc < 2 || id_code < 1 || id_code > G_MAXUINT16 || wait_ms < 0 || wait_ms > MAX_WAIT_MS ||
+      data_rate < 0)
+    {
+      g_printerr ("%s", g_option_context_get_help (context, TRUE, NULL));
+      return EXIT_FAILURE;
+    }
+
+  pdc.wait_ns = wait_ms * G_GINT64_CONSTANT (1000000);
+  pdc.listener = WATCH_LISTENER;
+  pdc.inputs = g_ptr_array_new ();
+  pdc.outputs = g_ptr_array_new_with_free_func ((GDestroyNotify) output_free);
+  pdc.epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+  pdc.listen_fd = listen_on (port);
+
+  if (pdc.epoll_fd < 0 || pdc.listen_fd < 0)
+    {
+      g_printerr ("Can't listen on port %d: %s\n", port, g_strerror (errno));
+      return EXIT_FAILURE;
+    }
+
+  event.events = EPOLLIN;
+  event.data.ptr = &pdc.listener;
+  epoll_ctl (pdc.epoll_fd, EPOLL_CTL_ADD, pdc.listen_fd, &event);
+
+  for (int i = 1; i < argc; i++)
+    {
+      Input *input = input_new (&pdc, argv[i]);
+
+      if (input == NULL)
+        {
+          g_printerr ("Invalid input '%s', expected HOST:PORT/ID\n", argv[i]);
+          return EXIT_FAILURE;
+        }
+
+      g_ptr_array_add (pdc.inputs, input);
+      input_connect (input);
+    }
+
+  pdc.startup_end = g_get_monotonic_time () + startup_seconds * G_USEC_PER_SEC;
+  next_housekeeping = g_get_monotonic_time () + G_USEC_PER_SEC;
+  next_stats = g_get_monotonic_time () + STATS_INTERVAL;
+
+  for (;;)
+    {
+      gint64 timeout = G_USEC_PER_SEC;
+      gint64 monotonic;
+      int count;
+
+      if (pdc.config)
+        timeout = (get_deadline (&pdc) - get_now_ns ()) / 1000;
+
+      timeout = CLAMP (timeout, 0, G_USEC_PER_SEC);
+      count = epoll_wait (pdc.epoll_fd, events, G_N_ELEMENTS (events),
+                          (timeout + 999) / 1000);
+
+      if (count < 0 && errno != EINTR)
+        {
+          g_printerr ("epoll: %s\n", g_strerror (errno));
+          return EXIT_FAILURE;
+        }
+
+      for (int i = 0; i < count; i++)
+        {
+          WatchKind *kind = events[i].data.ptr;
+
+          if (*kind == WATCH_LISTENER)
+            accept_output (&pdc);
+          else if (*kind == WATCH_INPUT)
+            handle_input ((Input *) kind, events[i].events);
+          else
+            handle_output ((Output *) kind, events[i].events);
+        }
+
+      advance_slots (&pdc, get_now_ns ());
+      sweep_outputs (&pdc);
+
+      monotonic = g_get_monotonic_time ();
+
+      if (monotonic >= next_housekeeping)
+        {
+          housekeeping (&pdc, monotonic);
+          next_housekeeping = monotonic + G_USEC_PER_SEC;
+        }
+
+      if (pdc.rebuild && !build_config (&pdc))
+        return EXIT_FAILURE;
+
+      if (verbose && monotonic >= next_stats)
+        {
+          print_stats (&pdc);
+          next_stats = monotonic + STATS_INTERVAL;
+        }
+    }
+
+  return EXIT_SUCCESS;
+}
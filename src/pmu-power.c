@@ -0,0 +1,185 @@
+/* pmu-power.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dsp/dsp.h"
+
+#include "pmu-power.h"
+
+/*
+ * Fills the power analogs of every PMU in a data frame from the phase
+ * phasors, following the channel layout of pmu-config.h:
+ *
+ *   Phasors 1 - 3: VR, VY, VB    Phasors 4 - 6: IR, IY, IB
+ *   Analogs 1 - 3: PR, PY, PB    Analogs 4 - 6: QR, QY, QB
+ *   Analogs 7 - 9: SR, SY, SB    Analogs 10 - 12: P3, Q3, S3
+ *
+ * Three phase P and Q are the sums of the phases. Three phase S is
+ * the magnitude of P3 + jQ3 (the "vector" apparent power), not the
+ * sum of the phase S.
+ *
+ * The phases of every PMU are gathered into lanes, phase by phase, so
+ * that a frame is a single call of the kernel.
+ */
+
+#define FIRST_VOLTAGE  1
+#define FIRST_CURRENT  4
+#define FIRST_ACTIVE   1
+#define FIRST_REACTIVE 4
+#define FIRST_APPARENT 7
+#define THREE_PHASE    10
+#define NUM_ANALOGS    12
+
+struct _PmuPower
+{
+  guint capacity;       /* PMUs */
+
+  DspPhasorArray voltage;
+  DspPhasorArray current;
+  gfloat *active;
+  gfloat *reactive;
+  gfloat *apparent;
+
+  /* The floats of every array above */
+  gfloat *buffer;
+};
+
+PmuPower *
+pmu_power_new (void)
+{
+  return g_new0 (PmuPower, 1);
+}
+
+void
+pmu_power_free (PmuPower *self)
+{
+  if (self == NULL)
+    return;
+
+  free (self->buffer);
+  g_free (self);
+}
+
+/**
+ * pmu_power_reserve:
+ * @self: A #PmuPower
+ * @num_pmu: The number of PMUs
+ *
+ * Allocate memory for frames of @num_pmu PMUs, so that
+ * pmu_power_update_data() doesn't have to.
+ *
+ * Returns: %TRUE on success, %FALSE if out of memory
+ */
+gboolean
+pmu_power_reserve (PmuPower *self,
+                   guint     num_pmu)
+{
+  gsize stride;
+  gfloat *buffer;
+
+  if (num_pmu <= self->capacity)
+    return TRUE;
+
+  /* A lane for each phase of each PMU */
+  stride = DSP_NUM_VECTORS (3 * num_pmu) * DSP_LANES;
+  buffer = dsp_calloc_aligned (sizeof (gfloat) * stride * 7);
+
+  if (buffer == NULL)
+    return FALSE;
+
+  free (self->buffer);
+  self->buffer = buffer;
+  self->capacity = num_pmu;
+
+  self->voltage.real = buffer;
+  self->voltage.imaginary = buffer + stride;
+  self->current.real = buffer + stride * 2;
+  self->current.imaginary = buffer + stride * 3;
+  self->active = buffer + stride * 4;
+  self->reactive = buffer + stride * 5;
+  self->apparent = buffer + stride * 6;
+
+  return TRUE;
+}
+
+/**
+ * pmu_power_update_data:
+ * @self: A #PmuPower
+ * @data: The data frame to update
+ *
+ * Set analogs 1 to 12 of every PMU in @data to the power computed
+ * from phasors 1 to 6. PMUs with less than 12 analogs are left as
+ * such.
+ */
+void
+pmu_power_update_data (PmuPower *self,
+                       CtsData  *data)
+{
+  CtsConf *config = cts_data_get_conf (data);
+  guint num_pmu = cts_conf_get_num_of_pmu (config);
+
+  if (!pmu_power_reserve (self, num_pmu))
+    return;
+
+  for (guint phase = 0; phase < 3; phase++)
+    for (guint i = 0; i < num_pmu; i++)
+      {
+        guint lane = phase * num_pmu + i;
+
+        /* Missing phasors give zero power */
+        self->voltage.real[lane] = self->voltage.imaginary[lane] = 0;
+        self->current.real[lane] = self->current.imaginary[lane] = 0;
+
+        cts_data_get_phasor_of_pmu (data, i + 1, FIRST_VOLTAGE + phase,
+                                    self->voltage.real + lane,
+                                    self->voltage.imaginary + lane);
+        cts_data_get_phasor_of_pmu (data, i + 1, FIRST_CURRENT + phase,
+                                    self->current.real + lane,
+                                    self->current.imaginary + lane);
+      }
+
+  dsp_power_process (&self->voltage, &self->current,
+                     self->active, self->reactive, self->apparent,
+                     3 * num_pmu);
+
+  for (guint i = 0; i < num_pmu; i++)
+    {
+      gfloat p3 = 0, q3 = 0;
+
+      if (cts_conf_get_num_of_analogs_of_pmu (config, i + 1) < NUM_ANALOGS)
+        continue;
+
+      for (guint phase = 0; phase < 3; phase++)
+        {
+          guint lane = phase * num_pmu + i;
+
+          cts_data_set_analog_of_pmu (data, i + 1, FIRST_ACTIVE + phase,
+                                      self->active[lane]);
+          cts_data_set_analog_of_pmu (data, i + 1, FIRST_REACTIVE + phase,
+                                      self->reactive[lane]);
+          cts_data_set_analog_of_pmu (data, i + 1, FIRST_APPARENT + phase,
+                                      self->apparent[lane]);
+
+          p3 += self->active[lane];
+          q3 += self->reactive[lane];
+        }
+
+      cts_data_set_analog_of_pmu (data, i + 1, THREE_PHASE, p3);
+      cts_data_set_analog_of_pmu (data, i + 1, THREE_PHASE + 1, q3);
+      cts_data_set_analog_of_pmu (data, i + 1, THREE_PHASE + 2, hypotf (p3, q3));
+    }
+}
@@ -0,0 +1,38 @@
+/* pmu-power.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "c37/c37.h"
+
+G_BEGIN_DECLS
+
+typedef struct _PmuPower PmuPower;
+
+PmuPower *pmu_power_new         (void);
+void      pmu_power_free        (PmuPower *self);
+gboolean  pmu_power_reserve     (PmuPower *self,
+                                 guint     num_pmu);
+void      pmu_power_update_data (PmuPower *self,
+                                 CtsData  *data);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PmuPower, pmu_power_free)
+
+G_END_DECLS
@@ -0,0 +1,878 @@
+/* pmu-relay.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+/*
+ * A relay: A single connection to each PMU (or PDC), served to any
+ * number of clients on a port of its own, as if they were connected
+ * to the PMU itself. A client gets the PMU of the ID code of its
+ * first command.
+ *
+ * The CFG-1, CFG-2, CFG-3 and header frames of each PMU are asked for
+ * once it is connected, and kept, to answer the commands of clients
+ * without going to the PMU. They are asked for again when a PMU sets
+ * STAT bit 10, its configuration about to change.
+ *
+ * The PMU is kept sending data whether or not anyone wants it, so
+ * that the load on it does not depend on the clients. Data frames are
+ * put in a ring, and each client sends from its own place in it, as
+ * far as its socket takes. A client that falls behind by the whole
+ * ring is disconnected.
+ *
+ * Everything runs in one thread around epoll.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <glib.h>
+
+#include "c37/c37.h"
+
+#define RETRY_INTERVAL      (5 * G_USEC_PER_SEC)
+#define REFRESH_INTERVAL    (5 * G_USEC_PER_SEC)
+#define STATS_INTERVAL      (10 * G_USEC_PER_SEC)
+#define MAX_PENDING         (1 << 20)
+
+static gint port = 4712;
+static gint buffer_kib = 1024;
+static gboolean verbose = FALSE;
+
+static GOptionEntry entries[] = {
+  { "port", 'p', 0, G_OPTION_ARG_INT, &port,
+    "TCP port to serve the PMUs on (default: 4712)", "PORT" },
+  { "buffer", 'b', 0, G_OPTION_ARG_INT, &buffer_kib,
+    "KiB of data frames kept of each PMU for slow clients (default: 1024)", "KIB" },
+  { "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+    "Print statistics every 10 seconds", NULL },
+  { NULL }
+};
+
+/* What an epoll event is about, the first member of each */
+typedef enum {
+  WATCH_LISTENER,
+  WATCH_UPSTREAM,
+  WATCH_CLIENT,
+} WatchKind;
+
+typedef enum {
+  UPSTREAM_DISCONNECTED,
+  UPSTREAM_CONNECTING,
+  UPSTREAM_CONFIGURING,
+  UPSTREAM_RUNNING,
+} UpstreamState;
+
+/* The frames kept of a PMU */
+typedef enum {
+  CACHED_CONFIG1,
+  CACHED_CONFIG2,
+  CACHED_CONFIG3,
+  CACHED_HEADER,
+  N_CACHED
+} Cached;
+
+static const guint16 cached_commands[N_CACHED] = {
+  CTS_COMMAND_SEND_CONFIG1,
+  CTS_COMMAND_SEND_CONFIG2,
+  CTS_COMMAND_SEND_CONFIG3,
+  CTS_COMMAND_SEND_HDR,
+};
+
+typedef struct _Relay Relay;
+
+typedef struct
+{
+  WatchKind  kind;
+  Relay     *relay;
+
+  gchar     *host;
+  gchar     *port;
+  guint16    id_code;
+
+  CtsClient     *client;
+  UpstreamState  state;
+  gint64         retry_time;
+  gint64         refresh_time;
+
+  GBytes *cached[N_CACHED];
+
+  /* Data frames as received, at head % ring size */
+  byte    *ring;
+  guint64  head;
+
+  guint64  frames;
+  guint64  refreshes;
+} Upstream;
+
+typedef struct
+{
+  WatchKind  kind;
+  Relay     *relay;
+
+  CtsClient *commands;
+  Upstream  *upstream;      /* Of the ID code of the first command */
+  gboolean   data_on;
+  gboolean   blocked;       /* Waiting for the socket to take more */
+  gboolean   closed;
+
+  /* Cached frames asked for before they were, a bit each */
+  guint      wanted;
+
+  /* Frames other than data, sent in between data frames */
+  GByteArray *pending;
+
+  /* The data frame being sent, and how much of it is */
+  guint64    cursor;
+  gsize      offset;
+
+  guint64    frames;
+} Client;
+
+struct _Relay
+{
+  int        epoll_fd;
+  int        listen_fd;
+  WatchKind  listener;
+
+  GPtrArray *upstreams;
+  GPtrArray *clients;
+  gsize      ring_size;
+
+  guint64    overruns;
+};
+
+static void
+client_close (Client *client)
+{
+  client->closed = TRUE;
+  client->data_on = FALSE;
+}
+
+static void
+client_update_events (Client *client)
+{
+  struct epoll_event event = { 0 };
+
+  event.events = EPOLLIN | (client->blocked ? EPOLLOUT : 0);
+  event.data.ptr = client;
+  epoll_ctl (client->relay->epoll_fd, EPOLL_CTL_MOD,
+             cts_client_get_fd (client->commands), &event);
+}
+
+static guint16
+ring_get_uint16 (Upstream *upstream,
+                 guint64   position)
+{
+  gsize size = upstream->relay->ring_size;
+
+  return upstream->ring[position % size] << 8 | upstream->ring[(position + 1) % size];
+}
+
+/*
+ * Send what @client is to be sent for as long as the socket takes it:
+ * The frames kept for it once a data frame is over, else the data
+ * frames it is behind by.
+ */
+static void
+client_flush (Client *client)
+{
+  Upstream *upstream = client->upstream;
+  gsize ring_size = client->relay->ring_size;
+
+  while (!client->closed && !client->blocked)
+    {
+      const byte *data;
+      gboolean is_data;
+      gsize size, frame_size = 0;
+      ssize_t sent;
+
+      if (client->offset == 0 && client->pending->len)
+        {
+          data = client->pending->data;
+          size = client->pending->len;
+          is_data = FALSE;
+        }
+      else if (upstream && (client->data_on || client->offset) &&
+               client->cursor < upstream->head)
+        {
+          gsize position;
+
+          if (upstream->head - client->cursor > ring_size)
+            {
+              client->relay->overruns++;
+              client_close (client);
+              return;
+            }
+
+          frame_size = ring_get_uint16 (upstream, client->cursor + 2);
+          position = (client->cursor + client->offset) % ring_size;
+          data = upstream->ring + position;
+          size = MIN (frame_size - client->offset, ring_size - position);
+          is_data = TRUE;
+        }
+      else
+        {
+          return;
+        }
+
+      sent = send (cts_client_get_fd (client->commands), data, size,
+                   MSG_NOSIGNAL | MSG_DONTWAIT);
+
+      if (sent < 0 && errno != EAGAIN && errno != EINTR)
+        {
+          client_close (client);
+          return;
+        }
+
+      sent = MAX (sent, 0);
+
+      if (!is_data)
+        {
+          g_byte_array_remove_range (client->pending, 0, sent);
+        }
+      else if ((client->offset += sent) == frame_size)
+        {
+          client->cursor += frame_size;
+          client->offset = 0;
+          client->frames++;
+        }
+
+      if ((gsize) sent < size)
+        {
+          client->blocked = TRUE;
+          client_update_events (client);
+        }
+    }
+}
+
+static void
+client_send_cached (Client *client,
+                    Cached  cached)
+{
+  GBytes *frame = client->upstream->cached[cached];
+  gsize size;
+
+  if (frame == NULL)
+    {
+      client->wanted |= 1 << cached;
+      return;
+    }
+
+  client->wanted &= ~(1 << cached);
+  size = g_bytes_get_size (frame);
+
+  if (client->pending->len + size > MAX_PENDING)
+    {
+      client_close (client);
+      return;
+    }
+
+  g_byte_array_append (client->pending, g_bytes_get_data (frame, NULL), size);
+  client_flush (client);
+}
+
+static Upstream *
+find_upstream (Relay   *relay,
+               guint16  id_code)
+{
+  for (guint i = 0; i < relay->upstreams->len; i++)
+    {
+      Upstream *upstream = g_ptr_array_index (relay->upstreams, i);
+
+      if (upstream->id_code == id_code)
+        return upstream;
+    }
+
+  return NULL;
+}
+
+static void
+client_frame_cb (CtsClient  *commands,
+                 const byte *frame,
+                 uint16_t    size,
+                 void        *user_data)
+{
+  Client *client = user_data;
+  guint16 id_code;
+
+  if ((frame[1] & 0x70) != (CTS_TYPE_COMMAND & 0x70) ||
+      size != COMMAND_MINIMUM_FRAME_SIZE)
+    return;
+
+  id_code = cts_common_get_size (frame, 4);
+
+  if (client->upstream == NULL)
+    client->upstream = find_upstream (client->relay, id_code);
+
+  if (client->upstream == NULL || client->upstream->id_code != id_code)
+    return;
+
+  switch (cts_bin_get_command_type (frame, TRUE))
+    {
+    case CTS_COMMAND_DATA_OFF:
+      client->data_on = FALSE;
+      break;
+
+    case CTS_COMMAND_DATA_ON:
+      /* From the next frame of the PMU, unless one is being sent */
+      if (!client->data_on && client->offset == 0)
+        client->cursor = client->upstream->head;
+
+      client->data_on = TRUE;
+      break;
+
+    case CTS_COMMAND_SEND_CONFIG1:
+      client_send_cached (client, CACHED_CONFIG1);
+      break;
+
+    case CTS_COMMAND_SEND_CONFIG2:
+      client_send_cached (client, CACHED_CONFIG2);
+      break;
+
+    case CTS_COMMAND_SEND_CONFIG3:
+      client_send_cached (client, CACHED_CONFIG3);
+      break;
+
+    case CTS_COMMAND_SEND_HDR:
+      client_send_cached (client, CACHED_HEADER);
+      break;
+
+    default:
+      break;
+    }
+}
+
+static void
+client_free (Client *client)
+{
+  cts_client_free (client->commands);
+  g_byte_array_unref (client->pending);
+  g_free (client);
+}
+
+static void
+accept_client (Relay *relay)
+{
+  CtsClientHandlers handlers = { .frame = client_frame_cb };
+  struct epoll_event event = { 0 };
+  Client *client;
+  int fd, one = 1;
+
+  fd = accept4 (relay->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+  if (fd < 0)
+    return;
+
+  setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+  client = g_new0 (Client, 1);
+  client->kind = WATCH_CLIENT;
+  client->relay = relay;
+  client->pending = g_byte_array_new ();
+  client->commands = cts_client_new (0);
+
+  if (client->commands == NULL)
+    {
+      close (fd);
+      client_free (client);
+      return;
+    }
+
+  cts_client_set_fd (client->commands, fd, CTS_TRANSPORT_TCP);
+  cts_client_set_handlers (client->commands, &handlers, client);
+
+  event.events = EPOLLIN;
+  event.data.ptr = client;
+  epoll_ctl (relay->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+
+  g_ptr_array_add (relay->clients, client);
+}
+
+static void
+sweep_clients (Relay *relay)
+{
+  for (guint i = 0; i < relay->clients->len; )
+    {
+      Client *client = g_ptr_array_index (relay->clients, i);
+
+      if (client->closed)
+        g_ptr_array_remove_index_fast (relay->clients, i);
+      else
+        i++;
+    }
+}
+
+static void
+handle_client (Client  *client,
+               guint32  events)
+{
+  ssize_t count;
+
+  if (events & EPOLLOUT)
+    {
+      client->blocked = FALSE;
+      client_flush (client);
+
+      if (!client->blocked)
+        client_update_events (client);
+    }
+
+  if (client->closed || !(events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+    return;
+
+  count = cts_client_read (client->commands);
+
+  if (count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR))
+    client_close (client);
+}
+
+/* Ask for every frame kept, on connecting and on a configuration change */
+static void
+upstream_refresh (Upstream *upstream)
+{
+  for (guint i = 0; i < N_CACHED; i++)
+    cts_client_send_command (upstream->client, cached_commands[i]);
+
+  upstream->refresh_time = g_get_monotonic_time () + REFRESH_INTERVAL;
+  upstream->refreshes++;
+}
+
+static void
+upstream_disconnect (Upstream *upstream)
+{
+  int fd = cts_client_get_fd (upstream->client);
+
+  if (fd >= 0)
+    epoll_ctl (upstream->relay->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+  cts_client_close (upstream->client);
+  upstream->state = UPSTREAM_DISCONNECTED;
+  upstream->retry_time = g_get_monotonic_time () + RETRY_INTERVAL;
+}
+
+static void
+upstream_frame_cb (CtsClient  *client,
+                   const byte *frame,
+                   uint16_t    size,
+                   void        *user_data)
+{
+  Upstream *upstream = user_data;
+  Relay *relay = upstream->relay;
+  Cached cached;
+
+  switch (frame[1] & 0x70)
+    {
+    case CTS_TYPE_CONFIG1 & 0x70:
+      cached = CACHED_CONFIG1;
+      break;
+
+    case CTS_TYPE_CONFIG2 & 0x70:
+      cached = CACHED_CONFIG2;
+      break;
+
+    case CTS_TYPE_CONFIG3 & 0x70:
+      cached = CACHED_CONFIG3;
+      break;
+
+    case CTS_TYPE_HEADER & 0x70:
+      cached = CACHED_HEADER;
+      break;
+
+    default:
+      return;
+    }
+
+  g_clear_pointer (&upstream->cached[cached], g_bytes_unref);
+  upstream->cached[cached] = g_bytes_new (frame, size);
+
+  for (guint i = 0; i < relay->clients->len; i++)
+    {
+      Client *c = g_ptr_array_index (relay->clients, i);
+
+      if (c->upstream == upstream && (c->wanted & (1 << cached)))
+        client_send_cached (c, cached);
+    }
+}
+
+static void
+upstream_config_cb (CtsClient *client,
+                    CtsConf   *config,
+                    byte       type,
+                    void      *user_data)
+{
+  Upstream *upstream = user_data;
+
+  if (type != CTS_TYPE_CONFIG1 && upstream->state == UPSTREAM_CONFIGURING)
+    {
+      cts_client_send_command (client, CTS_COMMAND_DATA_ON);
+      upstream->state = UPSTREAM_RUNNING;
+    }
+}
+
+static void
+upstream_data_cb (CtsClient         *client,
+                  const CtsDataView *view,
+                  void              *user_data)
+{
+  Upstream *upstream = user_data;
+  Relay *relay = upstream->relay;
+  guint16 size = cts_data_layout_get_frame_size (view->layout);
+  guint16 num_pmu = cts_data_layout_get_num_of_pmu (view->layout);
+  gsize position = upstream->head % relay->ring_size;
+  gsize first = MIN (size, relay->ring_size - position);
+
+  memcpy (upstream->ring + position, view->frame, first);
+  memcpy (upstream->ring, view->frame + first, size - first);
+  upstream->head += size;
+  upstream->frames++;
+
+  for (guint16 i = 1; i <= num_pmu; i++)
+    if (BIT_IS_SET (cts_data_view_get_stat_of_pmu (view, i), STAT_CONFIG_CHANGE_BIT) &&
+        g_get_monotonic_time () >= upstream->refresh_time)
+      upstream_refresh (upstream);
+
+  for (guint i = 0; i < relay->clients->len; i++)
+    {
+      Client *c = g_ptr_array_index (relay->clients, i);
+
+      if (c->upstream == upstream && c->data_on)
+        client_flush (c);
+    }
+}
+
+static void
+upstream_connect (Upstream *upstream)
+{
+  struct addrinfo hints = { 0 };
+  struct addrinfo *result;
+  struct epoll_event event = { 0 };
+  int fd, status;
+
+  upstream->retry_time = g_get_monotonic_time () + RETRY_INTERVAL;
+
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  if (getaddrinfo (upstream->host, upstream->port, &hints, &result) != 0)
+    return;
+
+  fd = socket (result->ai_family, result->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+               result->ai_protocol);
+
+  if (fd < 0)
+    {
+      freeaddrinfo (result);
+      return;
+    }
+
+  status = connect (fd, result->ai_addr, result->ai_addrlen);
+  freeaddrinfo (result);
+
+  if (status < 0 && errno != EINPROGRESS)
+    {
+      close (fd);
+      return;
+    }
+
+  cts_client_set_fd (upstream->client, fd, CTS_TRANSPORT_TCP);
+  upstream->state = UPSTREAM_CONNECTING;
+
+  event.events = EPOLLIN | EPOLLOUT;
+  event.data.ptr = upstream;
+  epoll_ctl (upstream->relay->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+static void
+upstream_connected (Upstream *upstream)
+{
+  struct epoll_event event = { 0 };
+  int fd = cts_client_get_fd (upstream->client);
+  socklen_t length = sizeof (int);
+  int error = 0, one = 1;
+
+  if (getsockopt (fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error)
+    {
+      upstream_disconnect (upstream);
+      return;
+    }
+
+  setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+  event.events = EPOLLIN;
+  event.data.ptr = upstream;
+  epoll_ctl (upstream->relay->epoll_fd, EPOLL_CTL_MOD, fd, &event);
+
+  upstream->state = UPSTREAM_CONFIGURING;
+  upstream->retry_time = g_get_monotonic_time () + RETRY_INTERVAL;
+  upstream_refresh (upstream);
+}
+
+static void
+handle_upstream (Upstream *upstream)
+{
+  ssize_t count;
+
+  if (upstream->state == UPSTREAM_CONNECTING)
+    {
+      upstream_connected (upstream);
+      return;
+    }
+
+  count = cts_client_read (upstream->client);
+
+  if (count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR))
+    upstream_disconnect (upstream);
+}
+
+/* Connections to retry, and configurations to ask again */
+static void
+housekeeping (Relay  *relay,
+              gint64  now)
+{
+  for (guint i = 0; i < relay->upstreams->len; i++)
+    {
+      Upstream *upstream = g_ptr_array_index (relay->upstreams, i);
+
+      if (now < upstream->retry_time)
+        continue;
+
+      if (upstream->state == UPSTREAM_DISCONNECTED)
+        {
+          upstream_connect (upstream);
+        }
+      else if (upstream->state == UPSTREAM_CONNECTING)
+        {
+          upstream_disconnect (upstream);
+        }
+      else if (upstream->state == UPSTREAM_CONFIGURING)
+        {
+          upstream->retry_time = now + RETRY_INTERVAL;
+          cts_client_send_command (upstream->client, CTS_COMMAND_SEND_CONFIG2);
+        }
+    }
+}
+
+static void
+print_stats (Relay *relay)
+{
+  g_printerr ("%u clients, %" G_GUINT64_FORMAT " dropped for falling behind\n",
+              relay->clients->len, relay->overruns);
+
+  for (guint i = 0; i < relay->upstreams->len; i++)
+    {
+      Upstream *upstream = g_ptr_array_index (relay->upstreams, i);
+      guint num_clients = 0;
+
+      for (guint j = 0; j < relay->clients->len; j++)
+        if (((Client *) g_ptr_array_index (relay->clients, j))->upstream == upstream)
+          num_clients++;
+
+      g_printerr ("  %s:%s/%u: %s, %" G_GUINT64_FORMAT " frames, %" G_GUINT64_FORMAT
+                  " refreshes, %u clients\n",
+                  upstream->host, upstream->port, upstream->id_code,
+                  upstream->state == UPSTREAM_RUNNING ? "running" :
+                  upstream->state == UPSTREAM_DISCONNECTED ? "disconnected" : "connecting",
+                  upstream->frames, upstream->refreshes, num_clients);
+    }
+}
+
+/* HOST:PORT/ID, HOST may be an IPv6 address in brackets */
+static Upstream *
+upstream_new (Relay       *relay,
+              const gchar *argument)
+{
+  CtsClientHandlers handlers = {
+    .frame = upstream_frame_cb,
+    .config = upstream_config_cb,
+    .data = upstream_data_cb,
+  };
+  g_autofree gchar *address = NULL;
+  const gchar *slash, *colon;
+  guint64 id = 0;
+  Upstream *upstream;
+
+  slash = strrchr (argument, '/');
+
+  if (slash == NULL || !g_ascii_string_to_unsigned (slash + 1, 10, 1, G_MAXUINT16, &id, NULL))
+    return NULL;
+
+  address = g_strndup (argument, slash - argument);
+  colon = strrchr (address, ':');
+
+  if (colon == NULL || colon == address || colon[1] == '\0' || find_upstream (relay, id))
+    return NULL;
+
+  upstream = g_new0 (Upstream, 1);
+  upstream->kind = WATCH_UPSTREAM;
+  upstream->relay = relay;
+  upstream->id_code = id;
+  upstream->port = g_strdup (colon + 1);
+  upstream->ring = g_malloc (relay->ring_size);
+
+  if (address[0] == '[' && colon[-1] == ']')
+    upstream->host = g_strndup (address + 1, colon - address - 2);
+  else
+    upstream->host = g_strndup (address, colon - address);
+
+  upstream->client = cts_client_new (id);
+  cts_client_set_handlers (upstream->client, &handlers, upstream);
+
+  return upstream;
+}
+
+static int
+listen_on (int port_number)
+{
+  struct sockaddr_in6 address = { 0 };
+  int fd, one = 1;
+
+  fd = socket (AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if (fd < 0)
+    return -1;
+
+  setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
+  address.sin6_family = AF_INET6;
+  address.sin6_addr = in6addr_any;
+  address.sin6_port = htons (port_number);
+
+  if (bind (fd, (struct sockaddr *) &address, sizeof address) < 0 ||
+      listen (fd, 64) < 0)
+    {
+      close (fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  struct epoll_event events[64];
+  struct epoll_event event = { 0 };
+  gint64 next_housekeeping, next_stats;
+  Relay relay = { 0 };
+
+  context = g_option_context_new ("HOST:PORT/ID…");
+  g_option_context_set_summary (context, "Serve PMUs to many clients over a single connection each");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  /* At least two of the largest frames */
+  if (argc < 2 || buffer_kib < 128 || buffer_kib > 1024 * 1024)
+    {
+      g_printerr ("%s", g_option_context_get_help (context, TRUE, NULL));
+      return EXIT_FAILURE;
+    }
+
+  relay.ring_size = (gsize) buffer_kib * 1024;
+  relay.listener = WATCH_LISTENER;
+  relay.upstreams = g_ptr_array_new ();
+  relay.clients = g_ptr_array_new_with_free_func ((GDestroyNotify) client_free);
+  relay.epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+  relay.listen_fd = listen_on (port);
+
+  if (relay.epoll_fd < 0 || relay.listen_fd < 0)
+    {
+      g_printerr ("Can't listen on port %d: %s\n", port, g_strerror (errno));
+      return EXIT_FAILURE;
+    }
+
+  event.events = EPOLLIN;
+  event.data.ptr = &relay.listener;
+  epoll_ctl (relay.epoll_fd, EPOLL_CTL_ADD, relay.listen_fd, &event);
+
+  for (int i = 1; i < argc; i++)
+    {
+      Upstream *upstream = upstream_new (&relay, argv[i]);
+
+      if (upstream == NULL)
+        {
+          g_printerr ("Invalid or repeated PMU '%s', expected HOST:PORT/ID\n", argv[i]);
+          return EXIT_FAILURE;
+        }
+
+      g_ptr_array_add (relay.upstreams, upstream);
+      upstream_connect (upstream);
+    }
+
+  next_housekeeping = g_get_monotonic_time () + G_USEC_PER_SEC;
+  next_stats = g_get_monotonic_time () + STATS_INTERVAL;
+
+  for (;;)
+    {
+      gint64 monotonic;
+      int count;
+
+      count = epoll_wait (relay.epoll_fd, events, G_N_ELEMENTS (events), 1000);
+
+      if (count < 0 && errno != EINTR)
+        {
+          g_printerr ("epoll: %s\n", g_strerror (errno));
+          return EXIT_FAILURE;
+        }
+
+      for (int i = 0; i < count; i++)
+        {
+          WatchKind *kind = events[i].data.ptr;
+
+          if (*kind == WATCH_LISTENER)
+            accept_client (&relay);
+          else if (*kind == WATCH_UPSTREAM)
+            handle_upstream ((Upstream *) kind);
+          else
+            handle_client ((Client *) kind, events[i].events);
+        }
+
+      sweep_clients (&relay);
+
+      monotonic = g_get_monotonic_time ();
+
+      if (monotonic >= next_housekeeping)
+        {
+          housekeeping (&relay, monotonic);
+          next_housekeeping = monotonic + G_USEC_PER_SEC;
+        }
+
+      if (verbose && monotonic >= next_stats)
+        {
+          print_stats (&relay);
+          next_stats = monotonic + STATS_INTERVAL;
+        }
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,197 @@
+/* pmu-rt.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "pmu-rt.h"
+
+static gboolean memory_locked = FALSE;
+
+G_LOCK_DEFINE_STATIC (memory_locked);
+
+/**
+ * pmu_rt_lock_memory:
+ *
+ * Lock every current and future page of the process into RAM, so that
+ * the acquisition and server threads never take a major page fault.
+ * Calling this more than once is harmless.
+ *
+ * Returns: %TRUE if memory is locked.
+ */
+gboolean
+pmu_rt_lock_memory (void)
+{
+  G_LOCK (memory_locked);
+
+  if (!memory_locked)
+    {
+      if (mlockall (MCL_CURRENT | MCL_FUTURE) == 0)
+        {
+          memory_locked = TRUE;
+          g_message ("rt: memory locked (mlockall)");
+        }
+      else
+        g_message ("rt: memory not locked: %s", g_strerror (errno));
+    }
+
+  G_UNLOCK (memory_locked);
+
+  return memory_locked;
+}
+
+/**
+ * pmu_rt_prefault:
+ * @mem: memory to be touched
+ * @size: size of @mem in bytes
+ *
+ * Write to every page of @mem, so that the pages are mapped
+ * (and locked, if pmu_rt_lock_memory() succeeded) before the
+ * hot path ever uses them.
+ */
+void
+pmu_rt_prefault (gpointer mem,
+                 gsize    size)
+{
+  volatile guchar *data = mem;
+  gsize page_size;
+
+  if (mem == NULL)
+    return;
+
+  page_size = sysconf (_SC_PAGESIZE);
+
+  for (gsize i = 0; i < size; i += page_size)
+    data[i] = data[i];
+
+  if (size)
+    data[size - 1] = data[size - 1];
+}
+
+static void
+prefault_stack (void)
+{
+  volatile guchar stack[PMU_RT_STACK_PREFAULT_SIZE];
+
+  memset ((guchar *)stack, 0, sizeof stack);
+}
+
+/**
+ * pmu_rt_setup_thread:
+ * @name: name of the thread, used only for the report
+ * @priority: SCHED_FIFO priority (1 to 99). 0 keeps SCHED_OTHER
+ * @cpu: the CPU the calling thread should be pinned to, or -1
+ *
+ * Apply the real-time policy to the calling thread and prefault its
+ * stack. What was (and was not) applied is logged, so that the startup
+ * log tells whether the box is configured for bounded latency.
+ *
+ * Returns: %TRUE if everything requested was applied.
+ */
+gboolean
+pmu_rt_setup_thread (const gchar *name,
+                     gint         priority,
+                     gint         cpu)
+{
+  g_autofree gchar *sched_report = NULL;
+  g_autofree gchar *cpu_report = NULL;
+  gboolean success = TRUE;
+  int ret;
+
+  if (priority > 0)
+    {
+      struct sched_param param = { 0 };
+
+      param.sched_priority = CLAMP (priority,
+                                    sched_get_priority_min (SCHED_FIFO),
+                                    sched_get_priority_max (SCHED_FIFO));
+      ret = pthread_setschedparam (pthread_self (), SCHED_FIFO, &param);
+
+      if (ret == 0)
+        sched_report = g_strdup_printf ("SCHED_FIFO %d", param.sched_priority);
+      else
+        {
+          sched_report = g_strdup_printf ("SCHED_FIFO %d failed (%s)",
+                                          param.sched_priority,
+                                          g_strerror (ret));
+          success = FALSE;
+        }
+    }
+  else
+    sched_report = g_strdup ("SCHED_OTHER");
+
+  if (cpu >= 0)
+    {
+      cpu_set_t cpu_set;
+
+      CPU_ZERO (&cpu_set);
+      CPU_SET (cpu, &cpu_set);
+      ret = pthread_setaffinity_np (pthread_self (), sizeof cpu_set, &cpu_set);
+
+      if (ret == 0)
+        cpu_report = g_strdup_printf ("CPU %d", cpu);
+      else
+        {
+          cpu_report = g_strdup_printf ("CPU %d failed (%s)",
+                                        cpu, g_strerror (ret));
+          success = FALSE;
+        }
+    }
+  else
+    cpu_report = g_strdup ("any CPU");
+
+  prefault_stack ();
+
+  g_message ("rt: %s thread: %s, %s, %d KiB stack prefaulted%s",
+             name, sched_report, cpu_report,
+             PMU_RT_STACK_PREFAULT_SIZE / 1024,
+             memory_locked ? ", memory locked" : "");
+
+  return success;
+}
+
+/**
+ * pmu_rt_reset_thread:
+ *
+ * Put the calling thread back to SCHED_OTHER on any CPU. Used by
+ * threads borrowed from a thread pool, so that the pool doesn't
+ * keep real-time threads around once the work is over.
+ */
+void
+pmu_rt_reset_thread (void)
+{
+  struct sched_param param = { 0 };
+  cpu_set_t cpu_set;
+  long num_cpu;
+
+  pthread_setschedparam (pthread_self (), SCHED_OTHER, &param);
+
+  num_cpu = sysconf (_SC_NPROCESSORS_CONF);
+  CPU_ZERO (&cpu_set);
+
+  for (long i = 0; i < num_cpu && i < CPU_SETSIZE; i++)
+    CPU_SET (i, &cpu_set);
+
+  pthread_setaffinity_np (pthread_self (), sizeof cpu_set, &cpu_set);
+}
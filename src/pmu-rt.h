@@ -0,0 +1,36 @@
+/* pmu-rt.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Amount of stack touched by each real-time thread before it starts */
+#define PMU_RT_STACK_PREFAULT_SIZE (128 * 1024)
+
+gboolean pmu_rt_lock_memory   (void);
+gboolean pmu_rt_setup_thread  (const gchar *name,
+                               gint         priority,
+                               gint         cpu);
+void     pmu_rt_reset_thread  (void);
+void     pmu_rt_prefault      (gpointer     mem,
+                               gsize        size);
+
+G_END_DECLS
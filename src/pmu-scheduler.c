@@ -0,0 +1,310 @@
+/* pmu-scheduler.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "pmu-scheduler.h"
+
+#define NSEC_PER_SEC G_GINT64_CONSTANT (1000000000)
+
+/*
+ * Schedules the reporting instants of data frames.
+ *
+ * The instants are on the grid defined by the configured DATA_RATE,
+ * phase locked to the UTC second: for a rate of N frames per second,
+ * the k-th frame of every second is at k/N seconds past the second.
+ * For negative rates (-N seconds per frame) the frames are at every
+ * second which is a multiple of N.
+ *
+ * Every deadline is derived from the second and the slot index, never
+ * by adding periods, so errors can't accumulate.
+ *
+ * The grid is of the clock selected with cts_common_set_clock_source(),
+ * in UTC, so that the slots are the timestamps the frames go with. A
+ * timer can't be set on CLOCK_TAI or on a PHC, so the wait is on
+ * CLOCK_MONOTONIC for what is left to the deadline on the selected
+ * clock, which is read again on waking up.
+ */
+struct _PmuScheduler
+{
+  int timer_fd;
+
+  /* Written from any thread, applied at the next slot */
+  gint requested_rate;
+
+  gint16 data_rate;
+  gint64 next_deadline; /* nanoseconds since epoch, 0 if not armed */
+
+  guint64 slots;
+  guint missed;         /* Also added to by the reader of the slots */
+};
+
+/* UTC in nanoseconds since epoch, of the selected clock, or 0 */
+static gint64
+get_clock_ns (void)
+{
+  CtsTime time;
+
+  cts_common_get_timestamp (&time);
+
+  return time.soc * NSEC_PER_SEC + time.nanoseconds;
+}
+
+/* Returns the first slot strictly after @time (in nanoseconds) */
+static gint64
+get_next_slot (gint16 data_rate,
+               gint64 time)
+{
+  gint64 seconds, nanoseconds, slot;
+
+  seconds = time / NSEC_PER_SEC;
+  nanoseconds = time % NSEC_PER_SEC;
+
+  if (data_rate < 0)
+    {
+      gint64 period = -data_rate;
+
+      return (seconds / period + 1) * period * NSEC_PER_SEC;
+    }
+
+  /* A rate of 0 is invalid, fallback to a frame per second */
+  if (data_rate == 0)
+    data_rate = 1;
+
+  slot = nanoseconds * data_rate / NSEC_PER_SEC;
+
+  while (slot < data_rate && slot * NSEC_PER_SEC / data_rate <= nanoseconds)
+    slot++;
+
+  if (slot >= data_rate)
+    return (seconds + 1) * NSEC_PER_SEC;
+
+  return seconds * NSEC_PER_SEC + slot * NSEC_PER_SEC / data_rate;
+}
+
+/**
+ * pmu_scheduler_new:
+ * @data_rate: The DATA_RATE as in configuration frame
+ *
+ * Create a new scheduler that paces frames at @data_rate.
+ * See cts_conf_set_data_rate() for the meaning of @data_rate.
+ *
+ * Returns: (transfer full) (nullable): a new #PmuScheduler, or %NULL
+ * if a timer can't be created. Free with pmu_scheduler_free().
+ */
+PmuScheduler *
+pmu_scheduler_new (gint16 data_rate)
+{
+  PmuScheduler *self;
+  int fd;
+
+  fd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC);
+
+  if (fd == -1)
+    {
+      g_warning ("Creating timer failed: %s", g_strerror (errno));
+      return NULL;
+    }
+
+  self = g_new0 (PmuScheduler, 1);
+  self->timer_fd = fd;
+  self->data_rate = data_rate;
+  self->requested_rate = data_rate;
+
+  return self;
+}
+
+void
+pmu_scheduler_free (PmuScheduler *self)
+{
+  if (self == NULL)
+    return;
+
+  close (self->timer_fd);
+  g_free (self);
+}
+
+/**
+ * pmu_scheduler_set_data_rate:
+ * @self: A #PmuScheduler
+ * @data_rate: The new DATA_RATE
+ *
+ * Change the rate of frames. This can be called from any thread.
+ * The new rate is used from the next slot onwards.
+ */
+void
+pmu_scheduler_set_data_rate (PmuScheduler *self,
+                             gint16        data_rate)
+{
+  g_atomic_int_set (&self->requested_rate, data_rate);
+}
+
+gint16
+pmu_scheduler_get_data_rate (PmuScheduler *self)
+{
+  return g_atomic_int_get (&self->requested_rate);
+}
+
+/**
+ * pmu_scheduler_get_period:
+ * @self: A #PmuScheduler
+ *
+ * Returns: The time between two frames, in nanoseconds.
+ */
+gint64
+pmu_scheduler_get_period (PmuScheduler *self)
+{
+  gint16 data_rate = pmu_scheduler_get_data_rate (self);
+
+  if (data_rate < 0)
+    return -data_rate * NSEC_PER_SEC;
+
+  return NSEC_PER_SEC / MAX (data_rate, 1);
+}
+
+/* Sleep for @duration nanoseconds of CLOCK_MONOTONIC */
+static gboolean
+sleep_for (PmuScheduler *self,
+           gint64        duration)
+{
+  struct itimerspec spec = { 0 };
+  guint64 expirations;
+  ssize_t size;
+
+  spec.it_value.tv_sec = duration / NSEC_PER_SEC;
+  spec.it_value.tv_nsec = duration % NSEC_PER_SEC;
+
+  if (timerfd_settime (self->timer_fd, 0, &spec, NULL) != 0)
+    return FALSE;
+
+  do
+    size = read (self->timer_fd, &expirations, sizeof expirations);
+  while (size == -1 && errno == EINTR);
+
+  return size != -1;
+}
+
+/**
+ * pmu_scheduler_wait:
+ * @self: A #PmuScheduler
+ * @slot_time: (out): The time of the slot
+ *
+ * Block until the next reporting instant. @slot_time is set to the
+ * instant of the slot (which is exactly on the reporting grid), with
+ * the time quality of the clock in use.
+ *
+ * If the caller was too late, and one or more slots have already
+ * passed, the latest passed slot is returned, and the skipped slots
+ * are accounted as missed.
+ *
+ * Returns: %TRUE if a slot was reached, %FALSE on error.
+ */
+gboolean
+pmu_scheduler_wait (PmuScheduler *self,
+                    CtsTime      *slot_time)
+{
+  gint16 data_rate;
+  gint64 slot, next, now;
+
+  data_rate = g_atomic_int_get (&self->requested_rate);
+  now = get_clock_ns ();
+
+  if (now == 0)
+    return FALSE;
+
+  /*
+   * The next deadline is never more than a period away, unless the
+   * clock was stepped back: get back on the grid then.
+   */
+  if (data_rate != self->data_rate || self->next_deadline == 0 ||
+      self->next_deadline - now > pmu_scheduler_get_period (self))
+    {
+      self->data_rate = data_rate;
+      self->next_deadline = get_next_slot (data_rate, now);
+    }
+
+  /* The selected clock and CLOCK_MONOTONIC may not run at the same rate */
+  while (now < self->next_deadline)
+    {
+      if (!sleep_for (self, self->next_deadline - now))
+        return FALSE;
+
+      now = get_clock_ns ();
+    }
+
+  slot = self->next_deadline;
+
+  /* Skip to the latest passed slot if we woke up too late */
+  for (next = get_next_slot (data_rate, slot);
+       next <= now;
+       next = get_next_slot (data_rate, slot))
+    {
+      slot = next;
+      g_atomic_int_inc (&self->missed);
+    }
+
+  self->next_deadline = next;
+  self->slots++;
+
+  cts_common_get_timestamp (slot_time);
+  slot_time->soc = slot / NSEC_PER_SEC;
+  slot_time->nanoseconds = slot % NSEC_PER_SEC;
+
+  return TRUE;
+}
+
+/**
+ * pmu_scheduler_add_missed:
+ * @self: A #PmuScheduler
+ * @count: Number of slots to add
+ *
+ * Account @count slots as missed, for example if the data
+ * wasn't ready in time for the slot.
+ */
+void
+pmu_scheduler_add_missed (PmuScheduler *self,
+                          guint         count)
+{
+  g_atomic_int_add (&self->missed, count);
+}
+
+/**
+ * pmu_scheduler_get_missed:
+ * @self: A #PmuScheduler
+ *
+ * Returns: The number of slots missed so far.
+ */
+guint
+pmu_scheduler_get_missed (PmuScheduler *self)
+{
+  return g_atomic_int_get (&self->missed);
+}
+
+/**
+ * pmu_scheduler_get_slots:
+ * @self: A #PmuScheduler
+ *
+ * Returns: The number of slots reached so far.
+ */
+guint64
+pmu_scheduler_get_slots (PmuScheduler *self)
+{
+  return self->slots;
+}
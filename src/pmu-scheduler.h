@@ -0,0 +1,44 @@
+/* pmu-scheduler.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "c37/c37.h"
+
+G_BEGIN_DECLS
+
+typedef struct _PmuScheduler PmuScheduler;
+
+PmuScheduler *pmu_scheduler_new           (gint16        data_rate);
+void          pmu_scheduler_free          (PmuScheduler *self);
+void          pmu_scheduler_set_data_rate (PmuScheduler *self,
+                                           gint16        data_rate);
+gint16        pmu_scheduler_get_data_rate (PmuScheduler *self);
+gint64        pmu_scheduler_get_period    (PmuScheduler *self);
+gboolean      pmu_scheduler_wait          (PmuScheduler *self,
+                                           CtsTime      *slot_time);
+void          pmu_scheduler_add_missed    (PmuScheduler *self,
+                                           guint         count);
+guint         pmu_scheduler_get_missed    (PmuScheduler *self);
+guint64       pmu_scheduler_get_slots     (PmuScheduler *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PmuScheduler, pmu_scheduler_free)
+
+G_END_DECLS
@@ -0,0 +1,161 @@
+/* pmu-sequence.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dsp/dsp.h"
+
+#include "pmu-sequence.h"
+
+/*
+ * Fills the positive sequence phasors "V Pos" and "I pos" of every
+ * PMU in a data frame from the phase phasors, following the channel
+ * layout of pmu-config.h:
+ *
+ *   1 - 3: VR, VY, VB    4 - 6: IR, IY, IB    7: V Pos    8: I pos
+ *
+ * The voltages of every PMU and then the currents of every PMU are
+ * gathered into lanes, so that a frame is a single call of the
+ * kernel, however many PMUs it has.
+ */
+
+#define FIRST_VOLTAGE  1
+#define FIRST_CURRENT  4
+#define VOLTAGE_PHASOR 7
+#define CURRENT_PHASOR 8
+
+struct _PmuSequence
+{
+  guint capacity;       /* PMUs */
+
+  DspPhasorArray phases[3];
+  DspPhasorArray sequences[3];
+
+  /* The floats of every array above */
+  gfloat *buffer;
+};
+
+PmuSequence *
+pmu_sequence_new (void)
+{
+  return g_new0 (PmuSequence, 1);
+}
+
+void
+pmu_sequence_free (PmuSequence *self)
+{
+  if (self == NULL)
+    return;
+
+  free (self->buffer);
+  g_free (self);
+}
+
+/**
+ * pmu_sequence_reserve:
+ * @self: A #PmuSequence
+ * @num_pmu: The number of PMUs
+ *
+ * Allocate memory for frames of @num_pmu PMUs, so that
+ * pmu_sequence_update_data() doesn't have to.
+ *
+ * Returns: %TRUE on success, %FALSE if out of memory
+ */
+gboolean
+pmu_sequence_reserve (PmuSequence *self,
+                      guint        num_pmu)
+{
+  gsize stride;
+  gfloat *buffer;
+
+  if (num_pmu <= self->capacity)
+    return TRUE;
+
+  /* A voltage and a current lane for each PMU */
+  stride = DSP_NUM_VECTORS (2 * num_pmu) * DSP_LANES;
+  buffer = dsp_calloc_aligned (sizeof (gfloat) * stride * 8);
+
+  if (buffer == NULL)
+    return FALSE;
+
+  free (self->buffer);
+  self->buffer = buffer;
+  self->capacity = num_pmu;
+
+  for (guint i = 0; i < 3; i++)
+    {
+      self->phases[i].real = buffer + stride * (2 * i);
+      self->phases[i].imaginary = buffer + stride * (2 * i + 1);
+    }
+
+  /* Only the positive sequence is needed */
+  memset (self->sequences, 0, sizeof self->sequences);
+  self->sequences[DSP_SEQUENCE_POSITIVE].real = buffer + stride * 6;
+  self->sequences[DSP_SEQUENCE_POSITIVE].imaginary = buffer + stride * 7;
+
+  return TRUE;
+}
+
+/**
+ * pmu_sequence_update_data:
+ * @self: A #PmuSequence
+ * @data: The data frame to update
+ *
+ * Set phasor 7 and 8 of every PMU in @data to the positive sequence
+ * of phasors 1 - 3 and 4 - 6. PMUs with less than 8 phasors are left
+ * as such.
+ */
+void
+pmu_sequence_update_data (PmuSequence *self,
+                          CtsData     *data)
+{
+  CtsConf *config = cts_data_get_conf (data);
+  guint num_pmu = cts_conf_get_num_of_pmu (config);
+  DspPhasorArray *positive = self->sequences + DSP_SEQUENCE_POSITIVE;
+
+  if (!pmu_sequence_reserve (self, num_pmu))
+    return;
+
+  for (guint i = 0; i < num_pmu; i++)
+    for (guint phase = 0; phase < 3; phase++)
+      {
+        DspPhasorArray *array = self->phases + phase;
+
+        /* Missing phasors give zero, and the PMU is skipped below */
+        array->real[i] = array->imaginary[i] = 0;
+        array->real[num_pmu + i] = array->imaginary[num_pmu + i] = 0;
+
+        cts_data_get_phasor_of_pmu (data, i + 1, FIRST_VOLTAGE + phase,
+                                    array->real + i, array->imaginary + i);
+        cts_data_get_phasor_of_pmu (data, i + 1, FIRST_CURRENT + phase,
+                                    array->real + num_pmu + i,
+                                    array->imaginary + num_pmu + i);
+      }
+
+  dsp_seqcomp_process (self->phases, self->sequences, 2 * num_pmu);
+
+  for (guint i = 0; i < num_pmu; i++)
+    {
+      if (cts_conf_get_num_of_phasors_of_pmu (config, i + 1) < CURRENT_PHASOR)
+        continue;
+
+      cts_data_set_phasor_of_pmu (data, i + 1, VOLTAGE_PHASOR,
+                                  positive->real[i], positive->imaginary[i]);
+      cts_data_set_phasor_of_pmu (data, i + 1, CURRENT_PHASOR,
+                                  positive->real[num_pmu + i],
+                                  positive->imaginary[num_pmu + i]);
+    }
+}
@@ -21,6 +21,8 @@
 #include "pmu-window.h"
 #include "pmu-spi.h"
 #include "pmu-details.h"
+#include "pmu-rt.h"
+#include "pmu-trace.h"
 
 #include "pmu-server.h"
 
@@ -46,8 +48,27 @@ typedef struct TcpRequest {
   GBytes *header;
   gsize data_length;
   guint cancellable_id;
+
+  /* The channels the client is subscribed to, NULL for all */
+  CtsSubset *subset;
+  gchar *subset_spec;
+
+  /* The configuration_generation the subset was made of */
+  gint subset_generation;
+
+  /* Of the frames sent, to mark the STAT of their PMUs */
+  CtsDataLayout *frame_layout;
+
+  /* Frames left to send with the configuration change bit */
+  guint config_change_frames;
 } TcpRequest;
 
+/* The sender thread uses the subset of the session */
+G_LOCK_DEFINE_STATIC (subset);
+
+/* Incremented by pmu_server_config_changed() */
+static gint configuration_generation = 0;
+
 TcpRequest *tcp_request = NULL;
 GThread *server_thread = NULL;
 PmuServer *default_server = NULL;
@@ -192,6 +213,12 @@ tcp_request_free (void)
 
   g_clear_object (&tcp_request->cancellable);
 
+  G_LOCK (subset);
+  g_clear_pointer (&tcp_request->subset, cts_subset_free);
+  g_clear_pointer (&tcp_request->subset_spec, g_free);
+  g_clear_pointer (&tcp_request->frame_layout, cts_data_layout_free);
+  G_UNLOCK (subset);
+
   g_bytes_unref (tcp_request->header);
   g_clear_pointer (&tcp_request, g_free);
 }
@@ -208,23 +235,226 @@ cancel_request (gpointer user_data)
   return G_SOURCE_REMOVE;
 }
 
+/* The channels in @spec of the current configuration, or NULL */
+static CtsSubset *
+create_subset (const gchar *spec,
+               gsize        length)
+{
+  CtsSubset *subset;
+
+  subset = cts_subset_new (cts_conf_get_default_config_one ());
+
+  if (subset == NULL)
+    return NULL;
+
+  if (!cts_subset_parse (subset, spec, length) ||
+      cts_subset_get_conf (subset) == NULL)
+    {
+      cts_subset_free (subset);
+      return NULL;
+    }
+
+  pmu_trace (PMU_TRACE_LEVEL_INFO, PMU_TRACE_SUBSET,
+             cts_subset_get_frame_size (subset),
+             cts_data_get_raw_data_size (cts_data_get_default ()), 0);
+
+  return subset;
+}
+
+/* Called with the subset lock held */
+static void
+set_frame_layout (void)
+{
+  CtsConf *conf = cts_conf_get_default_config_one ();
+
+  g_clear_pointer (&tcp_request->frame_layout, cts_data_layout_free);
+
+  if (tcp_request->subset)
+    conf = cts_subset_get_conf (tcp_request->subset);
+
+  if (conf)
+    tcp_request->frame_layout = cts_data_layout_new (conf);
+}
+
+/*
+ * Replace the subset of the session with the channels in @spec, see
+ * cts_subset_parse(). An empty @spec subscribes to all the channels.
+ */
+static gboolean
+set_session_subset (const gchar *spec,
+                    gsize        length)
+{
+  /* Before the subset is made, so a change meanwhile isn't missed */
+  gint generation = g_atomic_int_get (&configuration_generation);
+  CtsSubset *subset = NULL;
+
+  if (length)
+    {
+      subset = create_subset (spec, length);
+
+      if (subset == NULL)
+        return FALSE;
+    }
+
+  G_LOCK (subset);
+  cts_subset_free (tcp_request->subset);
+  g_free (tcp_request->subset_spec);
+  tcp_request->subset = subset;
+  tcp_request->subset_spec = subset ? g_strndup (spec, length) : NULL;
+  tcp_request->subset_generation = generation;
+  tcp_request->config_change_frames = 0;
+  set_frame_layout ();
+  G_UNLOCK (subset);
+
+  return TRUE;
+}
+
+/*
+ * Build the subset of the session again if the configuration changed
+ * since it was made, so that its CFG-2 and frames follow the new one.
+ * If its channels are gone, the session gets every channel instead.
+ * Called with the subset lock held.
+ */
+static void
+update_session_subset (void)
+{
+  gint generation = g_atomic_int_get (&configuration_generation);
+  gint data_rate;
+
+  if (tcp_request == NULL || tcp_request->subset == NULL ||
+      tcp_request->subset_generation == generation)
+    return;
+
+  tcp_request->subset_generation = generation;
+  cts_subset_invalidate (tcp_request->subset);
+
+  /* The PMUs or the number of channels changed, select them again */
+  if (cts_subset_get_conf (tcp_request->subset) == NULL)
+    {
+      CtsSubset *subset = create_subset (tcp_request->subset_spec,
+                                         strlen (tcp_request->subset_spec));
+
+      if (subset == NULL)
+        {
+          g_warning ("Channels %s are gone from the configuration, sending all",
+                     tcp_request->subset_spec);
+          g_clear_pointer (&tcp_request->subset_spec, g_free);
+        }
+
+      cts_subset_free (tcp_request->subset);
+      tcp_request->subset = subset;
+    }
+
+  set_frame_layout ();
+
+  /* Tell the client for a minute, it may read the CFG-2 again */
+  data_rate = cts_conf_get_data_rate (cts_conf_get_default_config_one ());
+  tcp_request->config_change_frames = data_rate > 0 ? 60 * data_rate : 60 / MAX (-data_rate, 1);
+}
+
+/* Called with the subset lock held */
+static void
+mark_config_change (guchar *frame,
+                    gsize   frame_size)
+{
+  guint16 num_pmu = cts_data_layout_get_num_of_pmu (tcp_request->frame_layout);
+  guint16 crc;
+
+  tcp_request->config_change_frames--;
+
+  if (cts_data_layout_get_frame_size (tcp_request->frame_layout) != frame_size)
+    return;
+
+  for (guint16 i = 1; i <= num_pmu; i++)
+    {
+      guint16 offset, size;
+
+      cts_data_layout_get_block_of_pmu (tcp_request->frame_layout, i, &offset, &size);
+      frame[offset] |= 1 << (STAT_CONFIG_CHANGE_BIT - 8);
+    }
+
+  crc = htons (cts_common_calc_crc (frame, frame_size - 2, NULL));
+  memcpy (frame + frame_size - 2, &crc, 2);
+}
+
+/**
+ * pmu_server_config_changed:
+ *
+ * To be called after the default configuration is changed, not when
+ * it is first made. The subset of the session is built again from the
+ * channels it selects, and its data frames have the configuration
+ * change bit of STAT set for a minute. Safe to call from any thread.
+ */
+void
+pmu_server_config_changed (void)
+{
+  g_atomic_int_inc (&configuration_generation);
+}
+
+/*
+ * The subset of a client can be set in the policy file, with the
+ * channels as the value of "channels" in the group of its address:
+ *
+ *   [192.168.1.20]
+ *   channels=1:P7,A13
+ *
+ * The client can change it later with a user defined command.
+ */
+static void
+load_session_subset (GSocketConnection *connection)
+{
+  g_autoptr(GKeyFile) key_file = NULL;
+  g_autoptr(GSocketAddress) address = NULL;
+  g_autofree gchar *path = NULL;
+  g_autofree gchar *client = NULL;
+  g_autofree gchar *spec = NULL;
+
+  address = g_socket_connection_get_remote_address (connection, NULL);
+
+  if (!G_IS_INET_SOCKET_ADDRESS (address))
+    return;
+
+  client = g_inet_address_to_string (
+    g_inet_socket_address_get_address (G_INET_SOCKET_ADDRESS (address)));
+
+  path = g_build_filename (g_get_user_config_dir (), "pmu", "subsets.conf", NULL);
+  key_file = g_key_file_new ();
+
+  if (!g_key_file_load_from_file (key_file, path, G_KEY_FILE_NONE, NULL))
+    return;
+
+  spec = g_key_file_get_string (key_file, client, "channels", NULL);
+
+  if (spec && !set_session_subset (spec, strlen (spec)))
+    g_warning ("Invalid channels for %s in %s", client, path);
+}
+
 void
 handle_data_request (GTask        *task,
                      gpointer      source_object,
                      gpointer      task_data,
                      GCancellable *cancellable)
 {
+  g_autofree guchar *subset_frame = NULL;
   GBytes *bytes;
   GOutputStream *out;
   gsize frame_size, byte_size;
   const guchar *data;
 
+  /* This runs in a thread borrowed from GTask pool, reset on return */
+  pmu_rt_setup_thread ("sender",
+                       pmu_details_get_server_priority (),
+                       pmu_details_get_server_cpu ());
+
+  subset_frame = g_malloc (G_MAXUINT16);
+
   while (1)
     {
       if (!default_server->cancellable || g_cancellable_is_cancelled (default_server->cancellable))
         {
           g_clear_object (&default_server->cancellable);
           g_clear_pointer (&default_server->data_task, g_object_unref);
+          pmu_rt_reset_thread ();
           return;
         }
 
@@ -239,12 +469,47 @@ handle_data_request (GTask        *task,
         }
 
       data = g_bytes_get_data (bytes, &frame_size);
+
+      G_LOCK (subset);
+      update_session_subset ();
+
+      if (tcp_request->subset)
+        {
+          gsize full_size = frame_size;
+
+          frame_size = cts_subset_write_frame (tcp_request->subset, data,
+                                               subset_frame);
+          data = subset_frame;
+
+          /* Not a frame of the configuration the subset was made of */
+          if (frame_size == 0)
+            pmu_trace (PMU_TRACE_LEVEL_WARNING, PMU_TRACE_SUBSET_DROPPED,
+                       full_size, cts_subset_get_frame_size (tcp_request->subset),
+                       cts_bin_get_time_seconds (g_bytes_get_data (bytes, NULL), TRUE));
+        }
+
+      if (frame_size && tcp_request->config_change_frames && tcp_request->frame_layout)
+        {
+          if (data != subset_frame)
+            data = memcpy (subset_frame, data, frame_size);
+
+          mark_config_change (subset_frame, frame_size);
+        }
+      G_UNLOCK (subset);
+
+      if (frame_size == 0)
+        {
+          g_bytes_unref (bytes);
+          continue;
+        }
+
       out = g_io_stream_get_output_stream (G_IO_STREAM (tcp_request->socket_connection));
       g_output_stream_write_all (out, data,
                                  frame_size,
                                  &byte_size, NULL, NULL);
 
-      g_print ("Here at out\n");
+      pmu_trace (PMU_TRACE_LEVEL_DEBUG, PMU_TRACE_FRAME_SENT,
+                 frame_size, byte_size, cts_bin_get_time_seconds (data, TRUE));
       g_bytes_unref (bytes);
       g_usleep (1);
     }
@@ -255,8 +520,10 @@ pmu_server_respond (const guchar *data,
                     gint          command)
 {
   guchar *response = NULL;
+  CtsConf *conf = NULL;
   gsize byte_size;
   gsize frame_size;
+  gsize length;
   GOutputStream *out;
 
   default_spi = pmu_spi_get_default ();
@@ -297,11 +564,27 @@ pmu_server_respond (const guchar *data,
       response = cts_conf_get_raw_data (cts_conf_get_default_config_one (), SYNC_CONFIG_ONE);
       break;
     case CTS_COMMAND_SEND_CONFIG2:
-      response = cts_conf_get_raw_data (cts_conf_get_default_config_one (), SYNC_CONFIG_TWO);
+      G_LOCK (subset);
+      update_session_subset ();
+
+      if (tcp_request->subset)
+        conf = cts_subset_get_conf (tcp_request->subset);
+      if (conf == NULL)
+        conf = cts_conf_get_default_config_one ();
+
+      response = cts_conf_get_raw_data (conf, SYNC_CONFIG_TWO);
+      G_UNLOCK (subset);
+      break;
+    case CTS_COMMAND_USER:
+      /* The channels to subscribe to follow the command word, as text */
+      length = tcp_request->data_length - COMMAND_MINIMUM_FRAME_SIZE;
+      if (!set_session_subset ((const gchar *)data + COMMAND_MINIMUM_FRAME_SIZE -
+                               REQUEST_HEADER_SIZE - 2, length))
+        pmu_trace (PMU_TRACE_LEVEL_WARNING, PMU_TRACE_COMMAND_INVALID,
+                   tcp_request->data_length, CTS_TYPE_COMMAND, command);
       break;
     case CTS_COMMAND_SEND_CONFIG3:
     case CTS_COMMAND_EXTENDED_FRAME:
-    case CTS_COMMAND_USER:
       break;
     }
 
@@ -345,7 +628,8 @@ complete_data_read_next (GInputStream *stream,
    */
   if (g_bytes_get_size (bytes) < REQUEST_HEADER_SIZE)
     {
-      g_print ("Size less than 4 bytes\n");
+      pmu_trace (PMU_TRACE_LEVEL_WARNING, PMU_TRACE_COMMAND_INVALID,
+                 g_bytes_get_size (bytes), 0, 0);
       g_bytes_unref (bytes);
       goto end;
     }
@@ -353,7 +637,8 @@ complete_data_read_next (GInputStream *stream,
   data = g_bytes_get_data (bytes, &size);
   if (cts_common_get_type (data) != CTS_TYPE_COMMAND)
     {
-      g_print ("Not a command\n");
+      pmu_trace (PMU_TRACE_LEVEL_WARNING, PMU_TRACE_COMMAND_INVALID,
+                 size, cts_common_get_type (data), 0);
       g_bytes_unref (bytes);
       goto end;
     }
@@ -365,7 +650,8 @@ complete_data_read_next (GInputStream *stream,
 
   if (size < COMMAND_MINIMUM_FRAME_SIZE)
     {
-      g_print ("size is <= 4 bytes\n");
+      pmu_trace (PMU_TRACE_LEVEL_WARNING, PMU_TRACE_COMMAND_INVALID,
+                 size, CTS_TYPE_COMMAND, 0);
       goto end;
     }
 
@@ -416,23 +702,19 @@ complete_data_read (GInputStream *stream,
     }
   data = g_bytes_get_data (bytes, &size);
 
-  for (int i = 0; i < 4; i++)
-    {
-      g_print ("%02X ", header_data[i]);
-    }
-
-  for (int i = 0; i < real_size - REQUEST_HEADER_SIZE; i++)
+  if (size != (real_size - REQUEST_HEADER_SIZE))
     {
-      g_print ("%02X ", data[i]);
+      pmu_trace (PMU_TRACE_LEVEL_WARNING, PMU_TRACE_COMMAND_INVALID,
+                 size + REQUEST_HEADER_SIZE, CTS_TYPE_COMMAND, 0);
+      g_bytes_unref (bytes);
+      goto out;
     }
-  g_print ("\n");
-
-  g_print ("Size:%d CRC: %X\n", g_bytes_get_size (bytes), cts_common_calc_crc (data, real_size - 2, header_data));
 
-  if (size != (real_size - REQUEST_HEADER_SIZE) ||
-      !cts_common_check_crc (data, real_size - 2, header_data, real_size - REQUEST_HEADER_SIZE - 2))
+  if (!cts_common_check_crc (data, real_size - 2, header_data, real_size - REQUEST_HEADER_SIZE - 2))
     {
-      g_print ("CRC check failed\n");
+      pmu_trace (PMU_TRACE_LEVEL_WARNING, PMU_TRACE_COMMAND_BAD_CRC,
+                 real_size, cts_common_get_crc (data, real_size - REQUEST_HEADER_SIZE - 2),
+                 cts_common_calc_crc (data, real_size - 2, header_data));
       g_bytes_unref (bytes);
       goto out;
     }
@@ -440,11 +722,15 @@ complete_data_read (GInputStream *stream,
   command = cts_bin_get_command_type (data, FALSE);
   if (command == CTS_COMMAND_INVALID)
     {
-      g_print ("Invalid request\n");
+      pmu_trace (PMU_TRACE_LEVEL_WARNING, PMU_TRACE_COMMAND_INVALID,
+                 real_size, CTS_TYPE_COMMAND, command);
       g_bytes_unref (bytes);
       goto out;
     }
 
+  pmu_trace (PMU_TRACE_LEVEL_INFO, PMU_TRACE_COMMAND,
+             command, real_size, cts_common_get_crc (data, real_size - REQUEST_HEADER_SIZE - 2));
+
   pmu_server_respond (data, command);
 
   g_bytes_unref (bytes);
@@ -458,7 +744,7 @@ complete_data_read (GInputStream *stream,
   return;
 
  out:
-  g_print ("Never here\n");
+  pmu_trace (PMU_TRACE_LEVEL_INFO, PMU_TRACE_SESSION_CLOSED, 0, 0, 0);
   tcp_request_free ();
 }
 
@@ -514,6 +800,9 @@ data_incoming_cb (GSocketService    *service,
   tcp_request->cancellable_id =
     g_timeout_add_seconds (10, (GSourceFunc)cancel_request, NULL);
 
+  if (tcp_request->subset == NULL)
+    load_session_subset (connection);
+
   g_input_stream_read_bytes_async (in, data_length - REQUEST_HEADER_SIZE,
                                    G_PRIORITY_DEFAULT,
                                    tcp_request->cancellable,
@@ -619,6 +908,10 @@ pmu_server_new (void)
 
   g_main_context_push_thread_default (server_context);
 
+  pmu_rt_setup_thread ("server",
+                       pmu_details_get_server_priority (),
+                       pmu_details_get_server_cpu ());
+
   default_server = g_object_new (PMU_TYPE_SERVER, NULL);
   default_server->service = NULL;
   default_server->port = pmu_details_get_port_number ();
@@ -35,5 +35,6 @@ GMainContext *pmu_server_get_default_context (void);
 gboolean      pmu_server_start               (gpointer user_data);
 gboolean      pmu_server_stop                (gpointer user_data);
 gboolean      pmu_server_is_running          (void);
+void          pmu_server_config_changed      (void);
 
 G_END_DECLS
@@ -19,7 +19,19 @@
 #include "c37/c37.h"
 #include "pmu-app.h"
 #include "pmu-window.h"
-
+#include "pmu-details.h"
+#include "pmu-rt.h"
+#include "pmu-scheduler.h"
+#include "pmu-estimator.h"
+#include "pmu-sequence.h"
+#include "pmu-power.h"
+#include "pmu-trigger.h"
+#include "pmu-oscillation.h"
+#include "pmu-lse.h"
+#include "pmu-stats.h"
+#include "pmu-trace.h"
+
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
@@ -40,9 +52,47 @@ struct _PmuSpi
   uint8_t bits_per_word;
   uint32_t speed;
 
-  guint update_time; /* in milliseconds */
+  PmuScheduler *scheduler;
+  gint streaming; /* Whether a client has requested data */
+
+  /* Compute V Pos, I pos and the power analogs of every frame */
+  PmuSequence *sequence;
+  PmuPower    *power;
+
+  /* Flags disturbances in STAT and captures the frames around them */
+  PmuTrigger  *trigger;
+
+  /* Flags poorly damped inter-area oscillations, NULL if not watching */
+  PmuOscillation *oscillation;
+
+  /* Bus voltages of the network of the PMUs, NULL if not estimating */
+  PmuLse      *lse;
+
+  /* Statistics of every channel over every interval */
+  PmuStats    *stats;
+
+  /* Set if frames are made up instead of read from the device */
+  gboolean synthetic;
+
+  /* Set if the device sends samples instead of phasors */
+  PmuEstimator *estimator;
+  guint64 next_sample;   /* Index of the next sample to be read */
+  guchar *samples;       /* Receive buffer for samples */
+  guchar *frame;         /* Data frames built from estimated phasors */
 };
 
+/* Frames per second read when no client has requested data */
+#define SPI_IDLE_DATA_RATE 2
+
+/*
+ * In samples mode the device sends every sample of 6 channels,
+ * which needs much more bandwidth than finished phasors.
+ */
+#define SPI_SAMPLES_SPEED (8 * 1000 * 1000) /* Hz */
+
+/* spidev refuses transfers bigger than its bufsiz (4096 by default) */
+#define SPI_MAX_TRANSFER_SIZE 4096
+
 GThread *spi_thread  = NULL;
 PmuSpi  *default_spi = NULL;
 guchar    buffer[2];
@@ -65,11 +115,31 @@ static guint signals[N_SIGNALS] = { 0, };
 
 GQueue *spi_data = NULL;
 
+/* Phasors, frequency and analogs of made up frames, as the device sends */
+static const uint16_t synthetic_values[] = {
+  230, 80, 232, -39, 229, -187,
+  5, 80, 4, -39, 5, -159,
+  231, 150, 15, 140,
+};
+
 G_LOCK_DEFINE (spi_data);
 
 static void
 pmu_spi_finalize (GObject *object)
 {
+  PmuSpi *self = PMU_SPI (object);
+
+  g_clear_pointer (&self->scheduler, pmu_scheduler_free);
+  g_clear_pointer (&self->estimator, pmu_estimator_free);
+  g_clear_pointer (&self->sequence, pmu_sequence_free);
+  g_clear_pointer (&self->power, pmu_power_free);
+  g_clear_pointer (&self->trigger, pmu_trigger_free);
+  g_clear_pointer (&self->oscillation, pmu_oscillation_free);
+  g_clear_pointer (&self->lse, pmu_lse_free);
+  g_clear_pointer (&self->stats, pmu_stats_free);
+  g_clear_pointer (&self->samples, g_free);
+  g_clear_pointer (&self->frame, g_free);
+
   G_OBJECT_CLASS (pmu_spi_parent_class)->finalize (object);
 }
 
@@ -129,7 +199,7 @@ pmu_spi_class_init (PmuSpiClass *klass)
                   G_TYPE_NONE,
                   0);
 
-  signals [START_SPI] =
+  signals [STOP_SPI] =
     g_signal_new ("stop-spi",
                   G_TYPE_FROM_CLASS (klass),
                   G_SIGNAL_RUN_LAST,
@@ -145,8 +215,9 @@ pmu_spi_class_init (PmuSpiClass *klass)
   if (spi_data == NULL)
     spi_data = g_queue_new ();
 
+  /* Samples are read in chunks as big as a transfer can be */
   if (tx == NULL)
-    tx = malloc (data_size + 1);
+    tx = malloc (MAX (data_size + 1, SPI_MAX_TRANSFER_SIZE));
 
   if (rx == NULL)
     rx = malloc (data_size + 1);
@@ -172,108 +243,358 @@ pmu_spi_get_default_context (void)
   return NULL;
 }
 
-guint
-pmu_spi_default_get_update_time (void)
+/**
+ * pmu_spi_get_missed_slots:
+ *
+ * Returns: The number of reporting slots for which no frame was
+ * produced, either because the thread woke up late or because the
+ * device didn't have data ready in time.
+ */
+guint64
+pmu_spi_get_missed_slots (void)
 {
-  if (default_spi)
-    return default_spi->update_time;
+  if (default_spi && default_spi->scheduler)
+    return pmu_scheduler_get_missed (default_spi->scheduler);
 
   return 0;
 }
 
-gboolean
-pmu_spi_default_set_update_time (guint update_time)
+/**
+ * pmu_spi_dup_latest_stats:
+ * @level: The statistics interval, 0 for the shortest
+ *
+ * Returns: (transfer full) (nullable): The statistics of the last
+ * interval that ended, see pmu_stats_dup_latest().
+ */
+PmuStatsRecord *
+pmu_spi_dup_latest_stats (guint level)
 {
-  if (default_spi == NULL)
-    return FALSE;
+  if (default_spi && default_spi->stats &&
+      level < pmu_stats_get_num_intervals (default_spi->stats))
+    return pmu_stats_dup_latest (default_spi->stats, level);
 
-  default_spi->update_time = update_time;
-  return TRUE;
+  return NULL;
 }
 
-static void
-pmu_spi_run (void)
+/**
+ * pmu_spi_dup_latest_estimate:
+ *
+ * Returns: (transfer full) (nullable): The bus voltages estimated
+ * from the last frame, see pmu_lse_dup_latest().
+ */
+PmuLseEstimate *
+pmu_spi_dup_latest_estimate (void)
+{
+  if (default_spi && default_spi->lse)
+    return pmu_lse_dup_latest (default_spi->lse);
+
+  return NULL;
+}
+
+static gboolean
+spi_data_is_ready (void)
 {
   int ret;
 
-  while (1)
+  memset (tx, 0xFD, 3);  /* 3 byte Debug test data */
+  memset (rx, 0x00, 3);
+
+  struct spi_ioc_transfer tr =
+    {
+     .tx_buf = (unsigned long)tx,
+     .rx_buf = (unsigned long)rx,
+     .len = 3,
+     .delay_usecs = 1,
+     .speed_hz = default_spi->speed,
+     .bits_per_word = default_spi->bits_per_word,
+    };
+
+  ret = ioctl(default_spi->spi_fd, SPI_IOC_MESSAGE(1), &tr);
+
+  if (ret < 0)
     {
-      memset (tx, 0xFD, 3);  /* 3 byte Debug test data */
-      memset (rx, 0x00, 3);
+      pmu_trace (PMU_TRACE_LEVEL_ERROR, PMU_TRACE_SPI_ERROR, errno, 0, 0);
+      return FALSE;
+    }
+
+  pmu_trace (PMU_TRACE_LEVEL_DEBUG, PMU_TRACE_SPI_POLL, rx[0], rx[1], rx[2]);
+
+  return rx[0] != 0xFF && rx[1] == 0xFF && rx[2] == 0xFF;
+}
+
+/*
+ * Read the samples since the previous slot up to @time, and build a data
+ * frame from phasors estimated over the latest cycle.
+ *
+ * The device sends one row of 16 bit big endian samples of VR, VY, VB,
+ * IR, IY and IB for every sample instant, oldest first, in reply to
+ * 0xFC bytes. As with data frames, the first byte received in each
+ * transfer is to be ignored.
+ */
+static GBytes *
+spi_read_samples (const CtsTime *time)
+{
+  PmuEstimator *estimator = default_spi->estimator;
+  CtsData *data = cts_data_get_default ();
+  guint64 end_sample, first_sample;
+  gsize num_samples, chunk_samples, done = 0;
+  gsize size;
+  int ret;
+
+  end_sample = pmu_estimator_get_sample_index (estimator, time);
+  first_sample = default_spi->next_sample;
+
+  /* On start, or if we are too far behind, a cycle is enough */
+  if (first_sample == 0 || first_sample >= end_sample ||
+      end_sample - first_sample > pmu_estimator_get_max_samples (estimator))
+    first_sample = end_sample - pmu_details_get_samples_per_cycle ();
+
+  num_samples = end_sample - first_sample;
+  chunk_samples = (SPI_MAX_TRANSFER_SIZE - 1) / PMU_ESTIMATOR_ROW_SIZE;
+
+  while (done < num_samples)
+    {
+      gsize count = MIN (chunk_samples, num_samples - done);
+      /* Samples are saved from default_spi->samples + 1 */
+      guchar *rx_buf = default_spi->samples + done * PMU_ESTIMATOR_ROW_SIZE;
+      guchar last_byte = rx_buf[0];
+
+      memset (tx, 0xFC, count * PMU_ESTIMATOR_ROW_SIZE + 1);
 
       struct spi_ioc_transfer tr =
         {
          .tx_buf = (unsigned long)tx,
-         .rx_buf = (unsigned long)rx,
-         .len = 3,
+         .rx_buf = (unsigned long)rx_buf,
+         .len = count * PMU_ESTIMATOR_ROW_SIZE + 1,
          .delay_usecs = 1,
          .speed_hz = default_spi->speed,
          .bits_per_word = default_spi->bits_per_word,
         };
 
-
       ret = ioctl(default_spi->spi_fd, SPI_IOC_MESSAGE(1), &tr);
 
-      g_usleep (10);
+      if (ret < 0)
+        {
+          pmu_trace (PMU_TRACE_LEVEL_ERROR, PMU_TRACE_SPI_ERROR, errno, 0, 0);
+
+          /* The stream has a hole now, start over */
+          default_spi->next_sample = 0;
+          pmu_estimator_reset (estimator);
+          return NULL;
+        }
+
+      /* The junk byte overwrote the last byte of the previous chunk */
+      rx_buf[0] = last_byte;
+      done += count;
+    }
+
+  default_spi->next_sample = end_sample;
+  pmu_estimator_process (estimator, default_spi->samples + 1,
+                         num_samples, first_sample);
+
+  if (!pmu_estimator_update_data (estimator, data))
+    return NULL;
+
+  pmu_sequence_update_data (default_spi->sequence, data);
+  pmu_power_update_data (default_spi->power, data);
+  pmu_trigger_update_data (default_spi->trigger, data);
+
+  if (default_spi->oscillation)
+    pmu_oscillation_update_data (default_spi->oscillation, data);
+
+  cts_data_set_time (data, time);
+
+  if (default_spi->lse)
+    pmu_lse_update_data (default_spi->lse, data);
+
+  pmu_stats_update_data (default_spi->stats, data);
+  size = cts_data_write_raw_data (data, default_spi->frame);
+
+  pmu_trace (PMU_TRACE_LEVEL_DEBUG, PMU_TRACE_SPI_FRAME,
+             size, time->soc, time->nanoseconds);
+
+  return g_bytes_new (default_spi->frame, size);
+}
+
+/*
+ * A data frame from the values read in rx, timestamped at @time, with
+ * everything the host computes filled in.
+ */
+static GBytes *
+spi_finish_frame (const CtsTime *time)
+{
+  CtsData *data = cts_data_get_default ();
+
+  /* The frame belongs to the reporting instant of the slot */
+  cts_data_set_time (data, time);
+
+  /*
+   * The device leaves the sequence phasors and the power to us: Parse
+   * the values, which start after the STAT of the first PMU, and write
+   * the frame again with them.
+   */
+  if (cts_data_get_raw_data_size (data) == data_size)
+    {
+      cts_data_populate_from_raw_data (data, rx + 1 + DATA_COMMON_SIZE, TRUE);
+      pmu_sequence_update_data (default_spi->sequence, data);
+      pmu_power_update_data (default_spi->power, data);
+      pmu_trigger_update_data (default_spi->trigger, data);
+      if (default_spi->oscillation)
+        pmu_oscillation_update_data (default_spi->oscillation, data);
+      if (default_spi->lse)
+        pmu_lse_update_data (default_spi->lse, data);
+      pmu_stats_update_data (default_spi->stats, data);
+      cts_data_write_raw_data (data, rx + 1);
+    }
+  else
+    cts_data_update_raw_data (data, rx + 1);
+
+  pmu_trace (PMU_TRACE_LEVEL_DEBUG, PMU_TRACE_SPI_FRAME,
+             data_size, time->soc, time->nanoseconds);
+
+  return g_bytes_new (rx + 1, data_size);
+}
+
+/* Read a data frame, as sent by the device */
+static GBytes *
+spi_read_frame (const CtsTime *time)
+{
+  int ret;
+
+  memset (tx, 0xFE, data_size - DATA_COMMON_SIZE + 1);
+  memset (rx, 0x00, 3);         /* Clear debug data */
+
+  struct spi_ioc_transfer tr =
+    {
+     .tx_buf = (unsigned long)tx,
+     /*
+      * DATA_COMMON_SIZE includes 2 bytes CRC, which is at the end of
+      * the data frame (so we don't need to skip that), and the PMU
+      * have 2 bytes STAT which is not included in DATA_COMMON_SIZE
+      * (which we have to skip). So in total, the offset will be
+      * rx + DATA_COMMON_SIZE - 2 + 2 == rx + DATA_COMMON_SIZE
+      */
+     .rx_buf = (unsigned long)rx + DATA_COMMON_SIZE,
+     /*
+      * We also need to avoid 2 byte STAT here
+      */
+     .len = data_size - DATA_COMMON_SIZE - 2 + 1,
+     .delay_usecs = 1,
+     .speed_hz = default_spi->speed,
+     .bits_per_word = default_spi->bits_per_word,
+    };
+
+  ret = ioctl(default_spi->spi_fd, SPI_IOC_MESSAGE(1), &tr);
+
+  if (ret < 0)
+    {
+      pmu_trace (PMU_TRACE_LEVEL_ERROR, PMU_TRACE_SPI_ERROR, errno, 0, 0);
+      return NULL;
+    }
+
+  return spi_finish_frame (time);
+}
 
-      g_print ("rx data: %02X %02X %02X\n", rx[0], rx[1], rx[2]);
-      if (rx[0] != 0xFF && rx[1] == 0xFF && rx[2] == 0xFF)
+/*
+ * Make up a data frame of synthetic_values, in place of reading one.
+ * Everything after is as for a frame read, so that the time the rest
+ * of the path takes can be measured without the device.
+ */
+static GBytes *
+spi_synthesize_frame (const CtsTime *time)
+{
+  guchar *values = rx + 1 + DATA_COMMON_SIZE;
+  gsize size = data_size - DATA_COMMON_SIZE - 2;
+
+  memset (values, 0, size);
+
+  for (guint i = 0; i < G_N_ELEMENTS (synthetic_values) && 2 * i + 2 <= size; i++)
+    {
+      uint16_t value = htons (synthetic_values[i]);
+
+      memcpy (values + 2 * i, &value, 2);
+    }
+
+  return spi_finish_frame (time);
+}
+
+/*
+ * The device may take a little while to get data ready. Give it at
+ * most half the frame period, so that we don't miss the next slot as
+ * well.
+ */
+static gboolean
+spi_wait_data_ready (void)
+{
+  gint64 poll_end;
+
+  poll_end = g_get_monotonic_time () +
+    pmu_scheduler_get_period (default_spi->scheduler) / 2000;
+
+  while (!spi_data_is_ready ())
+    {
+      if (g_get_monotonic_time () >= poll_end)
+        break;
+
+      g_usleep (100);
+    }
+
+  return rx[0] != 0xFF && rx[1] == 0xFF && rx[2] == 0xFF;
+}
+
+static void
+pmu_spi_run (void)
+{
+  CtsTime time;
+  GBytes *data;
+
+  while (1)
+    {
+      if (!pmu_scheduler_wait (default_spi->scheduler, &time))
         {
-          GBytes *data;
-          memset (tx, 0xFE, data_size - DATA_COMMON_SIZE + 1);
-          memset (rx, 0x00, 3);         /* Clear debug data */
-
-          struct spi_ioc_transfer tr =
-            {
-             .tx_buf = (unsigned long)tx,
-             /*
-              * DATA_COMMON_SIZE includes 2 bytes CRC, which is at the end of
-              * the data frame (so we don't need to skip that), and the PMU
-              * have 2 bytes STAT which is not included in DATA_COMMON_SIZE
-              * (which we have to skip). So in total, the offset will be
-              * rx + DATA_COMMON_SIZE - 2 + 2 == rx + DATA_COMMON_SIZE
-              */
-             .rx_buf = (unsigned long)rx + DATA_COMMON_SIZE,
-             /*
-              * We also need to avoid 2 byte STAT here
-              */
-             .len = data_size - DATA_COMMON_SIZE - 2 + 1,
-             .delay_usecs = 1,
-             .speed_hz = default_spi->speed,
-             .bits_per_word = default_spi->bits_per_word,
-            };
-
-          ret = ioctl(default_spi->spi_fd, SPI_IOC_MESSAGE(1), &tr);
-
-          cts_data_update_raw_data (cts_data_get_default (), rx + 1);
-          data = g_bytes_new (rx + 1, data_size);
-
-          for (int i = 1; i < data_size + 1; i++)
-            {
-              g_print ("%02X ", (int) rx[i]);
-            }
-          g_print ("\n");
-          G_LOCK (spi_data);
-          if (spi_data == NULL)
-            spi_data = g_queue_new ();
-
-          if (data != NULL)
-            g_queue_push_tail (spi_data, data);
-
-          if (default_spi->update_time >= 500 &&
-              g_queue_get_length (spi_data) > 1)
-            {
-              data = g_queue_pop_head (spi_data);
-              g_bytes_unref (data);
-            }
-
-          G_UNLOCK (spi_data);
-
-          g_usleep (default_spi->update_time * 1000);
+          g_usleep (1000);
+          continue;
         }
+
+      if (!default_spi->synthetic && !spi_wait_data_ready ())
+        {
+          pmu_scheduler_add_missed (default_spi->scheduler, 1);
+          pmu_trace (PMU_TRACE_LEVEL_WARNING, PMU_TRACE_SPI_MISSED,
+                     time.soc, time.nanoseconds,
+                     pmu_scheduler_get_missed (default_spi->scheduler));
+          continue;
+        }
+
+      if (default_spi->synthetic)
+        data = spi_synthesize_frame (&time);
+      else if (default_spi->estimator)
+        data = spi_read_samples (&time);
       else
-        g_usleep (100);
+        data = spi_read_frame (&time);
+
+      if (data == NULL)
+        {
+          pmu_scheduler_add_missed (default_spi->scheduler, 1);
+          continue;
+        }
 
+      pmu_trigger_push_frame (default_spi->trigger, data);
+
+      G_LOCK (spi_data);
+      if (spi_data == NULL)
+        spi_data = g_queue_new ();
+
+      g_queue_push_tail (spi_data, data);
+
+      /* If nobody is streaming, keep only the latest data for display */
+      if (!g_atomic_int_get (&default_spi->streaming) &&
+          g_queue_get_length (spi_data) > 1)
+        {
+          data = g_queue_pop_head (spi_data);
+          g_bytes_unref (data);
+        }
+
+      G_UNLOCK (spi_data);
     } // while loop
 }
 
@@ -281,6 +602,8 @@ static void
 start_spi_cb (PmuSpi   *self,
               gpointer  user_data)
 {
+  CtsConf *conf;
+
   if (spi_data)
     {
       G_LOCK (spi_data);
@@ -289,7 +612,11 @@ start_spi_cb (PmuSpi   *self,
       G_UNLOCK (spi_data);
     }
 
-  default_spi->update_time = 4;
+  conf = cts_data_get_conf (cts_data_get_default ());
+
+  g_atomic_int_set (&default_spi->streaming, TRUE);
+  pmu_scheduler_set_data_rate (default_spi->scheduler,
+                               cts_conf_get_data_rate (conf));
 }
 
 static void
@@ -304,7 +631,8 @@ stop_spi_cb (PmuSpi   *self,
       G_UNLOCK (spi_data);
     }
 
-  default_spi->update_time = 500;
+  g_atomic_int_set (&default_spi->streaming, FALSE);
+  pmu_scheduler_set_data_rate (default_spi->scheduler, SPI_IDLE_DATA_RATE);
 }
 
 static gboolean
@@ -378,12 +706,15 @@ pmu_spi_setup_device (PmuWindow *window)
 }
 
 static void
-insert_fake_data (uint16_t *fake_data, int length)
+insert_fake_data (const uint16_t *fake_data, int length)
 {
+      CtsTime time;
       int i;
       uint16_t value;
 
+      cts_common_get_timestamp (&time);
       i = DATA_COMMON_SIZE + 1;
+      memset (rx + i, 0, data_size - DATA_COMMON_SIZE);
 
       for (int j = 0; j < length; j++)
         {
@@ -392,6 +723,7 @@ insert_fake_data (uint16_t *fake_data, int length)
           i += 2;
         }
 
+      cts_data_set_time (cts_data_get_default (), &time);
       cts_data_update_raw_data (cts_data_get_default (), rx + 1);
 
       GBytes *data = g_bytes_new (rx + 1, data_size);
@@ -400,6 +732,84 @@ insert_fake_data (uint16_t *fake_data, int length)
       G_UNLOCK (spi_data);
 }
 
+/* Seconds of frames at the configured data rate */
+static guint
+get_frame_count (gdouble seconds)
+{
+  gint data_rate = cts_conf_get_data_rate (cts_conf_get_default_config_one ());
+
+  if (data_rate > 0)
+    return ceil (seconds * data_rate);
+  else if (data_rate < 0)
+    return ceil (seconds / -data_rate);
+
+  return 0;
+}
+
+static PmuTrigger *
+create_trigger (void)
+{
+  DspTriggerLimits limits = { 0 };
+  gdouble magnitude = pmu_details_get_trigger_magnitude ();
+
+  limits.rocof = pmu_details_get_trigger_rocof ();
+  limits.freq_high = pmu_details_get_trigger_frequency ();
+  limits.freq_low = -limits.freq_high;
+  limits.step = pmu_details_get_trigger_step ();
+  limits.digital = pmu_details_get_trigger_digital ();
+
+  if (magnitude > 0)
+    {
+      limits.sag = 1 - magnitude;
+      limits.swell = 1 + magnitude;
+    }
+
+  return pmu_trigger_new (&limits, pmu_details_get_nominal_voltage (),
+                          get_frame_count (pmu_details_get_capture_before ()),
+                          get_frame_count (pmu_details_get_capture_after ()));
+}
+
+static PmuOscillation *
+create_oscillation (void)
+{
+  PmuOscillation *oscillation;
+
+  if (pmu_details_get_oscillation_damping () <= 0)
+    return NULL;
+
+  oscillation = pmu_oscillation_new (cts_conf_get_data_rate (cts_conf_get_default_config_one ()),
+                                     pmu_details_get_nominal_voltage (),
+                                     pmu_details_get_oscillation_freq_low (),
+                                     pmu_details_get_oscillation_freq_high (),
+                                     pmu_details_get_oscillation_damping (),
+                                     pmu_details_get_oscillation_window ());
+  if (oscillation == NULL)
+    g_warning ("Oscillations up to %g Hz can't be watched at this data rate",
+               pmu_details_get_oscillation_freq_high ());
+
+  return oscillation;
+}
+
+static PmuLse *
+create_lse (void)
+{
+  g_autoptr(GError) error = NULL;
+  const gchar *network;
+  PmuLse *lse;
+
+  network = pmu_details_get_lse_network ();
+
+  if (network == NULL)
+    return NULL;
+
+  lse = pmu_lse_new_from_file (network, pmu_details_get_lse_residual (), &error);
+
+  if (lse == NULL)
+    g_warning ("Loading state estimator network failed: %s", error->message);
+
+  return lse;
+}
+
 static void
 pmu_spi_new (PmuWindow *window)
 {
@@ -407,47 +817,113 @@ pmu_spi_new (PmuWindow *window)
   g_autoptr(GMainContext) spi_context = NULL;
   g_autoptr(GMainLoop) spi_loop = NULL;
   gboolean status;
+  guint num_pmu;
 
   spi_context = g_main_context_new ();
   spi_loop = g_main_loop_new(spi_context, FALSE);
 
   g_main_context_push_thread_default (spi_context);
 
+  pmu_rt_setup_thread ("spi",
+                       pmu_details_get_spi_priority (),
+                       pmu_details_get_spi_cpu ());
+
   default_spi = g_object_new (PMU_TYPE_SPI, NULL);
+
+  /* The buffers are used on every transfer, map them right away */
+  pmu_rt_prefault (tx, MAX (data_size + 1, SPI_MAX_TRANSFER_SIZE));
+  pmu_rt_prefault (rx, data_size + 1);
   default_spi->context = spi_context;
-  default_spi->update_time = 5;
+  default_spi->scheduler = pmu_scheduler_new (SPI_IDLE_DATA_RATE);
+  default_spi->sequence = pmu_sequence_new ();
+  default_spi->power = pmu_power_new ();
+  num_pmu = cts_conf_get_num_of_pmu (cts_conf_get_default_config_one ());
+  pmu_sequence_reserve (default_spi->sequence, num_pmu);
+  pmu_power_reserve (default_spi->power, num_pmu);
+  default_spi->trigger = create_trigger ();
+  pmu_trigger_reserve (default_spi->trigger, num_pmu);
+  default_spi->oscillation = create_oscillation ();
+  if (default_spi->oscillation)
+    pmu_oscillation_reserve (default_spi->oscillation, num_pmu);
+  default_spi->lse = create_lse ();
+
+  {
+    const guint *intervals;
+    guint num_intervals;
+
+    intervals = pmu_details_get_stats_intervals (&num_intervals);
+    default_spi->stats = pmu_stats_new (intervals, num_intervals);
+  }
 
   default_spi->bits_per_word = 8;
   default_spi->speed = 100 * 1000; /* Speed in Hz */
 
-  status = pmu_spi_setup_device (window);
-
-  /* Debug */
-  if (!status)
+  if (pmu_details_get_estimate_phasors ())
     {
-      uint16_t data[29];
-
-      memcpy (data, (uint16_t [29]) {
-          230, 80, 232, -39, 229, -187,
-            5, 80, 4, -39, 5, -159,
-            231, 150, 15, 140,
-        }, 29 * sizeof (uint16_t));
+      CtsData *cts_data = cts_data_get_default ();
+      guint samples_per_cycle = pmu_details_get_samples_per_cycle ();
+      guint nominal_freq = pmu_details_get_nominal_freq ();
+      gint data_rate = cts_conf_get_data_rate (cts_data_get_conf (cts_data));
+      /* Enough for the slowest data rate we pace at */
+      gsize max_samples = samples_per_cycle * nominal_freq;
+
+      default_spi->estimator = pmu_estimator_new (samples_per_cycle,
+                                                  nominal_freq,
+                                                  data_rate,
+                                                  pmu_details_get_measurement_class (),
+                                                  max_samples);
+      if (default_spi->estimator)
+        {
+          for (guint i = 0; i < 3; i++)
+            pmu_estimator_set_scale (default_spi->estimator, i,
+                                     pmu_details_get_voltage_scale ());
+          for (guint i = 3; i < 6; i++)
+            pmu_estimator_set_scale (default_spi->estimator, i,
+                                     pmu_details_get_current_scale ());
+
+          if (!pmu_estimator_set_harmonic_order (default_spi->estimator,
+                                                 pmu_details_get_harmonic_order ()))
+            g_warning ("Creating harmonic analysis failed, harmonics won't be updated");
+
+          default_spi->speed = SPI_SAMPLES_SPEED;
+          default_spi->samples = g_malloc (max_samples * PMU_ESTIMATOR_ROW_SIZE + 1);
+          default_spi->frame = g_malloc (cts_data_get_raw_data_size (cts_data));
+          pmu_rt_prefault (default_spi->samples, max_samples * PMU_ESTIMATOR_ROW_SIZE + 1);
+          pmu_rt_prefault (default_spi->frame, cts_data_get_raw_data_size (cts_data));
+
+          g_message ("spi: estimating phasors from %u samples per cycle",
+                     samples_per_cycle);
+        }
+      else
+        g_warning ("Creating phasor estimator failed, expecting phasors from device");
+    }
 
-      insert_fake_data (data, 29);
+  if (pmu_details_get_synthetic_source ())
+    {
+      default_spi->synthetic = TRUE;
+      status = TRUE;
+      g_message ("spi: making up data frames, not using the device");
     }
-  /* Debug end */
+  else
+    status = pmu_spi_setup_device (window);
 
+  /* Debug */
   if (!status)
-    goto out;
+    insert_fake_data (synthetic_values, G_N_ELEMENTS (synthetic_values));
+  /* Debug end */
 
-  pmu_spi_run ();
+  if (!status || default_spi->scheduler == NULL)
+    goto out;
 
+  /* The signals are emitted from other threads, connect before looping */
   g_signal_connect (default_spi, "start-spi",
                     G_CALLBACK (start_spi_cb), window);
 
   g_signal_connect (default_spi, "stop-spi",
                     G_CALLBACK (stop_spi_cb), window);
 
+  pmu_spi_run ();
+
   g_main_loop_run(spi_loop);
 
  out:
@@ -21,6 +21,8 @@
 #include <gtk/gtk.h>
 
 #include "pmu-types.h"
+#include "pmu-stats.h"
+#include "pmu-lse.h"
 
 G_BEGIN_DECLS
 
@@ -36,5 +38,8 @@ gboolean      pmu_spi_stop                (gpointer user_data);
 GQueue       *pmu_spi_get_data            (void);
 GBytes       *pmu_spi_data_get_tail       (void);
 GBytes       *pmu_spi_data_pop_head       (void);
+guint64       pmu_spi_get_missed_slots    (void);
+PmuStatsRecord *pmu_spi_dup_latest_stats  (guint level);
+PmuLseEstimate *pmu_spi_dup_latest_estimate (void);
 
 G_END_DECLS
@@ -0,0 +1,558 @@
+/* pmu-stats.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <glib/gstdio.h>
+
+#include "pmu-trace.h"
+
+#include "pmu-stats.h"
+
+/*
+ * Minimum, maximum, mean, RMS and standard deviation of every channel
+ * of every data frame, over intervals of whole seconds aligned to the
+ * epoch, a minute of 60 seconds starting at the top of every minute
+ * say.
+ *
+ * The channels of every PMU, in the order of its configuration, are:
+ *
+ *   The magnitude of every phasor
+ *   FREQ and DFREQ, in Hz and Hz/s
+ *   Every analog value
+ *
+ * A #DspStats of a lane per channel is updated with every frame. When
+ * the first (shortest) interval ends, its statistics are merged into
+ * each of the longer ones, so a frame costs the same whatever the
+ * number of intervals, and the longer intervals are multiples of the
+ * first. At the end of every interval, a #PmuStatsRecord is kept as
+ * the latest of its interval, and handed to a sink in a thread of its
+ * own. Records are dropped if the sink falls behind.
+ */
+
+/* Records waiting for the sink before new ones are dropped */
+#define MAX_WAITING_RECORDS 16
+
+typedef struct
+{
+  guint interval;
+  DspStats *stats;
+  guint32 start;        /* SOC of the start of the interval */
+  PmuStatsRecord *latest;
+} Level;
+
+struct _PmuStats
+{
+  /* The shortest interval first */
+  Level *levels;
+  guint num_levels;
+
+  /* A lane per channel */
+  guint num_channels;
+  gchar **names;
+  gfloat *values;
+
+  /* The configuration of the channels, and its change counts */
+  CtsConf *config;
+  guint32 config_changes;
+
+  GMutex mutex;         /* For latest */
+
+  GThreadPool *pool;
+  PmuStatsSink sink;
+  gpointer sink_data;
+};
+
+static void
+run_sink (gpointer data,
+          gpointer user_data)
+{
+  PmuStats *self = user_data;
+  PmuStatsRecord *record = data;
+
+  if (self->sink)
+    self->sink (record, self->sink_data);
+
+  pmu_stats_record_free (record);
+}
+
+/**
+ * pmu_stats_new:
+ * @intervals: The intervals, in seconds
+ * @num_intervals: The number of @intervals
+ *
+ * Intervals that are not a multiple of the shortest one are ignored.
+ * Records are saved with pmu_stats_save_record() till another sink is
+ * set.
+ *
+ * Returns: (transfer full): A new #PmuStats. Free with
+ * pmu_stats_free().
+ */
+PmuStats *
+pmu_stats_new (const guint *intervals,
+               guint        num_intervals)
+{
+  PmuStats *self;
+  guint shortest = G_MAXUINT;
+
+  self = g_new0 (PmuStats, 1);
+  self->levels = g_new0 (Level, MAX (num_intervals, 1));
+
+  for (guint i = 0; i < num_intervals; i++)
+    if (intervals[i])
+      shortest = MIN (shortest, intervals[i]);
+
+  if (shortest == G_MAXUINT)
+    shortest = 1;
+
+  self->levels[self->num_levels++].interval = shortest;
+
+  for (guint i = 0; i < num_intervals; i++)
+    {
+      gboolean seen = FALSE;
+
+      if (intervals[i] == 0)
+        continue;
+
+      if (intervals[i] % shortest != 0)
+        {
+          g_warning ("Statistics interval of %u s is not a multiple of %u s, ignoring it",
+                     intervals[i], shortest);
+          continue;
+        }
+
+      for (guint j = 0; j < self->num_levels; j++)
+        seen |= self->levels[j].interval == intervals[i];
+
+      if (!seen)
+        self->levels[self->num_levels++].interval = intervals[i];
+    }
+
+  g_mutex_init (&self->mutex);
+  self->sink = pmu_stats_save_record;
+  self->pool = g_thread_pool_new (run_sink, self, 1, FALSE, NULL);
+
+  return self;
+}
+
+static void
+clear_channels (PmuStats *self)
+{
+  for (guint i = 0; i < self->num_levels; i++)
+    g_clear_pointer (&self->levels[i].stats, dsp_stats_free);
+
+  g_clear_pointer (&self->names, g_strfreev);
+  g_clear_pointer (&self->values, free);
+  self->num_channels = 0;
+}
+
+void
+pmu_stats_free (PmuStats *self)
+{
+  if (self == NULL)
+    return;
+
+  /* Let the sink finish the records given to it */
+  g_thread_pool_free (self->pool, FALSE, TRUE);
+
+  clear_channels (self);
+
+  for (guint i = 0; i < self->num_levels; i++)
+    g_clear_pointer (&self->levels[i].latest, pmu_stats_record_free);
+
+  g_mutex_clear (&self->mutex);
+  g_free (self->levels);
+  g_free (self);
+}
+
+/**
+ * pmu_stats_set_sink:
+ * @self: A #PmuStats
+ * @sink: (nullable): The function to give records to, %NULL to drop
+ * them
+ * @user_data: Data for @sink
+ *
+ * Set before the first frame, as the sink may be running.
+ */
+void
+pmu_stats_set_sink (PmuStats     *self,
+                    PmuStatsSink  sink,
+                    gpointer      user_data)
+{
+  self->sink = sink;
+  self->sink_data = user_data;
+}
+
+/**
+ * pmu_stats_get_num_intervals:
+ * @self: A #PmuStats
+ *
+ * Returns: The number of intervals in use, the levels of
+ * pmu_stats_dup_latest(), shortest first.
+ */
+guint
+pmu_stats_get_num_intervals (PmuStats *self)
+{
+  return self->num_levels;
+}
+
+static guint
+get_num_channels (CtsConf *config)
+{
+  guint num_pmu = cts_conf_get_num_of_pmu (config);
+  guint count = 0;
+
+  for (guint i = 1; i <= num_pmu; i++)
+    count += cts_conf_get_num_of_phasors_of_pmu (config, i) + 2 +
+      cts_conf_get_num_of_analogs_of_pmu (config, i);
+
+  return count;
+}
+
+/* Changes if the change count of any PMU does */
+static guint32
+get_config_changes (CtsConf *config)
+{
+  guint num_pmu = cts_conf_get_num_of_pmu (config);
+  guint32 changes = 0;
+
+  for (guint i = 1; i <= num_pmu; i++)
+    changes += cts_conf_get_change_count_of_pmu (config, i);
+
+  return changes;
+}
+
+static gchar *
+get_channel_name (CtsConf     *config,
+                  guint        pmu_index,
+                  const gchar *channel)
+{
+  g_autofree gchar *station = NULL;
+  g_autofree gchar *name = NULL;
+
+  station = g_strndup (cts_conf_get_station_name_of_pmu (config, pmu_index), 16);
+  name = g_strndup (channel, 16);
+
+  return g_strdup_printf ("%s/%s", g_strstrip (station), g_strstrip (name));
+}
+
+/* Set up the channels of @config, the first frame or a new one */
+static gboolean
+setup_channels (PmuStats *self,
+                CtsConf  *config)
+{
+  guint num_pmu = cts_conf_get_num_of_pmu (config);
+  guint num_channels = get_num_channels (config);
+  guint n = 0;
+
+  clear_channels (self);
+
+  self->values = dsp_calloc_aligned (sizeof (gfloat) *
+                                     DSP_NUM_VECTORS (num_channels) * DSP_LANES);
+
+  for (guint i = 0; i < self->num_levels; i++)
+    self->levels[i].stats = dsp_stats_new (num_channels);
+
+  for (guint i = 0; i < self->num_levels; i++)
+    if (self->levels[i].stats == NULL)
+      {
+        clear_channels (self);
+        return FALSE;
+      }
+
+  if (self->values == NULL)
+    {
+      clear_channels (self);
+      return FALSE;
+    }
+
+  self->names = g_new0 (gchar *, num_channels + 1);
+
+  for (guint i = 1; i <= num_pmu; i++)
+    {
+      char **names = cts_conf_get_channel_names_of_pmu (config, i);
+      guint num_phasors = cts_conf_get_num_of_phasors_of_pmu (config, i);
+      guint num_analogs = cts_conf_get_num_of_analogs_of_pmu (config, i);
+
+      for (guint j = 0; j < num_phasors; j++)
+        self->names[n++] = get_channel_name (config, i, names ? names[j] : "PHASOR");
+
+      self->names[n++] = get_channel_name (config, i, "FREQ");
+      self->names[n++] = get_channel_name (config, i, "DFREQ");
+
+      for (guint j = 0; j < num_analogs; j++)
+        self->names[n++] = get_channel_name (config, i,
+                                             names ? names[num_phasors + j] : "ANALOG");
+    }
+
+  self->num_channels = num_channels;
+  self->config = config;
+  self->config_changes = get_config_changes (config);
+
+  return TRUE;
+}
+
+static PmuStatsRecord *
+record_new (PmuStats *self,
+            Level    *level)
+{
+  PmuStatsRecord *record;
+
+  record = g_new0 (PmuStatsRecord, 1);
+  record->interval = level->interval;
+  record->soc = level->start;
+  record->num_channels = self->num_channels;
+  record->names = g_strdupv (self->names);
+  record->summaries = g_new0 (DspStatsSummary, self->num_channels);
+
+  for (guint i = 0; i < self->num_channels; i++)
+    dsp_stats_get (level->stats, i, record->summaries + i);
+
+  return record;
+}
+
+static void
+emit_record (PmuStats *self,
+             Level    *level)
+{
+  PmuStatsRecord *record;
+  guint waiting;
+
+  record = record_new (self, level);
+  dsp_stats_reset (level->stats);
+
+  g_mutex_lock (&self->mutex);
+  g_clear_pointer (&level->latest, pmu_stats_record_free);
+  level->latest = pmu_stats_record_copy (record);
+  g_mutex_unlock (&self->mutex);
+
+  waiting = g_thread_pool_unprocessed (self->pool);
+
+  if (waiting >= MAX_WAITING_RECORDS)
+    {
+      pmu_trace (PMU_TRACE_LEVEL_WARNING, PMU_TRACE_STATS_DROPPED,
+                 record->interval, waiting, record->soc);
+      pmu_stats_record_free (record);
+      return;
+    }
+
+  g_thread_pool_push (self->pool, record, NULL);
+}
+
+/*
+ * The shortest interval ended, with @soc the time of the frame after
+ * it. Roll it up into the longer intervals, and end those that end
+ * with it too, or all of them if @flush.
+ */
+static void
+end_interval (PmuStats *self,
+              guint32   soc,
+              gboolean  flush)
+{
+  Level *first = self->levels;
+
+  for (guint i = 1; i < self->num_levels; i++)
+    {
+      Level *level = self->levels + i;
+
+      if (dsp_stats_get_count (level->stats) == 0)
+        level->start = first->start - first->start % level->interval;
+
+      dsp_stats_merge (level->stats, first->stats);
+
+      if (flush || soc / level->interval != level->start / level->interval)
+        emit_record (self, level);
+    }
+
+  emit_record (self, first);
+}
+
+static void
+read_values (PmuStats *self,
+             CtsData  *data)
+{
+  CtsConf *config = cts_data_get_conf (data);
+  guint num_pmu = cts_conf_get_num_of_pmu (config);
+  gfloat *value = self->values;
+
+  for (guint i = 1; i <= num_pmu; i++)
+    {
+      guint num_phasors = cts_conf_get_num_of_phasors_of_pmu (config, i);
+      guint num_analogs = cts_conf_get_num_of_analogs_of_pmu (config, i);
+      gfloat real = 0, imaginary = 0;
+      gfloat freq = 0, rocof = 0;
+
+      for (guint j = 1; j <= num_phasors; j++)
+        {
+          cts_data_get_phasor_of_pmu (data, i, j, &real, &imaginary);
+          *value++ = hypotf (real, imaginary);
+        }
+
+      cts_data_get_freq_of_pmu (data, i, &freq, &rocof);
+      *value++ = freq;
+      *value++ = rocof;
+
+      for (guint j = 1; j <= num_analogs; j++)
+        {
+          *value = 0;
+          cts_data_get_analog_of_pmu (data, i, j, value++);
+        }
+    }
+}
+
+/**
+ * pmu_stats_update_data:
+ * @self: A #PmuStats
+ * @data: A data frame
+ *
+ * Add the values of @data. Frames should be given in the order of
+ * time. A frame in a new interval ends the previous one, so the
+ * records of an interval are made when the first frame after it is
+ * given.
+ */
+void
+pmu_stats_update_data (PmuStats *self,
+                       CtsData  *data)
+{
+  CtsConf *config = cts_data_get_conf (data);
+  Level *first = self->levels;
+  guint32 soc = cts_data_get_soc (data);
+
+  /* Channels may be reordered or scaled with the same count */
+  if (self->num_channels != get_num_channels (config) ||
+      self->config != config ||
+      self->config_changes != get_config_changes (config))
+    {
+      /* What was seen so far is of another configuration */
+      if (self->num_channels && dsp_stats_get_count (first->stats))
+        end_interval (self, soc, TRUE);
+
+      if (!setup_channels (self, config))
+        return;
+    }
+
+  if (dsp_stats_get_count (first->stats) &&
+      soc / first->interval != first->start / first->interval)
+    end_interval (self, soc, FALSE);
+
+  if (dsp_stats_get_count (first->stats) == 0)
+    first->start = soc - soc % first->interval;
+
+  read_values (self, data);
+  dsp_stats_add (first->stats, self->values);
+}
+
+/**
+ * pmu_stats_dup_latest:
+ * @self: A #PmuStats
+ * @level: The interval, from 0 (the shortest) to
+ * pmu_stats_get_num_intervals() - 1
+ *
+ * Get the record of the last interval that ended. Can be called from
+ * any thread.
+ *
+ * Returns: (transfer full) (nullable): A copy of the record, or %NULL
+ * if none has ended yet. Free with pmu_stats_record_free().
+ */
+PmuStatsRecord *
+pmu_stats_dup_latest (PmuStats *self,
+                      guint     level)
+{
+  PmuStatsRecord *record = NULL;
+
+  g_return_val_if_fail (level < self->num_levels, NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  if (self->levels[level].latest)
+    record = pmu_stats_record_copy (self->levels[level].latest);
+
+  g_mutex_unlock (&self->mutex);
+
+  return record;
+}
+
+PmuStatsRecord *
+pmu_stats_record_copy (const PmuStatsRecord *record)
+{
+  PmuStatsRecord *copy;
+
+  copy = g_memdup (record, sizeof *record);
+  copy->names = g_strdupv (record->names);
+  copy->summaries = g_memdup (record->summaries,
+                              sizeof (DspStatsSummary) * record->num_channels);
+
+  return copy;
+}
+
+void
+pmu_stats_record_free (PmuStatsRecord *record)
+{
+  if (record == NULL)
+    return;
+
+  g_strfreev (record->names);
+  g_free (record->summaries);
+  g_free (record);
+}
+
+/**
+ * pmu_stats_save_record:
+ * @record: A record
+ * @user_data: Unused
+ *
+ * A #PmuStatsSink that appends @record to
+ * $XDG_CACHE_HOME/pmu/stats-INTERVAL.csv, a line per channel of SOC,
+ * channel, count, min, max, mean, RMS and standard deviation.
+ */
+void
+pmu_stats_save_record (const PmuStatsRecord *record,
+                       gpointer              user_data)
+{
+  g_autofree gchar *directory = NULL;
+  g_autofree gchar *path = NULL;
+  gboolean exists;
+  FILE *file;
+
+  directory = g_build_filename (g_get_user_cache_dir (), "pmu", NULL);
+  g_mkdir_with_parents (directory, 0755);
+
+  path = g_strdup_printf ("%s/stats-%u.csv", directory, record->interval);
+  exists = g_file_test (path, G_FILE_TEST_EXISTS);
+  file = g_fopen (path, "a");
+
+  if (file == NULL)
+    {
+      g_warning ("Saving statistics to %s failed: %s", path, g_strerror (errno));
+      return;
+    }
+
+  if (!exists)
+    fprintf (file, "soc,channel,count,min,max,mean,rms,stddev\n");
+
+  for (guint i = 0; i < record->num_channels; i++)
+    {
+      const DspStatsSummary *summary = record->summaries + i;
+
+      fprintf (file, "%u,%s,%" G_GUINT64_FORMAT ",%g,%g,%g,%g,%g\n",
+               record->soc, record->names[i], (guint64) summary->count,
+               summary->min, summary->max, summary->mean,
+               summary->rms, summary->stddev);
+    }
+
+  fclose (file);
+}
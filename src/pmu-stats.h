@@ -0,0 +1,65 @@
+/* pmu-stats.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "c37/c37.h"
+#include "dsp/dsp-stats.h"
+
+G_BEGIN_DECLS
+
+typedef struct _PmuStats PmuStats;
+
+/* The statistics of every channel over an interval */
+typedef struct
+{
+  guint interval;               /* Seconds */
+  guint32 soc;                  /* The start of the interval */
+  guint num_channels;
+  gchar **names;                /* num_channels, "PMU/CHANNEL" */
+  DspStatsSummary *summaries;   /* num_channels */
+} PmuStatsRecord;
+
+/* Called in a thread of its own for every record, oldest first */
+typedef void (*PmuStatsSink) (const PmuStatsRecord *record,
+                              gpointer              user_data);
+
+PmuStats       *pmu_stats_new         (const guint   *intervals,
+                                       guint          num_intervals);
+void            pmu_stats_free        (PmuStats      *self);
+void            pmu_stats_set_sink    (PmuStats      *self,
+                                       PmuStatsSink   sink,
+                                       gpointer       user_data);
+guint           pmu_stats_get_num_intervals (PmuStats *self);
+void            pmu_stats_update_data (PmuStats      *self,
+                                       CtsData       *data);
+PmuStatsRecord *pmu_stats_dup_latest  (PmuStats      *self,
+                                       guint          level);
+
+PmuStatsRecord *pmu_stats_record_copy (const PmuStatsRecord *record);
+void            pmu_stats_record_free (PmuStatsRecord       *record);
+
+void            pmu_stats_save_record (const PmuStatsRecord *record,
+                                       gpointer              user_data);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PmuStats, pmu_stats_free)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PmuStatsRecord, pmu_stats_record_free)
+
+G_END_DECLS
@@ -0,0 +1,629 @@
+/* pmu-stress.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+/*
+ * A stress client: As many sessions to a PMU server (or PDC) as asked,
+ * each behaving as a PDC would, to see how the server copes.
+ *
+ * The number of sessions is stepped up through the levels given, new
+ * sessions being opened on top of those already open. Each level is
+ * let settle, then measured for --seconds, and reported in a line:
+ * sessions up, data frames and bytes per second, commands answered,
+ * and percentiles of two latencies:
+ *
+ *   data: when a data frame was received less its timestamp, which
+ *   includes however long the PMU takes to send a measurement
+ *   command: from a CFG or header command to its answer
+ *
+ * Each session follows a --pattern:
+ *
+ *   data: CFG-2, then DATA ON for good
+ *   mixed: as data, then at random every few seconds one of CFG-1,
+ *   CFG-2, header, or DATA OFF and ON again
+ *   config: CFG-2 and header, one after the other as soon as the
+ *   last is answered, data never asked
+ *
+ * Everything runs in one thread around epoll. A frame costs a parse
+ * and a clock read, so thousands of sessions at 50 frames per second
+ * are within a CPU.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <glib.h>
+
+#include "c37/c37.h"
+#include "pmu-histogram.h"
+
+#define NSEC_PER_SEC        G_GINT64_CONSTANT (1000000000)
+#define CONNECT_TIMEOUT     (5 * G_USEC_PER_SEC)
+#define COMMAND_TIMEOUT     (5 * G_USEC_PER_SEC)
+#define SETTLE_TIME         (2 * G_USEC_PER_SEC)
+#define MIN_ACTION_INTERVAL (1 * G_USEC_PER_SEC)
+#define MAX_ACTION_INTERVAL (5 * G_USEC_PER_SEC)
+
+static gint id_code = 1;
+static gchar *levels = NULL;
+static gint seconds = 10;
+static gchar *pattern = NULL;
+
+static GOptionEntry entries[] = {
+  { "id-code", 'i', 0, G_OPTION_ARG_INT, &id_code,
+    "ID code to send commands to (default: 1)", "ID" },
+  { "sessions", 's', 0, G_OPTION_ARG_STRING, &levels,
+    "Numbers of sessions to step through (default: 1,10,100,1000)", "N,N,…" },
+  { "seconds", 'S', 0, G_OPTION_ARG_INT, &seconds,
+    "Seconds to measure each level for (default: 10)", "SECONDS" },
+  { "pattern", 'm', 0, G_OPTION_ARG_STRING, &pattern,
+    "data, mixed or config (default: data)", "PATTERN" },
+  { NULL }
+};
+
+typedef enum {
+  PATTERN_DATA,
+  PATTERN_MIXED,
+  PATTERN_CONFIG,
+} Pattern;
+
+typedef enum {
+  SESSION_CONNECTING,
+  SESSION_CONFIGURING,
+  SESSION_RUNNING,
+  SESSION_CLOSED,
+} SessionState;
+
+typedef struct _Stress Stress;
+
+typedef struct
+{
+  Stress       *stress;
+  CtsClient    *client;
+  SessionState  state;
+
+  gboolean      data_on;
+  guint16       waiting;        /* The command awaiting an answer, or 0 */
+  gint64        command_time;
+  gint64        action_time;    /* Of the next, with --pattern mixed */
+  gint64        connect_time;
+} Session;
+
+typedef struct
+{
+  guint64 frames;
+  guint64 bytes;
+  guint64 commands;     /* Answered */
+  guint64 unanswered;
+  guint64 failed;       /* Connections failed or lost */
+} Counters;
+
+struct _Stress
+{
+  int              epoll_fd;
+  struct addrinfo *address;
+  Pattern          pattern;
+
+  GPtrArray       *sessions;
+  guint            num_up;
+
+  Counters         counters;
+  PmuHistogram    *data_latency;
+  PmuHistogram    *command_latency;
+};
+
+static gint64
+get_realtime_ns (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_REALTIME, &now);
+
+  return now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+static void
+session_close (Session *session,
+               gboolean failed)
+{
+  Stress *stress = session->stress;
+
+  if (session->state == SESSION_CLOSED)
+    return;
+
+  if (session->state != SESSION_CONNECTING)
+    stress->num_up--;
+
+  if (failed)
+    stress->counters.failed++;
+
+  cts_client_close (session->client);
+  session->state = SESSION_CLOSED;
+}
+
+static void
+session_command (Session  *session,
+                 guint16   command)
+{
+  if (!cts_client_send_command (session->client, command))
+    {
+      session_close (session, TRUE);
+      return;
+    }
+
+  if (command != CTS_COMMAND_DATA_ON && command != CTS_COMMAND_DATA_OFF)
+    {
+      session->waiting = command;
+      session->command_time = g_get_monotonic_time ();
+    }
+}
+
+static void
+session_answered (Session *session,
+                  guint16  command)
+{
+  Stress *stress = session->stress;
+
+  if (session->waiting != command)
+    return;
+
+  session->waiting = 0;
+  stress->counters.commands++;
+  pmu_histogram_add (stress->command_latency,
+                     (g_get_monotonic_time () - session->command_time) * 1000);
+
+  if (stress->pattern == PATTERN_CONFIG)
+    session_command (session, command == CTS_COMMAND_SEND_CONFIG2 ?
+                              CTS_COMMAND_SEND_HDR : CTS_COMMAND_SEND_CONFIG2);
+}
+
+static void
+session_schedule (Session *session)
+{
+  session->action_time = g_get_monotonic_time () +
+                         g_random_int_range (MIN_ACTION_INTERVAL, MAX_ACTION_INTERVAL);
+}
+
+static void
+config_cb (CtsClient *client,
+           CtsConf   *config,
+           byte       type,
+           void      *user_data)
+{
+  Session *session = user_data;
+
+  if (type == CTS_TYPE_CONFIG1)
+    {
+      session_answered (session, CTS_COMMAND_SEND_CONFIG1);
+      return;
+    }
+
+  session_answered (session, CTS_COMMAND_SEND_CONFIG2);
+
+  if (session->state == SESSION_CONFIGURING)
+    {
+      session->state = SESSION_RUNNING;
+
+      if (session->stress->pattern != PATTERN_CONFIG)
+        {
+          session_command (session, CTS_COMMAND_DATA_ON);
+          session->data_on = TRUE;
+          session_schedule (session);
+        }
+    }
+}
+
+static void
+header_cb (CtsClient  *client,
+           const char *text,
+           size_t      length,
+           void       *user_data)
+{
+  session_answered (user_data, CTS_COMMAND_SEND_HDR);
+}
+
+static void
+data_cb (CtsClient         *client,
+         const CtsDataView *view,
+         void              *user_data)
+{
+  Session *session = user_data;
+  Stress *stress = session->stress;
+  CtsTime time;
+
+  cts_data_view_get_time (view, &time);
+
+  stress->counters.frames++;
+  stress->counters.bytes += cts_data_layout_get_frame_size (view->layout);
+  pmu_histogram_add (stress->data_latency,
+                     get_realtime_ns () - (time.soc * NSEC_PER_SEC + time.nanoseconds));
+}
+
+static void
+session_connect (Session *session)
+{
+  Stress *stress = session->stress;
+  struct addrinfo *address = stress->address;
+  struct epoll_event event = { 0 };
+  int fd;
+
+  session->connect_time = g_get_monotonic_time ();
+  fd = socket (address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+               address->ai_protocol);
+
+  if (fd < 0)
+    {
+      session->state = SESSION_CLOSED;
+      stress->counters.failed++;
+      return;
+    }
+
+  if (connect (fd, address->ai_addr, address->ai_addrlen) < 0 && errno != EINPROGRESS)
+    {
+      close (fd);
+      session->state = SESSION_CLOSED;
+      stress->counters.failed++;
+      return;
+    }
+
+  cts_client_set_fd (session->client, fd, CTS_TRANSPORT_TCP);
+  session->state = SESSION_CONNECTING;
+
+  event.events = EPOLLIN | EPOLLOUT;
+  event.data.ptr = session;
+  epoll_ctl (stress->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+static void
+session_connected (Session *session)
+{
+  struct epoll_event event = { 0 };
+  int fd = cts_client_get_fd (session->client);
+  socklen_t length = sizeof (int);
+  int error = 0, one = 1;
+
+  if (getsockopt (fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error)
+    {
+      session_close (session, TRUE);
+      return;
+    }
+
+  setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+  event.events = EPOLLIN;
+  event.data.ptr = session;
+  epoll_ctl (session->stress->epoll_fd, EPOLL_CTL_MOD, fd, &event);
+
+  session->state = SESSION_CONFIGURING;
+  session->stress->num_up++;
+  session_command (session, CTS_COMMAND_SEND_CONFIG2);
+}
+
+static Session *
+session_new (Stress *stress)
+{
+  CtsClientHandlers handlers = {
+    .config = config_cb,
+    .header = header_cb,
+    .data = data_cb,
+  };
+  Session *session;
+
+  session = g_new0 (Session, 1);
+  session->stress = stress;
+  session->state = SESSION_CLOSED;
+  session->client = cts_client_new (id_code);
+
+  if (session->client == NULL)
+    {
+      g_free (session);
+      return NULL;
+    }
+
+  cts_client_set_handlers (session->client, &handlers, session);
+
+  return session;
+}
+
+static void
+session_free (Session *session)
+{
+  cts_client_free (session->client);
+  g_free (session);
+}
+
+static void
+handle_session (Session *session)
+{
+  ssize_t count;
+
+  if (session->state == SESSION_CONNECTING)
+    {
+      session_connected (session);
+      return;
+    }
+
+  count = cts_client_read (session->client);
+
+  if (count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR))
+    session_close (session, TRUE);
+}
+
+/* Timeouts, and the next step of --pattern mixed */
+static void
+session_tick (Session *session,
+              gint64   now)
+{
+  if (session->state == SESSION_CONNECTING)
+    {
+      if (now - session->connect_time > CONNECT_TIMEOUT)
+        session_close (session, TRUE);
+
+      return;
+    }
+
+  if (session->state == SESSION_CLOSED)
+    return;
+
+  if (session->waiting && now - session->command_time > COMMAND_TIMEOUT)
+    {
+      session->stress->counters.unanswered++;
+      session_command (session, session->waiting);
+      return;
+    }
+
+  if (session->stress->pattern != PATTERN_MIXED ||
+      session->state != SESSION_RUNNING || session->waiting ||
+      now < session->action_time)
+    return;
+
+  session_schedule (session);
+
+  if (!session->data_on)
+    {
+      session_command (session, CTS_COMMAND_DATA_ON);
+      session->data_on = TRUE;
+      return;
+    }
+
+  switch (g_random_int_range (0, 4))
+    {
+    case 0:
+      session_command (session, CTS_COMMAND_SEND_CONFIG1);
+      break;
+
+    case 1:
+      session_command (session, CTS_COMMAND_SEND_CONFIG2);
+      break;
+
+    case 2:
+      session_command (session, CTS_COMMAND_SEND_HDR);
+      break;
+
+    default:
+      session_command (session, CTS_COMMAND_DATA_OFF);
+      session->data_on = FALSE;
+      break;
+    }
+}
+
+static void
+run_for (Stress *stress,
+         gint64  duration)
+{
+  gint64 end = g_get_monotonic_time () + duration;
+  gint64 next_tick = 0;
+  struct epoll_event events[256];
+
+  for (;;)
+    {
+      gint64 now = g_get_monotonic_time ();
+      int count;
+
+      if (now >= end)
+        return;
+
+      if (now >= next_tick)
+        {
+          for (guint i = 0; i < stress->sessions->len; i++)
+            session_tick (g_ptr_array_index (stress->sessions, i), now);
+
+          next_tick = now + G_USEC_PER_SEC / 10;
+        }
+
+      count = epoll_wait (stress->epoll_fd, events, G_N_ELEMENTS (events),
+                          MIN (next_tick, end) / 1000 - now / 1000 + 1);
+
+      for (int i = 0; i < count; i++)
+        handle_session (events[i].data.ptr);
+    }
+}
+
+static void
+print_level (Stress   *stress,
+             guint     num_sessions,
+             gdouble   elapsed)
+{
+  Counters *counters = &stress->counters;
+  PmuHistogram *data = stress->data_latency;
+  PmuHistogram *command = stress->command_latency;
+
+  g_print ("%8u %8u %10.0f %8.1f %8.0f %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %8" G_GUINT64_FORMAT
+           " %8" G_GUINT64_FORMAT "\n",
+           num_sessions, stress->num_up,
+           counters->frames / elapsed,
+           counters->bytes * 8 / elapsed / 1e6,
+           counters->commands / elapsed,
+           pmu_histogram_get_percentile (data, 50) / 1e6,
+           pmu_histogram_get_percentile (data, 90) / 1e6,
+           pmu_histogram_get_percentile (data, 99) / 1e6,
+           pmu_histogram_get_percentile (data, 99.9) / 1e6,
+           pmu_histogram_get_max (data) / 1e6,
+           pmu_histogram_get_percentile (command, 50) / 1e6,
+           pmu_histogram_get_percentile (command, 99) / 1e6,
+           counters->unanswered, counters->failed);
+}
+
+static void
+raise_file_limit (void)
+{
+  struct rlimit limit;
+
+  if (getrlimit (RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+      limit.rlim_cur = limit.rlim_max;
+      setrlimit (RLIMIT_NOFILE, &limit);
+    }
+}
+
+static gboolean
+parse_address (Stress      *stress,
+               const gchar *address)
+{
+  g_autofree gchar *host = NULL;
+  struct addrinfo hints = { 0 };
+  const gchar *colon = strrchr (address, ':');
+
+  if (colon == NULL || colon == address || colon[1] == '\0')
+    return FALSE;
+
+  if (address[0] == '[' && colon[-1] == ']')
+    host = g_strndup (address + 1, colon - address - 2);
+  else
+    host = g_strndup (address, colon - address);
+
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  return getaddrinfo (host, colon + 1, &hints, &stress->address) == 0;
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  g_auto(GStrv) steps = NULL;
+  Stress stress = { 0 };
+
+  context = g_option_context_new ("HOST:PORT");
+  g_option_context_set_summary (context, "Open many sessions to a PMU server, and measure how it copes");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (pattern == NULL || g_str_equal (pattern, "data"))
+    stress.pattern = PATTERN_DATA;
+  else if (g_str_equal (pattern, "mixed"))
+    stress.pattern = PATTERN_MIXED;
+  else if (g_str_equal (pattern, "config"))
+    stress.pattern = PATTERN_CONFIG;
+  else
+    argc = 0;
+
+  steps = g_strsplit (levels ? levels : "1,10,100,1000", ",", -1);
+
+  for (guint i = 0; steps[i]; i++)
+    if (!g_ascii_string_to_unsigned (steps[i], 10, 1, 1000000, NULL, NULL))
+      argc = 0;
+
+  if (argc != 2 || seconds < 1 || id_code < 1 || id_code > G_MAXUINT16)
+    {
+      g_printerr ("%s", g_option_context_get_help (context, TRUE, NULL));
+      return EXIT_FAILURE;
+    }
+
+  if (!parse_address (&stress, argv[1]))
+    {
+      g_printerr ("Can't resolve '%s', expected HOST:PORT\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+
+  raise_file_limit ();
+
+  stress.epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+  stress.sessions = g_ptr_array_new_with_free_func ((GDestroyNotify) session_free);
+  stress.data_latency = pmu_histogram_new ();
+  stress.command_latency = pmu_histogram_new ();
+
+  g_print ("%8s %8s %10s %8s %8s %8s %8s %8s %8s %8s %8s %8s %8s %8s\n",
+           "sessions", "up", "frames/s", "Mbit/s", "cmds/s", "p50 ms", "p90 ms", "p99 ms",
+           "p99.9 ms", "max ms", "cmd p50", "cmd p99", "no reply", "failed");
+
+  for (guint i = 0; steps[i]; i++)
+    {
+      guint num_sessions = g_ascii_strtoull (steps[i], NULL, 10);
+      gint64 start;
+
+      /* Sessions lost on the way are opened again, those beyond closed */
+      for (guint j = num_sessions; j < stress.sessions->len; j++)
+        session_close (g_ptr_array_index (stress.sessions, j), FALSE);
+
+      for (guint j = 0; j < num_sessions; j++)
+        {
+          Session *session;
+
+          if (j < stress.sessions->len)
+            {
+              session = g_ptr_array_index (stress.sessions, j);
+
+              if (session->state == SESSION_CLOSED)
+                session_connect (session);
+
+              continue;
+            }
+
+          session = session_new (&stress);
+
+          if (session == NULL)
+            break;
+
+          g_ptr_array_add (stress.sessions, session);
+          session_connect (session);
+        }
+
+      run_for (&stress, SETTLE_TIME);
+
+      memset (&stress.counters, 0, sizeof stress.counters);
+      pmu_histogram_reset (stress.data_latency);
+      pmu_histogram_reset (stress.command_latency);
+      start = g_get_monotonic_time ();
+
+      run_for (&stress, seconds * G_USEC_PER_SEC);
+
+      print_level (&stress, num_sessions,
+                   (gdouble) (g_get_monotonic_time () - start) / G_USEC_PER_SEC);
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,285 @@
+/* pmu-trace-dump.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Print a binary trace written by pmu (see pmu-trace.c) as text.
+ *
+ * Records are written per thread, so they are sorted by time first.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pmu-trace.h"
+
+static gchar *level_option = NULL;
+static gboolean relative_time = FALSE;
+
+static GOptionEntry entries[] = {
+  { "level", 'l', 0, G_OPTION_ARG_STRING, &level_option,
+    "Show events of LEVEL and above only", "LEVEL" },
+  { "relative", 'r', 0, G_OPTION_ARG_NONE, &relative_time,
+    "Show the time since the previous event of the same thread", NULL },
+  { NULL }
+};
+
+static const gchar *level_names[] = {
+  "NONE", "ERROR", "WARN", "INFO", "DEBUG",
+};
+
+static const gchar *event_names[] = {
+  [PMU_TRACE_THREAD]          = "thread",
+  [PMU_TRACE_DROPPED]         = "dropped",
+  [PMU_TRACE_SPI_POLL]        = "spi-poll",
+  [PMU_TRACE_SPI_FRAME]       = "spi-frame",
+  [PMU_TRACE_SPI_MISSED]      = "spi-missed",
+  [PMU_TRACE_SPI_ERROR]       = "spi-error",
+  [PMU_TRACE_FRAME_SENT]      = "frame-sent",
+  [PMU_TRACE_COMMAND]         = "command",
+  [PMU_TRACE_COMMAND_BAD_CRC] = "command-bad-crc",
+  [PMU_TRACE_COMMAND_INVALID] = "command-invalid",
+  [PMU_TRACE_SESSION_CLOSED]  = "session-closed",
+  [PMU_TRACE_SUBSET]          = "subset",
+  [PMU_TRACE_TRIGGER]         = "trigger",
+  [PMU_TRACE_CAPTURE_DROPPED] = "capture-dropped",
+  [PMU_TRACE_STATS_DROPPED]   = "stats-dropped",
+  [PMU_TRACE_OSCILLATION]     = "oscillation",
+  [PMU_TRACE_LSE_UNOBSERVABLE] = "lse-unobservable",
+  [PMU_TRACE_LSE_BAD_DATA]    = "lse-bad-data",
+  [PMU_TRACE_SUBSET_DROPPED]  = "subset-dropped",
+};
+
+/* Threads are identified by an 8 bit index */
+static gchar thread_names[256][13];
+
+static gint
+compare_records (gconstpointer a,
+                 gconstpointer b)
+{
+  const PmuTraceRecord *record_a = a;
+  const PmuTraceRecord *record_b = b;
+
+  if (record_a->time != record_b->time)
+    return record_a->time < record_b->time ? -1 : 1;
+
+  /* The same thread can't produce two records at the same time */
+  return (gint)record_a->thread - (gint)record_b->thread;
+}
+
+static gchar *
+format_args (const PmuTraceRecord *record)
+{
+  const guint32 *args = record->args;
+
+  switch (record->event)
+    {
+    case PMU_TRACE_THREAD:
+      return g_strdup_printf ("name=%s", thread_names[record->thread]);
+
+    case PMU_TRACE_DROPPED:
+      return g_strdup_printf ("count=%u", args[0]);
+
+    case PMU_TRACE_SPI_POLL:
+      return g_strdup_printf ("rx=%02X %02X %02X", args[0], args[1], args[2]);
+
+    case PMU_TRACE_SPI_FRAME:
+      return g_strdup_printf ("size=%u time=%u.%09u", args[0], args[1], args[2]);
+
+    case PMU_TRACE_SPI_MISSED:
+      return g_strdup_printf ("slot=%u.%09u total=%u", args[0], args[1], args[2]);
+
+    case PMU_TRACE_SPI_ERROR:
+      return g_strdup_printf ("error=%s", g_strerror (args[0]));
+
+    case PMU_TRACE_FRAME_SENT:
+      return g_strdup_printf ("size=%u written=%u soc=%u", args[0], args[1], args[2]);
+
+    case PMU_TRACE_COMMAND:
+      return g_strdup_printf ("command=%u size=%u crc=%04X", args[0], args[1], args[2]);
+
+    case PMU_TRACE_COMMAND_BAD_CRC:
+      return g_strdup_printf ("size=%u crc=%04X expected=%04X", args[0], args[1], args[2]);
+
+    case PMU_TRACE_COMMAND_INVALID:
+      return g_strdup_printf ("size=%u type=%u command=%u", args[0], args[1], args[2]);
+
+    case PMU_TRACE_SESSION_CLOSED:
+      return g_strdup ("");
+
+    case PMU_TRACE_SUBSET:
+      return g_strdup_printf ("size=%u full=%u", args[0], args[1]);
+
+    case PMU_TRACE_TRIGGER:
+      return g_strdup_printf ("conditions=%02X pmu=%u", args[0], args[1]);
+
+    case PMU_TRACE_CAPTURE_DROPPED:
+      return g_strdup_printf ("frames=%u waiting=%u soc=%u", args[0], args[1], args[2]);
+
+    case PMU_TRACE_STATS_DROPPED:
+      return g_strdup_printf ("interval=%u waiting=%u soc=%u", args[0], args[1], args[2]);
+
+    case PMU_TRACE_OSCILLATION:
+      return g_strdup_printf ("frequency=%u.%03u damping=%u.%03u pmu=%u",
+                              args[0] / 1000, args[0] % 1000,
+                              args[1] / 1000, args[1] % 1000, args[2]);
+
+    case PMU_TRACE_LSE_UNOBSERVABLE:
+      return g_strdup_printf ("pmu=%u measurements=%u soc=%u", args[0], args[1], args[2]);
+
+    case PMU_TRACE_LSE_BAD_DATA:
+      return g_strdup_printf ("measurement=%u residual=%u.%02u soc=%u",
+                              args[0], args[1] / 100, args[1] % 100, args[2]);
+
+    case PMU_TRACE_SUBSET_DROPPED:
+      return g_strdup_printf ("size=%u subset=%u soc=%u", args[0], args[1], args[2]);
+
+    default:
+      return g_strdup_printf ("args=%08X %08X %08X", args[0], args[1], args[2]);
+    }
+}
+
+static void
+print_records (GArray *records)
+{
+  guint64 last_time[256] = { 0 };
+  guint64 start_time;
+  gint min_level = PMU_TRACE_LEVEL_DEBUG;
+
+  if (records->len == 0)
+    return;
+
+  if (level_option)
+    min_level = pmu_trace_level_from_string (level_option);
+
+  start_time = g_array_index (records, PmuTraceRecord, 0).time;
+
+  for (guint i = 0; i < records->len; i++)
+    {
+      PmuTraceRecord *record = &g_array_index (records, PmuTraceRecord, i);
+      g_autofree gchar *args = NULL;
+      const gchar *event = NULL;
+      guint64 time;
+
+      if (relative_time)
+        time = last_time[record->thread] ? record->time - last_time[record->thread] : 0;
+      else
+        time = record->time - start_time;
+
+      last_time[record->thread] = record->time;
+
+      if (record->level > min_level && record->event != PMU_TRACE_THREAD)
+        continue;
+
+      if (record->event < G_N_ELEMENTS (event_names))
+        event = event_names[record->event];
+
+      args = format_args (record);
+
+      g_print ("[%5" G_GUINT64_FORMAT ".%09" G_GUINT64_FORMAT "] %-12s %-5s %-16s %s\n",
+               time / 1000000000, time % 1000000000,
+               thread_names[record->thread],
+               level_names[MIN (record->level, PMU_TRACE_LEVEL_DEBUG)],
+               event ? event : "unknown", args);
+    }
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GArray) records = NULL;
+  g_autofree gchar *contents = NULL;
+  PmuTraceFileHeader header;
+  gsize length, record_size;
+
+  context = g_option_context_new ("FILE");
+  g_option_context_set_summary (context, "Print a binary trace recorded by pmu");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (argc != 2)
+    {
+      g_printerr ("%s", g_option_context_get_help (context, TRUE, NULL));
+      return EXIT_FAILURE;
+    }
+
+  if (level_option && pmu_trace_level_from_string (level_option) == -1)
+    {
+      g_printerr ("Invalid level '%s'\n", level_option);
+      return EXIT_FAILURE;
+    }
+
+  if (!g_file_get_contents (argv[1], &contents, &length, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (length < sizeof header)
+    {
+      g_printerr ("%s: Not a trace file\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+
+  memcpy (&header, contents, sizeof header);
+
+  if (memcmp (header.magic, PMU_TRACE_MAGIC, sizeof header.magic) != 0 ||
+      header.version != PMU_TRACE_VERSION)
+    {
+      g_printerr ("%s: Not a trace file, or unsupported version\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+
+  /* Newer versions may grow the record at the end */
+  record_size = header.record_size;
+  if (record_size < sizeof (PmuTraceRecord))
+    {
+      g_printerr ("%s: Invalid record size %zu\n", argv[1], record_size);
+      return EXIT_FAILURE;
+    }
+
+  records = g_array_new (FALSE, FALSE, sizeof (PmuTraceRecord));
+
+  for (gsize offset = sizeof header; offset + record_size <= length; offset += record_size)
+    {
+      PmuTraceRecord record;
+
+      memcpy (&record, contents + offset, sizeof record);
+
+      if (record.event == PMU_TRACE_THREAD)
+        memcpy (thread_names[record.thread], record.args, sizeof record.args);
+
+      g_array_append_val (records, record);
+    }
+
+  for (guint i = 0; i < G_N_ELEMENTS (thread_names); i++)
+    if (thread_names[i][0] == '\0')
+      g_snprintf (thread_names[i], sizeof thread_names[i], "thread-%u", i);
+
+  g_array_sort (records, compare_records);
+  print_records (records);
+
+  return EXIT_SUCCESS;
+}
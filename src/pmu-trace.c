@@ -0,0 +1,360 @@
+/* pmu-trace.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <glib/gstdio.h>
+
+#include "pmu-trace.h"
+
+/*
+ * Every thread that traces gets its own ring of records. The thread
+ * is the only producer of its ring and the flush thread is the only
+ * consumer, so a record costs a clock read and a few stores: No lock,
+ * no formatting and no I/O. If the ring is full, records are dropped
+ * (and the count of dropped records is traced later) instead of
+ * blocking the thread.
+ *
+ * The flush thread periodically copies the rings to a binary file,
+ * which can be read with pmu-trace-dump.
+ */
+
+#define TRACE_RING_SIZE  4096 /* records, should be a power of 2 */
+#define TRACE_MAX_RINGS  255
+#define TRACE_FLUSH_TIME (100 * 1000) /* microseconds */
+
+typedef struct _TraceRing
+{
+  PmuTraceRecord records[TRACE_RING_SIZE];
+
+  guint head;   /* Written by the owner thread only */
+  guint tail;   /* Written by the flushing thread only */
+  guint dropped;
+
+  guint8 index;
+} TraceRing;
+
+gint pmu_trace_level = PMU_TRACE_LEVEL_NONE;
+
+static TraceRing *rings[TRACE_MAX_RINGS];
+static gint       n_rings = 0;
+
+static __thread TraceRing *thread_ring = NULL;
+static __thread gboolean   thread_has_no_ring = FALSE;
+
+static FILE    *trace_file = NULL;
+static GThread *flush_thread = NULL;
+static gint     flush_running = FALSE;
+
+G_LOCK_DEFINE_STATIC (rings);
+G_LOCK_DEFINE_STATIC (trace_file);
+
+static const gchar *level_names[] = {
+  "none",
+  "error",
+  "warning",
+  "info",
+  "debug",
+};
+
+/**
+ * pmu_trace_level_from_string:
+ * @level: (nullable): one of "none", "error", "warning", "info", "debug"
+ *
+ * Returns: the #PmuTraceLevel for @level, or -1 if @level is invalid.
+ */
+gint
+pmu_trace_level_from_string (const gchar *level)
+{
+  if (level == NULL)
+    return -1;
+
+  for (guint i = 0; i < G_N_ELEMENTS (level_names); i++)
+    if (g_str_equal (level, level_names[i]))
+      return i;
+
+  return -1;
+}
+
+static inline guint64
+get_time (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * G_GUINT64_CONSTANT (1000000000) + ts.tv_nsec;
+}
+
+static inline void
+ring_push (TraceRing     *ring,
+           guint          head,
+           PmuTraceLevel  level,
+           PmuTraceEvent  event,
+           guint32        arg0,
+           guint32        arg1,
+           guint32        arg2)
+{
+  PmuTraceRecord *record;
+
+  record = ring->records + (head & (TRACE_RING_SIZE - 1));
+  record->time = get_time ();
+  record->event = event;
+  record->level = level;
+  record->thread = ring->index;
+  record->args[0] = arg0;
+  record->args[1] = arg1;
+  record->args[2] = arg2;
+
+  /* Publish the record to the flush thread */
+  g_atomic_int_set (&ring->head, head + 1);
+}
+
+static TraceRing *
+register_ring (void)
+{
+  TraceRing *ring = NULL;
+  gchar name[16] = { 0 };
+  guint32 args[3] = { 0 };
+
+  G_LOCK (rings);
+
+  if (n_rings < TRACE_MAX_RINGS)
+    {
+      ring = g_new0 (TraceRing, 1);
+      ring->index = n_rings;
+      rings[n_rings] = ring;
+      g_atomic_int_inc (&n_rings);
+    }
+
+  G_UNLOCK (rings);
+
+  if (ring == NULL)
+    {
+      thread_has_no_ring = TRUE;
+      return NULL;
+    }
+
+  /* The first record of every thread tells the name of the thread */
+  prctl (PR_GET_NAME, name);
+  memcpy (args, name, sizeof args);
+  ring_push (ring, 0, PMU_TRACE_LEVEL_ERROR, PMU_TRACE_THREAD,
+             args[0], args[1], args[2]);
+
+  thread_ring = ring;
+
+  return ring;
+}
+
+/**
+ * pmu_trace_record:
+ * @level: The level of the event
+ * @event: The event
+ * @arg0: first argument of @event
+ * @arg1: second argument of @event
+ * @arg2: third argument of @event
+ *
+ * Record @event to the ring of the calling thread. Use pmu_trace()
+ * macro instead, which skips disabled levels without a function call.
+ */
+void
+pmu_trace_record (PmuTraceLevel level,
+                  PmuTraceEvent event,
+                  guint32       arg0,
+                  guint32       arg1,
+                  guint32       arg2)
+{
+  TraceRing *ring = thread_ring;
+  guint head, tail;
+
+  if (G_UNLIKELY (ring == NULL))
+    {
+      if (thread_has_no_ring || (ring = register_ring ()) == NULL)
+        return;
+    }
+
+  head = ring->head;
+  tail = g_atomic_int_get (&ring->tail);
+
+  /* Keep one slot free to report the dropped records */
+  if (head - tail >= TRACE_RING_SIZE - 1)
+    {
+      ring->dropped++;
+      return;
+    }
+
+  if (G_UNLIKELY (ring->dropped))
+    {
+      ring_push (ring, head, PMU_TRACE_LEVEL_WARNING, PMU_TRACE_DROPPED,
+                 ring->dropped, 0, 0);
+      ring->dropped = 0;
+      head++;
+
+      if (head - tail >= TRACE_RING_SIZE - 1)
+        return;
+    }
+
+  ring_push (ring, head, level, event, arg0, arg1, arg2);
+}
+
+static void
+flush_ring (TraceRing *ring)
+{
+  guint head, tail, start, count;
+
+  head = g_atomic_int_get (&ring->head);
+  tail = ring->tail;
+
+  while (tail != head)
+    {
+      start = tail & (TRACE_RING_SIZE - 1);
+      count = MIN (head - tail, TRACE_RING_SIZE - start);
+
+      fwrite (ring->records + start, sizeof *ring->records, count, trace_file);
+      tail += count;
+    }
+
+  /* Hand the slots back to the owner thread */
+  g_atomic_int_set (&ring->tail, tail);
+}
+
+/**
+ * pmu_trace_flush:
+ *
+ * Write every pending record to the trace file.
+ */
+void
+pmu_trace_flush (void)
+{
+  gint count;
+
+  G_LOCK (trace_file);
+
+  if (trace_file)
+    {
+      count = g_atomic_int_get (&n_rings);
+
+      for (gint i = 0; i < count; i++)
+        flush_ring (rings[i]);
+
+      fflush (trace_file);
+    }
+
+  G_UNLOCK (trace_file);
+}
+
+static gpointer
+flush_thread_func (gpointer user_data)
+{
+  while (g_atomic_int_get (&flush_running))
+    {
+      g_usleep (TRACE_FLUSH_TIME);
+      pmu_trace_flush ();
+    }
+
+  return NULL;
+}
+
+/**
+ * pmu_trace_init:
+ * @level: (nullable): The trace level as string
+ *
+ * Start tracing events at @level and below. The environment variable
+ * PMU_TRACE, if set, overrides @level.
+ *
+ * Records are saved to $XDG_CACHE_HOME/pmu/trace-PID.bin
+ */
+void
+pmu_trace_init (const gchar *level)
+{
+  g_autofree gchar *directory = NULL;
+  g_autofree gchar *path = NULL;
+  PmuTraceFileHeader header = { PMU_TRACE_MAGIC, PMU_TRACE_VERSION,
+                                sizeof (PmuTraceRecord) };
+  const gchar *env_level;
+  gint trace_level;
+
+  env_level = g_getenv ("PMU_TRACE");
+  if (env_level)
+    level = env_level;
+
+  trace_level = pmu_trace_level_from_string (level);
+
+  if (trace_level == -1)
+    {
+      g_warning ("Invalid trace level '%s', tracing disabled", level);
+      return;
+    }
+
+  if (trace_level == PMU_TRACE_LEVEL_NONE || trace_file)
+    return;
+
+  if (trace_level > PMU_TRACE_MAX_LEVEL)
+    g_message ("trace: level '%s' requested, but '%s' is the maximum compiled in",
+               level_names[trace_level], level_names[PMU_TRACE_MAX_LEVEL]);
+
+  directory = g_build_filename (g_get_user_cache_dir (), "pmu", NULL);
+  g_mkdir_with_parents (directory, 0755);
+
+  path = g_strdup_printf ("%s/trace-%d.bin", directory, getpid ());
+  trace_file = g_fopen (path, "wb");
+
+  if (trace_file == NULL)
+    {
+      g_warning ("Opening trace file '%s' failed: %s", path, g_strerror (errno));
+      return;
+    }
+
+  fwrite (&header, sizeof header, 1, trace_file);
+
+  g_atomic_int_set (&flush_running, TRUE);
+  flush_thread = g_thread_new ("trace", flush_thread_func, NULL);
+
+  g_message ("trace: recording '%s' events to %s", level_names[trace_level], path);
+
+  /* Start recording only once the file is ready */
+  pmu_trace_level = trace_level;
+}
+
+/**
+ * pmu_trace_shutdown:
+ *
+ * Stop tracing and write the pending records.
+ */
+void
+pmu_trace_shutdown (void)
+{
+  pmu_trace_level = PMU_TRACE_LEVEL_NONE;
+
+  if (flush_thread)
+    {
+      g_atomic_int_set (&flush_running, FALSE);
+      g_thread_join (flush_thread);
+      flush_thread = NULL;
+    }
+
+  pmu_trace_flush ();
+
+  G_LOCK (trace_file);
+  g_clear_pointer (&trace_file, fclose);
+  G_UNLOCK (trace_file);
+}
@@ -0,0 +1,108 @@
+/* pmu-trace.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define PMU_TRACE_MAGIC   "PMUTRACE"
+#define PMU_TRACE_VERSION 1
+
+typedef enum {
+  PMU_TRACE_LEVEL_NONE,
+  PMU_TRACE_LEVEL_ERROR,
+  PMU_TRACE_LEVEL_WARNING,
+  PMU_TRACE_LEVEL_INFO,
+  PMU_TRACE_LEVEL_DEBUG,
+} PmuTraceLevel;
+
+/*
+ * Events with their arguments. New events shall be appended only,
+ * so that old traces can still be read by pmu-trace-dump.
+ */
+typedef enum {
+  PMU_TRACE_THREAD,           /* args: up to 12 bytes of thread name */
+  PMU_TRACE_DROPPED,          /* count of records dropped, ring full */
+  PMU_TRACE_SPI_POLL,         /* debug bytes received (3 bytes) */
+  PMU_TRACE_SPI_FRAME,        /* frame size, SOC, nanoseconds of the slot */
+  PMU_TRACE_SPI_MISSED,       /* SOC, nanoseconds of the slot, total missed */
+  PMU_TRACE_SPI_ERROR,        /* errno */
+  PMU_TRACE_FRAME_SENT,       /* frame size, bytes written, SOC */
+  PMU_TRACE_COMMAND,          /* command, frame size, CRC */
+  PMU_TRACE_COMMAND_BAD_CRC,  /* frame size, CRC received, CRC calculated */
+  PMU_TRACE_COMMAND_INVALID,  /* frame size, frame type, command */
+  PMU_TRACE_SESSION_CLOSED,
+  PMU_TRACE_SUBSET,           /* data frame size of the session, full size */
+  PMU_TRACE_TRIGGER,          /* conditions, PMU index */
+  PMU_TRACE_CAPTURE_DROPPED,  /* frames, captures waiting, SOC */
+  PMU_TRACE_STATS_DROPPED,    /* interval, records waiting, SOC */
+  PMU_TRACE_OSCILLATION,      /* frequency in mHz, damping per mille, PMU index */
+  PMU_TRACE_LSE_UNOBSERVABLE, /* PMUs in the frame, measurements, SOC */
+  PMU_TRACE_LSE_BAD_DATA,     /* measurement, normalised residual x 100, SOC */
+  PMU_TRACE_SUBSET_DROPPED,   /* frame size, subset frame size, SOC */
+  PMU_TRACE_N_EVENTS,
+} PmuTraceEvent;
+
+/* A record as saved in a trace file, in host byte order */
+typedef struct _PmuTraceRecord
+{
+  guint64 time;     /* CLOCK_MONOTONIC, in nanoseconds */
+  guint16 event;
+  guint8  level;
+  guint8  thread;   /* An index unique to each thread */
+  guint32 args[3];
+} PmuTraceRecord;
+
+/* The header of a trace file, followed by records */
+typedef struct _PmuTraceFileHeader
+{
+  gchar   magic[8];
+  guint32 version;
+  guint32 record_size;
+} PmuTraceFileHeader;
+
+/*
+ * Records above this level are compiled out. Can be set from
+ * configure with --enable-trace=LEVEL.
+ */
+#ifndef PMU_TRACE_MAX_LEVEL
+#define PMU_TRACE_MAX_LEVEL PMU_TRACE_LEVEL_DEBUG
+#endif
+
+/* Records above this level are skipped at runtime */
+extern gint pmu_trace_level;
+
+#define pmu_trace(level, event, arg0, arg1, arg2)                       \
+  G_STMT_START {                                                        \
+    if ((level) <= PMU_TRACE_MAX_LEVEL && (level) <= pmu_trace_level)   \
+      pmu_trace_record ((level), (event), (arg0), (arg1), (arg2));      \
+  } G_STMT_END
+
+void     pmu_trace_init      (const gchar   *level);
+void     pmu_trace_shutdown  (void);
+void     pmu_trace_flush     (void);
+void     pmu_trace_record    (PmuTraceLevel  level,
+                              PmuTraceEvent  event,
+                              guint32        arg0,
+                              guint32        arg1,
+                              guint32        arg2);
+gint     pmu_trace_level_from_string (const gchar *level);
+
+G_END_DECLS
@@ -0,0 +1,501 @@
+/* pmu-trigger.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pmu-trace.h"
+
+#include "pmu-trigger.h"
+
+/*
+ * Checks every data frame for disturbances, flags them in STAT and
+ * captures the frames around them.
+ *
+ * The conditions of every PMU are checked by a #DspTrigger, one lane
+ * per PMU, following the channel layout of pmu-config.h:
+ *
+ *   Phasors 1 - 3: VR, VY, VB, for sags and swells
+ *   Phasor 7: V Pos, for steps (phasor 1 if there is no 7th)
+ *   Status word 1, for changes (breaker status, say)
+ *
+ * While a condition is met, bit 11 of STAT is set with the reason in
+ * bits 0 - 3. A step has no reason of its own in C37.118.2, so it is
+ * given the first user defined one.
+ *
+ * The latest frames are kept in a ring. When a condition starts to be
+ * met, the frames in the ring, the frame and the frames after it are
+ * captured and handed to a sink in a thread of its own, so that a slow
+ * sink doesn't hold acquisition. Conditions starting during a capture
+ * are part of it. Captures are dropped if the sink falls behind.
+ */
+
+/* Captures waiting for the sink before new ones are dropped */
+#define MAX_WAITING_CAPTURES 4
+
+/* STAT reason of a step, the first user defined one */
+#define TRIGGER_REASON_STEP CTS_TRIGGER_REASON_USER
+
+typedef struct
+{
+  GPtrArray *frames;
+  guint32 conditions;
+} Capture;
+
+struct _PmuTrigger
+{
+  DspTriggerLimits limits;
+  gfloat nominal_voltage;
+
+  DspTrigger *dsp;
+  guint capacity;       /* PMUs */
+
+  /* A lane per PMU, frequency as deviation from nominal */
+  gfloat *freq;
+  gfloat *rocof;
+  gfloat *magnitude_min;
+  gfloat *magnitude_max;
+  gfloat *magnitude;
+  guint32 *digital;
+  guint32 *active;
+
+  /* The arrays above */
+  gpointer buffer;
+
+  /* Conditions of the previous frame, one per PMU */
+  guint32 *previous;
+
+  /* Conditions started, waiting for their frame to be pushed */
+  guint32 pending;
+
+  /* The latest frames, ring_length of them, before ring_next */
+  GBytes **ring;
+  guint ring_size;
+  guint ring_length;
+  guint ring_next;
+
+  /* The capture in progress, and the frames it still needs */
+  Capture *capture;
+  guint frames_after;
+  guint remaining;
+
+  GThreadPool *pool;
+  PmuTriggerSink sink;
+  gpointer sink_data;
+};
+
+static void
+capture_free (Capture *capture)
+{
+  g_ptr_array_unref (capture->frames);
+  g_free (capture);
+}
+
+static void
+run_sink (gpointer data,
+          gpointer user_data)
+{
+  PmuTrigger *self = user_data;
+  Capture *capture = data;
+
+  if (self->sink)
+    self->sink (capture->frames, capture->conditions, self->sink_data);
+
+  capture_free (capture);
+}
+
+/**
+ * pmu_trigger_new:
+ * @limits: The limits of the conditions. Frequencies are deviations
+ * from the nominal frequency, magnitudes are per unit of
+ * @nominal_voltage.
+ * @nominal_voltage: The nominal RMS phase voltage, in Volts
+ * @frames_before: Number of frames captured before a trigger
+ * @frames_after: Number of frames captured after a trigger
+ *
+ * Captures are saved with pmu_trigger_save_capture() till another
+ * sink is set.
+ *
+ * Returns: (transfer full): A new #PmuTrigger. Free with
+ * pmu_trigger_free().
+ */
+PmuTrigger *
+pmu_trigger_new (const DspTriggerLimits *limits,
+                 gfloat                  nominal_voltage,
+                 guint                   frames_before,
+                 guint                   frames_after)
+{
+  PmuTrigger *self;
+
+  self = g_new0 (PmuTrigger, 1);
+  self->limits = *limits;
+  self->nominal_voltage = nominal_voltage;
+  self->ring_size = frames_before;
+  self->ring = g_new0 (GBytes *, MAX (frames_before, 1));
+  self->frames_after = frames_after;
+  self->sink = pmu_trigger_save_capture;
+  self->pool = g_thread_pool_new (run_sink, self, 1, FALSE, NULL);
+
+  return self;
+}
+
+void
+pmu_trigger_free (PmuTrigger *self)
+{
+  if (self == NULL)
+    return;
+
+  /* Let the sink finish the captures given to it */
+  g_thread_pool_free (self->pool, FALSE, TRUE);
+  g_clear_pointer (&self->capture, capture_free);
+
+  for (guint i = 0; i < self->ring_size; i++)
+    g_clear_pointer (&self->ring[i], g_bytes_unref);
+
+  dsp_trigger_free (self->dsp);
+  free (self->buffer);
+  g_free (self->previous);
+  g_free (self->ring);
+  g_free (self);
+}
+
+/**
+ * pmu_trigger_set_sink:
+ * @self: A #PmuTrigger
+ * @sink: (nullable): The function to give captures to, %NULL to drop
+ * them
+ * @user_data: Data for @sink
+ *
+ * Set before the first frame, as the sink may be running.
+ */
+void
+pmu_trigger_set_sink (PmuTrigger     *self,
+                      PmuTriggerSink  sink,
+                      gpointer        user_data)
+{
+  self->sink = sink;
+  self->sink_data = user_data;
+}
+
+/**
+ * pmu_trigger_reserve:
+ * @self: A #PmuTrigger
+ * @num_pmu: The number of PMUs
+ *
+ * Allocate memory for frames of @num_pmu PMUs, so that
+ * pmu_trigger_update_data() doesn't have to.
+ *
+ * Returns: %TRUE on success, %FALSE if out of memory
+ */
+gboolean
+pmu_trigger_reserve (PmuTrigger *self,
+                     guint       num_pmu)
+{
+  DspTrigger *dsp;
+  gsize stride;
+  gfloat *buffer;
+
+  if (num_pmu <= self->capacity)
+    return TRUE;
+
+  stride = DSP_NUM_VECTORS (num_pmu) * DSP_LANES;
+  dsp = dsp_trigger_new (num_pmu, &self->limits);
+  buffer = dsp_calloc_aligned (sizeof (gfloat) * stride * 7);
+
+  if (dsp == NULL || buffer == NULL)
+    {
+      dsp_trigger_free (dsp);
+      free (buffer);
+      return FALSE;
+    }
+
+  dsp_trigger_free (self->dsp);
+  free (self->buffer);
+  g_free (self->previous);
+
+  self->dsp = dsp;
+  self->buffer = buffer;
+  self->previous = g_new0 (guint32, num_pmu);
+  self->capacity = num_pmu;
+
+  self->freq = buffer;
+  self->rocof = buffer + stride;
+  self->magnitude_min = buffer + stride * 2;
+  self->magnitude_max = buffer + stride * 3;
+  self->magnitude = buffer + stride * 4;
+  self->digital = (guint32 *) (buffer + stride * 5);
+  self->active = (guint32 *) (buffer + stride * 6);
+
+  return TRUE;
+}
+
+static gfloat
+get_magnitude (CtsData *data,
+               guint    pmu_index,
+               guint    phasor_index,
+               gfloat   scale)
+{
+  gfloat real, imaginary;
+
+  /* A missing phasor is at nominal, and never triggers */
+  if (!cts_data_get_phasor_of_pmu (data, pmu_index, phasor_index,
+                                   &real, &imaginary))
+    return 1.0;
+
+  return hypotf (real, imaginary) * scale;
+}
+
+static guint16
+get_stat_reason (guint32 conditions)
+{
+  if (conditions & DSP_TRIGGER_SAG)
+    return CTS_TRIGGER_REASON_MAGNITUDE_LOW;
+  if (conditions & DSP_TRIGGER_SWELL)
+    return CTS_TRIGGER_REASON_MAGNITUDE_HIGH;
+  if (conditions & (DSP_TRIGGER_FREQ_LOW | DSP_TRIGGER_FREQ_HIGH))
+    return CTS_TRIGGER_REASON_FREQUENCY;
+  if (conditions & DSP_TRIGGER_ROCOF)
+    return CTS_TRIGGER_REASON_DF_DT;
+  if (conditions & DSP_TRIGGER_STEP)
+    return TRIGGER_REASON_STEP;
+
+  return CTS_TRIGGER_REASON_DIGITAL;
+}
+
+/**
+ * pmu_trigger_update_data:
+ * @self: A #PmuTrigger
+ * @data: The data frame to check
+ *
+ * Check the conditions on every PMU of @data, and set the trigger
+ * bits of their STAT. The frame should be given to
+ * pmu_trigger_push_frame() once encoded.
+ *
+ * Returns: %TRUE if a condition started to be met in this frame.
+ */
+gboolean
+pmu_trigger_update_data (PmuTrigger *self,
+                         CtsData    *data)
+{
+  CtsConf *config = cts_data_get_conf (data);
+  guint num_pmu = cts_conf_get_num_of_pmu (config);
+  gfloat scale = 1.0f / self->nominal_voltage;
+  DspTriggerInput input;
+  guint32 started = 0;
+
+  if (!pmu_trigger_reserve (self, num_pmu))
+    return FALSE;
+
+  for (guint i = 0; i < num_pmu; i++)
+    {
+      guint nominal_freq = cts_conf_get_nominal_freq_of_pmu (config, i + 1);
+      gfloat freq = nominal_freq, rocof = 0;
+      guint16 word = 0;
+      guint positive = 7;
+
+      cts_data_get_freq_of_pmu (data, i + 1, &freq, &rocof);
+      self->freq[i] = freq - nominal_freq;
+      self->rocof[i] = rocof;
+
+      self->magnitude_min[i] = G_MAXFLOAT;
+      self->magnitude_max[i] = 0;
+
+      for (guint phase = 1; phase <= 3; phase++)
+        {
+          gfloat magnitude = get_magnitude (data, i + 1, phase, scale);
+
+          self->magnitude_min[i] = MIN (self->magnitude_min[i], magnitude);
+          self->magnitude_max[i] = MAX (self->magnitude_max[i], magnitude);
+        }
+
+      if (cts_conf_get_num_of_phasors_of_pmu (config, i + 1) < positive)
+        positive = 1;
+
+      self->magnitude[i] = get_magnitude (data, i + 1, positive, scale);
+
+      cts_data_get_status_word_of_pmu (data, i + 1, 1, &word);
+      self->digital[i] = word;
+    }
+
+  input.freq = self->freq;
+  input.rocof = self->rocof;
+  input.magnitude_min = self->magnitude_min;
+  input.magnitude_max = self->magnitude_max;
+  input.magnitude = self->magnitude;
+  input.digital = self->digital;
+
+  dsp_trigger_process (self->dsp, &input, self->active);
+
+  for (guint i = 0; i < num_pmu; i++)
+    {
+      guint32 active = self->active[i];
+      guint16 stat = cts_data_get_stat_of_pmu (data, i + 1);
+
+      CLEAR_BIT (stat, STAT_TRIGGER_DETECTED_BIT);
+      stat &= ~CTS_TRIGGER_REASON_MASK;
+
+      if (active)
+        {
+          SET_BIT (stat, STAT_TRIGGER_DETECTED_BIT);
+          stat |= get_stat_reason (active);
+        }
+
+      cts_data_set_stat_of_pmu (data, i + 1, stat);
+
+      if (active & ~self->previous[i])
+        pmu_trace (PMU_TRACE_LEVEL_INFO, PMU_TRACE_TRIGGER,
+                   active & ~self->previous[i], i + 1, 0);
+
+      started |= active & ~self->previous[i];
+      self->previous[i] = active;
+    }
+
+  self->pending |= started;
+
+  return started != 0;
+}
+
+static void
+hand_off_capture (PmuTrigger *self)
+{
+  Capture *capture = self->capture;
+  guint waiting;
+
+  self->capture = NULL;
+  waiting = g_thread_pool_unprocessed (self->pool);
+
+  if (waiting >= MAX_WAITING_CAPTURES)
+    {
+      GBytes *first = g_ptr_array_index (capture->frames, 0);
+
+      pmu_trace (PMU_TRACE_LEVEL_WARNING, PMU_TRACE_CAPTURE_DROPPED,
+                 capture->frames->len, waiting,
+                 cts_bin_get_time_seconds (g_bytes_get_data (first, NULL), TRUE));
+      capture_free (capture);
+      return;
+    }
+
+  g_thread_pool_push (self->pool, capture, NULL);
+}
+
+/**
+ * pmu_trigger_push_frame:
+ * @self: A #PmuTrigger
+ * @frame: The data frame, as sent
+ *
+ * Keep @frame for captures. Should be called for every frame, in the
+ * order of time.
+ */
+void
+pmu_trigger_push_frame (PmuTrigger *self,
+                        GBytes     *frame)
+{
+  if (self->capture == NULL && self->pending)
+    {
+      guint first = self->ring_next + self->ring_size - self->ring_length;
+
+      self->capture = g_new0 (Capture, 1);
+      self->capture->frames = g_ptr_array_new_full (self->ring_length + 1 + self->frames_after,
+                                                    (GDestroyNotify) g_bytes_unref);
+
+      for (guint i = 0; i < self->ring_length; i++)
+        g_ptr_array_add (self->capture->frames,
+                         g_bytes_ref (self->ring[(first + i) % self->ring_size]));
+
+      /* The frame of the trigger is taken below, after the ones before */
+      self->remaining = self->frames_after + 1;
+    }
+
+  if (self->capture)
+    {
+      /* Conditions starting during a capture go with it */
+      self->capture->conditions |= self->pending;
+      self->pending = 0;
+
+      g_ptr_array_add (self->capture->frames, g_bytes_ref (frame));
+
+      if (--self->remaining == 0)
+        hand_off_capture (self);
+    }
+
+  if (self->ring_size == 0)
+    return;
+
+  g_clear_pointer (&self->ring[self->ring_next], g_bytes_unref);
+  self->ring[self->ring_next] = g_bytes_ref (frame);
+  self->ring_next = (self->ring_next + 1) % self->ring_size;
+  self->ring_length = MIN (self->ring_length + 1, self->ring_size);
+}
+
+/**
+ * pmu_trigger_save_capture:
+ * @frames: The data frames
+ * @conditions: The conditions that started the capture
+ * @user_data: Unused
+ *
+ * A #PmuTriggerSink that saves the CFG-2 and the data frames of a
+ * capture to $XDG_CACHE_HOME/pmu/capture-SOC-FRACSEC.c37, named after
+ * the first frame.
+ */
+void
+pmu_trigger_save_capture (GPtrArray *frames,
+                          guint32    conditions,
+                          gpointer   user_data)
+{
+  g_autoptr(GByteArray) contents = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *directory = NULL;
+  g_autofree gchar *path = NULL;
+  const guchar *first;
+  guchar *config;
+  guint32 fracsec;
+
+  if (frames->len == 0)
+    return;
+
+  contents = g_byte_array_new ();
+  config = cts_conf_get_raw_data (cts_conf_get_default_config_one (), SYNC_CONFIG_TWO);
+
+  if (config)
+    {
+      g_byte_array_append (contents, config, cts_common_get_size (config, 2));
+      free (config);
+    }
+
+  for (guint i = 0; i < frames->len; i++)
+    {
+      GBytes *frame = g_ptr_array_index (frames, i);
+
+      g_byte_array_append (contents, g_bytes_get_data (frame, NULL),
+                           g_bytes_get_size (frame));
+    }
+
+  first = g_bytes_get_data (g_ptr_array_index (frames, 0), NULL);
+  memcpy (&fracsec, first + 10, 4);
+
+  directory = g_build_filename (g_get_user_cache_dir (), "pmu", NULL);
+  g_mkdir_with_parents (directory, 0755);
+
+  path = g_strdup_printf ("%s/capture-%u-%u.c37", directory,
+                          cts_bin_get_time_seconds (first, TRUE),
+                          ntohl (fracsec) & 0x00FFFFFF);
+
+  if (!g_file_set_contents (path, (const gchar *) contents->data,
+                            contents->len, &error))
+    g_warning ("Saving capture failed: %s", error->message);
+  else
+    g_message ("trigger: saved %u frames (conditions %02X) to %s",
+               frames->len, conditions, path);
+}
@@ -0,0 +1,60 @@
+/* pmu-trigger.h
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "c37/c37.h"
+#include "dsp/dsp-trigger.h"
+
+G_BEGIN_DECLS
+
+typedef struct _PmuTrigger PmuTrigger;
+
+/*
+ * Called in a thread of its own with the data frames (#GBytes) of a
+ * capture, oldest first, and the #DspTriggerType of the conditions
+ * that started it.
+ */
+typedef void (*PmuTriggerSink) (GPtrArray *frames,
+                                guint32    conditions,
+                                gpointer   user_data);
+
+PmuTrigger *pmu_trigger_new         (const DspTriggerLimits *limits,
+                                     gfloat                  nominal_voltage,
+                                     guint                   frames_before,
+                                     guint                   frames_after);
+void        pmu_trigger_free        (PmuTrigger     *self);
+void        pmu_trigger_set_sink    (PmuTrigger     *self,
+                                     PmuTriggerSink  sink,
+                                     gpointer        user_data);
+gboolean    pmu_trigger_reserve     (PmuTrigger     *self,
+                                     guint           num_pmu);
+gboolean    pmu_trigger_update_data (PmuTrigger     *self,
+                                     CtsData        *data);
+void        pmu_trigger_push_frame  (PmuTrigger     *self,
+                                     GBytes         *frame);
+
+void        pmu_trigger_save_capture (GPtrArray *frames,
+                                      guint32    conditions,
+                                      gpointer   user_data);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PmuTrigger, pmu_trigger_free)
+
+G_END_DECLS
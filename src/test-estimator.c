@@ -0,0 +1,282 @@
+/* test-estimator.c
+ *
+ * Copyright (C) 2017 Mohammed Sadiq <sadiq@sadiqpk.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Steady state accuracy of the phasors estimated from samples, as the
+ * TVE of C37.118.1 against the phasors of clean balanced three phase
+ * sine waves, at and off nominal frequency. And of the harmonics, off
+ * nominal, of waves with a 3rd and a 5th.
+ */
+
+#include <math.h>
+
+#include "pmu-estimator.h"
+
+#define NOMINAL_FREQ      50
+#define SAMPLES_PER_CYCLE 64
+#define DATA_RATE         50
+#define SAMPLE_RATE       (NOMINAL_FREQ * SAMPLES_PER_CYCLE)
+#define FRAME_SAMPLES     (SAMPLE_RATE / DATA_RATE)
+#define FIRST_SOC         1000
+#define SETTLE_SECONDS    2
+#define MEASURE_SECONDS   1
+#define SCALE             0.01
+#define MAX_TVE           0.01
+#define HARMONIC_ORDER    5
+#define MAX_HARMONIC_ERROR 0.01
+
+/* RMS and angle at time 0 of VR, VY, VB, IR, IY, IB */
+static const gdouble rms[PMU_ESTIMATOR_NUM_CHANNELS] = { 200, 200, 200, 150, 150, 150 };
+static const gdouble angles[PMU_ESTIMATOR_NUM_CHANNELS] = {
+  0, -2 * G_PI / 3, 2 * G_PI / 3,
+  -0.5, -0.5 - 2 * G_PI / 3, -0.5 + 2 * G_PI / 3,
+};
+
+/* Of the fundamental, by order, in the distorted waves */
+static const gdouble harmonics[HARMONIC_ORDER + 1] = { 0, 1, 0, 0.1, 0, 0.05 };
+
+#define NUM_ANALOGS (14 + PMU_ESTIMATOR_NUM_HARMONIC_ANALOGS (HARMONIC_ORDER))
+
+static char channel_name_text[8 + NUM_ANALOGS + 16][17];
+static char *channel_names[8 + NUM_ANALOGS + 16 + 1];
+
+static CtsData *
+create_data (guint num_analogs)
+{
+  CtsConf *config = cts_conf_new ();
+  CtsData *data = cts_data_get_default ();
+
+  for (guint i = 0; i < G_N_ELEMENTS (channel_name_text); i++)
+    {
+      g_snprintf (channel_name_text[i], 17, "CHANNEL%-9u", i + 1);
+      channel_names[i] = channel_name_text[i];
+    }
+
+  cts_conf_set_id_code (config, 1);
+  cts_conf_set_time_base (config, 1000000);
+  cts_conf_set_data_rate (config, DATA_RATE);
+  cts_conf_set_num_of_pmu (config, 1);
+  cts_conf_set_station_name_of_pmu (config, 1, "TEST", 4);
+  cts_conf_set_id_code_of_pmu (config, 1, 1);
+  cts_conf_set_nominal_freq_of_pmu (config, 1, NOMINAL_FREQ);
+  cts_conf_set_num_of_phasors_of_pmu (config, 1, 8);
+  cts_conf_set_num_of_analogs_of_pmu (config, 1, num_analogs);
+  cts_conf_set_num_of_status_of_pmu (config, 1, 1);
+  cts_conf_set_phasor_data_type_of_pmu (config, 1, VALUE_TYPE_FLOAT);
+  cts_conf_set_freq_data_type_of_pmu (config, 1, VALUE_TYPE_FLOAT);
+  cts_conf_set_analog_data_type_of_pmu (config, 1, VALUE_TYPE_FLOAT);
+  cts_conf_set_phasor_complex_type_of_pmu (config, 1, FALSE);
+  cts_conf_set_channel_names_of_pmu (config, 1, channel_names);
+
+  for (guint16 i = 1; i <= 8; i++)
+    cts_conf_set_phasor_measure_type_of_pmu (config, 1, i,
+                                             i % 4 ? VALUE_TYPE_VOLTAGE : VALUE_TYPE_CURRENT);
+
+  cts_conf_update_frame_size (config);
+
+  g_assert_true (cts_data_set_config (data, config));
+
+  return data;
+}
+
+/* Rows of big endian samples, from sample @index on */
+static void
+make_samples (guchar   *rows,
+              guint64   index,
+              gdouble   freq,
+              gboolean  distorted)
+{
+  for (guint i = 0; i < FRAME_SAMPLES; i++, index++)
+    {
+      /* Time from the first second, to keep the angle precise */
+      gdouble t = (gdouble) (index - (guint64) FIRST_SOC * SAMPLE_RATE) / SAMPLE_RATE;
+
+      for (guint c = 0; c < PMU_ESTIMATOR_NUM_CHANNELS; c++)
+        {
+          gdouble value = 0;
+          gint16 raw;
+
+          for (guint h = 1; h <= (distorted ? HARMONIC_ORDER : 1); h++)
+            value += G_SQRT2 * rms[c] * harmonics[h] *
+              cos (h * (2 * G_PI * freq * t + angles[c]));
+
+          raw = lround (value / SCALE);
+
+          *rows++ = (guint16) raw >> 8;
+          *rows++ = (guint16) raw & 0xFF;
+        }
+    }
+}
+
+static PmuEstimator *
+create_estimator (guint harmonic_order)
+{
+  PmuEstimator *estimator;
+
+  estimator = pmu_estimator_new (SAMPLES_PER_CYCLE, NOMINAL_FREQ, DATA_RATE,
+                                 FALSE, FRAME_SAMPLES);
+  g_assert_nonnull (estimator);
+
+  for (guint i = 0; i < PMU_ESTIMATOR_NUM_CHANNELS; i++)
+    pmu_estimator_set_scale (estimator, i, SCALE);
+
+  if (harmonic_order)
+    g_assert_true (pmu_estimator_set_harmonic_order (estimator, harmonic_order));
+
+  return estimator;
+}
+
+/* The largest TVE of any channel, once the frequency has settled */
+static gdouble
+get_max_tve (gdouble freq)
+{
+  g_autoptr(PmuEstimator) estimator = create_estimator (0);
+  guchar rows[FRAME_SAMPLES * PMU_ESTIMATOR_ROW_SIZE];
+  CtsData *data = create_data (14);
+  guint64 index = (guint64) FIRST_SOC * SAMPLE_RATE;
+  gdouble max_tve = 0;
+
+  for (guint frame = 0; frame < (SETTLE_SECONDS + MEASURE_SECONDS) * DATA_RATE; frame++)
+    {
+      /* The phasors are of the instant of the next sample */
+      gdouble t;
+
+      make_samples (rows, index, freq, FALSE);
+      pmu_estimator_process (estimator, rows, FRAME_SAMPLES, index);
+      index += FRAME_SAMPLES;
+
+      if (!pmu_estimator_update_data (estimator, data) ||
+          frame < SETTLE_SECONDS * DATA_RATE)
+        continue;
+
+      t = (gdouble) (index - (guint64) FIRST_SOC * SAMPLE_RATE) / SAMPLE_RATE;
+
+      for (guint c = 0; c < PMU_ESTIMATOR_NUM_CHANNELS; c++)
+        {
+          gdouble angle = 2 * G_PI * (freq - NOMINAL_FREQ) * t + angles[c];
+          gfloat real, imaginary;
+          gdouble tve;
+
+          g_assert_true (cts_data_get_phasor_of_pmu (data, 1, c + 1, &real, &imaginary));
+
+          tve = hypot (real - rms[c] * cos (angle), imaginary - rms[c] * sin (angle)) / rms[c];
+          max_tve = MAX (max_tve, tve);
+        }
+    }
+
+  return max_tve;
+}
+
+static void
+test_estimator_tve (gconstpointer user_data)
+{
+  gdouble freq = NOMINAL_FREQ + *(const gdouble *) user_data;
+  gdouble tve = get_max_tve (freq);
+
+  g_test_message ("%.2f Hz: TVE %.4f %%", freq, tve * 100);
+  g_assert_cmpfloat (tve, <, MAX_TVE);
+}
+
+/* The largest error of any harmonic, as a ratio to its magnitude */
+static gdouble
+get_max_harmonic_error (gdouble freq)
+{
+  g_autoptr(PmuEstimator) estimator = create_estimator (HARMONIC_ORDER);
+  guchar rows[FRAME_SAMPLES * PMU_ESTIMATOR_ROW_SIZE];
+  CtsData *data = create_data (NUM_ANALOGS);
+  guint64 index = (guint64) FIRST_SOC * SAMPLE_RATE;
+  gdouble max_error = 0;
+
+  for (guint frame = 0; frame < SETTLE_SECONDS * DATA_RATE; frame++)
+    {
+      make_samples (rows, index, freq, TRUE);
+      pmu_estimator_process (estimator, rows, FRAME_SAMPLES, index);
+      index += FRAME_SAMPLES;
+    }
+
+  g_assert_true (pmu_estimator_update_data (estimator, data));
+
+  for (guint c = 0; c < PMU_ESTIMATOR_NUM_CHANNELS; c++)
+    for (guint h = 2; h <= HARMONIC_ORDER; h++)
+      {
+        guint analog = PMU_ESTIMATOR_FIRST_HARMONIC_ANALOG + PMU_ESTIMATOR_NUM_CHANNELS +
+          c * (HARMONIC_ORDER - 1) + h - 2;
+        gdouble expected = rms[c] * harmonics[h];
+        gfloat value;
+
+        g_assert_true (cts_data_get_analog_of_pmu (data, 1, analog, &value));
+
+        /* Relative to the 3rd, for the orders that aren't there */
+        max_error = MAX (max_error, fabs (value - expected) /
+                         (expected ? expected : rms[c] * harmonics[3]));
+      }
+
+  return max_error;
+}
+
+static void
+test_estimator_harmonics (gconstpointer user_data)
+{
+  gdouble freq = NOMINAL_FREQ + *(const gdouble *) user_data;
+  gdouble error = get_max_harmonic_error (freq);
+
+  g_test_message ("%.2f Hz: harmonics off by %.4f %%", freq, error * 100);
+  g_assert_cmpfloat (error, <, MAX_HARMONIC_ERROR);
+}
+
+/* Negative data rates are seconds per frame, as in a CFG frame */
+static void
+test_estimator_data_rate (void)
+{
+  PmuEstimator *estimator;
+
+  g_assert_null (pmu_estimator_new (SAMPLES_PER_CYCLE, NOMINAL_FREQ, 0,
+                                    TRUE, FRAME_SAMPLES));
+
+  estimator = pmu_estimator_new (SAMPLES_PER_CYCLE, NOMINAL_FREQ, -2,
+                                 TRUE, FRAME_SAMPLES);
+  g_assert_nonnull (estimator);
+  pmu_estimator_free (estimator);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  static const gdouble deviations[] = { 0, -0.5, 0.5, -1, 1, -2, 2 };
+
+  g_test_init (&argc, &argv, NULL);
+
+  for (guint i = 0; i < G_N_ELEMENTS (deviations); i++)
+    {
+      g_autofree gchar *path = g_strdup_printf ("/estimator/tve/%+.1f-hz", deviations[i]);
+
+      g_test_add_data_func (path, deviations + i, test_estimator_tve);
+    }
+
+  for (guint i = 0; i < G_N_ELEMENTS (deviations); i++)
+    {
+      g_autofree gchar *path = g_strdup_printf ("/estimator/harmonics/%+.1f-hz", deviations[i]);
+
+      g_test_add_data_func (path, deviations + i, test_estimator_harmonics);
+    }
+
+  g_test_add_func ("/estimator/data-rate", test_estimator_data_rate);
+
+  return g_test_run ();
+}